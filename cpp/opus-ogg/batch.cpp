@@ -0,0 +1,266 @@
+#include "batch.h"
+#include <chrono>
+#include <dirent.h>
+#include <sys/stat.h>
+
+static uint64_t fileSize(const std::string &path)
+{
+    struct stat st;
+    return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+static bool endsWith(const std::string &name, const std::string &suffix)
+{
+    return name.size() >= suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+BatchTranscoder::BatchTranscoder(bool encodeMode, int workers, size_t maxInFlight)
+    : encodeMode(encodeMode), workers(workers), maxInFlight(maxInFlight), queued(0), inFlight(0), finished(false),
+      okFiles(0), failedFiles(0), inputBytes(0), outputBytes(0), pcmBytes(0)
+{
+    if (this->workers <= 0)
+    {
+        this->workers = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (this->maxInFlight == 0)
+    {
+        this->maxInFlight = this->workers * 2;
+    }
+    for (int i = 0; i < this->workers; i++)
+    {
+        queues.emplace_back(new WorkerQueue());
+    }
+}
+
+bool BatchTranscoder::acceptInput(const std::string &name) const
+{
+    if (encodeMode)
+    {
+        return endsWith(name, ".pcm");
+    }
+    return endsWith(name, ".opus") || endsWith(name, ".ogg");
+}
+
+std::string BatchTranscoder::outputName(const std::string &input, const std::string &outputDir) const
+{
+    size_t slash = input.find_last_of('/');
+    std::string name = slash == std::string::npos ? input : input.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    if (dot != std::string::npos && dot > 0)
+    {
+        name.resize(dot);
+    }
+    return outputDir + "/" + name + (encodeMode ? ".opus" : ".pcm");
+}
+
+// 等到在途文件数低于上限再提交，按轮转放到各工作线程的队列
+void BatchTranscoder::submit(const BatchJob &job, size_t &next)
+{
+    {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        slotReady.wait(lock, [this]
+                       { return inFlight < maxInFlight; });
+        inFlight++;
+    }
+    {
+        WorkerQueue &queue = *queues[next++ % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.jobs.push_back(job);
+    }
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        queued++;
+    }
+    jobReady.notify_one();
+}
+
+// 先认领一个任务名额，再从自己的队列头部取，取不到就从其他队列尾部窃取
+bool BatchTranscoder::takeJob(int id, BatchJob &job)
+{
+    {
+        std::unique_lock<std::mutex> lock(stateMutex);
+        jobReady.wait(lock, [this]
+                      { return queued > 0 || finished; });
+        if (queued == 0)
+        {
+            return false; // 全部提交完成且没有剩余任务
+        }
+        queued--;
+    }
+
+    // 认领了名额就一定能在某个队列中拿到任务
+    while (true)
+    {
+        {
+            WorkerQueue &own = *queues[id];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty())
+            {
+                job = std::move(own.jobs.front());
+                own.jobs.pop_front();
+                return true;
+            }
+        }
+        for (size_t i = 1; i < queues.size(); i++)
+        {
+            WorkerQueue &victim = *queues[(id + i) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty())
+            {
+                job = std::move(victim.jobs.back());
+                victim.jobs.pop_back();
+                return true;
+            }
+        }
+        std::this_thread::yield(); // 任务已计数但还没放进队列
+    }
+}
+
+void BatchTranscoder::runJob(OpusOggEncoder &encoder, OpusOggDecoder &decoder, const BatchJob &job)
+{
+    auto begin = std::chrono::steady_clock::now();
+    bool ok;
+    if (encodeMode)
+    {
+        std::remove(job.output.c_str()); // 编码器以追加方式写输出，先删掉上次的结果
+        ok = encoder.encodeParallel(job.input, job.output, 1);
+    }
+    else
+    {
+        ok = decoder.decodeParallel(job.input, job.output, 1);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+    uint64_t in = fileSize(job.input);
+    uint64_t out = ok ? fileSize(job.output) : 0;
+    if (ok)
+    {
+        okFiles++;
+        inputBytes += in;
+        outputBytes += out;
+        pcmBytes += encodeMode ? in : out;
+    }
+    else
+    {
+        failedFiles++;
+    }
+
+    std::lock_guard<std::mutex> lock(printMutex);
+    printf("[%s] %s -> %s, %llu -> %llu bytes, %.2f ms\n", ok ? "OK" : "FAIL", job.input.c_str(), job.output.c_str(),
+           (unsigned long long)in, (unsigned long long)out, ms);
+}
+
+void BatchTranscoder::workerLoop(int id)
+{
+    // 每个工作线程的编解码器在文件之间复用
+    OpusOggEncoder encoder(BATCH_SAMPLE_RATE, BATCH_CHANNELS, BATCH_FRAME_SIZE);
+    OpusOggDecoder decoder;
+    encoder.setVerbose(false);
+    decoder.setVerbose(false);
+
+    BatchJob job;
+    while (takeJob(id, job))
+    {
+        runJob(encoder, decoder, job);
+        {
+            std::lock_guard<std::mutex> lock(stateMutex);
+            inFlight--;
+        }
+        slotReady.notify_one();
+    }
+}
+
+bool BatchTranscoder::run(const std::string &source, const std::string &outputDir)
+{
+    auto begin = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < workers; i++)
+    {
+        threads.emplace_back(&BatchTranscoder::workerLoop, this, i);
+    }
+
+    // 边读清单/目录边提交，任务列表不需要全部放在内存中
+    size_t next = 0;
+    size_t submitted = 0;
+    bool sourceOk = true;
+    struct stat st;
+    if (stat(source.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+    {
+        DIR *dir = opendir(source.c_str());
+        if (!dir)
+        {
+            std::cerr << "Cannot open directory: " << source << std::endl;
+            sourceOk = false;
+        }
+        struct dirent *entry;
+        while (dir && (entry = readdir(dir)) != nullptr)
+        {
+            BatchJob job;
+            job.input = source + "/" + entry->d_name;
+            struct stat entryStat;
+            if (!acceptInput(entry->d_name) || stat(job.input.c_str(), &entryStat) != 0 || !S_ISREG(entryStat.st_mode))
+            {
+                continue;
+            }
+            job.output = outputName(job.input, outputDir);
+            submit(job, next);
+            submitted++;
+        }
+        if (dir)
+        {
+            closedir(dir);
+        }
+    }
+    else
+    {
+        std::ifstream manifest(source);
+        if (!manifest.is_open())
+        {
+            std::cerr << "Cannot open manifest: " << source << std::endl;
+            sourceOk = false;
+        }
+        std::string line;
+        while (std::getline(manifest, line))
+        {
+            size_t start = line.find_first_not_of(" \t\r");
+            if (start == std::string::npos || line[start] == '#')
+            {
+                continue;
+            }
+            size_t split = line.find_first_of(" \t", start);
+            BatchJob job;
+            job.input = line.substr(start, split == std::string::npos ? std::string::npos : split - start);
+            size_t outStart = split == std::string::npos ? std::string::npos : line.find_first_not_of(" \t", split);
+            if (outStart != std::string::npos)
+            {
+                size_t outEnd = line.find_last_not_of(" \t\r");
+                job.output = line.substr(outStart, outEnd - outStart + 1);
+            }
+            else
+            {
+                job.output = outputName(job.input, outputDir);
+            }
+            submit(job, next);
+            submitted++;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(stateMutex);
+        finished = true;
+    }
+    jobReady.notify_all();
+    for (auto &thread : threads)
+    {
+        thread.join();
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    double audioSeconds = static_cast<double>(pcmBytes) / (BATCH_SAMPLE_RATE * BATCH_CHANNELS * sizeof(opus_int16));
+    printf("Batch %s finished: files %zu, ok %zu, failed %zu, workers %d, wall %.3f s\n", encodeMode ? "encode" : "decode",
+           submitted, okFiles.load(), failedFiles.load(), workers, seconds);
+    printf("Throughput: %.1f files/s, input %.2f MB/s, output %.2f MB/s, audio %.1fx realtime\n",
+           submitted / seconds, inputBytes / seconds / 1e6, outputBytes / seconds / 1e6, audioSeconds / seconds);
+
+    return sourceOk && failedFiles == 0;
+}
@@ -0,0 +1,73 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+#include "opus_ogg.h"
+
+// 批量编码的PCM参数，与单文件模式一致
+#define BATCH_SAMPLE_RATE 24000
+#define BATCH_CHANNELS 1
+#define BATCH_FRAME_SIZE 480
+
+// 批量转码的一个文件
+struct BatchJob
+{
+    std::string input;
+    std::string output;
+};
+
+// 批量转码: 从清单文件或目录中逐个读出文件，分发到各工作线程的队列，空闲线程从其他队列尾部窃取
+// 每个工作线程持有自己的编码器/解码器，在文件之间复用；排队和正在处理的文件数不超过maxInFlight
+class BatchTranscoder
+{
+private:
+    // 每个工作线程的任务队列，自己从头部取，其他线程从尾部窃取
+    struct WorkerQueue
+    {
+        std::mutex mutex;
+        std::deque<BatchJob> jobs;
+    };
+
+    bool encodeMode;
+    int workers;
+    size_t maxInFlight;
+
+    std::vector<std::unique_ptr<WorkerQueue>> queues;
+    std::mutex stateMutex;
+    std::condition_variable jobReady;  // 有新任务或全部提交完成
+    std::condition_variable slotReady; // 有文件处理完，可以继续提交
+    size_t queued;                     // 已提交还没被取走的任务数
+    size_t inFlight;                   // 排队和正在处理的任务数
+    bool finished;                     // 全部任务都已提交
+
+    std::mutex printMutex;
+    std::atomic<size_t> okFiles;
+    std::atomic<size_t> failedFiles;
+    std::atomic<uint64_t> inputBytes;
+    std::atomic<uint64_t> outputBytes;
+    std::atomic<uint64_t> pcmBytes; // 编码的输入或解码的输出，用于计算音频时长
+
+    void submit(const BatchJob &job, size_t &next);
+    bool takeJob(int id, BatchJob &job);
+    void workerLoop(int id);
+    void runJob(OpusOggEncoder &encoder, OpusOggDecoder &decoder, const BatchJob &job);
+    std::string outputName(const std::string &input, const std::string &outputDir) const;
+    bool acceptInput(const std::string &name) const;
+
+public:
+    // workers<=0时按CPU核数，maxInFlight为0时取工作线程数的2倍
+    BatchTranscoder(bool encodeMode, int workers = 0, size_t maxInFlight = 0);
+
+    // source为目录时处理其中的.pcm(编码)或.opus/.ogg(解码)文件，输出到outputDir，文件名只换扩展名
+    // 否则作为清单文件，每行"输入 [输出]"，省略输出时按上面的规则放到outputDir；空行和#开头的行忽略
+    // 全部成功返回true
+    bool run(const std::string &source, const std::string &outputDir);
+};
+
+#endif
@@ -12,7 +12,10 @@ bool OpusOggDecoder::readPage(std::ifstream &inputFile, ogg_page &page)
         {
             return false;
         }
-        printf("bytesRead %d\n", bytesRead);
+        if (verbose)
+        {
+            printf("bytesRead %zu\n", bytesRead);
+        }
         ogg_sync_wrote(&oggSyncState, bytesRead);
     }
     return true;
@@ -20,6 +23,11 @@ bool OpusOggDecoder::readPage(std::ifstream &inputFile, ogg_page &page)
 
 bool OpusOggDecoder::initializeDecoder()
 {
+    // 采样率和声道数不变时复用已有的解码器，只清空状态
+    if (decoder && decoderChannels == channels && decoderSampleRate == sampleRate)
+    {
+        return opus_decoder_ctl(decoder.get(), OPUS_RESET_STATE) == OPUS_OK;
+    }
     int err;
     OpusDecoder *dec = opus_decoder_create(sampleRate, channels, &err);
     if (!dec)
@@ -28,6 +36,8 @@ bool OpusOggDecoder::initializeDecoder()
         return false;
     }
     decoder.reset(dec);
+    decoderChannels = channels;
+    decoderSampleRate = sampleRate;
     return true;
 }
 
@@ -125,7 +135,6 @@ bool OpusOggDecoder::decode(const std::string &inputFileName, const std::string
     }
 
     // 读取Comment Header包
-    printf("--- 1 ---\n");
     if (!readPage(inputFile, page) ||
         ogg_stream_pagein(&oggStreamState, &page) < 0 ||
         ogg_stream_packetout(&oggStreamState, &packet) != 1 ||
@@ -191,10 +200,571 @@ bool OpusOggDecoder::decode(const std::string &inputFileName, const std::string
         totalSamples += samplesDecoded;
     }
 
-    printf("Decoding channels: %d, sampleRate:%d\n", channels, sampleRate);
-    std::cout << "Decoding completed successfully" << std::endl;
-    std::cout << "Total decoded samples: " << totalSamples << std::endl;
-    std::cout << "Audio duration: " << static_cast<double>(totalSamples) / sampleRate << " seconds" << std::endl;
+    if (verbose)
+    {
+        printf("Decoding channels: %d, sampleRate:%d\n", channels, sampleRate);
+        std::cout << "Decoding completed successfully" << std::endl;
+        std::cout << "Total decoded samples: " << totalSamples << std::endl;
+        std::cout << "Audio duration: " << static_cast<double>(totalSamples) / sampleRate << " seconds" << std::endl;
+    }
+
+    return true;
+}
+
+// 不经过libogg直接扫描内存中的页面，记录每页位置，并根据包的TOC计算每页的采样起点
+bool OpusOggDecoder::scanPages(const unsigned char *data, size_t size, std::vector<OggPageInfo> &pages, size_t &firstAudioPage, int64_t &totalSamples)
+{
+    size_t pos = 0;
+    int packetIndex = 0;       // 已完成的包个数，前两个是OpusHead和OpusTags
+    size_t packetBytes = 0;    // 当前包已扫描的长度
+    unsigned char toc[2] = {}; // 当前包的前两个字节，用于计算采样数
+    firstAudioPage = 0;
+    totalSamples = 0;
+
+    while (pos + 27 <= size)
+    {
+        const unsigned char *header = data + pos;
+        if (std::memcmp(header, "OggS", 4) != 0)
+        {
+            std::cerr << "Lost sync at offset " << pos << std::endl;
+            return false;
+        }
+        size_t segments = header[26];
+        if (pos + 27 + segments > size)
+        {
+            break;
+        }
+        size_t bodyLen = 0;
+        for (size_t i = 0; i < segments; i++)
+        {
+            bodyLen += header[27 + i];
+        }
+        if (pos + 27 + segments + bodyLen > size)
+        {
+            break; // 文件末尾不完整的页面
+        }
+
+        OggPageInfo page;
+        page.offset = pos;
+        page.headerLen = 27 + segments;
+        page.bodyLen = bodyLen;
+        page.startSample = totalSamples;
+        pages.push_back(page);
+
+        const unsigned char *body = header + page.headerLen;
+        for (size_t i = 0; i < segments; i++)
+        {
+            size_t lacing = header[27 + i];
+            for (size_t j = 0; j < lacing && packetBytes + j < 2; j++)
+            {
+                toc[packetBytes + j] = body[j];
+            }
+            packetBytes += lacing;
+            body += lacing;
+            if (lacing == 255)
+            {
+                continue; // 包还没结束
+            }
+
+            if (packetIndex >= 2 && packetBytes > 0)
+            {
+                int frames = opus_packet_get_nb_frames(toc, packetBytes);
+                if (frames > 0)
+                {
+                    totalSamples += frames * opus_packet_get_samples_per_frame(toc, sampleRate);
+                }
+            }
+            packetIndex++;
+            packetBytes = 0;
+            if (packetIndex == 2)
+            {
+                firstAudioPage = pages.size(); // OpusTags所在页的下一页开始是音频
+            }
+        }
+        pos += page.headerLen + bodyLen;
+    }
+    return packetIndex >= 2;
+}
+
+// 解码 [begin, end) 页完成的包，直接写到output中本段的位置；begin之前的若干页只用来预热解码器
+// dec为空时创建该段自己的解码器
+bool OpusOggDecoder::decodePages(OpusDecoder *dec, const unsigned char *data, const std::vector<OggPageInfo> &pages, size_t firstAudioPage,
+                                 size_t begin, size_t end, int64_t totalSamples, int serialno, int preSkip, opus_int16 *output)
+{
+    std::unique_ptr<OpusDecoder, OpusDecoderDeleter> segmentDecoder;
+    if (!dec)
+    {
+        int err;
+        segmentDecoder.reset(opus_decoder_create(sampleRate, channels, &err));
+        if (!segmentDecoder)
+        {
+            std::cerr << "Failed to create Opus decoder: " << opus_strerror(err) << std::endl;
+            return false;
+        }
+        dec = segmentDecoder.get();
+    }
+    ogg_stream_state stream;
+    if (ogg_stream_init(&stream, serialno) != 0)
+    {
+        std::cerr << "Failed to initialize Ogg stream" << std::endl;
+        return false;
+    }
+
+    int64_t prerollSamples = static_cast<int64_t>(sampleRate) * PARALLEL_PREROLL_MS / 1000;
+    size_t start = begin;
+    while (start > firstAudioPage && pages[begin].startSample - pages[start].startSample < prerollSamples)
+    {
+        start--;
+    }
+    if (begin == firstAudioPage && preSkip > 0)
+    {
+        // 与顺序解码保持一致
+        std::vector<opus_int16> skipBuffer(preSkip * channels);
+        opus_decode(dec, nullptr, 0, skipBuffer.data(), preSkip, 0);
+    }
+
+    int64_t position = pages[begin].startSample; // 下一个包输出的采样位置
+    int64_t endSample = end < pages.size() ? pages[end].startSample : totalSamples;
+    std::vector<opus_int16> prerollBuffer(MAX_FRAME_SIZE * channels);
+    bool ok = true;
+
+    for (size_t i = start; i < end && ok; i++)
+    {
+        ogg_page page;
+        page.header = const_cast<unsigned char *>(data + pages[i].offset);
+        page.header_len = pages[i].headerLen;
+        page.body = page.header + page.header_len;
+        page.body_len = pages[i].bodyLen;
+        if (ogg_stream_pagein(&stream, &page) < 0)
+        {
+            std::cerr << "Error reading page " << i << std::endl;
+            ok = false;
+            break;
+        }
+
+        ogg_packet packet;
+        int result;
+        while ((result = ogg_stream_packetout(&stream, &packet)) != 0)
+        {
+            if (result < 0)
+            {
+                continue; // 预热起点的续包会被libogg丢弃
+            }
+            if (i < begin)
+            {
+                opus_decode(dec, packet.packet, packet.bytes, prerollBuffer.data(), MAX_FRAME_SIZE, 0);
+                continue;
+            }
+            // 扫描时已经按TOC算好了每个包的采样数，直接解码到输出中
+            int capacity = std::min<int64_t>(endSample - position, MAX_FRAME_SIZE);
+            int samplesDecoded = opus_decode(dec, packet.packet, packet.bytes, output + position * channels, capacity, 0);
+            if (samplesDecoded < 0)
+            {
+                // 解码失败的位置保持静音，后面的包仍按扫描得到的位置写入
+                std::cerr << "Decoding error: " << opus_strerror(samplesDecoded) << std::endl;
+                samplesDecoded = opus_packet_get_nb_samples(packet.packet, packet.bytes, sampleRate);
+                samplesDecoded = std::max(0, std::min(samplesDecoded, capacity));
+            }
+            position += samplesDecoded;
+        }
+    }
+    ogg_stream_clear(&stream);
+    return ok;
+}
+
+bool OpusOggDecoder::decodeParallel(const std::string &inputFileName, const std::string &outputFileName, int threads)
+{
+    // 直接映射整个文件，从映射区解析页面；管道等无法映射时退回到流式的decode
+    MappedInput input;
+    if (!input.open(inputFileName))
+    {
+        return decode(inputFileName, outputFileName);
+    }
+    const unsigned char *data = input.data();
+    size_t size = input.size();
+
+    // 第一页就是OpusHead
+    if (size < 28 || data[26] == 0)
+    {
+        std::cerr << "Failed to read first page" << std::endl;
+        return false;
+    }
+    OpusHeader opusHeader;
+    const unsigned char *firstBody = data + 27 + data[26];
+    if (firstBody + data[27] > data + size || !parseOpusHeader(firstBody, data[27], opusHeader))
+    {
+        std::cerr << "Failed to parse Opus header" << std::endl;
+        return false;
+    }
+    channels = opusHeader.channels;
+    sampleRate = opusHeader.sampleRate;
+    int serialno = data[14] | (data[15] << 8) | (data[16] << 16) | (data[17] << 24);
+
+    std::vector<OggPageInfo> pages;
+    size_t firstAudioPage;
+    int64_t totalSamples;
+    if (!scanPages(data, size, pages, firstAudioPage, totalSamples))
+    {
+        std::cerr << "Failed to scan Ogg pages" << std::endl;
+        return false;
+    }
+
+    // 输出长度已知，一次性预分配，各段直接解码到自己的位置
+    size_t outputBytes = totalSamples * channels * sizeof(opus_int16);
+    MappedOutput outputFile;
+    unsigned char *output = nullptr;
+    if (!outputFile.open(outputFileName, outputBytes) || !(output = outputFile.reserve(outputBytes)))
+    {
+        std::cerr << "Cannot open output file: " << outputFileName << std::endl;
+        return false;
+    }
+    opus_int16 *pcm = reinterpret_cast<opus_int16 *>(output);
+
+    // 按页数均分音频页
+    size_t audioPages = pages.size() - firstAudioPage;
+    size_t segments = std::min<size_t>(std::max(threads, 1), std::max<size_t>(audioPages, 1));
+    std::vector<std::thread> workers;
+    std::vector<char> results(segments, 0);
+    for (size_t i = 1; i < segments; i++)
+    {
+        size_t begin = firstAudioPage + audioPages * i / segments;
+        size_t end = firstAudioPage + audioPages * (i + 1) / segments;
+        workers.emplace_back([=, &pages, &results]
+                             { results[i] = decodePages(nullptr, data, pages, firstAudioPage, begin, end, totalSamples, serialno, opusHeader.preSkip, pcm); });
+    }
+    // 第一段在当前线程用成员解码器解码，重复调用时复用
+    results[0] = initializeDecoder() &&
+                 decodePages(decoder.get(), data, pages, firstAudioPage, firstAudioPage, firstAudioPage + audioPages / segments, totalSamples, serialno, opusHeader.preSkip, pcm);
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    if (!outputFile.commit(outputBytes) || !outputFile.close())
+    {
+        std::cerr << "Failed to write output file: " << outputFileName << std::endl;
+        return false;
+    }
+
+    for (char ok : results)
+    {
+        if (!ok)
+        {
+            return false;
+        }
+    }
+
+    if (verbose)
+    {
+        printf("Decoding channels: %d, sampleRate:%d, threads: %zu\n", channels, sampleRate, segments);
+        std::cout << "Decoding completed successfully" << std::endl;
+        std::cout << "Total decoded samples: " << totalSamples << std::endl;
+        std::cout << "Audio duration: " << static_cast<double>(totalSamples) / sampleRate << " seconds" << std::endl;
+    }
+
+    return true;
+}
+
+bool OpusOggDecoder::readSeekIndex(const std::string &inputFileName, int serialno, int64_t fileSize, std::vector<OggSeekPoint> &index)
+{
+    std::ifstream indexFile(inputFileName + SEEK_INDEX_SUFFIX, std::ios::binary | std::ios::ate);
+    if (!indexFile.is_open())
+    {
+        return false;
+    }
+    std::vector<unsigned char> data(static_cast<size_t>(indexFile.tellg()));
+    indexFile.seekg(0);
+    indexFile.read(reinterpret_cast<char *>(data.data()), data.size());
+
+    if (data.size() < 16 || std::memcmp(data.data(), "OPUSIDX1", 8) != 0)
+    {
+        return false;
+    }
+    uint32_t indexSerialno = 0;
+    uint32_t count = 0;
+    for (int i = 0; i < 4; i++)
+    {
+        indexSerialno |= static_cast<uint32_t>(data[8 + i]) << (8 * i);
+        count |= static_cast<uint32_t>(data[12 + i]) << (8 * i);
+    }
+    // 索引和文件不匹配(比如文件被重新编码过)时不使用
+    if (indexSerialno != static_cast<uint32_t>(serialno) || data.size() != 16 + static_cast<size_t>(count) * 16)
+    {
+        return false;
+    }
+
+    index.resize(count);
+    const unsigned char *pos = data.data() + 16;
+    for (auto &point : index)
+    {
+        uint64_t granulepos = 0;
+        uint64_t offset = 0;
+        for (int i = 0; i < 8; i++)
+        {
+            granulepos |= static_cast<uint64_t>(pos[i]) << (8 * i);
+            offset |= static_cast<uint64_t>(pos[8 + i]) << (8 * i);
+        }
+        point.granulepos = granulepos;
+        point.offset = offset;
+        if (point.offset >= fileSize)
+        {
+            return false;
+        }
+        pos += 16;
+    }
+    return true;
+}
+
+// 找到granulepos <= targetGranule的最后一个音频页，从它开始解码，后面页面的包都在seekGranule之后
+bool OpusOggDecoder::findSeekPage(OggPageReader &reader, const std::string &inputFileName, int serialno, int64_t audioStart, int64_t fileSize,
+                                  int64_t targetGranule, int64_t &seekOffset, int64_t &seekGranule)
+{
+    std::vector<OggSeekPoint> index;
+    if (readSeekIndex(inputFileName, serialno, fileSize, index))
+    {
+        auto it = std::upper_bound(index.begin(), index.end(), targetGranule,
+                                   [](int64_t granulepos, const OggSeekPoint &point)
+                                   { return granulepos < point.granulepos; });
+        if (it == index.begin() || (it - 1)->offset < audioStart)
+        {
+            return false;
+        }
+        --it;
+        seekOffset = it->offset;
+        seekGranule = it->granulepos;
+        return true;
+    }
+
+    // 没有索引时按granulepos二分
+    bool found = false;
+    int64_t lo = audioStart;
+    int64_t hi = fileSize;
+    ogg_page page;
+    int64_t pageOffset;
+    while (hi - lo > SEEK_LINEAR_BYTES)
+    {
+        int64_t mid = lo + (hi - lo) / 2;
+        int64_t granulepos = -1;
+        reader.seek(mid);
+        // mid之后第一个带granulepos的页面
+        while (reader.next(page, pageOffset) && pageOffset < hi)
+        {
+            if (ogg_page_serialno(&page) == serialno && ogg_page_granulepos(&page) != -1)
+            {
+                granulepos = ogg_page_granulepos(&page);
+                break;
+            }
+        }
+        if (granulepos == -1 || granulepos > targetGranule)
+        {
+            hi = mid;
+            continue;
+        }
+        found = true;
+        seekOffset = pageOffset;
+        seekGranule = granulepos;
+        lo = reader.offset;
+    }
+
+    // 剩下的范围顺序扫描
+    reader.seek(lo);
+    while (reader.next(page, pageOffset) && pageOffset < hi)
+    {
+        int64_t granulepos = ogg_page_granulepos(&page);
+        if (ogg_page_serialno(&page) != serialno || granulepos == -1)
+        {
+            continue;
+        }
+        if (granulepos > targetGranule)
+        {
+            break;
+        }
+        found = true;
+        seekOffset = pageOffset;
+        seekGranule = granulepos;
+    }
+    return found;
+}
+
+// start/end的单位是1/rate秒，rate为0时表示输出采样
+bool OpusOggDecoder::decodeSpan(const std::string &inputFileName, const std::string &outputFileName, int64_t start, int64_t end, int rate)
+{
+    std::ifstream inputFile(inputFileName, std::ios::binary | std::ios::ate);
+    if (!inputFile.is_open())
+    {
+        std::cerr << "Cannot open input file: " << inputFileName << std::endl;
+        return false;
+    }
+    int64_t fileSize = inputFile.tellg();
+
+    std::ofstream outputFile(outputFileName, std::ios::binary);
+    if (!outputFile.is_open())
+    {
+        std::cerr << "Cannot open output file: " << outputFileName << std::endl;
+        return false;
+    }
+
+    // 读取ID Header
+    OggPageReader reader(inputFile);
+    reader.seek(0);
+    ogg_page page;
+    int64_t pageOffset;
+    if (!reader.next(page, pageOffset) || !ogg_page_bos(&page))
+    {
+        std::cerr << "Failed to read first page" << std::endl;
+        return false;
+    }
+    int serialno = ogg_page_serialno(&page);
+    if (streamInitialized)
+    {
+        ogg_stream_reset_serialno(&oggStreamState, serialno);
+    }
+    else if (ogg_stream_init(&oggStreamState, serialno) == 0)
+    {
+        streamInitialized = true;
+    }
+    else
+    {
+        std::cerr << "Failed to initialize Ogg stream" << std::endl;
+        return false;
+    }
+
+    ogg_packet packet;
+    OpusHeader opusHeader;
+    if (ogg_stream_pagein(&oggStreamState, &page) < 0 ||
+        ogg_stream_packetout(&oggStreamState, &packet) != 1 ||
+        !parseOpusHeader(packet.packet, packet.bytes, opusHeader))
+    {
+        std::cerr << "Failed to parse Opus header" << std::endl;
+        return false;
+    }
+    channels = opusHeader.channels;
+    sampleRate = opusHeader.sampleRate;
+    if (!initializeDecoder())
+    {
+        return false;
+    }
+
+    // 读取Comment Header，可能跨多个页面
+    int result;
+    while ((result = ogg_stream_packetout(&oggStreamState, &packet)) == 0)
+    {
+        if (!reader.next(page, pageOffset) || ogg_stream_pagein(&oggStreamState, &page) < 0)
+        {
+            break;
+        }
+    }
+    if (result != 1 || !skipOpusComments(packet))
+    {
+        std::cerr << "Error reading comment header" << std::endl;
+        return false;
+    }
+    int64_t audioStart = reader.offset;
+
+    int64_t startSample = rate == 0 ? start : start * sampleRate / rate;
+    int64_t endSample = rate == 0 ? end : end * sampleRate / rate;
+    startSample = std::max<int64_t>(startSample, 0);
+    if (endSample <= startSample)
+    {
+        std::cerr << "Invalid decode range" << std::endl;
+        return false;
+    }
+
+    // position为下一个解码出的采样在输出时间轴上的位置，granulepos以48kHz为单位
+    std::vector<opus_int16> pcmBuffer(MAX_FRAME_SIZE * channels);
+    int64_t position = 0;
+    int64_t seekOffset;
+    int64_t seekGranule;
+    int64_t targetGranule = startSample * 48000 / sampleRate - SEEK_PREROLL_MS * 48;
+    if (targetGranule > 0 && findSeekPage(reader, inputFileName, serialno, audioStart, fileSize, targetGranule, seekOffset, seekGranule))
+    {
+        reader.seek(seekOffset);
+        ogg_stream_reset(&oggStreamState);
+        if (!reader.next(page, pageOffset) || ogg_stream_pagein(&oggStreamState, &page) < 0)
+        {
+            std::cerr << "Error reading page at offset " << seekOffset << std::endl;
+            return false;
+        }
+        // seek页本身完成的包都在seekGranule之前结束，只用来预热解码器
+        while ((result = ogg_stream_packetout(&oggStreamState, &packet)) != 0)
+        {
+            if (result > 0)
+            {
+                opus_decode(decoder.get(), packet.packet, packet.bytes, pcmBuffer.data(), MAX_FRAME_SIZE, 0);
+            }
+        }
+        position = seekGranule * sampleRate / 48000;
+    }
+    else
+    {
+        // 从头解码，与decode保持一致
+        reader.seek(audioStart);
+        if (opusHeader.preSkip > 0)
+        {
+            std::vector<opus_int16> skipBuffer(opusHeader.preSkip * channels);
+            opus_decode(decoder.get(), nullptr, 0, skipBuffer.data(), opusHeader.preSkip, 0);
+        }
+    }
+
+    int64_t skippedSamples = startSample - position;
+    int64_t totalSamples = 0;
+    while (position < endSample)
+    {
+        result = ogg_stream_packetout(&oggStreamState, &packet);
+        if (result == 0)
+        {
+            if (!reader.next(page, pageOffset))
+            {
+                break; // 文件结束
+            }
+            if (ogg_page_serialno(&page) == serialno && ogg_stream_pagein(&oggStreamState, &page) < 0)
+            {
+                std::cerr << "Error reading page" << std::endl;
+                return false;
+            }
+            continue;
+        }
+        if (result < 0)
+        {
+            std::cerr << "Corrupt or missing data in bitstream" << std::endl;
+            continue;
+        }
+
+        int samplesDecoded = opus_decode(decoder.get(), packet.packet, packet.bytes, pcmBuffer.data(), MAX_FRAME_SIZE, 0);
+        if (samplesDecoded < 0)
+        {
+            std::cerr << "Decoding error: " << opus_strerror(samplesDecoded) << std::endl;
+            continue;
+        }
+
+        // 只写出与 [startSample, endSample) 重叠的部分
+        int64_t from = std::max(position, startSample);
+        int64_t to = std::min(position + samplesDecoded, endSample);
+        if (to > from)
+        {
+            outputFile.write(reinterpret_cast<const char *>(pcmBuffer.data() + (from - position) * channels), (to - from) * channels * sizeof(opus_int16));
+            totalSamples += to - from;
+        }
+        position += samplesDecoded;
+    }
+
+    if (verbose)
+    {
+        printf("Decoding channels: %d, sampleRate:%d, pre-roll samples: %lld\n", channels, sampleRate, (long long)skippedSamples);
+        std::cout << "Decoding completed successfully" << std::endl;
+        std::cout << "Total decoded samples: " << totalSamples << std::endl;
+        std::cout << "Audio duration: " << static_cast<double>(totalSamples) / sampleRate << " seconds" << std::endl;
+    }
 
     return true;
-}
\ No newline at end of file
+}
+
+bool OpusOggDecoder::decodeSamples(const std::string &inputFileName, const std::string &outputFileName, int64_t startSample, int64_t endSample)
+{
+    return decodeSpan(inputFileName, outputFileName, startSample, endSample, 0);
+}
+
+bool OpusOggDecoder::decodeRange(const std::string &inputFileName, const std::string &outputFileName, double startSeconds, double endSeconds)
+{
+    // 以微秒为单位传入，读到头部得到采样率后再换算
+    return decodeSpan(inputFileName, outputFileName, static_cast<int64_t>(startSeconds * 1000000), static_cast<int64_t>(endSeconds * 1000000), 1000000);
+}
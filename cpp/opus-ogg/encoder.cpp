@@ -1,29 +1,48 @@
 #include "opus_ogg.h"
 
-bool OpusOggEncoder::initializeEncoder()
+OpusEncoder *OpusOggEncoder::createEncoder()
 {
     int err;
     OpusEncoder *enc = opus_encoder_create(sampleRate, channels, OPUS_APPLICATION_AUDIO, &err);
     if (!enc)
     {
         std::cerr << "Failed to create Opus encoder: " << opus_strerror(err) << std::endl;
-        return false;
+        return nullptr;
     }
-    encoder.reset(enc);
 
     // 设置编码器参数
-    opus_encoder_ctl(encoder.get(), OPUS_SET_VBR(0)); // 0:CBR, 1:VBR
-    opus_encoder_ctl(encoder.get(), OPUS_SET_BITRATE(48000));
-    opus_encoder_ctl(encoder.get(), OPUS_SET_COMPLEXITY(8));
-    opus_encoder_ctl(encoder.get(), OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
-    opus_encoder_ctl(encoder.get(), OPUS_SET_LSB_DEPTH(16));
+    opus_encoder_ctl(enc, OPUS_SET_VBR(0)); // 0:CBR, 1:VBR
+    opus_encoder_ctl(enc, OPUS_SET_BITRATE(48000));
+    opus_encoder_ctl(enc, OPUS_SET_COMPLEXITY(8));
+    opus_encoder_ctl(enc, OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
+    opus_encoder_ctl(enc, OPUS_SET_LSB_DEPTH(16));
 
+    return enc;
+}
+
+bool OpusOggEncoder::initializeEncoder()
+{
+    // 重复编码时复用已有的编码器，只清空状态，参数保持不变
+    if (encoder)
+    {
+        return opus_encoder_ctl(encoder.get(), OPUS_RESET_STATE) == OPUS_OK;
+    }
+    OpusEncoder *enc = createEncoder();
+    if (!enc)
+    {
+        return false;
+    }
+    encoder.reset(enc);
     return true;
 }
 
 bool OpusOggEncoder::initializeOggStream()
 {
     std::srand(std::time(nullptr));
+    if (streamInitialized)
+    {
+        return ogg_stream_reset_serialno(&oggStreamState, std::rand()) == 0;
+    }
     if (ogg_stream_init(&oggStreamState, std::rand()) != 0)
     {
         std::cerr << "Failed to initialize Ogg stream" << std::endl;
@@ -33,7 +52,86 @@ bool OpusOggEncoder::initializeOggStream()
     return true;
 }
 
-bool OpusOggEncoder::writeOpusHeader(std::ofstream &outputFile)
+bool OpusOggEncoder::writePage(MappedOutput &outputFile, const ogg_page &page)
+{
+    // 记录音频页的位置，头部页的granulepos为0不记录
+    ogg_int64_t granulepos = ogg_page_granulepos(&page);
+    if (writeIndex && granulepos > 0)
+    {
+        seekIndex.push_back(OggSeekPoint{granulepos, bytesWritten});
+    }
+    unsigned char *dst = outputFile.reserve(page.header_len + page.body_len);
+    if (!dst)
+    {
+        return false;
+    }
+    std::memcpy(dst, page.header, page.header_len);
+    std::memcpy(dst + page.header_len, page.body, page.body_len);
+    bytesWritten += page.header_len + page.body_len;
+    return outputFile.commit(page.header_len + page.body_len);
+}
+
+// 取出Ogg流里已成页的数据写入输出，flush为true时把不足一页的包也冲刷成页
+bool OpusOggEncoder::drainPages(MappedOutput &outputFile, bool flush)
+{
+    ogg_page og;
+    while ((flush ? ogg_stream_flush(&oggStreamState, &og) : ogg_stream_pageout(&oggStreamState, &og)) != 0)
+    {
+        if (!writePage(outputFile, og))
+        {
+            std::cerr << "Failed to write output" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void OpusOggEncoder::startIndex(MappedOutput &outputFile)
+{
+    // 输出文件是追加打开的，页面偏移从文件当前末尾算起
+    bytesWritten = outputFile.size();
+    seekIndex.clear();
+}
+
+// 索引文件格式(小端序): "OPUSIDX1" | serialno(32bit) | 条目数(32bit) | 条目数 * (granulepos(64bit) | 页面偏移(64bit))
+bool OpusOggEncoder::writeSeekIndex(const std::string &outputFileName)
+{
+    if (!writeIndex)
+    {
+        return true;
+    }
+
+    std::ofstream indexFile(outputFileName + SEEK_INDEX_SUFFIX, std::ios::binary | std::ios::trunc);
+    if (!indexFile.is_open())
+    {
+        std::cerr << "Cannot open index file: " << outputFileName << SEEK_INDEX_SUFFIX << std::endl;
+        return false;
+    }
+
+    std::vector<unsigned char> data(16 + seekIndex.size() * 16);
+    std::memcpy(data.data(), "OPUSIDX1", 8);
+    uint32_t serialno = oggStreamState.serialno;
+    uint32_t count = seekIndex.size();
+    for (int i = 0; i < 4; i++)
+    {
+        data[8 + i] = (serialno >> (8 * i)) & 0xFF;
+        data[12 + i] = (count >> (8 * i)) & 0xFF;
+    }
+    size_t pos = 16;
+    for (const auto &point : seekIndex)
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            data[pos + i] = (static_cast<uint64_t>(point.granulepos) >> (8 * i)) & 0xFF;
+            data[pos + 8 + i] = (static_cast<uint64_t>(point.offset) >> (8 * i)) & 0xFF;
+        }
+        pos += 16;
+    }
+    indexFile.write(reinterpret_cast<const char *>(data.data()), data.size());
+    return indexFile.good();
+}
+
+bool OpusOggEncoder::writeOpusHeader(MappedOutput &outputFile)
 {
     std::vector<unsigned char> header(19);
 
@@ -68,17 +166,10 @@ bool OpusOggEncoder::writeOpusHeader(std::ofstream &outputFile)
         return false;
     }
 
-    ogg_page og;
-    while (ogg_stream_flush(&oggStreamState, &og) != 0)
-    {
-        outputFile.write(reinterpret_cast<const char *>(og.header), og.header_len);
-        outputFile.write(reinterpret_cast<const char *>(og.body), og.body_len);
-    }
-
-    return true;
+    return drainPages(outputFile, true);
 }
 
-bool OpusOggEncoder::writeOpusComments(std::ofstream &outputFile)
+bool OpusOggEncoder::writeOpusComments(MappedOutput &outputFile)
 {
     std::string vendor = "pcm2opusogg encoder";
     std::vector<std::string> comments; // 可以添加额外的注释
@@ -140,14 +231,7 @@ bool OpusOggEncoder::writeOpusComments(std::ofstream &outputFile)
         return false;
     }
 
-    ogg_page og;
-    while (ogg_stream_flush(&oggStreamState, &og) != 0)
-    {
-        outputFile.write(reinterpret_cast<const char *>(og.header), og.header_len);
-        outputFile.write(reinterpret_cast<const char *>(og.body), og.body_len);
-    }
-
-    return true;
+    return drainPages(outputFile, true);
 }
 
 bool OpusOggEncoder::encode(const std::string &inputFileName, const std::string &outputFileName)
@@ -159,8 +243,8 @@ bool OpusOggEncoder::encode(const std::string &inputFileName, const std::string
         return false;
     }
 
-    std::ofstream outputFile(outputFileName, std::ios::binary | std::ios::app);
-    if (!outputFile.is_open())
+    MappedOutput outputFile;
+    if (!outputFile.open(outputFileName, 0, true))
     {
         std::cerr << "Cannot open output file: " << outputFileName << std::endl;
         return false;
@@ -171,6 +255,7 @@ bool OpusOggEncoder::encode(const std::string &inputFileName, const std::string
     {
         return false;
     }
+    startIndex(outputFile);
 
     // 写入头部信息
     if (!writeOpusHeader(outputFile) || !writeOpusComments(outputFile))
@@ -221,9 +306,12 @@ bool OpusOggEncoder::encode(const std::string &inputFileName, const std::string
         op.bytes = encodedBytes;
         op.b_o_s = 0;
         op.e_o_s = inputFile.eof() && samplesRead < frameSize ? 1 : 0;
-        op.granulepos = granulepos;
+        op.granulepos = granulepos + granule_increment; // 页面granulepos为最后一个完成的包的结束位置
         op.packetno = packetno++;
-        printf("bytes %d, packetno %d, e_o_s %d, index: %d, samplesRead: %d, encodedBytes: %d\n", granulepos, packetno, op.e_o_s, index++, samplesRead, encodedBytes);
+        if (verbose)
+        {
+            printf("bytes %d, packetno %d, e_o_s %d, index: %d, samplesRead: %d, encodedBytes: %d\n", granulepos, packetno, op.e_o_s, index++, samplesRead, encodedBytes);
+        }
         // 写入包
         if (ogg_stream_packetin(&oggStreamState, &op) != 0)
         {
@@ -232,27 +320,210 @@ bool OpusOggEncoder::encode(const std::string &inputFileName, const std::string
         }
 
         // 写入页面
-        ogg_page og;
-        while (ogg_stream_pageout(&oggStreamState, &og) != 0)
+        if (!drainPages(outputFile, false))
         {
-            outputFile.write(reinterpret_cast<const char *>(og.header), og.header_len);
-            outputFile.write(reinterpret_cast<const char *>(og.body), og.body_len);
+            return false;
         }
         granulepos += granule_increment;
     }
 
     // 冲刷最后的数据
-    ogg_page og;
-    while (ogg_stream_flush(&oggStreamState, &og) != 0)
+    if (!drainPages(outputFile, true))
+    {
+        return false;
+    }
+
+    if (!outputFile.close())
+    {
+        std::cerr << "Failed to write output file: " << outputFileName << std::endl;
+        return false;
+    }
+    if (!writeSeekIndex(outputFileName))
+    {
+        return false;
+    }
+
+    if (verbose)
     {
-        outputFile.write(reinterpret_cast<const char *>(og.header), og.header_len);
-        outputFile.write(reinterpret_cast<const char *>(og.body), og.body_len);
+        printf("Encoding channels: %d, sampleRate:%d\n", channels, sampleRate);
+        std::cout << "Encoding completed successfully" << std::endl;
+        std::cout << "Total samples encoded: " << granulepos << std::endl;
+        std::cout << "Audio duration: " << static_cast<double>(granulepos) / 48000.0 << " seconds" << std::endl;
     }
 
-    printf("Encoding channels: %d, sampleRate:%d\n", channels, sampleRate);
-    std::cout << "Encoding completed successfully" << std::endl;
-    std::cout << "Total samples encoded: " << granulepos << std::endl;
-    std::cout << "Audio duration: " << static_cast<double>(granulepos) / 48000.0 << " seconds" << std::endl;
+    return true;
+}
+
+bool OpusOggEncoder::writePacket(MappedOutput &outputFile, const unsigned char *data, int bytes, int64_t granulepos, int packetno, bool eos)
+{
+    ogg_packet op;
+    op.packet = const_cast<unsigned char *>(data);
+    op.bytes = bytes;
+    op.b_o_s = 0;
+    op.e_o_s = eos ? 1 : 0;
+    op.granulepos = granulepos;
+    op.packetno = packetno;
+    if (ogg_stream_packetin(&oggStreamState, &op) != 0)
+    {
+        std::cerr << "Error while writing packet to Ogg stream" << std::endl;
+        return false;
+    }
+
+    return drainPages(outputFile, false);
+}
+
+// 编码 [begin, end) 帧，begin之前的若干帧只用来预热编码器，输出丢弃；pcmSamples为pcm中的采样总数(含各声道)
+// enc为空时创建该段自己的编码器
+void OpusOggEncoder::encodeSegment(OpusEncoder *enc, const opus_int16 *pcm, size_t pcmSamples, size_t begin, size_t end, EncodedSegment &segment)
+{
+    std::unique_ptr<OpusEncoder, OpusEncoderDeleter> segmentEncoder;
+    if (!enc)
+    {
+        segmentEncoder.reset(createEncoder());
+        enc = segmentEncoder.get();
+    }
+    if (!enc)
+    {
+        return;
+    }
+
+    size_t prerollFrames = (static_cast<size_t>(sampleRate) * PARALLEL_PREROLL_MS / 1000 + frameSize - 1) / frameSize;
+    size_t start = begin > prerollFrames ? begin - prerollFrames : 0;
+    size_t samplesPerFrame = frameSize * channels;
+    unsigned char opusData[MAX_PACKET_SIZE];
+    std::vector<opus_int16> lastFrame;
+
+    segment.data.reserve((end - begin) * 256);
+    segment.sizes.reserve(end - begin);
+    for (size_t frame = start; frame < end; frame++)
+    {
+        const opus_int16 *input = pcm + frame * samplesPerFrame;
+        if ((frame + 1) * samplesPerFrame > pcmSamples)
+        {
+            // 末尾不足一帧，复制出来补0，不能越过映射区读取
+            lastFrame.assign(samplesPerFrame, 0);
+            std::copy(input, pcm + pcmSamples, lastFrame.begin());
+            input = lastFrame.data();
+        }
+        int encodedBytes = opus_encode(enc, input, frameSize, opusData, MAX_PACKET_SIZE);
+        if (encodedBytes < 0)
+        {
+            std::cerr << "Encoding failed: " << opus_strerror(encodedBytes) << std::endl;
+            return;
+        }
+        if (frame < begin)
+        {
+            continue; // 预热帧
+        }
+        segment.data.insert(segment.data.end(), opusData, opusData + encodedBytes);
+        segment.sizes.push_back(encodedBytes);
+    }
+    segment.ok = true;
+}
+
+bool OpusOggEncoder::encodeParallel(const std::string &inputFileName, const std::string &outputFileName, int threads)
+{
+    // 直接映射整个PCM文件，管道等无法映射时退回到流式编码
+    MappedInput input;
+    if (!input.open(inputFileName))
+    {
+        return encode(inputFileName, outputFileName);
+    }
+    const opus_int16 *pcm = reinterpret_cast<const opus_int16 *>(input.data());
+    size_t pcmSamples = input.size() / sizeof(opus_int16) / channels * channels;
+    size_t totalFrames = (pcmSamples / channels + frameSize - 1) / frameSize;
+
+    // 按帧边界均分，段数只取决于线程数，保证输出确定
+    size_t segments = std::min<size_t>(std::max(threads, 1), std::max<size_t>(totalFrames, 1));
+    std::vector<EncodedSegment> results(segments);
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < segments; i++)
+    {
+        size_t begin = totalFrames * i / segments;
+        size_t end = totalFrames * (i + 1) / segments;
+        workers.emplace_back(&OpusOggEncoder::encodeSegment, this, nullptr, pcm, pcmSamples, begin, end, std::ref(results[i]));
+    }
+    // 第一段在当前线程用成员编码器编码，重复调用时复用
+    if (initializeEncoder())
+    {
+        encodeSegment(encoder.get(), pcm, pcmSamples, 0, totalFrames / segments, results[0]);
+    }
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    size_t encodedBytes = 0;
+    for (const auto &result : results)
+    {
+        if (!result.ok)
+        {
+            return false;
+        }
+        encodedBytes += result.data.size();
+    }
+
+    // 包数据的总长已知，加上页头的开销一次性预分配输出文件
+    MappedOutput outputFile;
+    if (!outputFile.open(outputFileName, encodedBytes + totalFrames + 4096, true))
+    {
+        std::cerr << "Cannot open output file: " << outputFileName << std::endl;
+        return false;
+    }
+
+    // 按顺序拼接成一个Ogg流，packetno和granulepos连续编号
+    if (!initializeOggStream())
+    {
+        return false;
+    }
+    startIndex(outputFile);
+    if (!writeOpusHeader(outputFile) || !writeOpusComments(outputFile))
+    {
+        std::cerr << "Failed to write Opus headers" << std::endl;
+        return false;
+    }
+
+    const opus_int32 granule_increment = frameSize * (48000.0 / sampleRate);
+    int64_t granulepos = 0;
+    int packetno = 2; // 从2开始，因为0和1已用于头信息
+    size_t frame = 0;
+    for (const auto &result : results)
+    {
+        const unsigned char *data = result.data.data();
+        for (int bytes : result.sizes)
+        {
+            frame++;
+            if (!writePacket(outputFile, data, bytes, granulepos + granule_increment, packetno++, frame == totalFrames))
+            {
+                return false;
+            }
+            data += bytes;
+            granulepos += granule_increment;
+        }
+    }
+
+    // 冲刷最后的数据
+    if (!drainPages(outputFile, true))
+    {
+        return false;
+    }
+
+    if (!outputFile.close())
+    {
+        std::cerr << "Failed to write output file: " << outputFileName << std::endl;
+        return false;
+    }
+    if (!writeSeekIndex(outputFileName))
+    {
+        return false;
+    }
+
+    if (verbose)
+    {
+        printf("Encoding channels: %d, sampleRate:%d, threads: %zu\n", channels, sampleRate, segments);
+        std::cout << "Encoding completed successfully" << std::endl;
+        std::cout << "Total samples encoded: " << granulepos << std::endl;
+        std::cout << "Audio duration: " << static_cast<double>(granulepos) / 48000.0 << " seconds" << std::endl;
+    }
 
     return true;
 }
@@ -1,27 +1,61 @@
 #include "opus_ogg.h"
+#include "batch.h"
 
 int main(int argc, char *argv[])
 {
-    if (argc != 4)
+    if (argc < 4 || argc > 7)
     {
-        std::cerr << "Usage: " << argv[0] << " encode/decode <input.pcm> <output.opus>" << std::endl;
+        std::cerr << "Usage: " << argv[0] << " encode <input.pcm> <output.opus> [threads] [index]" << std::endl;
+        std::cerr << "       " << argv[0] << " decode <input.opus> <output.pcm> [threads]" << std::endl;
+        std::cerr << "       " << argv[0] << " range <input.opus> <output.pcm> <startSeconds> <endSeconds>" << std::endl;
+        std::cerr << "       " << argv[0] << " batch encode/decode <manifest|dir> <outputDir> [workers] [maxInFlight]" << std::endl;
         return 1;
     }
-
     std::string mode(argv[1]);
-    if (mode == "encode")
+    // encode 末尾加 index 时额外写出 <output>.idx 的seek索引，默认不写
+    bool writeIndex = mode == "encode" && std::string(argv[argc - 1]) == "index";
+    if (writeIndex)
+    {
+        argc--;
+    }
+    int threads = argc == 5 ? std::atoi(argv[4]) : 1;
+
+    if (mode == "batch" && argc >= 5)
+    {
+        std::string op(argv[2]);
+        if (op != "encode" && op != "decode")
+        {
+            std::cerr << "Invalid batch mode" << std::endl;
+            return 1;
+        }
+        int workers = argc >= 6 ? std::atoi(argv[5]) : 0;
+        size_t maxInFlight = argc >= 7 ? std::atoi(argv[6]) : 0;
+        BatchTranscoder batch(op == "encode", workers, maxInFlight);
+        return batch.run(argv[3], argv[4]) ? 0 : 1;
+    }
+    else if (mode == "encode" && argc <= 5)
     {
         OpusOggEncoder encoder(24000, 1, 480);
-        if (!encoder.encode(argv[2], argv[3]))
+        encoder.setWriteIndex(writeIndex);
+        if (!encoder.encodeParallel(argv[2], argv[3], threads))
         {
             std::cerr << "Encoding failed" << std::endl;
             return 1;
         }
     }
-    else if (mode == "decode")
+    else if (mode == "decode" && argc <= 5)
+    {
+        OpusOggDecoder decoder;
+        if (!decoder.decodeParallel(argv[2], argv[3], threads))
+        {
+            std::cerr << "Decoding failed" << std::endl;
+            return 1;
+        }
+    }
+    else if (mode == "range" && argc == 6)
     {
         OpusOggDecoder decoder;
-        if (!decoder.decode(argv[2], argv[3]))
+        if (!decoder.decodeRange(argv[2], argv[3], std::atof(argv[4]), std::atof(argv[5])))
         {
             std::cerr << "Decoding failed" << std::endl;
             return 1;
@@ -0,0 +1,265 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MAPPED_OUTPUT_MIN_CAPACITY (64 * 1024) // 输出映射区的最小容量，不够时按倍数扩大
+
+// 只读映射整个输入文件，直接从映射区解析，省去read系统调用和拷贝
+// 只支持非空的普通文件，管道等无法映射时open返回false，调用方退回到流读取
+class MappedInput
+{
+private:
+    void *addr;
+    size_t length;
+
+public:
+    MappedInput() : addr(MAP_FAILED), length(0)
+    {
+    }
+
+    ~MappedInput()
+    {
+        close();
+    }
+
+    MappedInput(const MappedInput &) = delete;
+    MappedInput &operator=(const MappedInput &) = delete;
+
+    bool open(const std::string &path, int advice = MADV_SEQUENTIAL)
+    {
+        close();
+        // 先按路径判断类型，打开管道再关闭会让写端提前结束
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        {
+            return false;
+        }
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            return false;
+        }
+        if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd); // 映射建立后文件描述符就不需要了
+        if (p == MAP_FAILED)
+        {
+            return false;
+        }
+        madvise(p, st.st_size, advice);
+        addr = p;
+        length = st.st_size;
+        return true;
+    }
+
+    void close()
+    {
+        if (addr != MAP_FAILED)
+        {
+            munmap(addr, length);
+            addr = MAP_FAILED;
+            length = 0;
+        }
+    }
+
+    const unsigned char *data() const
+    {
+        return static_cast<const unsigned char *>(addr);
+    }
+
+    size_t size() const
+    {
+        return length;
+    }
+};
+
+// 输出文件，普通文件用fallocate预分配后映射写入，close时截断到实际长度
+// 管道、字符设备等无法映射时退回到std::ofstream
+class MappedOutput
+{
+private:
+    int fd;
+    unsigned char *addr;
+    size_t capacity;
+    size_t length; // 文件当前的有效长度
+    std::ofstream stream;
+    std::vector<unsigned char> buffer; // 流模式下reserve返回的缓冲区
+
+    bool remap(size_t newCapacity)
+    {
+        if (addr)
+        {
+            munmap(addr, capacity);
+            addr = nullptr;
+            capacity = 0;
+        }
+        // 预分配磁盘空间，文件系统不支持fallocate时退回到ftruncate
+        if (fallocate(fd, 0, 0, newCapacity) != 0 && ftruncate(fd, newCapacity) != 0)
+        {
+            return false;
+        }
+        void *p = mmap(nullptr, newCapacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED)
+        {
+            return false;
+        }
+        madvise(p, newCapacity, MADV_SEQUENTIAL);
+        addr = static_cast<unsigned char *>(p);
+        capacity = newCapacity;
+        return true;
+    }
+
+public:
+    MappedOutput() : fd(-1), addr(nullptr), capacity(0), length(0)
+    {
+    }
+
+    ~MappedOutput()
+    {
+        close();
+    }
+
+    MappedOutput(const MappedOutput &) = delete;
+    MappedOutput &operator=(const MappedOutput &) = delete;
+
+    // sizeHint为预计写入的字节数，用于一次性预分配；append为true时保留原有内容，从末尾继续写
+    bool open(const std::string &path, size_t sizeHint, bool append = false)
+    {
+        close();
+        struct stat st;
+        bool regular = stat(path.c_str(), &st) != 0 || S_ISREG(st.st_mode); // 不存在时会新建普通文件
+        if (regular)
+        {
+            fd = ::open(path.c_str(), O_RDWR | O_CREAT | (append ? 0 : O_TRUNC), 0644);
+            if (fd >= 0 && fstat(fd, &st) == 0)
+            {
+                length = st.st_size;
+                if (remap(length + std::max<size_t>(sizeHint, MAPPED_OUTPUT_MIN_CAPACITY)))
+                {
+                    return true;
+                }
+                close(); // 映射失败时恢复原长度，改用流写入
+            }
+            else if (fd >= 0)
+            {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+
+        stream.open(path, std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+        if (!stream.is_open())
+        {
+            return false;
+        }
+        length = 0;
+        if (append)
+        {
+            // 管道上无法定位，失败时清掉错误状态，长度从0算起
+            std::streamoff pos = stream.seekp(0, std::ios::end).tellp();
+            length = pos > 0 ? pos : 0;
+            stream.clear();
+        }
+        return true;
+    }
+
+    bool mapped() const
+    {
+        return fd >= 0;
+    }
+
+    // 返回可以直接写入n字节的位置，写完后调用commit；映射模式下是映射区，容量不够时扩大，之前返回的指针失效
+    unsigned char *reserve(size_t n)
+    {
+        if (fd < 0)
+        {
+            if (buffer.size() < n)
+            {
+                buffer.resize(n);
+            }
+            return buffer.data();
+        }
+        if (length + n > capacity && !remap(std::max(capacity * 2, length + n)))
+        {
+            return nullptr;
+        }
+        return addr + length;
+    }
+
+    bool commit(size_t n)
+    {
+        if (fd < 0)
+        {
+            stream.write(reinterpret_cast<const char *>(buffer.data()), n);
+            if (!stream.good())
+            {
+                return false;
+            }
+        }
+        length += n;
+        return true;
+    }
+
+    bool write(const void *data, size_t n)
+    {
+        if (fd < 0)
+        {
+            stream.write(static_cast<const char *>(data), n);
+            length += n;
+            return stream.good();
+        }
+        unsigned char *dst = reserve(n);
+        if (!dst)
+        {
+            return false;
+        }
+        std::memcpy(dst, data, n);
+        length += n;
+        return true;
+    }
+
+    // 文件当前长度，追加模式下包含原有内容
+    size_t size() const
+    {
+        return length;
+    }
+
+    bool close()
+    {
+        bool ok = true;
+        if (fd >= 0)
+        {
+            if (addr)
+            {
+                munmap(addr, capacity);
+                addr = nullptr;
+                capacity = 0;
+            }
+            ok = ftruncate(fd, length) == 0;
+            ::close(fd);
+            fd = -1;
+        }
+        if (stream.is_open())
+        {
+            stream.close();
+            ok = ok && !stream.fail();
+        }
+        length = 0;
+        return ok;
+    }
+};
+
+#endif
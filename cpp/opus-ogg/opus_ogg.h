@@ -8,11 +8,19 @@
 #include <memory>
 #include <cstring>
 #include <ctime>
+#include <cstdlib>
+#include <thread>
+#include <algorithm>
 #include <opus/opus.h>
 #include <ogg/ogg.h>
+#include "mapped_file.h"
 
 #define MAX_FRAME_SIZE 5760 // 120ms@48kHz
 #define MAX_PACKET_SIZE (3 * 1276)
+#define PARALLEL_PREROLL_MS 80 // 并行编解码时每段在起点前多处理的时长，让编解码器状态在接缝处收敛
+#define SEEK_PREROLL_MS 80      // seek后丢弃的解码时长，RFC 7845建议至少80ms
+#define SEEK_INDEX_SUFFIX ".idx" // 编码器写出的seek索引文件后缀
+#define SEEK_LINEAR_BYTES 65536  // 二分到这个范围以内后改为顺序扫描
 
 struct OpusHeader
 {
@@ -24,6 +32,67 @@ struct OpusHeader
     unsigned char channelMappingFamily;
 };
 
+// seek索引中的一项，音频页的granulepos和它在文件中的偏移
+struct OggSeekPoint
+{
+    int64_t granulepos;
+    int64_t offset;
+};
+
+// 从文件任意偏移开始读取Ogg页面，并记录每个页面在文件中的位置
+struct OggPageReader
+{
+    std::ifstream &file;
+    ogg_sync_state sync;
+    int64_t offset; // sync中下一个未处理的字节在文件中的偏移
+
+    OggPageReader(std::ifstream &file) : file(file), offset(0)
+    {
+        ogg_sync_init(&sync);
+    }
+
+    ~OggPageReader()
+    {
+        ogg_sync_clear(&sync);
+    }
+
+    void seek(int64_t pos)
+    {
+        ogg_sync_reset(&sync);
+        file.clear();
+        file.seekg(pos);
+        offset = pos;
+    }
+
+    // 读取下一个完整页面，pageOffset为页面起点；页面数据在下一次调用前有效
+    bool next(ogg_page &page, int64_t &pageOffset)
+    {
+        while (true)
+        {
+            long ret = ogg_sync_pageseek(&sync, &page);
+            if (ret > 0)
+            {
+                pageOffset = offset;
+                offset += ret;
+                return true;
+            }
+            if (ret < 0)
+            {
+                offset -= ret; // 跳过不是页面的数据
+                continue;
+            }
+            char *buffer = ogg_sync_buffer(&sync, 4096);
+            file.read(buffer, 4096);
+            size_t bytesRead = file.gcount();
+            if (bytesRead == 0)
+            {
+                return false;
+            }
+            ogg_sync_wrote(&sync, bytesRead);
+        }
+    }
+};
+
 struct OpusEncoderDeleter
 {
     void operator()(OpusEncoder *encoder)
@@ -43,10 +112,30 @@ private:
     int sampleRate;
     int frameSize;
 
+    // 并行编码时一段输出的opus包，data中按顺序存放，sizes为每个包的长度
+    struct EncodedSegment
+    {
+        std::vector<unsigned char> data;
+        std::vector<int> sizes;
+        bool ok = false;
+    };
+
+    bool writeIndex;
+    bool verbose;
+    int64_t bytesWritten; // 当前输出文件已写入的字节数
+    std::vector<OggSeekPoint> seekIndex;
+
+    OpusEncoder *createEncoder();
     bool initializeEncoder();
     bool initializeOggStream();
-    bool writeOpusHeader(std::ofstream &outputFile);
-    bool writeOpusComments(std::ofstream &outputFile);
+    void encodeSegment(OpusEncoder *enc, const opus_int16 *pcm, size_t pcmSamples, size_t begin, size_t end, EncodedSegment &segment);
+    bool writePacket(MappedOutput &outputFile, const unsigned char *data, int bytes, int64_t granulepos, int packetno, bool eos);
+    bool writePage(MappedOutput &outputFile, const ogg_page &page);
+    bool drainPages(MappedOutput &outputFile, bool flush);
+    void startIndex(MappedOutput &outputFile);
+    bool writeSeekIndex(const std::string &outputFileName);
+    bool writeOpusHeader(MappedOutput &outputFile);
+    bool writeOpusComments(MappedOutput &outputFile);
 
     void cleanup()
     {
@@ -59,7 +148,7 @@ private:
 
 public:
     OpusOggEncoder(int sampleRate = 24000, int channels = 1, int frameSize = 480)
-        : streamInitialized(false), channels(channels), sampleRate(sampleRate), frameSize(frameSize)
+        : streamInitialized(false), channels(channels), sampleRate(sampleRate), frameSize(frameSize), writeIndex(false), verbose(true), bytesWritten(0)
     {
     }
 
@@ -68,7 +157,22 @@ public:
         cleanup();
     }
 
+    // 关闭逐帧日志和编码完成后的统计输出，批量处理时使用
+    void setVerbose(bool enable)
+    {
+        verbose = enable;
+    }
+
+    // 编码完成后额外写出 输出文件名+SEEK_INDEX_SUFFIX 的seek索引，解码器seek时优先使用
+    void setWriteIndex(bool enable)
+    {
+        writeIndex = enable;
+    }
+
     bool encode(const std::string &inputFileName, const std::string &outputFileName);
+    // 把PCM按帧边界切成threads段，每段用独立的编码器并行编码，再按顺序拼成一个Ogg流，同样的线程数输出确定
+    // 输入直接映射读取，输出fallocate预分配后映射写入；输入无法映射(管道等)时退回到流式的encode
+    bool encodeParallel(const std::string &inputFileName, const std::string &outputFileName, int threads);
 };
 
 struct OpusDecoderDeleter
@@ -87,13 +191,32 @@ private:
     ogg_sync_state oggSyncState;
     ogg_stream_state oggStreamState;
     bool streamInitialized;
+    bool verbose;
     int channels;
     int sampleRate;
+    int decoderChannels;   // 当前解码器创建时的声道数
+    int decoderSampleRate; // 当前解码器创建时的采样率
+
+    // 扫描得到的一个Ogg页面
+    struct OggPageInfo
+    {
+        size_t offset;       // 页面在文件中的偏移
+        size_t headerLen;    // 页头长度(含lacing表)
+        size_t bodyLen;      // 页面数据长度
+        int64_t startSample; // 本页之前完成的包解码出的采样数，即本页输出在PCM中的起点
+    };
 
     bool readPage(std::ifstream &inputFile, ogg_page &page);
     bool initializeDecoder();
+    bool scanPages(const unsigned char *data, size_t size, std::vector<OggPageInfo> &pages, size_t &firstAudioPage, int64_t &totalSamples);
+    bool decodePages(OpusDecoder *dec, const unsigned char *data, const std::vector<OggPageInfo> &pages, size_t firstAudioPage,
+                     size_t begin, size_t end, int64_t totalSamples, int serialno, int preSkip, opus_int16 *output);
     bool parseOpusHeader(const unsigned char *data, size_t len, OpusHeader &header);
     bool skipOpusComments(ogg_packet &packet);
+    bool readSeekIndex(const std::string &inputFileName, int serialno, int64_t fileSize, std::vector<OggSeekPoint> &index);
+    bool findSeekPage(OggPageReader &reader, const std::string &inputFileName, int serialno, int64_t audioStart, int64_t fileSize,
+                      int64_t targetGranule, int64_t &seekOffset, int64_t &seekGranule);
+    bool decodeSpan(const std::string &inputFileName, const std::string &outputFileName, int64_t start, int64_t end, int rate);
 
     void cleanup()
     {
@@ -106,7 +229,7 @@ private:
     }
 
 public:
-    OpusOggDecoder() : streamInitialized(false), channels(0), sampleRate(0)
+    OpusOggDecoder() : streamInitialized(false), verbose(true), channels(0), sampleRate(0), decoderChannels(0), decoderSampleRate(0)
     {
         ogg_sync_init(&oggSyncState);
     }
@@ -116,7 +239,22 @@ public:
         cleanup();
     }
 
+    // 关闭逐页读取日志和解码完成后的统计输出，批量处理时使用
+    void setVerbose(bool enable)
+    {
+        verbose = enable;
+    }
+
     bool decode(const std::string &inputFileName, const std::string &outputFileName);
+    // 先扫描页面边界和每页的采样起点，再把音频页分成threads段，每段用独立的解码器并行解码，
+    // 直接写到预先分配好大小的输出文件的对应位置；输入映射读取，输出fallocate后映射写入
+    // 输入无法映射(管道等)时退回到流式的decode
+    bool decodeParallel(const std::string &inputFileName, const std::string &outputFileName, int threads);
+    // 只解码 [startSample, endSample) 的PCM，采样位置与decode输出的时间轴一致
+    // 先用编码器写的seek索引定位，没有索引时按granulepos二分，从目标前SEEK_PREROLL_MS处开始解码并丢弃预热部分
+    bool decodeSamples(const std::string &inputFileName, const std::string &outputFileName, int64_t startSample, int64_t endSample);
+    // 按时间(秒)解码 [startSeconds, endSeconds)
+    bool decodeRange(const std::string &inputFileName, const std::string &outputFileName, double startSeconds, double endSeconds);
 };
 
 #endif // OPUS_OGG_H
\ No newline at end of file
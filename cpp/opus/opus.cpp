@@ -2,30 +2,145 @@
 #include <fstream>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 #include <opus.h>
+#include "mapped_file.h"
+#include "opus_v2.h"
 
 #define SAMPLE_RATE 24000          // 采样率
 #define CHANNELS 1                 // 单通道
 #define FRAME_SIZE 480             // 20 ms for 24kHz
 #define MAX_PACKET_SIZE (3 * 1276) // opus 最大数据包 1276
 
-void pcm2opus(const std::string &inputFile, const std::string &outputFile);
+// 编码输入的采样格式，均为小端；S16 以外的格式转换成 float 编码
+enum InputFormat
+{
+    FORMAT_S16, // 16位整数，默认
+    FORMAT_F32, // 32位浮点，满幅为[-1, 1]
+    FORMAT_S24, // 24位整数，每个采样3字节紧密排列
+    FORMAT_S32, // 32位整数
+};
+
+void pcm2opus(const std::string &inputFile, const std::string &outputFile, InputFormat format = FORMAT_S16);
 void opus2pcm(const std::string &inputFile, const std::string &outputFile);
 
-int main()
+static bool parseInputFormat(const std::string &name, InputFormat &format)
+{
+    const char *names[] = {"s16", "f32", "s24", "s32"};
+    for (int i = 0; i < 4; i++)
+    {
+        if (name == names[i])
+        {
+            format = static_cast<InputFormat>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// 不带参数时按 v1 编解码 input/1.pcm
+// encode 默认写 v1，加 v2 写带索引的 v2 容器，输入格式默认 s16，v1 还支持 f32/s24/s32；
+// decode 按文件头自动识别，v2 按段多线程解码；range 只支持 v2
+int main(int argc, char *argv[])
 {
-    // OPUS
-    pcm2opus("input/1.pcm", "output/1.opus");
-    opus2pcm("output/1.opus", "output/1.pcm");
+    if (argc == 1)
+    {
+        // OPUS
+        pcm2opus("input/1.pcm", "output/1.opus");
+        opus2pcm("output/1.opus", "output/1.pcm");
+        return 0;
+    }
+
+    std::string mode(argc > 1 ? argv[1] : "");
+    if (mode == "encode" && argc >= 4 && argc <= 6)
+    {
+        std::string version(argc >= 5 ? argv[4] : "v1");
+        InputFormat format = FORMAT_S16;
+        if (argc == 6 && !parseInputFormat(argv[5], format))
+        {
+            std::cerr << "Invalid format" << std::endl;
+            return 1;
+        }
+        if (version == "v2")
+        {
+            if (format != FORMAT_S16)
+            {
+                std::cerr << "v2 only supports s16 input" << std::endl;
+                return 1;
+            }
+            return pcm2opusV2(argv[2], argv[3], SAMPLE_RATE, CHANNELS, FRAME_SIZE) ? 0 : 1;
+        }
+        if (version != "v1")
+        {
+            std::cerr << "Invalid version" << std::endl;
+            return 1;
+        }
+        pcm2opus(argv[2], argv[3], format);
+    }
+    else if (mode == "decode" && (argc == 4 || argc == 5))
+    {
+        if (isOpusV2File(argv[2]))
+        {
+            return opusV2ToPcm(argv[2], argv[3], argc == 5 ? std::atoi(argv[4]) : 1) ? 0 : 1;
+        }
+        opus2pcm(argv[2], argv[3]);
+    }
+    else if (mode == "range" && argc == 6)
+    {
+        return opusV2Range(argv[2], argv[3], std::atof(argv[4]), std::atof(argv[5])) ? 0 : 1;
+    }
+    else
+    {
+        std::cerr << "Usage: " << argv[0] << " encode <input.pcm> <output.opus> [v1|v2] [s16|f32|s24|s32]" << std::endl;
+        std::cerr << "       " << argv[0] << " decode <input.opus> <output.pcm> [threads]" << std::endl;
+        std::cerr << "       " << argv[0] << " range <input.opus> <output.pcm> <startSeconds> <endSeconds>" << std::endl;
+        return 1;
+    }
     return 0;
 }
 
 /***************** OPUS ********************/
 
-void pcm2opus(const std::string &inputFile, const std::string &outputFile)
+static size_t inputFormatBytes(InputFormat format)
 {
-    std::ifstream inFile(inputFile.c_str(), std::ios::binary);
-    if (!inFile)
+    return format == FORMAT_S16 ? 2 : format == FORMAT_S24 ? 3 : 4;
+}
+
+// n个采样转成float，整数按满幅归一化到[-1, 1)
+static void convertToFloat(InputFormat format, const unsigned char *src, float *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        if (format == FORMAT_F32)
+        {
+            std::memcpy(dst + i, src + i * 4, 4);
+        }
+        else if (format == FORMAT_S24)
+        {
+            const unsigned char *s = src + i * 3;
+            int32_t v = static_cast<int32_t>(static_cast<uint32_t>(s[0]) << 8 | static_cast<uint32_t>(s[1]) << 16 | static_cast<uint32_t>(s[2]) << 24);
+            dst[i] = (v >> 8) * (1.0f / 8388608);
+        }
+        else
+        {
+            int32_t v;
+            std::memcpy(&v, src + i * 4, 4);
+            dst[i] = v * (1.0f / 2147483648.0f);
+        }
+    }
+}
+
+void pcm2opus(const std::string &inputFile, const std::string &outputFile, InputFormat format)
+{
+    // 普通文件直接映射读取，管道等无法映射时用流读取
+    MappedInput mappedInput;
+    std::ifstream inFile;
+    bool mapped = mappedInput.open(inputFile);
+    if (!mapped)
+    {
+        inFile.open(inputFile.c_str(), std::ios::binary);
+    }
+    if (!mapped && !inFile)
     {
         std::cerr << "无法打开输入文件: " << inputFile << std::endl;
         return;
@@ -44,32 +159,72 @@ void pcm2opus(const std::string &inputFile, const std::string &outputFile)
     opus_encoder_ctl(encoder, OPUS_SET_BITRATE(48000));
     opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(8)); // 0~10
     opus_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
-    opus_encoder_ctl(encoder, OPUS_SET_LSB_DEPTH(16));
+    opus_encoder_ctl(encoder, OPUS_SET_LSB_DEPTH(format == FORMAT_S16 ? 16 : 24)); // 高于16位的输入按24位精度分配比特
 
-    std::ofstream outFile(outputFile.c_str(), std::ios::binary);
-    if (!outFile)
+    // 输出按码率估算大小后预分配并映射，编码结果直接写到映射区
+    size_t sampleBytes = inputFormatBytes(format);
+    size_t frameInputBytes = FRAME_SIZE * CHANNELS * sampleBytes;
+    size_t frameBytes = 2 + 48000 / 8 * FRAME_SIZE / SAMPLE_RATE;
+    MappedOutput outFile;
+    if (!outFile.open(outputFile, mappedInput.size() / frameInputBytes * frameBytes))
     {
         std::cerr << "无法打开输出文件: " << outputFile << std::endl;
         opus_encoder_destroy(encoder);
         return;
     }
 
-    int16_t pcm[FRAME_SIZE];                 // 读取 PCM 数据并进行编码
-    unsigned char opusData[MAX_PACKET_SIZE]; // Opus 编码后的数据缓冲区
-    while (inFile.read(reinterpret_cast<char *>(pcm), sizeof(pcm)))
+    std::vector<unsigned char> pcm(frameInputBytes); // 流读取时的 PCM 数据缓冲区，按输入格式
+    float floatPcm[FRAME_SIZE * CHANNELS];           // 非 S16 输入转换后的一帧
+    size_t offset = 0;                               // 映射读取时的位置
+    while (true)
     {
-        int frameSize = inFile.gcount() / sizeof(int16_t);
+        const unsigned char *frame = pcm.data();
+        int frameSize;
+        if (mapped)
+        {
+            if (offset + frameInputBytes > mappedInput.size())
+            {
+                break;
+            }
+            frame = mappedInput.data() + offset;
+            offset += frameInputBytes;
+            frameSize = FRAME_SIZE;
+        }
+        else
+        {
+            if (!inFile.read(reinterpret_cast<char *>(pcm.data()), frameInputBytes))
+            {
+                break;
+            }
+            frameSize = inFile.gcount() / (CHANNELS * sampleBytes);
+        }
 
         // 如果读取的样本少于 FRAME_SIZE，填充剩余部分
         if (frameSize < FRAME_SIZE)
         {
             std::cout << "读取的样本少于 " << FRAME_SIZE << ", 填充剩余部分, frameSize: " << frameSize << std::endl;
             frameSize = frameSize < 0 ? 0 : frameSize;
-            std::fill(pcm + frameSize, pcm + FRAME_SIZE, 0); // 用零填充
+            std::fill(pcm.begin() + frameSize * CHANNELS * sampleBytes, pcm.end(), 0); // 用零填充
             frameSize = FRAME_SIZE;
         }
 
-        int numBytes = opus_encode(encoder, pcm, frameSize, opusData, sizeof(opusData));
+        // 前2字节留给长度，opus 数据直接编码到输出中
+        unsigned char *dst = outFile.reserve(2 + MAX_PACKET_SIZE);
+        if (!dst)
+        {
+            std::cerr << "写入输出文件失败: " << outputFile << std::endl;
+            break;
+        }
+        int numBytes;
+        if (format == FORMAT_S16)
+        {
+            numBytes = opus_encode(encoder, reinterpret_cast<const int16_t *>(frame), frameSize, dst + 2, MAX_PACKET_SIZE);
+        }
+        else
+        {
+            convertToFloat(format, frame, floatPcm, FRAME_SIZE * CHANNELS);
+            numBytes = opus_encode_float(encoder, floatPcm, frameSize, dst + 2, MAX_PACKET_SIZE);
+        }
         if (numBytes < 0)
         {
             printf("编码失败,code=%d,msg=%s\n", numBytes, opus_strerror(numBytes));
@@ -81,11 +236,13 @@ void pcm2opus(const std::string &inputFile, const std::string &outputFile)
 
         // 截断为 2 字节（只保留低 16 位）, 按大端序分成字节
         uint16_t truncatedNum = numBytes & 0xFFFF;
-        uint8_t bytes[2];
-        bytes[0] = (truncatedNum >> 8) & 0xFF; // 高字节
-        bytes[1] = truncatedNum & 0xFF;        // 低字节
-        outFile.write(reinterpret_cast<char *>(bytes), 2);
-        outFile.write(reinterpret_cast<char *>(opusData), numBytes);
+        dst[0] = (truncatedNum >> 8) & 0xFF; // 高字节
+        dst[1] = truncatedNum & 0xFF;        // 低字节
+        if (!outFile.commit(2 + numBytes))
+        {
+            std::cerr << "写入输出文件失败: " << outputFile << std::endl;
+            break;
+        }
     }
 
     // 清理资源
@@ -96,8 +253,15 @@ void pcm2opus(const std::string &inputFile, const std::string &outputFile)
 
 void opus2pcm(const std::string &inputFile, const std::string &outputFile)
 {
-    std::ifstream inFile(inputFile.c_str(), std::ios::binary);
-    if (!inFile)
+    // 普通文件直接映射读取，管道等无法映射时用流读取
+    MappedInput mappedInput;
+    std::ifstream inFile;
+    bool mapped = mappedInput.open(inputFile);
+    if (!mapped)
+    {
+        inFile.open(inputFile.c_str(), std::ios::binary);
+    }
+    if (!mapped && !inFile)
     {
         std::cerr << "无法打开输入文件: " << inputFile << std::endl;
         return;
@@ -111,53 +275,95 @@ void opus2pcm(const std::string &inputFile, const std::string &outputFile)
         return;
     }
 
-    std::ofstream outFile(outputFile.c_str(), std::ios::binary);
-    if (!outFile)
+    // 输出按帧数估算大小后预分配并映射，解码结果直接写到映射区
+    size_t frameBytes = 2 + 48000 / 8 * FRAME_SIZE / SAMPLE_RATE;
+    MappedOutput outFile;
+    if (!outFile.open(outputFile, mappedInput.size() / frameBytes * FRAME_SIZE * sizeof(int16_t)))
     {
         std::cerr << "无法打开输出文件: " << outputFile << std::endl;
         opus_decoder_destroy(decoder);
         return;
     }
 
-    unsigned char opusData[MAX_PACKET_SIZE]; // Opus 编码数据缓冲区
-    int16_t pcm[FRAME_SIZE];                 // PCM 数据缓冲区
+    unsigned char opusData[MAX_PACKET_SIZE]; // 流读取时的 Opus 编码数据缓冲区
+    size_t offset = 0;                       // 映射读取时的位置
     int numBytes;
 
     while (true)
     {
+        const unsigned char *packet = opusData;
         uint8_t bytes[2];
-        inFile.read(reinterpret_cast<char *>(bytes), 2);
-        numBytes = inFile.gcount();
-        if (numBytes <= 0)
+        int numBytesPerFrame;
+        if (mapped)
         {
-            std::cerr << "读取数据失败或者数据已全部读取。" << std::endl;
-            break;
+            if (offset >= mappedInput.size())
+            {
+                std::cerr << "读取数据失败或者数据已全部读取。" << std::endl;
+                break;
+            }
+            if (offset + 2 > mappedInput.size())
+            {
+                std::cerr << "读取opus数据帧长度失败了" << std::endl;
+                break;
+            }
+            // 按大端序将字节组合成一个 16 位整数
+            numBytesPerFrame = (mappedInput.data()[offset] << 8) | mappedInput.data()[offset + 1];
+            offset += 2;
+
+            // opus 数据直接从映射区解码
+            numBytes = std::min<size_t>(numBytesPerFrame, mappedInput.size() - offset);
+            if (numBytes <= 0)
+            {
+                std::cerr << "读取数据失败或者数据已全部读取。" << std::endl;
+                break;
+            }
+            packet = mappedInput.data() + offset;
+            offset += numBytes;
         }
-        if (inFile.gcount() != 2)
+        else
         {
-            std::cerr << "读取opus数据帧长度失败了" << std::endl;
-            break;
+            inFile.read(reinterpret_cast<char *>(bytes), 2);
+            numBytes = inFile.gcount();
+            if (numBytes <= 0)
+            {
+                std::cerr << "读取数据失败或者数据已全部读取。" << std::endl;
+                break;
+            }
+            if (inFile.gcount() != 2)
+            {
+                std::cerr << "读取opus数据帧长度失败了" << std::endl;
+                break;
+            }
+            // 按大端序将字节组合成一个 16 位整数
+            numBytesPerFrame = (bytes[0] << 8) | bytes[1];
+
+            inFile.read(reinterpret_cast<char *>(opusData), numBytesPerFrame);
+            numBytes = inFile.gcount();
+            if (numBytes <= 0)
+            {
+                std::cerr << "读取数据失败或者数据已全部读取。" << std::endl;
+                break;
+            }
         }
-        // 按大端序将字节组合成一个 16 位整数
-        int numBytesPerFrame = (bytes[0] << 8) | bytes[1];
-        
 
-        inFile.read(reinterpret_cast<char *>(opusData), numBytesPerFrame);
-        numBytes = inFile.gcount();
-        if (numBytes <= 0)
+        int16_t *pcm = reinterpret_cast<int16_t *>(outFile.reserve(FRAME_SIZE * sizeof(int16_t)));
+        if (!pcm)
         {
-            std::cerr << "读取数据失败或者数据已全部读取。" << std::endl;
+            std::cerr << "写入输出文件失败: " << outputFile << std::endl;
             break;
         }
-
-        int framesDecoded = opus_decode(decoder, opusData, numBytes, pcm, FRAME_SIZE, 0);
+        int framesDecoded = opus_decode(decoder, packet, numBytes, pcm, FRAME_SIZE, 0);
         if (framesDecoded < 0)
         {
             printf("解码失败,code=%d,msg=%s\n", framesDecoded, opus_strerror(framesDecoded));
             break;
         }
         printf("[fn:opus2pcm] numBytesPerFrame:%d, read_numBytes:%d, decoded_frameSize:%d\n", numBytesPerFrame, numBytes, framesDecoded);
-        outFile.write(reinterpret_cast<char *>(pcm), framesDecoded * sizeof(int16_t));
+        if (!outFile.commit(framesDecoded * sizeof(int16_t)))
+        {
+            std::cerr << "写入输出文件失败: " << outputFile << std::endl;
+            break;
+        }
     }
 
     inFile.close();
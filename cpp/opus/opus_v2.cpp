@@ -0,0 +1,630 @@
+#include "opus_v2.h"
+#include "mapped_file.h"
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <cstdio>
+#include <opus.h>
+
+#define OPUS_V2_MAX_PACKET_SIZE (3 * 1276) // opus 最大数据包 1276
+
+namespace
+{
+    // 按大端序读写整数
+    void putU16(unsigned char *p, uint32_t v)
+    {
+        p[0] = (v >> 8) & 0xFF;
+        p[1] = v & 0xFF;
+    }
+
+    void putU32(unsigned char *p, uint32_t v)
+    {
+        putU16(p, v >> 16);
+        putU16(p + 2, v);
+    }
+
+    void putU64(unsigned char *p, uint64_t v)
+    {
+        putU32(p, v >> 32);
+        putU32(p + 4, static_cast<uint32_t>(v));
+    }
+
+    uint32_t getU16(const unsigned char *p)
+    {
+        return (p[0] << 8) | p[1];
+    }
+
+    uint32_t getU32(const unsigned char *p)
+    {
+        return (getU16(p) << 16) | getU16(p + 2);
+    }
+
+    uint64_t getU64(const unsigned char *p)
+    {
+        return (static_cast<uint64_t>(getU32(p)) << 32) | getU32(p + 4);
+    }
+
+    // CRC-32 (IEEE 802.3，与 zlib 相同)
+    struct CrcTable
+    {
+        uint32_t values[256];
+
+        CrcTable()
+        {
+            for (uint32_t i = 0; i < 256; i++)
+            {
+                uint32_t c = i;
+                for (int k = 0; k < 8; k++)
+                {
+                    c = (c & 1) ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+                }
+                values[i] = c;
+            }
+        }
+    };
+
+    uint32_t crc32(const unsigned char *data, size_t n)
+    {
+        static const CrcTable table;
+        uint32_t c = 0xFFFFFFFF;
+        for (size_t i = 0; i < n; i++)
+        {
+            c = table.values[(c ^ data[i]) & 0xFF] ^ (c >> 8);
+        }
+        return c ^ 0xFFFFFFFF;
+    }
+
+    struct OpusV2Packet
+    {
+        const unsigned char *data;
+        int length;
+    };
+
+    // 同步头之后按长度前缀依次取出段内的包，段已经过 readSegment 校验
+    void collectPackets(const unsigned char *data, const OpusV2Segment &segment, std::vector<OpusV2Packet> &packets)
+    {
+        packets.clear();
+        const unsigned char *p = data + segment.offset + OPUS_V2_SYNC_SIZE;
+        for (uint32_t i = 0; i < segment.frames; i++)
+        {
+            int length = getU16(p);
+            packets.push_back({p + 2, length});
+            p += 2 + length;
+        }
+    }
+
+    // 解析 offset 处的同步头，检查魔数、CRC，以及包长之和与 payloadBytes 一致
+    bool readSegment(const unsigned char *data, size_t size, uint64_t offset, OpusV2Segment &segment)
+    {
+        if (offset < OPUS_V2_HEADER_SIZE || offset > size || size - offset < OPUS_V2_SYNC_SIZE)
+        {
+            return false;
+        }
+        const unsigned char *sync = data + offset;
+        if (std::memcmp(sync, OPUS_V2_SYNC_MAGIC, 4) != 0)
+        {
+            return false;
+        }
+        segment.offset = offset;
+        segment.firstFrame = getU32(sync + 4);
+        segment.frames = getU16(sync + 8);
+        segment.payloadBytes = getU32(sync + 10);
+        segment.valid = false;
+        const unsigned char *payload = sync + OPUS_V2_SYNC_SIZE;
+        if (segment.frames == 0 || size - offset - OPUS_V2_SYNC_SIZE < segment.payloadBytes ||
+            crc32(payload, segment.payloadBytes) != getU32(sync + 14))
+        {
+            return false;
+        }
+        size_t pos = 0;
+        for (uint32_t i = 0; i < segment.frames; i++)
+        {
+            if (pos + 2 > segment.payloadBytes)
+            {
+                return false;
+            }
+            size_t length = getU16(payload + pos);
+            if (length == 0 || length > OPUS_V2_MAX_PACKET_SIZE)
+            {
+                return false;
+            }
+            pos += 2 + length;
+        }
+        segment.valid = pos == segment.payloadBytes;
+        return segment.valid;
+    }
+
+    bool readHeader(const unsigned char *data, size_t size, OpusV2Header &header)
+    {
+        if (size < OPUS_V2_HEADER_SIZE || std::memcmp(data, OPUS_V2_MAGIC, 4) != 0)
+        {
+            std::cerr << "不是 v2 文件" << std::endl;
+            return false;
+        }
+        if (data[4] != OPUS_V2_VERSION)
+        {
+            std::cerr << "不支持的 v2 版本: " << static_cast<int>(data[4]) << std::endl;
+            return false;
+        }
+        header.channels = data[5];
+        header.frameSize = getU16(data + 6);
+        header.sampleRate = getU32(data + 8);
+        header.segmentFrames = getU16(data + 12);
+        if (header.channels < 1 || header.channels > 2 || header.frameSize == 0 || header.segmentFrames == 0)
+        {
+            std::cerr << "v2 文件头参数错误" << std::endl;
+            return false;
+        }
+        return true;
+    }
+
+    // 从文件尾的索引取得各段位置，索引本身不对时返回 false；索引指向的段损坏时记为无效段
+    bool loadIndex(const unsigned char *data, size_t size, const OpusV2Header &header,
+                   std::vector<OpusV2Segment> &segments, uint32_t &totalFrames)
+    {
+        if (size < OPUS_V2_HEADER_SIZE + OPUS_V2_FOOTER_SIZE)
+        {
+            return false;
+        }
+        const unsigned char *footer = data + size - OPUS_V2_FOOTER_SIZE;
+        if (std::memcmp(footer + 12, OPUS_V2_INDEX_MAGIC, 4) != 0)
+        {
+            return false;
+        }
+        uint64_t indexOffset = getU64(footer);
+        uint32_t frames = getU32(footer + 8);
+        uint64_t count = (static_cast<uint64_t>(frames) + header.segmentFrames - 1) / header.segmentFrames;
+        uint64_t indexEnd = size - OPUS_V2_FOOTER_SIZE;
+        if (indexOffset < OPUS_V2_HEADER_SIZE || indexOffset > indexEnd || indexEnd - indexOffset != count * 8)
+        {
+            return false;
+        }
+
+        segments.clear();
+        for (uint64_t k = 0; k < count; k++)
+        {
+            OpusV2Segment segment;
+            uint32_t firstFrame = k * header.segmentFrames;
+            uint32_t segmentFrames = std::min<uint32_t>(header.segmentFrames, frames - firstFrame);
+            uint64_t offset = getU64(data + indexOffset + k * 8);
+            if (!readSegment(data, indexOffset, offset, segment) || segment.firstFrame != firstFrame || segment.frames != segmentFrames)
+            {
+                std::cerr << "第 " << k << " 段损坏，输出静音" << std::endl;
+                segment = {offset, firstFrame, segmentFrames, 0, false};
+            }
+            segments.push_back(segment);
+        }
+        totalFrames = frames;
+        return true;
+    }
+
+    // 没有可用的索引时从头扫描同步头，遇到损坏的数据就向后查找下一个 "OPSY"，中间缺失的帧记为无效段
+    void scanSegments(const unsigned char *data, size_t size, std::vector<OpusV2Segment> &segments, uint32_t &totalFrames)
+    {
+        const unsigned char *magic = reinterpret_cast<const unsigned char *>(OPUS_V2_SYNC_MAGIC);
+        uint64_t pos = OPUS_V2_HEADER_SIZE;
+        uint32_t nextFrame = 0;
+        segments.clear();
+        while (pos + OPUS_V2_SYNC_SIZE <= size)
+        {
+            OpusV2Segment segment;
+            if (readSegment(data, size, pos, segment) && segment.firstFrame >= nextFrame)
+            {
+                if (segment.firstFrame > nextFrame)
+                {
+                    std::cerr << "第 " << nextFrame << " 帧起缺失 " << segment.firstFrame - nextFrame << " 帧，输出静音" << std::endl;
+                    segments.push_back({pos, nextFrame, segment.firstFrame - nextFrame, 0, false});
+                }
+                segments.push_back(segment);
+                nextFrame = segment.firstFrame + segment.frames;
+                pos += OPUS_V2_SYNC_SIZE + segment.payloadBytes;
+                continue;
+            }
+            pos = std::search(data + pos + 1, data + size, magic, magic + 4) - data;
+        }
+        totalFrames = nextFrame;
+    }
+
+    // 普通文件直接映射，管道等无法映射时整个读入内存
+    bool loadInput(const std::string &inputFile, MappedInput &mappedInput, std::vector<unsigned char> &buffer,
+                   const unsigned char *&data, size_t &size)
+    {
+        if (mappedInput.open(inputFile, MADV_WILLNEED))
+        {
+            data = mappedInput.data();
+            size = mappedInput.size();
+            return true;
+        }
+        std::ifstream inFile(inputFile.c_str(), std::ios::binary);
+        if (!inFile)
+        {
+            std::cerr << "无法打开输入文件: " << inputFile << std::endl;
+            return false;
+        }
+        buffer.assign(std::istreambuf_iterator<char>(inFile), std::istreambuf_iterator<char>());
+        data = buffer.data();
+        size = buffer.size();
+        return true;
+    }
+
+    bool loadSegments(const unsigned char *data, size_t size, OpusV2Header &header,
+                      std::vector<OpusV2Segment> &segments, uint32_t &totalFrames)
+    {
+        if (!readHeader(data, size, header))
+        {
+            return false;
+        }
+        if (!loadIndex(data, size, header, segments, totalFrames))
+        {
+            std::cerr << "索引缺失或损坏，扫描同步头" << std::endl;
+            scanSegments(data, size, segments, totalFrames);
+        }
+        return true;
+    }
+
+    // 解码 segments[begin, end) 中落在 [fromFrame, toFrame) 的帧，第 fromFrame 帧写到 pcm 开头
+    // 上一段末尾的 OPUS_V2_PREROLL_MS 和本段 fromFrame 之前的帧只用来恢复解码器状态，输出丢弃
+    bool decodeSegments(const unsigned char *data, const OpusV2Header &header, const std::vector<OpusV2Segment> &segments,
+                        size_t begin, size_t end, uint64_t fromFrame, uint64_t toFrame, int16_t *pcm)
+    {
+        int err;
+        OpusDecoder *decoder = opus_decoder_create(header.sampleRate, header.channels, &err);
+        if (!decoder)
+        {
+            std::cerr << "无法创建 Opus 解码器" << opus_strerror(err) << std::endl;
+            return false;
+        }
+
+        size_t frameSamples = static_cast<size_t>(header.frameSize) * header.channels;
+        std::vector<int16_t> scratch(frameSamples);
+        std::vector<OpusV2Packet> packets;
+        if (begin > 0 && segments[begin - 1].valid && segments[begin - 1].firstFrame + segments[begin - 1].frames == segments[begin].firstFrame)
+        {
+            size_t prerollFrames = (OPUS_V2_PREROLL_MS * header.sampleRate / 1000 + header.frameSize - 1) / header.frameSize;
+            collectPackets(data, segments[begin - 1], packets);
+            for (size_t i = packets.size() > prerollFrames ? packets.size() - prerollFrames : 0; i < packets.size(); i++)
+            {
+                opus_decode(decoder, packets[i].data, packets[i].length, scratch.data(), header.frameSize, 0);
+            }
+        }
+
+        for (size_t s = begin; s < end; s++)
+        {
+            const OpusV2Segment &segment = segments[s];
+            if (segment.firstFrame >= toFrame)
+            {
+                break;
+            }
+            uint64_t first = std::max<uint64_t>(segment.firstFrame, fromFrame);
+            uint64_t last = std::min<uint64_t>(segment.firstFrame + segment.frames, toFrame);
+            if (!segment.valid)
+            {
+                // 损坏或缺失的段输出静音保持时间轴，下一段从头开始解码
+                if (first < last)
+                {
+                    std::fill(pcm + (first - fromFrame) * frameSamples, pcm + (last - fromFrame) * frameSamples, 0);
+                }
+                opus_decoder_ctl(decoder, OPUS_RESET_STATE);
+                continue;
+            }
+
+            collectPackets(data, segment, packets);
+            for (uint32_t i = 0; i < segment.frames && segment.firstFrame + i < toFrame; i++)
+            {
+                uint64_t frame = segment.firstFrame + i;
+                int16_t *dst = frame >= fromFrame ? pcm + (frame - fromFrame) * frameSamples : scratch.data();
+                int framesDecoded = opus_decode(decoder, packets[i].data, packets[i].length, dst, header.frameSize, 0);
+                if (framesDecoded < 0)
+                {
+                    printf("解码失败,code=%d,msg=%s\n", framesDecoded, opus_strerror(framesDecoded));
+                    framesDecoded = 0;
+                }
+                // 每个包固定 frameSize 个采样，解出的不够时补零
+                std::fill(dst + framesDecoded * header.channels, dst + frameSamples, 0);
+            }
+        }
+
+        opus_decoder_destroy(decoder);
+        return true;
+    }
+
+    bool writeSegment(MappedOutput &outFile, std::vector<uint64_t> &index, uint32_t firstFrame, uint32_t frames,
+                      const std::vector<unsigned char> &payload)
+    {
+        unsigned char sync[OPUS_V2_SYNC_SIZE];
+        std::memcpy(sync, OPUS_V2_SYNC_MAGIC, 4);
+        putU32(sync + 4, firstFrame);
+        putU16(sync + 8, frames);
+        putU32(sync + 10, payload.size());
+        putU32(sync + 14, crc32(payload.data(), payload.size()));
+        index.push_back(outFile.size());
+        return outFile.write(sync, sizeof(sync)) && outFile.write(payload.data(), payload.size());
+    }
+}
+
+bool isOpusV2File(const std::string &inputFile)
+{
+    struct stat st;
+    if (stat(inputFile.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    {
+        return false;
+    }
+    std::ifstream inFile(inputFile.c_str(), std::ios::binary);
+    char magic[4];
+    return inFile.read(magic, sizeof(magic)) && std::memcmp(magic, OPUS_V2_MAGIC, 4) == 0;
+}
+
+bool pcm2opusV2(const std::string &inputFile, const std::string &outputFile, int sampleRate, int channels, int frameSize, int segmentFrames)
+{
+    if (channels < 1 || channels > 2 || frameSize <= 0 || frameSize > 0xFFFF || segmentFrames <= 0 || segmentFrames > 0xFFFF)
+    {
+        std::cerr << "v2 编码参数错误" << std::endl;
+        return false;
+    }
+
+    // 普通文件直接映射读取，管道等无法映射时用流读取
+    MappedInput mappedInput;
+    std::ifstream inFile;
+    bool mapped = mappedInput.open(inputFile);
+    if (!mapped)
+    {
+        inFile.open(inputFile.c_str(), std::ios::binary);
+    }
+    if (!mapped && !inFile)
+    {
+        std::cerr << "无法打开输入文件: " << inputFile << std::endl;
+        return false;
+    }
+
+    int err;
+    OpusEncoder *encoder = opus_encoder_create(sampleRate, channels, OPUS_APPLICATION_AUDIO, &err);
+    if (!encoder)
+    {
+        std::cerr << "无法创建 Opus 编码器" << opus_strerror(err) << std::endl;
+        return false;
+    }
+
+    // 与 v1 相同的编码参数
+    opus_encoder_ctl(encoder, OPUS_SET_VBR(0)); // 0:CBR, 1:VBR
+    opus_encoder_ctl(encoder, OPUS_SET_BITRATE(48000));
+    opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(8)); // 0~10
+    opus_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
+    opus_encoder_ctl(encoder, OPUS_SET_LSB_DEPTH(16));
+
+    size_t frameLength = static_cast<size_t>(frameSize) * channels * sizeof(int16_t);
+    size_t frameBytes = 2 + 48000 / 8 * frameSize / sampleRate;
+    MappedOutput outFile;
+    if (!outFile.open(outputFile, mappedInput.size() / frameLength * frameBytes))
+    {
+        std::cerr << "无法打开输出文件: " << outputFile << std::endl;
+        opus_encoder_destroy(encoder);
+        return false;
+    }
+
+    unsigned char header[OPUS_V2_HEADER_SIZE];
+    std::memcpy(header, OPUS_V2_MAGIC, 4);
+    header[4] = OPUS_V2_VERSION;
+    header[5] = channels;
+    putU16(header + 6, frameSize);
+    putU32(header + 8, sampleRate);
+    putU16(header + 12, segmentFrames);
+    putU16(header + 14, 0);
+    bool ok = outFile.write(header, sizeof(header));
+
+    std::vector<int16_t> pcm(frameLength / sizeof(int16_t)); // 流读取和最后不足一帧时的缓冲区
+    std::vector<unsigned char> payload;                      // 当前段的包，整段编码完后连同同步头一起写出
+    payload.reserve(segmentFrames * (2 + OPUS_V2_MAX_PACKET_SIZE));
+    std::vector<uint64_t> index;
+    uint32_t totalFrames = 0;
+    int segmentCount = 0; // 当前段已编码的包数
+    size_t offset = 0;    // 映射读取时的位置
+    while (ok)
+    {
+        const int16_t *frame = pcm.data();
+        size_t bytesRead;
+        if (mapped)
+        {
+            if (offset >= mappedInput.size())
+            {
+                break;
+            }
+            bytesRead = std::min(frameLength, mappedInput.size() - offset);
+            if (bytesRead == frameLength)
+            {
+                frame = reinterpret_cast<const int16_t *>(mappedInput.data() + offset);
+            }
+            else
+            {
+                std::memcpy(pcm.data(), mappedInput.data() + offset, bytesRead);
+            }
+            offset += bytesRead;
+        }
+        else
+        {
+            inFile.read(reinterpret_cast<char *>(pcm.data()), frameLength);
+            bytesRead = inFile.gcount();
+            if (bytesRead == 0)
+            {
+                break;
+            }
+        }
+        // 最后不足一帧时用零填充
+        if (bytesRead < frameLength)
+        {
+            std::memset(reinterpret_cast<char *>(pcm.data()) + bytesRead, 0, frameLength - bytesRead);
+        }
+
+        // 段的第一个包不参考之前的帧，解码器从这里开始也能正确解码
+        if (segmentCount == 0)
+        {
+            opus_encoder_ctl(encoder, OPUS_SET_PREDICTION_DISABLED(1));
+        }
+        size_t pos = payload.size();
+        payload.resize(pos + 2 + OPUS_V2_MAX_PACKET_SIZE);
+        int numBytes = opus_encode(encoder, frame, frameSize, &payload[pos + 2], OPUS_V2_MAX_PACKET_SIZE);
+        if (segmentCount == 0)
+        {
+            opus_encoder_ctl(encoder, OPUS_SET_PREDICTION_DISABLED(0));
+        }
+        if (numBytes < 0)
+        {
+            printf("编码失败,code=%d,msg=%s\n", numBytes, opus_strerror(numBytes));
+            ok = false;
+            break;
+        }
+        putU16(&payload[pos], numBytes);
+        payload.resize(pos + 2 + numBytes);
+        totalFrames++;
+
+        if (++segmentCount == segmentFrames)
+        {
+            ok = writeSegment(outFile, index, totalFrames - segmentCount, segmentCount, payload);
+            payload.clear();
+            segmentCount = 0;
+        }
+    }
+    if (ok && segmentCount > 0)
+    {
+        ok = writeSegment(outFile, index, totalFrames - segmentCount, segmentCount, payload);
+    }
+
+    // 文件尾: 各段偏移和指向它们的尾部
+    if (ok)
+    {
+        std::vector<unsigned char> trailer(index.size() * 8 + OPUS_V2_FOOTER_SIZE);
+        for (size_t k = 0; k < index.size(); k++)
+        {
+            putU64(&trailer[k * 8], index[k]);
+        }
+        unsigned char *footer = &trailer[index.size() * 8];
+        putU64(footer, outFile.size());
+        putU32(footer + 8, totalFrames);
+        std::memcpy(footer + 12, OPUS_V2_INDEX_MAGIC, 4);
+        ok = outFile.write(trailer.data(), trailer.size());
+    }
+    if (!ok)
+    {
+        std::cerr << "写入输出文件失败: " << outputFile << std::endl;
+    }
+
+    ok = outFile.close() && ok;
+    opus_encoder_destroy(encoder);
+    printf("[fn:pcm2opusV2] frames:%u, segments:%zu\n", totalFrames, index.size());
+    return ok;
+}
+
+bool opusV2ToPcm(const std::string &inputFile, const std::string &outputFile, int threads)
+{
+    MappedInput mappedInput;
+    std::vector<unsigned char> buffer;
+    const unsigned char *data;
+    size_t size;
+    OpusV2Header header;
+    std::vector<OpusV2Segment> segments;
+    uint32_t totalFrames;
+    if (!loadInput(inputFile, mappedInput, buffer, data, size) || !loadSegments(data, size, header, segments, totalFrames))
+    {
+        return false;
+    }
+
+    // 输出长度已知，一次性预分配，各线程直接解码到自己的位置
+    size_t outputBytes = static_cast<size_t>(totalFrames) * header.frameSize * header.channels * sizeof(int16_t);
+    MappedOutput outFile;
+    unsigned char *output = nullptr;
+    if (!outFile.open(outputFile, outputBytes) || !(output = outFile.reserve(outputBytes)))
+    {
+        std::cerr << "无法打开输出文件: " << outputFile << std::endl;
+        return false;
+    }
+    int16_t *pcm = reinterpret_cast<int16_t *>(output);
+
+    // 按段数均分，第一组在当前线程解码
+    size_t groups = std::min<size_t>(std::max(threads, 1), std::max<size_t>(segments.size(), 1));
+    std::vector<std::thread> workers;
+    std::vector<char> results(groups, 0);
+    for (size_t i = 1; i < groups; i++)
+    {
+        size_t begin = segments.size() * i / groups;
+        size_t end = segments.size() * (i + 1) / groups;
+        workers.emplace_back([=, &header, &segments, &results]
+                             { results[i] = decodeSegments(data, header, segments, begin, end, 0, totalFrames, pcm); });
+    }
+    results[0] = decodeSegments(data, header, segments, 0, segments.size() / groups, 0, totalFrames, pcm);
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+    if (!outFile.commit(outputBytes) || !outFile.close())
+    {
+        std::cerr << "写入输出文件失败: " << outputFile << std::endl;
+        return false;
+    }
+
+    printf("[fn:opusV2ToPcm] channels:%d, sampleRate:%d, frames:%u, segments:%zu, threads:%zu\n",
+           header.channels, header.sampleRate, totalFrames, segments.size(), groups);
+    for (char ok : results)
+    {
+        if (!ok)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool opusV2Range(const std::string &inputFile, const std::string &outputFile, double startSeconds, double endSeconds)
+{
+    MappedInput mappedInput;
+    std::vector<unsigned char> buffer;
+    const unsigned char *data;
+    size_t size;
+    OpusV2Header header;
+    std::vector<OpusV2Segment> segments;
+    uint32_t totalFrames;
+    if (!loadInput(inputFile, mappedInput, buffer, data, size) || !loadSegments(data, size, header, segments, totalFrames))
+    {
+        return false;
+    }
+
+    uint64_t totalSamples = static_cast<uint64_t>(totalFrames) * header.frameSize;
+    uint64_t startSample = std::min<uint64_t>(std::max(startSeconds, 0.0) * header.sampleRate, totalSamples);
+    uint64_t endSample = std::min<uint64_t>(std::max(endSeconds, 0.0) * header.sampleRate, totalSamples);
+    if (endSample < startSample)
+    {
+        std::cerr << "结束时间早于开始时间" << std::endl;
+        return false;
+    }
+
+    // 按帧对齐解码，再截掉首尾多出的采样
+    uint64_t fromFrame = startSample / header.frameSize;
+    uint64_t toFrame = (endSample + header.frameSize - 1) / header.frameSize;
+    size_t frameSamples = static_cast<size_t>(header.frameSize) * header.channels;
+    size_t decodedBytes = (toFrame - fromFrame) * frameSamples * sizeof(int16_t);
+    size_t outputBytes = (endSample - startSample) * header.channels * sizeof(int16_t);
+    MappedOutput outFile;
+    unsigned char *output = nullptr;
+    if (!outFile.open(outputFile, decodedBytes) || !(output = outFile.reserve(decodedBytes)))
+    {
+        std::cerr << "无法打开输出文件: " << outputFile << std::endl;
+        return false;
+    }
+
+    // 二分查找包含 fromFrame 的段，从它开始解码
+    size_t begin = std::upper_bound(segments.begin(), segments.end(), fromFrame,
+                                    [](uint64_t frame, const OpusV2Segment &segment)
+                                    { return frame < segment.firstFrame; }) -
+                   segments.begin();
+    begin = begin > 0 ? begin - 1 : 0;
+    bool ok = decodeSegments(data, header, segments, begin, segments.size(), fromFrame, toFrame, reinterpret_cast<int16_t *>(output));
+    size_t skipBytes = (startSample - fromFrame * header.frameSize) * header.channels * sizeof(int16_t);
+    std::memmove(output, output + skipBytes, outputBytes);
+    if (!outFile.commit(outputBytes) || !outFile.close())
+    {
+        std::cerr << "写入输出文件失败: " << outputFile << std::endl;
+        return false;
+    }
+    printf("[fn:opusV2Range] samples:[%llu, %llu), first segment:%zu\n",
+           static_cast<unsigned long long>(startSample), static_cast<unsigned long long>(endSample), begin);
+    return ok;
+}
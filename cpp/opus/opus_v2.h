@@ -0,0 +1,62 @@
+#ifndef OPUS_V2_H
+#define OPUS_V2_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+// v2 容器，整数均为大端序
+//
+// 文件头 16 字节:
+//   "OPV2" | version u8 | channels u8 | frameSize u16 | sampleRate u32 | segmentFrames u16 | reserved u16
+// 之后是若干段，每段 segmentFrames 个包(最后一段可以更少)，以同步头开始:
+//   "OPSY" | firstFrame u32 | frames u16 | payloadBytes u32 | crc32 u32
+//   payload: frames 个 [长度 u16 | opus 包]，与 v1 的帧格式相同
+// 每段的第一个包关闭帧间预测，解码器从段起点开始(加上前一段末尾的少量预热包)即可解码
+// 文件尾是段偏移索引和 16 字节的尾部:
+//   index: 段数个 u64，依次为每段同步头的文件偏移
+//   footer: indexOffset u64 | totalFrames u32 | "OPIX"
+// 索引缺失或损坏时按同步头顺序扫描，同步头或 CRC 不对的段跳过并输出静音，之后按 "OPSY" 重新同步
+//
+// v1 没有文件头，开头就是 2 字节长度，"OP" 作为长度是 20304，超过 opus 最大包长，两者可以直接区分
+
+#define OPUS_V2_MAGIC "OPV2"
+#define OPUS_V2_SYNC_MAGIC "OPSY"
+#define OPUS_V2_INDEX_MAGIC "OPIX"
+#define OPUS_V2_VERSION 2
+#define OPUS_V2_HEADER_SIZE 16
+#define OPUS_V2_SYNC_SIZE 18
+#define OPUS_V2_FOOTER_SIZE 16
+#define OPUS_V2_SEGMENT_FRAMES 50 // 默认每段的包数，20ms 帧时为 1 秒
+#define OPUS_V2_PREROLL_MS 80     // 从段起点解码时先用前一段末尾这么长的包预热解码器
+
+struct OpusV2Header
+{
+    int channels;
+    int frameSize;
+    int sampleRate;
+    int segmentFrames;
+};
+
+// 一段在文件中的位置，valid 为 false 的段解码时输出静音
+struct OpusV2Segment
+{
+    uint64_t offset; // 同步头的文件偏移
+    uint32_t firstFrame;
+    uint32_t frames;
+    uint32_t payloadBytes;
+    bool valid;
+};
+
+// 文件开头是否为 v2 文件头，只检查普通文件，管道等按 v1 处理
+bool isOpusV2File(const std::string &inputFile);
+
+// 编码为 v2 容器，segmentFrames 为每段的包数
+bool pcm2opusV2(const std::string &inputFile, const std::string &outputFile, int sampleRate, int channels, int frameSize,
+                int segmentFrames = OPUS_V2_SEGMENT_FRAMES);
+// 按段均分给 threads 个线程解码，每个线程有自己的解码器，输出直接写到各自的位置
+bool opusV2ToPcm(const std::string &inputFile, const std::string &outputFile, int threads);
+// 用索引定位到包含 startSeconds 的段，只解码 [startSeconds, endSeconds) 这一段 PCM
+bool opusV2Range(const std::string &inputFile, const std::string &outputFile, double startSeconds, double endSeconds);
+
+#endif
@@ -0,0 +1,2 @@
+g++ -O2 -std=c++11 -o alloc_check alloc_check.cpp interface.cpp opus_codec.cpp sample_format.cpp -I /usr/local/include/opus -ldl
+./alloc_check "$@"
@@ -1,2 +1,2 @@
-g++ -g -std=c++11 -shared -o libopus_codec.so interface.cpp opus_codec.cpp -fPIC -I /usr/local/include/opus -L ./lib -lopus -ldl
-go build -o main main.go
\ No newline at end of file
+g++ -g -std=c++11 -shared -o libopus_codec.so interface.cpp opus_codec.cpp sample_format.cpp -fPIC -I /usr/local/include/opus -L ./lib -lopus -ldl
+go build -o main main.go bench.go
\ No newline at end of file
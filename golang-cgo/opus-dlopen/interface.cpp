@@ -6,15 +6,25 @@ extern "C"
 {
 #endif
     int OpusCodecInit(const char *libName)
+    {
+        return OpusCodecInitDispatch(libName, false);
+    }
+
+    int OpusCodecInitDispatch(const char *libNames, bool calibrate)
     {
         dlHandler* dlh = dlHandler::GetInstance();
-        int ret = dlh->Open(libName);
+        int ret = dlh->Open(libNames, calibrate);
         if (ret != 0) {
             return ret;
         }
         return 0;
     }
 
+    const char *OpusCodecBackend()
+    {
+        return dlHandler::GetInstance()->Backend().c_str();
+    }
+
     void OpusCodecFini()
     {
         dlHandler *dlh = dlHandler::GetInstance();
@@ -51,9 +61,9 @@ extern "C"
         }
 
         OpusCodec *oc = static_cast<OpusCodec *>(inst);
-        std::vector<char> inputVec(input, input + inputLen);
-        std::vector<char> outputVec;
-        int ret = oc->Encode(inputVec, outputVec, last);
+        // 直接读取input，结果先写入实例自带的缓冲区，只在返回给调用方时malloc一次
+        std::vector<char> &outputVec = oc->Scratch();
+        int ret = oc->Encode(input, inputLen, outputVec, last);
         if (ret != 0)
         {
             return ret;
@@ -68,10 +78,101 @@ extern "C"
         return 0;
     }
 
-    // not implemented
     int OpusCodecDecode(void *inst, const char *input, int inputLen, char **output, int *outputLen, bool last)
     {
-        return -1;
+        if (!inst || (inputLen > 0 && !input) || !output || !outputLen)
+        {
+            return -1; // 参数错误
+        }
+
+        OpusCodec *oc = static_cast<OpusCodec *>(inst);
+        // 直接读取input，结果先写入实例自带的缓冲区，只在返回给调用方时malloc一次
+        std::vector<char> &outputVec = oc->Scratch();
+        int ret = oc->Decode(input, inputLen, outputVec, last);
+        if (ret != 0)
+        {
+            return ret;
+        }
+        *outputLen = outputVec.size();
+        *output = (char *)malloc(*outputLen); // 使用 malloc, 外层go一定要注意 free 内存
+        if (*output == nullptr)
+        {
+            return -1;
+        }
+        std::memcpy(*output, outputVec.data(), *outputLen);
+        return 0;
+    }
+
+    int OpusCodecDecodeBound(void *inst, const char *input, int inputLen)
+    {
+        if (!inst || inputLen < 0 || (inputLen > 0 && !input))
+        {
+            return OPUS_CODEC_ERR;
+        }
+        OpusCodec *oc = static_cast<OpusCodec *>(inst);
+        return oc->DecodeBound(input, inputLen);
+    }
+
+    int OpusCodecDecodeInto(void *inst, const char *input, int inputLen, char *output, int outputCap, int *outputLen, bool last)
+    {
+        if (!inst || inputLen < 0 || (inputLen > 0 && !input) || outputCap < 0 || (outputCap > 0 && !output) || !outputLen)
+        {
+            return OPUS_CODEC_ERR; // 参数错误
+        }
+
+        OpusCodec *oc = static_cast<OpusCodec *>(inst);
+        // 先算出本次输入解码后的大小，不够时不消费输入，解码器状态保持不变
+        size_t bound = oc->DecodeBound(input, inputLen);
+        if (static_cast<size_t>(outputCap) < bound)
+        {
+            *outputLen = bound;
+            return OPUS_CODEC_ERR_BUFFER_TOO_SMALL;
+        }
+        OutputSpan span(output, outputCap);
+        int ret = oc->Decode(input, inputLen, span, last);
+        *outputLen = span.size;
+        return ret;
+    }
+
+    int OpusCodecEncodeBound(void *inst, int inputLen, bool last)
+    {
+        if (!inst || inputLen < 0)
+        {
+            return OPUS_CODEC_ERR;
+        }
+        OpusCodec *oc = static_cast<OpusCodec *>(inst);
+        return oc->EncodeBound(inputLen, last);
+    }
+
+    int OpusCodecSetInputFormat(void *inst, int format, int inputChannels)
+    {
+        if (!inst || !sampleFormatValid(format))
+        {
+            return OPUS_CODEC_ERR;
+        }
+        OpusCodec *oc = static_cast<OpusCodec *>(inst);
+        return oc->SetInputFormat(static_cast<SampleFormat>(format), inputChannels) ? OPUS_CODEC_OK : OPUS_CODEC_ERR;
+    }
+
+    int OpusCodecEncodeInto(void *inst, const char *input, int inputLen, char *output, int outputCap, int *outputLen, bool last)
+    {
+        if (!inst || inputLen < 0 || (inputLen > 0 && !input) || outputCap < 0 || (outputCap > 0 && !output) || !outputLen)
+        {
+            return OPUS_CODEC_ERR; // 参数错误
+        }
+
+        OpusCodec *oc = static_cast<OpusCodec *>(inst);
+        // 先按最坏情况检查容量，不够时不消费输入，编码器状态保持不变
+        size_t bound = oc->EncodeBound(inputLen, last);
+        if (static_cast<size_t>(outputCap) < bound)
+        {
+            *outputLen = bound;
+            return OPUS_CODEC_ERR_BUFFER_TOO_SMALL;
+        }
+        OutputSpan span(output, outputCap);
+        int ret = oc->Encode(input, inputLen, span, last);
+        *outputLen = span.size;
+        return ret;
     }
 
 #ifdef __cplusplus
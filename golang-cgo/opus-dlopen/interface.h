@@ -9,13 +9,44 @@ extern "C"
 #include <stdlib.h>
 #include <stdbool.h>
 
+// 返回码
+#define OPUS_CODEC_OK 0
+#define OPUS_CODEC_ERR -1                  // 参数错误或编解码失败
+#define OPUS_CODEC_ERR_BUFFER_TOO_SMALL -2 // 输出缓冲区不足，*outputLen 为需要的字节数，本次输入未被消费
+
+    // libName 可以是逗号分隔的多个候选库，每项可加 "级别:" 前缀标注构建时的指令集:
+    // generic、sse4.1、avx2、avx512(或 x86-64、x86-64-v2、x86-64-v3、x86-64-v4)，没有前缀的按 generic 处理，
+    // 如 "avx2:lib/v3/libopus.so.0,libopus.so.0"；按本机 CPU 支持的最高级别选择能加载全部符号的库
     int OpusCodecInit(const char *libName);
+    // calibrate 为 true 时对本机支持的候选各跑一次约 1 秒音频的编码测试，选最快的，代价是初始化多花几十毫秒
+    int OpusCodecInitDispatch(const char *libNames, bool calibrate);
+    // 当前选用的库，如 "avx2 lib/v3/libopus.so.0 (libopus 1.4, cpu avx512)"，Fini 之前有效，未初始化时为空串
+    const char *OpusCodecBackend();
     void OpusCodecFini();
     int OpusCodecStart(void **inst, int sampleRate);
     int OpusCodecEnd(void **inst);
     int OpusCodecEncode(void *inst, const char *input, int inputLen, char **output, int *outputLen, bool last);
     int OpusCodecDecode(void *inst, const char *input, int inputLen, char **output, int *outputLen, bool last);
 
+    // 零拷贝接口：直接读取调用方的 input，结果直接写入调用方持有的 output(容量 outputCap)
+    // EncodeBound 返回本次编码最坏情况下的输出字节数，output 不小于该值时编码一定成功
+    int OpusCodecEncodeBound(void *inst, int inputLen, bool last);
+    int OpusCodecEncodeInto(void *inst, const char *input, int inputLen, char *output, int outputCap, int *outputLen, bool last);
+
+// 编码输入的采样格式，均为小端、多声道交错排列
+#define OPUS_CODEC_FORMAT_S16 0 // 16位整数，默认
+#define OPUS_CODEC_FORMAT_F32 1 // 32位浮点，满幅为[-1, 1]
+#define OPUS_CODEC_FORMAT_S24 2 // 24位整数，每个采样3字节紧密排列
+#define OPUS_CODEC_FORMAT_S32 3 // 32位整数
+    // Start 之后、第一次 Encode 之前调用，输入直接转换进编码帧，非 S16 格式用 opus_encode_float 编码
+    // inputChannels 为 2 而编码为单声道时先下混
+    int OpusCodecSetInputFormat(void *inst, int format, int inputChannels);
+
+    // 解码 2 字节大端长度头 + opus 包 的流，input 可以在任意字节处切分，不完整的长度头和包缓存到下次调用
+    // DecodeBound 返回本次输入中完整的包解码后的总字节数，按每包的 TOC 计算，不解码
+    int OpusCodecDecodeBound(void *inst, const char *input, int inputLen);
+    int OpusCodecDecodeInto(void *inst, const char *input, int inputLen, char *output, int outputCap, int *outputLen, bool last);
+
 #ifdef __cplusplus
 }
 #endif
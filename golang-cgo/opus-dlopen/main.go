@@ -27,14 +27,22 @@ func main() {
 		i              string
 		outputFileName string
 		o              string
+		libNames       string
+		calibrate      bool
+		inputFormat    string
+		inputChannels  int
 	)
 
-	flag.StringVar(&mode, "mode", "", "encode or decode")
-	flag.StringVar(&m, "m", "default", "encode or decode")
+	flag.StringVar(&mode, "mode", "", "encode, decode or bench")
+	flag.StringVar(&m, "m", "default", "encode, decode or bench")
 	flag.StringVar(&inputFileName, "inputFileName", "", "输入文件")
 	flag.StringVar(&i, "i", "default", "输入文件")
 	flag.StringVar(&outputFileName, "outputFileName", "", "输出文件")
 	flag.StringVar(&o, "o", "default", "输出文件")
+	flag.StringVar(&libNames, "lib", "libopus.so.0", "逗号分隔的候选 libopus，可加级别前缀，如 avx2:lib/v3/libopus.so.0,libopus.so.0")
+	flag.BoolVar(&calibrate, "calibrate", false, "对候选库跑一次短编码测试，选最快的")
+	flag.StringVar(&inputFormat, "format", "s16", "编码输入的采样格式: s16, f32, s24 或 s32")
+	flag.IntVar(&inputChannels, "inputChannels", 1, "编码输入的声道数，2 时下混成单声道")
 	flag.Parse()
 
 	if m != "default" {
@@ -49,13 +57,20 @@ func main() {
 
 	fmt.Println("Params:", mode, inputFileName, outputFileName)
 
-	var libNamesC *C.char = C.CString("libopus.so.0")
+	var libNamesC *C.char = C.CString(libNames)
 	defer C.free(unsafe.Pointer(libNamesC))
-	code := C.OpusCodecInit(libNamesC)
+	code := C.OpusCodecInitDispatch(libNamesC, C.bool(calibrate))
 	if code != 0 {
 		fmt.Printf("opusCodecInit failed, code=%d\n", int(code))
 		return
 	}
+	fmt.Println("Backend:", C.GoString(C.OpusCodecBackend()))
+
+	if mode == "bench" {
+		runBenchmarks()
+		C.OpusCodecFini()
+		return
+	}
 
 	oi := &opusInst{}
 	cIntSampleRate := C.int(24000)
@@ -64,6 +79,14 @@ func main() {
 		fmt.Println("Start error ", retC)
 		return
 	}
+	if mode == "encode" {
+		formats := map[string]C.int{"s16": C.OPUS_CODEC_FORMAT_S16, "f32": C.OPUS_CODEC_FORMAT_F32, "s24": C.OPUS_CODEC_FORMAT_S24, "s32": C.OPUS_CODEC_FORMAT_S32}
+		format, ok := formats[inputFormat]
+		if !ok || C.OpusCodecSetInputFormat(oi.inst, format, C.int(inputChannels)) != C.OPUS_CODEC_OK {
+			fmt.Println("Invalid input format", inputFormat, inputChannels)
+			return
+		}
+	}
 
 	inputFile, err := os.Open(inputFileName)
 	if err != nil {
@@ -1,4 +1,6 @@
 #include "opus_codec.h"
+#include <chrono>
+#include <cmath>
 /**** dlHandler ****/
 dlHandler *dlHandler::dlInst = new dlHandler();
 
@@ -6,48 +8,313 @@ dlHandler *dlHandler::GetInstance()
 {
     return dlInst;
 }
-int dlHandler::Open(const char *libName)
+
+namespace
 {
-    void *handle = dlopen(libName, RTLD_NOW);
-    if (handle == NULL)
+    struct CpuLevelAlias
     {
-        std::cerr << dlerror() << std::endl;
-        return -1;
+        const char *name;
+        CpuLevel level;
+    };
+
+    const CpuLevelAlias cpuLevelAliases[] = {
+        {"generic", CPU_LEVEL_GENERIC},
+        {"x86-64", CPU_LEVEL_GENERIC},
+        {"sse4.1", CPU_LEVEL_SSE41},
+        {"x86-64-v2", CPU_LEVEL_SSE41},
+        {"avx2", CPU_LEVEL_AVX2},
+        {"x86-64-v3", CPU_LEVEL_AVX2},
+        {"avx512", CPU_LEVEL_AVX512},
+        {"x86-64-v4", CPU_LEVEL_AVX512},
+    };
+
+    struct LibCandidate
+    {
+        std::string path;
+        CpuLevel level;
+    };
+
+    // "级别:路径" 拆成候选，前缀不是已知级别时整项都是路径
+    std::vector<LibCandidate> parseCandidates(const char *libNames)
+    {
+        std::vector<LibCandidate> candidates;
+        std::string names(libNames ? libNames : "");
+        size_t begin = 0;
+        while (begin <= names.size())
+        {
+            size_t end = names.find(',', begin);
+            if (end == std::string::npos)
+                end = names.size();
+            std::string item = names.substr(begin, end - begin);
+            begin = end + 1;
+            item.erase(0, item.find_first_not_of(" \t"));
+            item.erase(item.find_last_not_of(" \t") + 1);
+            if (item.empty())
+                continue;
+
+            LibCandidate candidate = {item, CPU_LEVEL_GENERIC};
+            size_t colon = item.find(':');
+            if (colon != std::string::npos)
+            {
+                for (const CpuLevelAlias &alias : cpuLevelAliases)
+                {
+                    if (item.compare(0, colon, alias.name) == 0 && std::strlen(alias.name) == colon)
+                    {
+                        candidate = {item.substr(colon + 1), alias.level};
+                        break;
+                    }
+                }
+            }
+            candidates.push_back(candidate);
+        }
+        return candidates;
+    }
+
+    template <typename T>
+    bool resolve(void *handle, const char *name, T &func)
+    {
+        func = reinterpret_cast<T>(dlsym(handle, name));
+        if (!func)
+        {
+            std::cerr << "Failed to load symbol '" << name << "': " << dlerror() << std::endl;
+        }
+        return func != nullptr;
     }
-    libHandle = handle;
 
-    // 清除任何存在的错误
-    dlerror();
+    // 加载一个候选库并解析全部符号，缺少任何一个都视为不可用
+    void *loadLibrary(const std::string &path, OpusApi &api)
+    {
+        void *handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (handle == NULL)
+        {
+            std::cerr << dlerror() << std::endl;
+            return nullptr;
+        }
+        // 清除任何存在的错误
+        dlerror();
+
+        bool ok = resolve(handle, "opus_strerror", api.opus_strerror) &&
+                  resolve(handle, "opus_get_version_string", api.opus_get_version_string) &&
+                  resolve(handle, "opus_encoder_get_size", api.opus_encoder_get_size) &&
+                  resolve(handle, "opus_encoder_create", api.opus_encoder_create) &&
+                  resolve(handle, "opus_encoder_init", api.opus_encoder_init) &&
+                  resolve(handle, "opus_encoder_ctl", api.opus_encoder_ctl) &&
+                  resolve(handle, "opus_encode", api.opus_encode) &&
+                  resolve(handle, "opus_encode_float", api.opus_encode_float) &&
+                  resolve(handle, "opus_encoder_destroy", api.opus_encoder_destroy) &&
+                  resolve(handle, "opus_decoder_get_size", api.opus_decoder_get_size) &&
+                  resolve(handle, "opus_decoder_create", api.opus_decoder_create) &&
+                  resolve(handle, "opus_decoder_init", api.opus_decoder_init) &&
+                  resolve(handle, "opus_decoder_ctl", api.opus_decoder_ctl) &&
+                  resolve(handle, "opus_decode", api.opus_decode) &&
+                  resolve(handle, "opus_decode_float", api.opus_decode_float) &&
+                  resolve(handle, "opus_decoder_destroy", api.opus_decoder_destroy) &&
+                  resolve(handle, "opus_packet_get_nb_samples", api.opus_packet_get_nb_samples) &&
+                  resolve(handle, "opus_packet_get_nb_frames", api.opus_packet_get_nb_frames) &&
+                  resolve(handle, "opus_packet_get_samples_per_frame", api.opus_packet_get_samples_per_frame) &&
+                  resolve(handle, "opus_multistream_encoder_create", api.opus_multistream_encoder_create) &&
+                  resolve(handle, "opus_multistream_surround_encoder_create", api.opus_multistream_surround_encoder_create) &&
+                  resolve(handle, "opus_multistream_encoder_ctl", api.opus_multistream_encoder_ctl) &&
+                  resolve(handle, "opus_multistream_encode", api.opus_multistream_encode) &&
+                  resolve(handle, "opus_multistream_encode_float", api.opus_multistream_encode_float) &&
+                  resolve(handle, "opus_multistream_encoder_destroy", api.opus_multistream_encoder_destroy) &&
+                  resolve(handle, "opus_multistream_decoder_create", api.opus_multistream_decoder_create) &&
+                  resolve(handle, "opus_multistream_decoder_ctl", api.opus_multistream_decoder_ctl) &&
+                  resolve(handle, "opus_multistream_decode", api.opus_multistream_decode) &&
+                  resolve(handle, "opus_multistream_decode_float", api.opus_multistream_decode_float) &&
+                  resolve(handle, "opus_multistream_decoder_destroy", api.opus_multistream_decoder_destroy) &&
+                  resolve(handle, "opus_repacketizer_create", api.opus_repacketizer_create) &&
+                  resolve(handle, "opus_repacketizer_init", api.opus_repacketizer_init) &&
+                  resolve(handle, "opus_repacketizer_cat", api.opus_repacketizer_cat) &&
+                  resolve(handle, "opus_repacketizer_get_nb_frames", api.opus_repacketizer_get_nb_frames) &&
+                  resolve(handle, "opus_repacketizer_out", api.opus_repacketizer_out) &&
+                  resolve(handle, "opus_repacketizer_out_range", api.opus_repacketizer_out_range) &&
+                  resolve(handle, "opus_repacketizer_destroy", api.opus_repacketizer_destroy);
+        if (!ok)
+        {
+            std::cerr << "Incomplete libopus: " << path << std::endl;
+            dlclose(handle);
+            return nullptr;
+        }
+        return handle;
+    }
+
+    // 用与 Pcm2OpusEncoder 相同的参数编码一秒合成音频，返回三轮中最快一轮的纳秒数，失败返回 -1
+    int64_t calibrateEncode(const OpusApi &api)
+    {
+        const int sampleRate = 24000;
+        const int frameSize = 480;
+        const int frames = 50;
+        std::vector<opus_int16> pcm(frameSize * frames);
+        uint32_t seed = 1;
+        for (size_t i = 0; i < pcm.size(); i++)
+        {
+            seed = seed * 1664525 + 1013904223; // 线性同余噪声叠加两个正弦，各个库的输入完全相同
+            double t = static_cast<double>(i) / sampleRate;
+            pcm[i] = static_cast<opus_int16>(6000 * std::sin(2 * M_PI * 220 * t) + 3000 * std::sin(2 * M_PI * 3100 * t) + (static_cast<int32_t>(seed >> 16) - 32768) / 16);
+        }
+
+        int err;
+        OpusEncoder *enc = api.opus_encoder_create(sampleRate, 1, OPUS_APPLICATION_AUDIO, &err);
+        if (!enc)
+        {
+            return -1;
+        }
+        api.opus_encoder_ctl(enc, OPUS_SET_VBR(0));
+        api.opus_encoder_ctl(enc, OPUS_SET_BITRATE(48000));
+        api.opus_encoder_ctl(enc, OPUS_SET_COMPLEXITY(8));
+        api.opus_encoder_ctl(enc, OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
+        api.opus_encoder_ctl(enc, OPUS_SET_LSB_DEPTH(16));
+
+        unsigned char packet[MAX_PACKET_SIZE];
+        int64_t best = -1;
+        for (int round = 0; round < 3; round++)
+        {
+            api.opus_encoder_ctl(enc, OPUS_RESET_STATE);
+            auto start = std::chrono::steady_clock::now();
+            for (int f = 0; f < frames; f++)
+            {
+                if (api.opus_encode(enc, pcm.data() + f * frameSize, frameSize, packet, MAX_PACKET_SIZE) < 0)
+                {
+                    api.opus_encoder_destroy(enc);
+                    return -1;
+                }
+            }
+            int64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+            best = best < 0 ? elapsed : std::min(best, elapsed);
+        }
+        api.opus_encoder_destroy(enc);
+        return best;
+    }
+}
+
+CpuLevel DetectCpuLevel()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    // __builtin_cpu_supports 同时检查了操作系统是否保存 AVX/AVX-512 寄存器
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl") &&
+        __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("bmi2"))
+        return CPU_LEVEL_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("bmi2"))
+        return CPU_LEVEL_AVX2;
+    if (__builtin_cpu_supports("sse4.1") && __builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+        return CPU_LEVEL_SSE41;
+#endif
+    return CPU_LEVEL_GENERIC;
+}
+
+const char *CpuLevelName(CpuLevel level)
+{
+    switch (level)
+    {
+    case CPU_LEVEL_SSE41:
+        return "sse4.1";
+    case CPU_LEVEL_AVX2:
+        return "avx2";
+    case CPU_LEVEL_AVX512:
+        return "avx512";
+    default:
+        return "generic";
+    }
+}
 
-    // 获取所需符号
-    opus_encoder_create = (opus_encoder_create_func)dlsym(handle, "opus_encoder_create");
-    opus_encoder_destroy = (opus_encoder_destroy_func)dlsym(handle, "opus_encoder_destroy");
-    opus_encoder_ctl = (opus_encoder_ctl_func)dlsym(handle, "opus_encoder_ctl");
-    opus_encode = (opus_encode_func)dlsym(handle, "opus_encode");
-    opus_strerror = (opus_strerror_func)dlsym(handle, "opus_strerror");
+int dlHandler::Open(const char *libNames, bool calibrate)
+{
+    CpuLevel cpuLevel = DetectCpuLevel();
+    std::vector<LibCandidate> candidates = parseCandidates(libNames);
+    // 去掉本机不支持的构建，级别高的排在前面，同级别保持给出的顺序
+    candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
+                                    [cpuLevel](const LibCandidate &c)
+                                    { return c.level > cpuLevel; }),
+                     candidates.end());
+    std::stable_sort(candidates.begin(), candidates.end(),
+                     [](const LibCandidate &a, const LibCandidate &b)
+                     { return a.level > b.level; });
 
-    // 检查是否成功获取符号
-    const char *dlsym_error = dlerror();
-    if (dlsym_error)
+    void *handle = nullptr;
+    OpusApi api;
+    const LibCandidate *chosen = nullptr;
+    int64_t chosenNs = -1;
+    for (const LibCandidate &candidate : candidates)
+    {
+        OpusApi candidateApi;
+        void *candidateHandle = loadLibrary(candidate.path, candidateApi);
+        if (!candidateHandle)
+        {
+            continue;
+        }
+        if (!calibrate)
+        {
+            handle = candidateHandle;
+            api = candidateApi;
+            chosen = &candidate;
+            break;
+        }
+        int64_t ns = calibrateEncode(candidateApi);
+        if (ns >= 0 && (chosenNs < 0 || ns < chosenNs))
+        {
+            if (handle)
+                dlclose(handle);
+            handle = candidateHandle;
+            api = candidateApi;
+            chosen = &candidate;
+            chosenNs = ns;
+        }
+        else
+        {
+            dlclose(candidateHandle);
+        }
+    }
+    if (!handle)
     {
-        std::cerr << "Failed to load symbol 'add': " << dlsym_error << std::endl;
-        dlclose(handle);
+        std::cerr << "No usable libopus in '" << (libNames ? libNames : "") << "' for cpu level " << CpuLevelName(cpuLevel) << std::endl;
         return -1;
     }
+
+    Close();
+    libHandle = handle;
+    static_cast<OpusApi &>(*this) = api;
+    backend = std::string(CpuLevelName(chosen->level)) + " " + chosen->path + " (" + api.opus_get_version_string() +
+              ", cpu " + CpuLevelName(cpuLevel);
+    if (chosenNs >= 0)
+    {
+        backend += ", calibrate " + std::to_string(chosenNs / 1000) + " us/s";
+    }
+    backend += ")";
     return 0;
 }
 
 /**** OpusCodec ****/
 
+int OpusCodec::Encode(const char *input, size_t inputLength, OutputSpan &output, bool last)
+{
+    return encoder->Encode(input, inputLength, output, last);
+}
+
+int OpusCodec::Encode(const char *input, size_t inputLength, std::vector<char> &output, bool last)
+{
+    return encoder->Encode(input, inputLength, output, last);
+}
+
 int OpusCodec::Encode(const std::vector<char> &input, std::vector<char> &output, bool last)
 {
     return encoder->Encode(input, output, last);
 }
 
-// not implemented
+int OpusCodec::Decode(const char *input, size_t inputLength, OutputSpan &output, bool last)
+{
+    return decoder->Decode(input, inputLength, output, last);
+}
+
+int OpusCodec::Decode(const char *input, size_t inputLength, std::vector<char> &output, bool last)
+{
+    return decoder->Decode(input, inputLength, output, last);
+}
+
 int OpusCodec::Decode(const std::vector<char> &input, std::vector<char> &output, bool last)
 {
-    return -1;
+    return decoder->Decode(input.data(), input.size(), output, last);
 }
 
 /**** Pcm2OpusEncoder ****/
@@ -69,6 +336,12 @@ bool Pcm2OpusEncoder::initializeEncoder()
     dl->opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(8));
     dl->opus_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
     dl->opus_encoder_ctl(encoder, OPUS_SET_LSB_DEPTH(16));
+
+    // 按码率估算单包大小上限，CBR下每包大小固定，留一倍余量给VBR，输出缓冲区据此预留
+    opus_int32 bitrate = 0;
+    dl->opus_encoder_ctl(encoder, OPUS_GET_BITRATE(&bitrate));
+    size_t nominalBytes = static_cast<int64_t>(bitrate) * frameSize / sampleRate / 8;
+    maxPacketBytes = std::min<size_t>(MAX_PACKET_SIZE, std::max<size_t>(nominalBytes * 2, 256));
     return true;
 }
 
@@ -77,77 +350,138 @@ bool Pcm2OpusEncoder::Start()
     return initializeEncoder();
 }
 
-int Pcm2OpusEncoder::Encode(const std::vector<char> &input, std::vector<char> &output, bool last)
+bool Pcm2OpusEncoder::SetInputFormat(SampleFormat format, int inputChannels)
 {
-    int inputLength = input.size();
-    std::vector<unsigned char> pcmBuffer(bytesReadPerFrame * 2); // pcm音频数据缓冲区，适当大小
-    std::vector<unsigned char> opusData(MAX_PACKET_SIZE);        // opus 数据缓冲区
+    if (!encoder || !sampleFormatValid(format) || !(inputChannels == channels || (inputChannels == 2 && channels == 1)))
+    {
+        std::cerr << "Invalid input format " << format << " with " << inputChannels << " channels" << std::endl;
+        return false;
+    }
+    if (cachedBytes != 0)
+    {
+        std::cerr << "Cannot change input format with cached input" << std::endl;
+        return false;
+    }
+    this->inputFormat = format;
+    this->inputChannels = inputChannels;
+    bytesReadPerFrame = frameSize * inputChannels * sampleFormatBytes(format);
+    // 格式确定后一次分配好，编码过程中不再分配内存
+    frameBuffer.resize(bytesReadPerFrame);
+    pcmBuffer.resize(format == SAMPLE_FORMAT_S16 && inputChannels != channels ? frameSize * channels : 0);
+    floatBuffer.resize(format != SAMPLE_FORMAT_S16 ? frameSize * inputChannels : 0);
+    // 高于16位的输入让编码器按24位精度分配比特
+    return dl->opus_encoder_ctl(encoder, OPUS_SET_LSB_DEPTH(format == SAMPLE_FORMAT_S16 ? 16 : 24)) == OPUS_OK;
+}
 
-    for (int index = 0; (inputLength == 0 && last) || index < inputLength;)
+bool Pcm2OpusEncoder::directInput(const char *frame) const
+{
+    // 与编码器格式相同且对齐时直接把调用方内存交给opus，否则转换时会读取输入，不要求对齐
+    if (inputChannels != channels)
     {
-        size_t bytesRead;
-        if (index == 0)
+        return true;
+    }
+    if (inputFormat == SAMPLE_FORMAT_S16)
+    {
+        return reinterpret_cast<uintptr_t>(frame) % alignof(opus_int16) == 0;
+    }
+    if (inputFormat == SAMPLE_FORMAT_F32)
+    {
+        return reinterpret_cast<uintptr_t>(frame) % alignof(float) == 0;
+    }
+    return true;
+}
+
+const void *Pcm2OpusEncoder::convertFrame(const unsigned char *frame)
+{
+    if (inputFormat == SAMPLE_FORMAT_S16)
+    {
+        if (inputChannels == channels)
         {
-            size_t cachedBytes = internalBuffer.size();
-            // 算上缓存，长度满足一帧
-            if (inputLength + cachedBytes >= bytesReadPerFrame)
-            {
-                std::memcpy(pcmBuffer.data(), internalBuffer.data(), cachedBytes);
-                internalBuffer.clear();
-                bytesRead = bytesReadPerFrame - cachedBytes;
-                std::memcpy(pcmBuffer.data() + cachedBytes, input.data(), bytesRead);
-                index += bytesRead;
-            }
-            else // 算上缓存，长度不满足一帧
-            {
-                if (last)
-                { // 最后一帧了，不缓存了，梭哈
-                    std::memcpy(pcmBuffer.data(), internalBuffer.data(), cachedBytes);
-                    internalBuffer.clear();
-                    bytesRead = inputLength;
-                    std::memcpy(pcmBuffer.data() + cachedBytes, input.data(), bytesRead);
-                    index += bytesRead;
-                    // 填充0
-                    std::fill(pcmBuffer.begin() + bytesRead + cachedBytes, pcmBuffer.end(), 0);
-                }
-                else
-                { // 还没结束，继续缓存，等待满足1帧
-                    printf("continue cached %d\n", inputLength);
-                    internalBuffer.insert(internalBuffer.end(), input.begin(), input.end());
-                    break;
-                }
-            }
+            return frame;
+        }
+        downmixS16(frame, pcmBuffer.data(), frameSize);
+        return pcmBuffer.data();
+    }
+    if (inputFormat == SAMPLE_FORMAT_F32 && inputChannels == channels)
+    {
+        return frame;
+    }
+    const float *pcm = reinterpret_cast<const float *>(frame);
+    if (inputFormat != SAMPLE_FORMAT_F32)
+    {
+        convertToFloat(inputFormat, frame, floatBuffer.data(), frameSize * inputChannels);
+        pcm = floatBuffer.data();
+    }
+    if (inputChannels != channels)
+    {
+        downmixFloat(pcm, floatBuffer.data(), frameSize);
+    }
+    return floatBuffer.data();
+}
+
+size_t Pcm2OpusEncoder::EncodeBound(size_t inputLength, bool last) const
+{
+    // 本次最多编码的帧数，last时末尾不足一帧也会补0编码一帧
+    size_t frames = (cachedBytes + inputLength) / bytesReadPerFrame + (last ? 1 : 0);
+    return frames * (FRAME_HEADER_SIZE + maxPacketBytes);
+}
+
+int Pcm2OpusEncoder::Encode(const char *input, size_t inputLength, std::vector<char> &output, bool last)
+{
+    // output的容量会被保留，调用方复用同一个vector时稳定后不再分配内存
+    size_t offset = output.size();
+    output.resize(offset + EncodeBound(inputLength, last));
+    OutputSpan span(output.data() + offset, output.size() - offset);
+    int ret = Encode(input, inputLength, span, last);
+    output.resize(offset + span.size);
+    return ret;
+}
+
+int Pcm2OpusEncoder::Encode(const char *input, size_t inputLength, OutputSpan &output, bool last)
+{
+    size_t index = 0;
+    bool flushCached = last && inputLength == 0; // 最后一次调用没有新数据时，把缓存(可能为空)补0编码成最后一帧
+    while (index < inputLength || flushCached)
+    {
+        flushCached = false;
+        const unsigned char *frame;
+        if (cachedBytes == 0 && inputLength - index >= bytesReadPerFrame && directInput(input + index))
+        {
+            // 没有缓存且剩余长度满足一帧，直接从调用方内存编码或转换
+            frame = reinterpret_cast<const unsigned char *>(input + index);
+            index += bytesReadPerFrame;
         }
         else
         {
-            // 剩余长度满足一帧
-            if (inputLength - index >= bytesReadPerFrame)
-            {
-                bytesRead = bytesReadPerFrame;
-                std::memcpy(pcmBuffer.data(), input.data() + index, bytesRead);
-                index += bytesRead;
-            }
-            else
+            // 先凑满frameBuffer
+            size_t bytesRead = std::min(bytesReadPerFrame - cachedBytes, inputLength - index);
+            std::memcpy(frameBuffer.data() + cachedBytes, input + index, bytesRead);
+            cachedBytes += bytesRead;
+            index += bytesRead;
+            if (cachedBytes < bytesReadPerFrame)
             {
-                if (last) // 最后一帧了，梭哈
-                {
-                    bytesRead = inputLength - index;
-                    std::memcpy(pcmBuffer.data(), input.data() + index, bytesRead);
-                    index += bytesRead;
-                    // 填充0
-                    std::fill(pcmBuffer.begin() + bytesRead, pcmBuffer.end(), 0);
-                }
-                else // 不够1帧，缓存起来
-                {
-                    printf("cached %d\n", inputLength - index);
-                    internalBuffer.insert(internalBuffer.end(), input.begin() + index, input.end());
+                if (!last)
+                { // 不够1帧，留在frameBuffer里等待下次输入
                     break;
                 }
+                // 最后一帧了，填充0
+                std::fill(frameBuffer.begin() + cachedBytes, frameBuffer.end(), 0);
             }
+            cachedBytes = 0;
+            frame = frameBuffer.data();
+        }
+
+        // 编码，S16以外的格式转换成float编码
+        const void *pcm = convertFrame(frame);
+        int encodedBytes;
+        if (inputFormat == SAMPLE_FORMAT_S16)
+        {
+            encodedBytes = dl->opus_encode(encoder, static_cast<const opus_int16 *>(pcm), frameSize, opusData.data(), maxPacketBytes);
+        }
+        else
+        {
+            encodedBytes = dl->opus_encode_float(encoder, static_cast<const float *>(pcm), frameSize, opusData.data(), maxPacketBytes);
         }
-        // 编码
-        printf("[fn:Pcm2OpusEncoder.Encode] pcmBuffer:%p[len=%d],frameSize:%d,opusData:%p\n", pcmBuffer.data(), pcmBuffer.size(), frameSize, opusData.data());
-        int encodedBytes = dl->opus_encode(encoder, reinterpret_cast<const opus_int16 *>(pcmBuffer.data()), frameSize, opusData.data(), MAX_PACKET_SIZE);
         if (encodedBytes < 0)
         {
             std::cerr << "Encoding failed: " << dl->opus_strerror(encodedBytes) << std::endl;
@@ -159,15 +493,161 @@ int Pcm2OpusEncoder::Encode(const std::vector<char> &input, std::vector<char> &o
         uint8_t bytesLen[2];
         bytesLen[0] = (truncatedNum >> 8) & 0xFF; // 高字节
         bytesLen[1] = truncatedNum & 0xFF;        // 低字节
-        char *srcBytsLen = reinterpret_cast<char *>(bytesLen);
-        output.insert(output.end(), srcBytsLen, srcBytsLen + 2);
-        char *srcOpusData = reinterpret_cast<char *>(opusData.data());
-        output.insert(output.end(), srcOpusData, srcOpusData + encodedBytes);
+        if (!output.append(bytesLen, FRAME_HEADER_SIZE) || !output.append(opusData.data(), encodedBytes))
+        {
+            std::cerr << "Output buffer too small" << std::endl;
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**** Opus2PcmDecoder ****/
+
+bool Opus2PcmDecoder::initializeDecoder()
+{
+    int err;
+    OpusDecoder *dec = dl->opus_decoder_create(sampleRate, channels, &err);
+    if (!dec)
+    {
+        std::cerr << "Failed to create Opus decoder: " << dl->opus_strerror(err) << std::endl;
+        return false;
+    }
+    decoder = dec;
+    return true;
+}
+
+bool Opus2PcmDecoder::Start()
+{
+    return initializeDecoder();
+}
+
+int Opus2PcmDecoder::packetSamples(const char *input, size_t index, size_t cached, size_t length) const
+{
+    // 采样数只由TOC和code 3的帧数字节决定，前两个字节可能一部分在缓存里一部分在输入里
+    unsigned char toc[2] = {0, 0};
+    for (size_t i = 0; i < 2 && i < length; i++)
+    {
+        toc[i] = i < cached ? packetBuffer[i] : static_cast<unsigned char>(input[index + i - cached]);
+    }
+    return dl->opus_packet_get_nb_samples(toc, length, sampleRate);
+}
 
-        if (inputLength == 0 && last)
-        { // 防止无限循环
+size_t Opus2PcmDecoder::DecodeBound(const char *input, size_t inputLength) const
+{
+    // 按长度头逐包扫描，不解码，与Decode按相同的规则拼包
+    size_t bound = 0;
+    size_t index = 0;
+    unsigned char header[FRAME_HEADER_SIZE] = {lengthHeader[0], lengthHeader[1]};
+    size_t have = headerBytes;
+    size_t cached = cachedBytes;
+    while (true)
+    {
+        while (have < FRAME_HEADER_SIZE && index < inputLength)
+        {
+            header[have++] = input[index++];
+        }
+        size_t length = packetLength(header);
+        if (have < FRAME_HEADER_SIZE || length == 0 || length > MAX_PACKET_SIZE || cached + (inputLength - index) < length)
+        {
             break;
         }
+        int samples = packetSamples(input, index, cached, length);
+        if (samples > 0)
+        {
+            bound += samples * channels * sizeof(opus_int16);
+        }
+        index += length - cached;
+        have = 0;
+        cached = 0;
+    }
+    return bound;
+}
+
+int Opus2PcmDecoder::Decode(const char *input, size_t inputLength, std::vector<char> &output, bool last)
+{
+    // output的容量会被保留，调用方复用同一个vector时稳定后不再分配内存
+    size_t offset = output.size();
+    output.resize(offset + DecodeBound(input, inputLength));
+    OutputSpan span(output.data() + offset, output.size() - offset);
+    int ret = Decode(input, inputLength, span, last);
+    output.resize(offset + span.size);
+    return ret;
+}
+
+int Opus2PcmDecoder::Decode(const char *input, size_t inputLength, OutputSpan &output, bool last)
+{
+    size_t index = 0;
+    while (true)
+    {
+        // 先凑齐长度头
+        while (headerBytes < FRAME_HEADER_SIZE && index < inputLength)
+        {
+            lengthHeader[headerBytes++] = input[index++];
+        }
+        if (headerBytes < FRAME_HEADER_SIZE)
+        {
+            break;
+        }
+        size_t length = packetLength(lengthHeader);
+        if (length == 0 || length > MAX_PACKET_SIZE)
+        {
+            std::cerr << "Invalid packet length " << length << std::endl;
+            headerBytes = 0;
+            cachedBytes = 0;
+            return -1;
+        }
+
+        const unsigned char *packet;
+        if (cachedBytes == 0 && inputLength - index >= length)
+        {
+            // 包完整地在本次输入里，直接从调用方内存解码
+            packet = reinterpret_cast<const unsigned char *>(input + index);
+            index += length;
+        }
+        else
+        {
+            // 跨调用的包先凑满packetBuffer
+            size_t bytesRead = std::min(length - cachedBytes, inputLength - index);
+            std::memcpy(packetBuffer.data() + cachedBytes, input + index, bytesRead);
+            cachedBytes += bytesRead;
+            index += bytesRead;
+            if (cachedBytes < length)
+            {
+                break; // 不够1个包，留在packetBuffer里等待下次输入
+            }
+            packet = packetBuffer.data();
+        }
+        headerBytes = 0;
+        cachedBytes = 0;
+
+        int samples = dl->opus_packet_get_nb_samples(packet, length, sampleRate);
+        if (samples < 0)
+        {
+            std::cerr << "Invalid packet: " << dl->opus_strerror(samples) << std::endl;
+            continue;
+        }
+        if (samples * channels * sizeof(opus_int16) > output.remaining())
+        {
+            std::cerr << "Output buffer too small" << std::endl;
+            return -1;
+        }
+
+        // 解码，PCM直接写入输出缓冲区
+        int samplesDecoded = dl->opus_decode(decoder, packet, length, reinterpret_cast<opus_int16 *>(output.data + output.size), samples, 0);
+        if (samplesDecoded < 0)
+        {
+            std::cerr << "Decoding error: " << dl->opus_strerror(samplesDecoded) << std::endl;
+            continue;
+        }
+        output.size += samplesDecoded * channels * sizeof(opus_int16);
+    }
+
+    if (last && (headerBytes > 0 || cachedBytes > 0))
+    {
+        std::cerr << "Truncated packet at end of stream, " << headerBytes + cachedBytes << " bytes dropped" << std::endl;
+        headerBytes = 0;
+        cachedBytes = 0;
     }
     return 0;
-}
\ No newline at end of file
+}
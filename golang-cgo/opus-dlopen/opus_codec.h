@@ -5,40 +5,163 @@
 #include <vector>
 #include <memory>
 #include <cstring>
+#include <cstdint>
+#include <string>
+#include <algorithm>
 #include <dlfcn.h>
 #include <opus.h>
+#include <opus_multistream.h>
+#include "sample_format.h"
 
-typedef OpusEncoder *(*opus_encoder_create_func)(opus_int32 Fs, int channels, int application, int *error);
 typedef const char *(*opus_strerror_func)(int error);
+typedef const char *(*opus_get_version_string_func)();
+typedef int (*opus_encoder_get_size_func)(int channels);
+typedef OpusEncoder *(*opus_encoder_create_func)(opus_int32 Fs, int channels, int application, int *error);
+typedef int (*opus_encoder_init_func)(OpusEncoder *st, opus_int32 Fs, int channels, int application);
 typedef int (*opus_encoder_ctl_func)(OpusEncoder *st, int request, ...);
 typedef int (*opus_encode_func)(OpusEncoder *st, const opus_int16 *pcm, int frame_size, unsigned char *data, opus_int32 max_data_bytes);
+typedef opus_int32 (*opus_encode_float_func)(OpusEncoder *st, const float *pcm, int frame_size, unsigned char *data, opus_int32 max_data_bytes);
 typedef void (*opus_encoder_destroy_func)(OpusEncoder *st);
+typedef int (*opus_decoder_get_size_func)(int channels);
+typedef OpusDecoder *(*opus_decoder_create_func)(opus_int32 Fs, int channels, int *error);
+typedef int (*opus_decoder_init_func)(OpusDecoder *st, opus_int32 Fs, int channels);
+typedef int (*opus_decoder_ctl_func)(OpusDecoder *st, int request, ...);
+typedef int (*opus_decode_func)(OpusDecoder *st, const unsigned char *data, opus_int32 len, opus_int16 *pcm, int frame_size, int decode_fec);
+typedef int (*opus_decode_float_func)(OpusDecoder *st, const unsigned char *data, opus_int32 len, float *pcm, int frame_size, int decode_fec);
+typedef void (*opus_decoder_destroy_func)(OpusDecoder *st);
+typedef int (*opus_packet_get_nb_samples_func)(const unsigned char packet[], opus_int32 len, opus_int32 Fs);
+typedef int (*opus_packet_get_nb_frames_func)(const unsigned char packet[], opus_int32 len);
+typedef int (*opus_packet_get_samples_per_frame_func)(const unsigned char *data, opus_int32 Fs);
+typedef OpusMSEncoder *(*opus_multistream_encoder_create_func)(opus_int32 Fs, int channels, int streams, int coupled_streams, const unsigned char *mapping, int application, int *error);
+typedef OpusMSEncoder *(*opus_multistream_surround_encoder_create_func)(opus_int32 Fs, int channels, int mapping_family, int *streams, int *coupled_streams, unsigned char *mapping, int application, int *error);
+typedef int (*opus_multistream_encoder_ctl_func)(OpusMSEncoder *st, int request, ...);
+typedef int (*opus_multistream_encode_func)(OpusMSEncoder *st, const opus_int16 *pcm, int frame_size, unsigned char *data, opus_int32 max_data_bytes);
+typedef int (*opus_multistream_encode_float_func)(OpusMSEncoder *st, const float *pcm, int frame_size, unsigned char *data, opus_int32 max_data_bytes);
+typedef void (*opus_multistream_encoder_destroy_func)(OpusMSEncoder *st);
+typedef OpusMSDecoder *(*opus_multistream_decoder_create_func)(opus_int32 Fs, int channels, int streams, int coupled_streams, const unsigned char *mapping, int *error);
+typedef int (*opus_multistream_decoder_ctl_func)(OpusMSDecoder *st, int request, ...);
+typedef int (*opus_multistream_decode_func)(OpusMSDecoder *st, const unsigned char *data, opus_int32 len, opus_int16 *pcm, int frame_size, int decode_fec);
+typedef int (*opus_multistream_decode_float_func)(OpusMSDecoder *st, const unsigned char *data, opus_int32 len, float *pcm, int frame_size, int decode_fec);
+typedef void (*opus_multistream_decoder_destroy_func)(OpusMSDecoder *st);
+typedef OpusRepacketizer *(*opus_repacketizer_create_func)();
+typedef OpusRepacketizer *(*opus_repacketizer_init_func)(OpusRepacketizer *rp);
+typedef int (*opus_repacketizer_cat_func)(OpusRepacketizer *rp, const unsigned char *data, opus_int32 len);
+typedef int (*opus_repacketizer_get_nb_frames_func)(OpusRepacketizer *rp);
+typedef opus_int32 (*opus_repacketizer_out_func)(OpusRepacketizer *rp, unsigned char *data, opus_int32 maxlen);
+typedef opus_int32 (*opus_repacketizer_out_range_func)(OpusRepacketizer *rp, int begin, int end, unsigned char *data, opus_int32 maxlen);
+typedef void (*opus_repacketizer_destroy_func)(OpusRepacketizer *rp);
 
 const int MAX_PACKET_SIZE = 3828; // opus 最大数据包 1276
+const int FRAME_HEADER_SIZE = 2;  // 每帧前2字节大端序长度
+
+// 调用方持有的输出缓冲区，编码结果直接写入，不经过中间vector
+struct OutputSpan
+{
+    char *data;
+    size_t capacity;
+    size_t size;
+
+    OutputSpan(char *data, size_t capacity) : data(data), capacity(capacity), size(0) {}
+
+    size_t remaining() const
+    {
+        return capacity - size;
+    }
+
+    bool append(const void *src, size_t len)
+    {
+        if (len > remaining())
+        {
+            return false;
+        }
+        std::memcpy(data + size, src, len);
+        size += len;
+        return true;
+    }
+};
+
+// 从一个 libopus 解析出的全部符号：编解码、多流和重新打包
+struct OpusApi
+{
+    opus_strerror_func opus_strerror;
+    opus_get_version_string_func opus_get_version_string;
+    opus_encoder_get_size_func opus_encoder_get_size;
+    opus_encoder_create_func opus_encoder_create;
+    opus_encoder_init_func opus_encoder_init;
+    opus_encoder_ctl_func opus_encoder_ctl;
+    opus_encode_func opus_encode;
+    opus_encode_float_func opus_encode_float;
+    opus_encoder_destroy_func opus_encoder_destroy;
+    opus_decoder_get_size_func opus_decoder_get_size;
+    opus_decoder_create_func opus_decoder_create;
+    opus_decoder_init_func opus_decoder_init;
+    opus_decoder_ctl_func opus_decoder_ctl;
+    opus_decode_func opus_decode;
+    opus_decode_float_func opus_decode_float;
+    opus_decoder_destroy_func opus_decoder_destroy;
+    opus_packet_get_nb_samples_func opus_packet_get_nb_samples;
+    opus_packet_get_nb_frames_func opus_packet_get_nb_frames;
+    opus_packet_get_samples_per_frame_func opus_packet_get_samples_per_frame;
+    opus_multistream_encoder_create_func opus_multistream_encoder_create;
+    opus_multistream_surround_encoder_create_func opus_multistream_surround_encoder_create;
+    opus_multistream_encoder_ctl_func opus_multistream_encoder_ctl;
+    opus_multistream_encode_func opus_multistream_encode;
+    opus_multistream_encode_float_func opus_multistream_encode_float;
+    opus_multistream_encoder_destroy_func opus_multistream_encoder_destroy;
+    opus_multistream_decoder_create_func opus_multistream_decoder_create;
+    opus_multistream_decoder_ctl_func opus_multistream_decoder_ctl;
+    opus_multistream_decode_func opus_multistream_decode;
+    opus_multistream_decode_float_func opus_multistream_decode_float;
+    opus_multistream_decoder_destroy_func opus_multistream_decoder_destroy;
+    opus_repacketizer_create_func opus_repacketizer_create;
+    opus_repacketizer_init_func opus_repacketizer_init;
+    opus_repacketizer_cat_func opus_repacketizer_cat;
+    opus_repacketizer_get_nb_frames_func opus_repacketizer_get_nb_frames;
+    opus_repacketizer_out_func opus_repacketizer_out;
+    opus_repacketizer_out_range_func opus_repacketizer_out_range;
+    opus_repacketizer_destroy_func opus_repacketizer_destroy;
+};
+
+// 候选库需要的 CPU 指令集级别，对应 -march=x86-64、x86-64-v2、x86-64-v3、x86-64-v4 的构建
+enum CpuLevel
+{
+    CPU_LEVEL_GENERIC = 0,
+    CPU_LEVEL_SSE41,  // SSE4.1/SSE4.2/POPCNT
+    CPU_LEVEL_AVX2,   // AVX2/FMA/BMI2
+    CPU_LEVEL_AVX512, // AVX-512 F/BW/VL
+};
+
+// 本机 CPU 支持的最高级别，非 x86 上总是 CPU_LEVEL_GENERIC
+CpuLevel DetectCpuLevel();
+const char *CpuLevelName(CpuLevel level);
 
-class dlHandler
+class dlHandler : public OpusApi
 {
 private:
     static dlHandler *dlInst;
-    void *libHandle;
+    void *libHandle = nullptr;
+    std::string backend; // 选用的库的描述
     dlHandler() = default;
     ~dlHandler() = default;
 
 public:
     static dlHandler *GetInstance();
-    int Open(const char *libName);
+    // libNames 是逗号分隔的候选库，每项可以用 "级别:" 前缀标注构建时的指令集，如
+    // "avx512:lib/v4/libopus.so.0,avx2:lib/v3/libopus.so.0,libopus.so.0"，没有前缀的按 generic 处理；
+    // 只考虑本机 CPU 支持的候选，默认选级别最高且能加载全部符号的一个，
+    // calibrate 时对这些候选各跑一次短编码测试，选最快的
+    int Open(const char *libNames, bool calibrate = false);
     void Close()
     {
-        dlclose(libHandle);
+        if (libHandle)
+            dlclose(libHandle);
         libHandle = nullptr;
+        backend.clear();
+    }
+    const std::string &Backend() const
+    {
+        return backend;
     }
-
-public:
-    opus_encoder_create_func opus_encoder_create;
-    opus_encoder_destroy_func opus_encoder_destroy;
-    opus_encoder_ctl_func opus_encoder_ctl;
-    opus_encode_func opus_encode;
-    opus_strerror_func opus_strerror;
 };
 
 class Pcm2OpusEncoder
@@ -49,19 +172,29 @@ private:
     int channels;
     int sampleRate;
     int frameSize;
-    opus_int16 sampleSize;    // 每个采样点的大小
-    size_t bytesReadPerFrame; // 每帧读取的字节数
-    std::vector<char> internalBuffer;
+    size_t bytesReadPerFrame; // 每帧读取的输入字节数，按输入格式和声道数计算
+    std::vector<unsigned char> frameBuffer;  // 凑帧缓冲区，固定一帧大小，缓存不足一帧的输入
+    size_t cachedBytes = 0;                  // frameBuffer中已缓存的字节数
+    std::vector<unsigned char> opusData;     // opus 数据缓冲区
+    size_t maxPacketBytes = MAX_PACKET_SIZE; // 按码率估算的单包大小上限
+    SampleFormat inputFormat = SAMPLE_FORMAT_S16;
+    int inputChannels;                       // 输入的声道数，与channels不同时下混
+    std::vector<opus_int16> pcmBuffer;       // S16下混后的一帧
+    std::vector<float> floatBuffer;          // 非S16输入转换后的一帧，送opus_encode_float
 
     bool initializeEncoder(); // 初始化编码器
+    bool directInput(const char *frame) const;
+    const void *convertFrame(const unsigned char *frame);
 
 public:
     Pcm2OpusEncoder(int sampleRate = 24000, int channels = 1, int frameSize = 480)
-        : dl(dlHandler::GetInstance()), channels(channels), sampleRate(sampleRate), frameSize(frameSize)
+        : dl(dlHandler::GetInstance()), encoder(nullptr), channels(channels), sampleRate(sampleRate), frameSize(frameSize),
+          inputChannels(channels)
     {
-        sampleSize = channels * sizeof(opus_int16);
-        bytesReadPerFrame = frameSize * sampleSize;
-        internalBuffer.reserve(bytesReadPerFrame * 2); // 适当大小空间
+        bytesReadPerFrame = frameSize * channels * sizeof(opus_int16);
+        // 编码用到的缓冲区在构造时一次分配好，编码过程中不再分配内存
+        frameBuffer.resize(bytesReadPerFrame);
+        opusData.resize(MAX_PACKET_SIZE);
     }
 
     ~Pcm2OpusEncoder()
@@ -73,26 +206,105 @@ public:
     };
 
     bool Start();
-    int Encode(const std::vector<char> &input, std::vector<char> &output, bool last);
+    // Start之后、第一次Encode之前设置输入的采样格式，inputChannels只能等于channels或者为2(下混成单声道)
+    bool SetInputFormat(SampleFormat format, int inputChannels);
+    // 本次输入最坏情况下产生的输出字节数
+    size_t EncodeBound(size_t inputLength, bool last) const;
+    int Encode(const char *input, size_t inputLength, OutputSpan &output, bool last);
+    int Encode(const char *input, size_t inputLength, std::vector<char> &output, bool last);
+    int Encode(const std::vector<char> &input, std::vector<char> &output, bool last)
+    {
+        return Encode(input.data(), input.size(), output, last);
+    }
+};
+
+// 2字节长度头 + opus包 格式的流式解码器，输入可以在任意字节处切分
+class Opus2PcmDecoder
+{
+private:
+    dlHandler *dl;
+    OpusDecoder *decoder;
+    int channels;
+    int sampleRate;
+    unsigned char lengthHeader[FRAME_HEADER_SIZE]; // 跨调用的不完整长度头
+    size_t headerBytes = 0;                        // lengthHeader中已收到的字节数
+    std::vector<unsigned char> packetBuffer;       // 跨调用的不完整包，固定MAX_PACKET_SIZE
+    size_t cachedBytes = 0;                        // packetBuffer中已缓存的字节数
+
+    bool initializeDecoder();
+    size_t packetLength(const unsigned char *header) const
+    {
+        return (header[0] << 8) | header[1];
+    }
+    int packetSamples(const char *input, size_t index, size_t cached, size_t length) const;
+
+public:
+    Opus2PcmDecoder(int sampleRate = 24000, int channels = 1)
+        : dl(dlHandler::GetInstance()), decoder(nullptr), channels(channels), sampleRate(sampleRate)
+    {
+        // 解码用到的缓冲区在构造时一次分配好，解码过程中不再分配内存
+        packetBuffer.resize(MAX_PACKET_SIZE);
+    }
+
+    ~Opus2PcmDecoder()
+    {
+        if (decoder)
+            dl->opus_decoder_destroy(decoder);
+        decoder = nullptr;
+        dl = nullptr;
+    };
+
+    bool Start();
+    // 本次输入中完整的包解码后的总字节数，不完整的包留到下次
+    size_t DecodeBound(const char *input, size_t inputLength) const;
+    // 解码本次输入中所有完整的包，PCM直接写入output；不完整的长度头和包缓存在内部，
+    // last时丢弃末尾不完整的数据
+    int Decode(const char *input, size_t inputLength, OutputSpan &output, bool last);
+    int Decode(const char *input, size_t inputLength, std::vector<char> &output, bool last);
 };
 
 class OpusCodec
 {
 private:
     std::unique_ptr<Pcm2OpusEncoder> encoder;
+    std::unique_ptr<Opus2PcmDecoder> decoder;
+    std::vector<char> scratch; // 旧接口复用的输出缓冲区
 
 public:
     OpusCodec(int sampleRate)
-        : encoder(std::unique_ptr<Pcm2OpusEncoder>(new Pcm2OpusEncoder(sampleRate, 1, 480)))
+        : encoder(std::unique_ptr<Pcm2OpusEncoder>(new Pcm2OpusEncoder(sampleRate, 1, 480))),
+          decoder(std::unique_ptr<Opus2PcmDecoder>(new Opus2PcmDecoder(sampleRate, 1)))
     {
     }
     ~OpusCodec() = default;
 
     bool Start()
     {
-        return encoder->Start();
+        return encoder->Start() && decoder->Start();
+    }
+    bool SetInputFormat(SampleFormat format, int inputChannels)
+    {
+        return encoder->SetInputFormat(format, inputChannels);
+    }
+    size_t EncodeBound(size_t inputLength, bool last) const
+    {
+        return encoder->EncodeBound(inputLength, last);
+    }
+    size_t DecodeBound(const char *input, size_t inputLength) const
+    {
+        return decoder->DecodeBound(input, inputLength);
+    }
+    // 清空并返回实例自带的输出缓冲区，容量在多次调用间保留
+    std::vector<char> &Scratch()
+    {
+        scratch.clear();
+        return scratch;
     }
+    int Encode(const char *input, size_t inputLength, OutputSpan &output, bool last);
+    int Encode(const char *input, size_t inputLength, std::vector<char> &output, bool last);
     int Encode(const std::vector<char> &input, std::vector<char> &output, bool last);
+    int Decode(const char *input, size_t inputLength, OutputSpan &output, bool last);
+    int Decode(const char *input, size_t inputLength, std::vector<char> &output, bool last);
     int Decode(const std::vector<char> &input, std::vector<char> &output, bool last);
 };
 
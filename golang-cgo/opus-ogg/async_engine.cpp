@@ -0,0 +1,262 @@
+#include "async_engine.h"
+#include "opus_ogg.h"
+#include <cerrno>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+AsyncEngine *AsyncEngine::engineInst = new AsyncEngine();
+
+AsyncEngine *AsyncEngine::GetInstance()
+{
+    return engineInst;
+}
+
+int AsyncEngine::Start(int workerCount, int queueDepth, bool pin)
+{
+    if (running.load())
+    {
+        std::cerr << "Async engine already started" << std::endl;
+        return OPUS_OGG_ERR;
+    }
+
+    // 只用进程允许运行的核，容器里可能只分到一部分
+    std::vector<int> cpus;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    if (workerCount <= 0)
+    {
+        workerCount = cpus.empty() ? std::max(1u, std::thread::hardware_concurrency()) : cpus.size();
+    }
+    size_t depth = queueDepth > 0 ? queueDepth : ASYNC_QUEUE_DEPTH;
+
+    eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventFd < 0)
+    {
+        std::cerr << "Failed to create eventfd" << std::endl;
+        return OPUS_OGG_ERR;
+    }
+    completions.reset(new BoundedQueue<OpusOggCodecCompletion>(depth * workerCount));
+    stopping.store(false);
+    for (int i = 0; i < workerCount; i++)
+    {
+        workers.emplace_back(new Worker(depth));
+    }
+    for (int i = 0; i < workerCount; i++)
+    {
+        int cpu = pin && !cpus.empty() ? cpus[i % cpus.size()] : -1;
+        workers[i]->thread = std::thread(&AsyncEngine::workerLoop, this, workers[i].get(), cpu);
+    }
+    running.store(true);
+    return eventFd;
+}
+
+void AsyncEngine::Stop()
+{
+    if (!running.exchange(false))
+    {
+        return;
+    }
+    stopping.store(true);
+    {
+        std::lock_guard<std::mutex> lock(completionMutex);
+    }
+    completionCond.notify_all();
+    for (auto &worker : workers)
+    {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+        }
+        worker->cond.notify_one();
+    }
+    for (auto &worker : workers)
+    {
+        worker->thread.join();
+    }
+    workers.clear();
+    completions.reset();
+    close(eventFd);
+    eventFd = -1;
+}
+
+int AsyncEngine::Submit(const AsyncJob &job)
+{
+    if (!running.load(std::memory_order_acquire) || !job.codec)
+    {
+        return OPUS_OGG_ERR;
+    }
+
+    // 实例第一次提交时分配工作线程，之后一直在同一个线程上执行，保证顺序和缓存局部性
+    int index = job.codec->AsyncWorker();
+    if (index < 0 || index >= static_cast<int>(workers.size()))
+    {
+        index = nextWorker.fetch_add(1, std::memory_order_relaxed) % workers.size();
+        job.codec->SetAsyncWorker(index);
+    }
+    Worker *worker = workers[index].get();
+    if (!worker->queue.Push(job))
+    {
+        return OPUS_OGG_ERR_QUEUE_FULL;
+    }
+    // 与工作线程睡眠前的检查配对：要么它看到新任务，要么这里看到它在睡眠
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (worker->sleeping.load(std::memory_order_relaxed))
+    {
+        {
+            std::lock_guard<std::mutex> lock(worker->mutex);
+        }
+        worker->cond.notify_one();
+    }
+    return OPUS_OGG_OK;
+}
+
+int AsyncEngine::Poll(OpusOggCodecCompletion *output, int max, int timeoutMs)
+{
+    if (!running.load(std::memory_order_acquire) || !output || max <= 0)
+    {
+        return OPUS_OGG_ERR;
+    }
+
+    for (int round = 0; round < 2; round++)
+    {
+        // 先清掉 eventfd 的计数再取，之后完成的任务会重新写 eventfd，不会漏掉通知
+        uint64_t counter;
+        if (read(eventFd, &counter, sizeof(counter)) < 0 && errno != EAGAIN)
+        {
+            return OPUS_OGG_ERR;
+        }
+        int n = 0;
+        while (n < max && completions->Pop(output[n]))
+        {
+            n++;
+        }
+        // 与工作线程等待前的检查配对：要么它看到腾出的空间，要么这里看到它在等
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (n > 0 && completionWaiters.load(std::memory_order_relaxed) > 0)
+        {
+            {
+                std::lock_guard<std::mutex> lock(completionMutex);
+            }
+            completionCond.notify_all();
+        }
+        if (n > 0 || timeoutMs == 0 || round > 0)
+        {
+            return n;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = eventFd;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, timeoutMs) < 0 && errno != EINTR)
+        {
+            return OPUS_OGG_ERR;
+        }
+    }
+    return 0;
+}
+
+void AsyncEngine::signal()
+{
+    uint64_t one = 1;
+    if (write(eventFd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+    {
+        std::cerr << "Failed to write eventfd" << std::endl;
+    }
+}
+
+void AsyncEngine::execute(const AsyncJob &job)
+{
+    TRACE_SPAN("AsyncJob");
+    OpusOggCodecCompletion completion;
+    completion.userData = job.userData;
+    completion.inst = job.codec;
+    completion.op = job.op;
+    completion.outputLen = 0;
+    switch (job.op)
+    {
+    case OPUS_OGG_JOB_ENCODE:
+        completion.status = OpusOggCodecEncodeInto(job.codec, job.input, job.inputLen, job.output, job.outputCap, &completion.outputLen, job.last);
+        break;
+    case OPUS_OGG_JOB_DECODE:
+        completion.status = OpusOggCodecDecodeInto(job.codec, job.input, job.inputLen, job.output, job.outputCap, &completion.outputLen, job.last);
+        break;
+    case OPUS_OGG_JOB_FLUSH:
+        completion.status = OpusOggCodecFlushInto(job.codec, job.output, job.outputCap, &completion.outputLen);
+        break;
+    default:
+        completion.status = OPUS_OGG_ERR;
+        break;
+    }
+
+    if (completions->Push(completion))
+    {
+        return;
+    }
+    // 完成队列满时睡眠等调用方取走，不占着核空转；停止时没有人再取，直接丢弃
+    signal();
+    std::unique_lock<std::mutex> lock(completionMutex);
+    completionWaiters.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (!completions->Push(completion) && !stopping.load())
+    {
+        completionCond.wait(lock);
+    }
+    completionWaiters.fetch_sub(1, std::memory_order_relaxed);
+}
+
+void AsyncEngine::workerLoop(Worker *worker, int cpu)
+{
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        {
+            std::cerr << "Failed to pin async worker to cpu " << cpu << std::endl;
+        }
+    }
+
+    AsyncJob job;
+    while (true)
+    {
+        int done = 0;
+        while (worker->queue.Pop(job))
+        {
+            execute(job);
+            if (++done % ASYNC_SIGNAL_BATCH == 0)
+            {
+                signal();
+            }
+        }
+        if (done % ASYNC_SIGNAL_BATCH != 0)
+        {
+            signal();
+        }
+
+        // 队列空了就睡眠，Submit 看到 sleeping 时唤醒
+        std::unique_lock<std::mutex> lock(worker->mutex);
+        worker->sleeping.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        worker->cond.wait(lock, [&]
+                          { return !worker->queue.Empty() || stopping.load(); });
+        worker->sleeping.store(false, std::memory_order_relaxed);
+        if (stopping.load() && worker->queue.Empty())
+        {
+            return;
+        }
+    }
+}
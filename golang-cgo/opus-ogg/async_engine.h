@@ -0,0 +1,193 @@
+#ifndef ASYNC_ENGINE_H
+#define ASYNC_ENGINE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "interface.h"
+
+#define ASYNC_QUEUE_DEPTH 1024 // 每个工作线程默认的队列长度
+#define ASYNC_SIGNAL_BATCH 64  // 工作线程每完成这么多个任务至少通知一次 eventfd
+
+// 有界的多生产者多消费者无锁队列(Dmitry Vyukov 的算法)，容量向上取2的幂
+// 每个格子带一个序号，生产者和消费者各自只在一个位置计数上做CAS，不需要加锁
+template <typename T>
+class BoundedQueue
+{
+private:
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    char pad0[64]; // 生产者和消费者的位置放在不同的缓存行
+    std::atomic<size_t> enqueuePos;
+    char pad1[64];
+    std::atomic<size_t> dequeuePos;
+    char pad2[64];
+
+public:
+    explicit BoundedQueue(size_t capacity) : enqueuePos(0), dequeuePos(0)
+    {
+        size_t size = 2;
+        while (size < capacity)
+        {
+            size <<= 1;
+        }
+        cells.reset(new Cell[size]);
+        mask = size - 1;
+        for (size_t i = 0; i < size; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    BoundedQueue(const BoundedQueue &) = delete;
+    BoundedQueue &operator=(const BoundedQueue &) = delete;
+
+    size_t Capacity() const
+    {
+        return mask + 1;
+    }
+
+    // 队列已满时返回false
+    bool Push(const T &value)
+    {
+        Cell *cell;
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if (diff == 0)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = value;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 队列为空时返回false
+    bool Pop(T &value)
+    {
+        Cell *cell;
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        while (true)
+        {
+            cell = &cells[pos & mask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if (diff == 0)
+            {
+                if (dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (diff < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = dequeuePos.load(std::memory_order_relaxed);
+            }
+        }
+        value = cell->value;
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 队首的格子是否已经写入，只作为睡眠前的检查
+    bool Empty() const
+    {
+        size_t pos = dequeuePos.load(std::memory_order_acquire);
+        return cells[pos & mask].sequence.load(std::memory_order_acquire) != pos + 1;
+    }
+};
+
+class OpusOggCodec;
+
+struct AsyncJob
+{
+    OpusOggCodec *codec;
+    int op; // OPUS_OGG_JOB_*
+    const char *input;
+    int inputLen;
+    char *output;
+    int outputCap;
+    bool last;
+    unsigned long long userData;
+};
+
+// 异步编解码引擎：每个实例第一次提交时按轮转固定分给一个工作线程，之后的任务都进入该线程的队列，
+// 同一实例的任务按提交顺序执行，编解码器状态一直留在这个核的缓存里；
+// 完成事件进入共享的完成队列，每批任务完成后写一次 eventfd
+class AsyncEngine
+{
+private:
+    struct Worker
+    {
+        BoundedQueue<AsyncJob> queue;
+        std::thread thread;
+        std::mutex mutex; // 只用于睡眠和唤醒，入队出队不加锁
+        std::condition_variable cond;
+        std::atomic<bool> sleeping;
+
+        explicit Worker(size_t depth) : queue(depth), sleeping(false) {}
+    };
+
+    static AsyncEngine *engineInst;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::unique_ptr<BoundedQueue<OpusOggCodecCompletion>> completions;
+    // 完成队列满时工作线程睡在这里，Poll 取走事件后看到有人在等才唤醒
+    std::mutex completionMutex;
+    std::condition_variable completionCond;
+    std::atomic<int> completionWaiters;
+    int eventFd;
+    std::atomic<bool> running;
+    std::atomic<bool> stopping;
+    std::atomic<unsigned> nextWorker; // 新实例分配工作线程的轮转计数
+
+    AsyncEngine() : completionWaiters(0), eventFd(-1), running(false), stopping(false), nextWorker(0) {}
+    ~AsyncEngine() = default;
+
+    void workerLoop(Worker *worker, int cpu);
+    void execute(const AsyncJob &job);
+    void signal();
+
+public:
+    static AsyncEngine *GetInstance();
+
+    // workers<=0 时按可用核数，pin 时第i个工作线程绑定到第i个可用核；成功返回 eventfd
+    int Start(int workerCount, int queueDepth, bool pin);
+    // 执行完已提交的任务后停止工作线程；Submit/Poll 直接访问工作线程和完成队列，不加锁，
+    // 调用方要保证 Stop 时没有正在执行的 Submit/Poll，之后也不再调用
+    void Stop();
+    int Submit(const AsyncJob &job);
+    int Poll(OpusOggCodecCompletion *output, int max, int timeoutMs);
+};
+
+#endif // ASYNC_ENGINE_H
@@ -0,0 +1,546 @@
+// 编解码性能基准: 各参数下的帧率和实时倍数、流式Encode按输入块大小的单次调用延迟、
+// Ogg封装与2字节长度前缀封装(cpp/opus的格式)的开销对比
+// 结果以JSON写出，可与保存的基线比较，超过阈值的退化会让进程返回1
+//
+// 用法: ./bench [-o result.json] [-b baseline.json] [-t 阈值百分比] [-s 每项音频秒数] [-r 重复次数]
+
+#include "opus_ogg.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <new>
+#include <atomic>
+#include <set>
+
+// 统计C++侧的内存分配次数(libopus/libogg内部的malloc不在内)
+static std::atomic<size_t> allocCount(0);
+
+void *operator new(size_t size)
+{
+    allocCount++;
+    void *p = std::malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+struct BenchConfig
+{
+    int sampleRate;
+    int channels;
+    int frameSize;
+    int bitrate;
+    int complexity;
+
+    std::string Name() const
+    {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "sr=%d,ch=%d,fs=%d,br=%d,cx=%d", sampleRate, channels, frameSize, bitrate, complexity);
+        return buf;
+    }
+};
+
+struct BenchResult
+{
+    std::string name;
+    double value;
+    std::string unit;
+    bool higherIsBetter;
+};
+
+static std::vector<BenchResult> results;
+
+static void report(const std::string &name, double value, const std::string &unit, bool higherIsBetter)
+{
+    results.push_back(BenchResult{name, value, unit, higherIsBetter});
+    fprintf(stderr, "%-72s %14.2f %s\n", name.c_str(), value, unit.c_str());
+}
+
+static double nowSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 确定性的测试信号: 几个缓慢变化的正弦加少量噪声，各声道相位不同
+static std::vector<opus_int16> makePcm(int sampleRate, int channels, size_t samples)
+{
+    std::vector<opus_int16> pcm(samples * channels);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < samples; i++)
+    {
+        double t = static_cast<double>(i) / sampleRate;
+        for (int c = 0; c < channels; c++)
+        {
+            double v = 0.3 * std::sin(2 * M_PI * (220 + 40 * std::sin(t)) * t + c) +
+                       0.2 * std::sin(2 * M_PI * 1375 * t + 2 * c) +
+                       0.1 * std::sin(2 * M_PI * 3000 * t * (1 + 0.1 * std::sin(3 * t)));
+            seed = seed * 1664525 + 1013904223;
+            v += 0.02 * (static_cast<int>(seed >> 16) - 32768) / 32768.0;
+            pcm[i * channels + c] = static_cast<opus_int16>(v * 32767 * 0.8);
+        }
+    }
+    return pcm;
+}
+
+static OpusOggCodec *startCodec(const BenchConfig &config)
+{
+    OpusOggCodec *codec = new OpusOggCodec(config.sampleRate, config.channels, config.frameSize);
+    if (!codec->Start() || !codec->SetBitrate(config.bitrate) || !codec->SetComplexity(config.complexity))
+    {
+        delete codec;
+        return nullptr;
+    }
+    return codec;
+}
+
+// 按chunkBytes分块流式编码整段PCM，返回Ogg数据
+// latencies非空时记录每次调用的耗时(ns)，allocs累加这些调用中的分配次数
+static bool encodeStream(const BenchConfig &config, const std::vector<opus_int16> &pcm, size_t chunkBytes,
+                         std::vector<char> &ogg, std::vector<double> *latencies, size_t *allocs = nullptr)
+{
+    std::unique_ptr<OpusOggCodec> codec(startCodec(config));
+    if (!codec)
+    {
+        return false;
+    }
+    const char *input = reinterpret_cast<const char *>(pcm.data());
+    size_t inputLength = pcm.size() * sizeof(opus_int16);
+    size_t calls = (inputLength + chunkBytes - 1) / chunkBytes;
+
+    // 输出一次性按上界预留，计时范围内不扩容
+    ogg.resize(codec->EncodeBound(inputLength, true) + calls * MAX_OGG_HEADER_SIZE);
+    OutputSpan output(ogg.data(), ogg.size());
+    for (size_t offset = 0; offset < inputLength; offset += chunkBytes)
+    {
+        size_t len = std::min(chunkBytes, inputLength - offset);
+        size_t allocsBefore = allocCount;
+        double begin = latencies ? nowSeconds() : 0;
+        if (codec->Encode(input + offset, len, output, false) != 0)
+        {
+            return false;
+        }
+        if (latencies)
+        {
+            latencies->push_back((nowSeconds() - begin) * 1e9);
+        }
+        if (allocs)
+        {
+            *allocs += allocCount - allocsBefore;
+        }
+    }
+    if (codec->Encode(nullptr, 0, output, true) != 0)
+    {
+        return false;
+    }
+    ogg.resize(output.size);
+    return true;
+}
+
+static bool decodeStream(const std::vector<char> &ogg, size_t chunkBytes, std::vector<char> &pcm)
+{
+    OpusOggCodec codec(24000);
+    OutputSpan output(pcm.data(), pcm.size());
+    size_t needed = 0;
+    for (size_t offset = 0; offset < ogg.size(); offset += chunkBytes)
+    {
+        size_t len = std::min(chunkBytes, ogg.size() - offset);
+        if (codec.Decode(ogg.data() + offset, len, output, false, &needed) < 0)
+        {
+            return false;
+        }
+    }
+    // 第一次调用只解析了OpusHead，再调用一次取完剩余的包
+    if (codec.Decode(nullptr, 0, output, true, &needed) < 0)
+    {
+        return false;
+    }
+    pcm.resize(output.size);
+    return true;
+}
+
+// 各参数下编解码的帧率和实时倍数，重复多次取最快的一次
+static void benchThroughput(const BenchConfig &config, double seconds, int repeats)
+{
+    size_t frames = static_cast<size_t>(seconds * config.sampleRate / config.frameSize);
+    std::vector<opus_int16> pcm = makePcm(config.sampleRate, config.channels, frames * config.frameSize);
+    size_t frameBytes = config.frameSize * config.channels * sizeof(opus_int16);
+
+    double encodeTime = 1e30;
+    double decodeTime = 1e30;
+    std::vector<char> ogg;
+    std::vector<char> decoded;
+    for (int r = 0; r < repeats; r++)
+    {
+        double begin = nowSeconds();
+        if (!encodeStream(config, pcm, frameBytes, ogg, nullptr))
+        {
+            fprintf(stderr, "encode failed: %s\n", config.Name().c_str());
+            return;
+        }
+        encodeTime = std::min(encodeTime, nowSeconds() - begin);
+
+        decoded.assign(frames * frameBytes, 0);
+        begin = nowSeconds();
+        if (!decodeStream(ogg, 4096, decoded))
+        {
+            fprintf(stderr, "decode failed: %s\n", config.Name().c_str());
+            return;
+        }
+        decodeTime = std::min(decodeTime, nowSeconds() - begin);
+    }
+
+    double audioSeconds = static_cast<double>(frames) * config.frameSize / config.sampleRate;
+    std::string name = config.Name();
+    report("encode/" + name + "/frames_per_sec", frames / encodeTime, "frames/s", true);
+    report("encode/" + name + "/realtime", audioSeconds / encodeTime, "x", true);
+    report("decode/" + name + "/frames_per_sec", frames / decodeTime, "frames/s", true);
+    report("decode/" + name + "/realtime", audioSeconds / decodeTime, "x", true);
+}
+
+// 流式Encode按输入块大小的单次调用延迟，块大小覆盖不足一帧、整帧和多帧
+static void benchLatency(const BenchConfig &config, double seconds)
+{
+    size_t frameBytes = config.frameSize * config.channels * sizeof(opus_int16);
+    std::vector<opus_int16> pcm = makePcm(config.sampleRate, config.channels, static_cast<size_t>(seconds * config.sampleRate));
+
+    struct Chunk
+    {
+        const char *name;
+        size_t bytes;
+    };
+    const Chunk chunks[] = {
+        {"half_frame", frameBytes / 2},
+        {"frame_minus_2", frameBytes - 2},
+        {"frame", frameBytes},
+        {"frame_and_half", frameBytes * 3 / 2},
+        {"4_frames", frameBytes * 4},
+        {"10_frames", frameBytes * 10},
+    };
+    for (const auto &chunk : chunks)
+    {
+        std::vector<double> latencies;
+        std::vector<char> ogg;
+        latencies.reserve(pcm.size() * sizeof(opus_int16) / chunk.bytes + 1);
+        size_t allocs = 0;
+        // 先跑一遍预热，第二遍计时
+        encodeStream(config, pcm, chunk.bytes, ogg, nullptr);
+        if (!encodeStream(config, pcm, chunk.bytes, ogg, &latencies, &allocs) || latencies.empty())
+        {
+            fprintf(stderr, "latency bench failed: %s\n", chunk.name);
+            continue;
+        }
+        double allocsPerCall = static_cast<double>(allocs) / latencies.size();
+
+        double sum = 0;
+        for (double ns : latencies)
+        {
+            sum += ns;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::string name = "latency/" + std::string(chunk.name) + "_" + std::to_string(chunk.bytes) + "B";
+        report(name + "/mean", sum / latencies.size(), "ns", false);
+        report(name + "/p50", latencies[latencies.size() / 2], "ns", false);
+        report(name + "/p99", latencies[latencies.size() * 99 / 100], "ns", false);
+        report(name + "/max", latencies.back(), "ns", false);
+        report(name + "/allocs_per_call", allocsPerCall, "allocs", false);
+    }
+}
+
+// Ogg封装和cpp/opus的2字节长度前缀封装对比: 同样的编码参数，整段编码的耗时和字节数
+// 这里只比较封装格式，Pcm2OpusEncoder 本身的吞吐和延迟由 golang-cgo/opus 的 bench 测量
+static void benchFraming(const BenchConfig &config, double seconds, int repeats)
+{
+    size_t frames = static_cast<size_t>(seconds * config.sampleRate / config.frameSize);
+    std::vector<opus_int16> pcm = makePcm(config.sampleRate, config.channels, frames * config.frameSize);
+    size_t frameBytes = config.frameSize * config.channels * sizeof(opus_int16);
+
+    double oggTime = 1e30;
+    double prefixTime = 1e30;
+    size_t oggBytes = 0;
+    size_t prefixBytes = 0;
+    std::vector<char> ogg;
+    std::vector<unsigned char> prefixed(frames * (2 + MAX_PACKET_SIZE));
+    for (int r = 0; r < repeats; r++)
+    {
+        double begin = nowSeconds();
+        encodeStream(config, pcm, frameBytes, ogg, nullptr);
+        oggTime = std::min(oggTime, nowSeconds() - begin);
+        oggBytes = ogg.size();
+
+        // 与cpp/opus的pcm2opus相同: 每帧前2字节大端序长度，编码器参数与OpusOggEncoder一致
+        begin = nowSeconds();
+        int err;
+        std::unique_ptr<OpusEncoder, OpusEncoderDeleter> enc(opus_encoder_create(config.sampleRate, config.channels, OPUS_APPLICATION_AUDIO, &err));
+        opus_encoder_ctl(enc.get(), OPUS_SET_VBR(0));
+        opus_encoder_ctl(enc.get(), OPUS_SET_BITRATE(config.bitrate));
+        opus_encoder_ctl(enc.get(), OPUS_SET_COMPLEXITY(config.complexity));
+        opus_encoder_ctl(enc.get(), OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
+        opus_encoder_ctl(enc.get(), OPUS_SET_LSB_DEPTH(16));
+        size_t pos = 0;
+        for (size_t i = 0; i < frames; i++)
+        {
+            int bytes = opus_encode(enc.get(), pcm.data() + i * config.frameSize * config.channels, config.frameSize,
+                                    prefixed.data() + pos + 2, MAX_PACKET_SIZE);
+            if (bytes < 0)
+            {
+                fprintf(stderr, "encode failed: %s\n", opus_strerror(bytes));
+                return;
+            }
+            prefixed[pos] = (bytes >> 8) & 0xFF;
+            prefixed[pos + 1] = bytes & 0xFF;
+            pos += 2 + bytes;
+        }
+        prefixTime = std::min(prefixTime, nowSeconds() - begin);
+        prefixBytes = pos;
+    }
+
+    report("framing/ogg/ns_per_frame", oggTime / frames * 1e9, "ns", false);
+    report("framing/length_prefix/ns_per_frame", prefixTime / frames * 1e9, "ns", false);
+    report("framing/ogg_overhead/ns_per_frame", (oggTime - prefixTime) / frames * 1e9, "ns", false);
+    report("framing/ogg/bytes_per_frame", static_cast<double>(oggBytes) / frames, "bytes", false);
+    report("framing/length_prefix/bytes_per_frame", static_cast<double>(prefixBytes) / frames, "bytes", false);
+    report("framing/ogg_overhead/bytes_pct", 100.0 * (static_cast<double>(oggBytes) - prefixBytes) / prefixBytes, "%", false);
+}
+
+// 只比较封装本身: 预先编码好的包分别写成长度前缀格式和经libogg分页，不含编码耗时
+static void benchFramingOnly(const BenchConfig &config, double seconds, int repeats)
+{
+    size_t frames = static_cast<size_t>(seconds * config.sampleRate / config.frameSize);
+    std::vector<opus_int16> pcm = makePcm(config.sampleRate, config.channels, frames * config.frameSize);
+
+    int err;
+    std::unique_ptr<OpusEncoder, OpusEncoderDeleter> enc(opus_encoder_create(config.sampleRate, config.channels, OPUS_APPLICATION_AUDIO, &err));
+    if (err != OPUS_OK)
+    {
+        fprintf(stderr, "Failed to create encoder: %s\n", opus_strerror(err));
+        return;
+    }
+    opus_encoder_ctl(enc.get(), OPUS_SET_VBR(0));
+    opus_encoder_ctl(enc.get(), OPUS_SET_BITRATE(config.bitrate));
+    opus_encoder_ctl(enc.get(), OPUS_SET_COMPLEXITY(config.complexity));
+    std::vector<std::vector<unsigned char>> packets(frames);
+    unsigned char packet[MAX_PACKET_SIZE];
+    for (size_t i = 0; i < frames; i++)
+    {
+        int bytes = opus_encode(enc.get(), pcm.data() + i * config.frameSize * config.channels, config.frameSize, packet, MAX_PACKET_SIZE);
+        if (bytes < 0)
+        {
+            fprintf(stderr, "encode failed: %s\n", opus_strerror(bytes));
+            return;
+        }
+        packets[i].assign(packet, packet + bytes);
+    }
+
+    std::vector<unsigned char> out(frames * (MAX_PACKET_SIZE + MAX_OGG_HEADER_SIZE));
+    double oggTime = 1e30;
+    double prefixTime = 1e30;
+    for (int r = 0; r < repeats; r++)
+    {
+        double begin = nowSeconds();
+        size_t pos = 0;
+        for (const auto &p : packets)
+        {
+            out[pos] = (p.size() >> 8) & 0xFF;
+            out[pos + 1] = p.size() & 0xFF;
+            std::memcpy(out.data() + pos + 2, p.data(), p.size());
+            pos += 2 + p.size();
+        }
+        prefixTime = std::min(prefixTime, nowSeconds() - begin);
+
+        ogg_stream_state os;
+        ogg_stream_init(&os, 1);
+        begin = nowSeconds();
+        pos = 0;
+        ogg_int64_t granulepos = 0;
+        for (size_t i = 0; i < frames; i++)
+        {
+            granulepos += config.frameSize * 48000 / config.sampleRate;
+            ogg_packet op;
+            op.packet = const_cast<unsigned char *>(packets[i].data());
+            op.bytes = packets[i].size();
+            op.b_o_s = 0;
+            op.e_o_s = i + 1 == frames;
+            op.granulepos = granulepos;
+            op.packetno = i + 2;
+            ogg_stream_packetin(&os, &op);
+            ogg_page og;
+            while (op.e_o_s ? ogg_stream_flush(&os, &og) : ogg_stream_pageout(&os, &og))
+            {
+                std::memcpy(out.data() + pos, og.header, og.header_len);
+                std::memcpy(out.data() + pos + og.header_len, og.body, og.body_len);
+                pos += og.header_len + og.body_len;
+            }
+        }
+        oggTime = std::min(oggTime, nowSeconds() - begin);
+        ogg_stream_clear(&os);
+    }
+
+    report("framing_only/length_prefix/ns_per_frame", prefixTime / frames * 1e9, "ns", false);
+    report("framing_only/ogg/ns_per_frame", oggTime / frames * 1e9, "ns", false);
+}
+
+static bool writeJson(const std::string &path, double seconds, int repeats)
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f)
+    {
+        fprintf(stderr, "Cannot open output file: %s\n", path.c_str());
+        return false;
+    }
+    fprintf(f, "{\n  \"seconds\": %g,\n  \"repeats\": %d,\n  \"results\": [\n", seconds, repeats);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"value\": %.4f, \"unit\": \"%s\", \"better\": \"%s\"}%s\n", r.name.c_str(), r.value,
+                r.unit.c_str(), r.higherIsBetter ? "higher" : "lower", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    return true;
+}
+
+// 只解析writeJson写出的格式: 每行一个结果
+static bool readBaseline(const std::string &path, std::vector<BenchResult> &baseline)
+{
+    std::ifstream in(path);
+    if (!in.is_open())
+    {
+        fprintf(stderr, "Cannot open baseline: %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        size_t name = line.find("\"name\": \"");
+        size_t value = line.find("\"value\": ");
+        if (name == std::string::npos || value == std::string::npos)
+        {
+            continue;
+        }
+        name += 9;
+        BenchResult r;
+        r.name = line.substr(name, line.find('"', name) - name);
+        r.value = std::atof(line.c_str() + value + 9);
+        r.higherIsBetter = line.find("\"better\": \"higher\"") != std::string::npos;
+        baseline.push_back(r);
+    }
+    return true;
+}
+
+// 与基线比较，返回退化超过阈值的项数
+static int compareBaseline(const std::vector<BenchResult> &baseline, double thresholdPct)
+{
+    int regressions = 0;
+    fprintf(stderr, "\n%-72s %12s %12s %9s\n", "compare with baseline", "baseline", "current", "change");
+    for (const auto &r : results)
+    {
+        for (const auto &b : baseline)
+        {
+            if (b.name != r.name)
+            {
+                continue;
+            }
+            double change = b.value != 0 ? (r.value - b.value) / std::fabs(b.value) * 100 : 0;
+            bool regressed = r.higherIsBetter ? change < -thresholdPct : change > thresholdPct;
+            regressions += regressed ? 1 : 0;
+            fprintf(stderr, "%-72s %12.2f %12.2f %+8.1f%%%s\n", r.name.c_str(), b.value, r.value, change, regressed ? "  REGRESSION" : "");
+            break;
+        }
+    }
+    fprintf(stderr, "%d regression(s) beyond %.1f%%\n", regressions, thresholdPct);
+    return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string outputPath = "bench_result.json";
+    std::string baselinePath;
+    double thresholdPct = 10;
+    double seconds = 5;
+    int repeats = 3;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string opt(argv[i]);
+        if (opt == "-o")
+            outputPath = argv[i + 1];
+        else if (opt == "-b")
+            baselinePath = argv[i + 1];
+        else if (opt == "-t")
+            thresholdPct = std::atof(argv[i + 1]);
+        else if (opt == "-s")
+            seconds = std::atof(argv[i + 1]);
+        else if (opt == "-r")
+            repeats = std::max(1, std::atoi(argv[i + 1]));
+    }
+
+    // 以默认参数为中心，每次只改变一个维度
+    const BenchConfig base = {24000, 1, 480, 48000, 8};
+    std::vector<BenchConfig> configs;
+    for (int frameMs10 : {25, 50, 100, 200, 400, 600})
+    {
+        BenchConfig c = base;
+        c.frameSize = c.sampleRate * frameMs10 / 10000;
+        configs.push_back(c);
+    }
+    for (int complexity : {0, 3, 5, 8, 10})
+    {
+        BenchConfig c = base;
+        c.complexity = complexity;
+        configs.push_back(c);
+    }
+    for (int bitrate : {16000, 32000, 48000, 96000, 128000})
+    {
+        BenchConfig c = base;
+        c.bitrate = bitrate;
+        configs.push_back(c);
+    }
+    for (int sampleRate : {8000, 16000, 24000, 48000})
+    {
+        BenchConfig c = base;
+        c.sampleRate = sampleRate;
+        c.frameSize = sampleRate / 50;
+        configs.push_back(c);
+    }
+    for (int channels : {1, 2})
+    {
+        BenchConfig c = base;
+        c.channels = channels;
+        configs.push_back(c);
+    }
+
+    std::set<std::string> done;
+    for (const auto &config : configs)
+    {
+        if (done.insert(config.Name()).second)
+        {
+            benchThroughput(config, seconds, repeats);
+        }
+    }
+    benchLatency(base, seconds);
+    benchFraming(base, seconds, repeats);
+    benchFramingOnly(base, seconds, repeats);
+
+    if (!writeJson(outputPath, seconds, repeats))
+    {
+        return 1;
+    }
+    fprintf(stderr, "results written to %s\n", outputPath.c_str());
+
+    if (!baselinePath.empty())
+    {
+        std::vector<BenchResult> baseline;
+        if (!readBaseline(baselinePath, baseline))
+        {
+            return 1;
+        }
+        return compareBaseline(baseline, thresholdPct) > 0 ? 1 : 0;
+    }
+    return 0;
+}
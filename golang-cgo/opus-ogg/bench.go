@@ -0,0 +1,336 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "interface.h"
+*/
+import "C"
+import (
+	"fmt"
+	"math"
+	"os"
+	"runtime"
+	"sync"
+	"sync/atomic"
+	"testing"
+	"unsafe"
+)
+
+// -mode bench: 测量 Go 经 cgo 调用编解码接口的开销，与 bench.cpp 的纯 C++ 数字对比即为边界上的损耗
+// 每个并发度下各 goroutine 持有独立实例；ns/op 为单次接口调用的墙钟时间(多 goroutine 时为总时间除以总调用数)，
+// copiedB/op 为每次调用在 C 侧 malloc 拷贝和 C.GoBytes 上额外复制的字节数，零拷贝接口为 0
+// 编码器的调试输出被丢弃但 printf 本身的开销仍计入，结果写到标准错误
+
+const (
+	benchSampleRate = 24000
+	benchSeconds    = 30 // 测试音频时长，解码时每个 goroutine 循环解这段流，到末尾重新 Start
+)
+
+var (
+	benchEncodeChunks = []int{960, 4096, 9600, 38400} // PCM 字节数: 1 帧、main 的读块大小、10 帧、40 帧
+	benchDecodeChunks = []int{512, 4096, 16384}       // Ogg 字节数
+)
+
+// 每个 goroutine 的被测函数，run 执行 ops 次调用并返回额外复制的字节数
+type benchWorker struct {
+	run   func(ops int) int64
+	close func()
+}
+
+func runBenchmarks() {
+	pcm := makeBenchPCM(benchSampleRate, benchSeconds)
+	ogg, err := encodeBenchOgg(pcm)
+	if err != nil {
+		fmt.Fprintln(os.Stderr, "Prepare bench input failed:", err)
+		return
+	}
+	fmt.Fprintf(os.Stderr, "GOMAXPROCS=%d, pcm %d bytes, ogg %d bytes\n", runtime.GOMAXPROCS(0), len(pcm), len(ogg))
+
+	for _, chunk := range benchEncodeChunks {
+		for _, workers := range benchConcurrency() {
+			chunk, workers := chunk, workers
+			runBench(fmt.Sprintf("OpusOggCodecEncode/chunk=%d/goroutines=%d", chunk, workers), chunk, workers,
+				func() benchWorker { return newEncodeWorker(pcm, chunk, false) })
+			runBench(fmt.Sprintf("OpusOggCodecEncodeInto/chunk=%d/goroutines=%d", chunk, workers), chunk, workers,
+				func() benchWorker { return newEncodeWorker(pcm, chunk, true) })
+		}
+	}
+	runAsyncBenchmarks(pcm)
+	for _, chunk := range benchDecodeChunks {
+		for _, workers := range benchConcurrency() {
+			chunk, workers := chunk, workers
+			runBench(fmt.Sprintf("OpusOggCodecDecode/chunk=%d/goroutines=%d", chunk, workers), chunk, workers,
+				func() benchWorker { return newDecodeWorker(ogg, chunk, false) })
+			runBench(fmt.Sprintf("OpusOggCodecDecodeInto/chunk=%d/goroutines=%d", chunk, workers), chunk, workers,
+				func() benchWorker { return newDecodeWorker(ogg, chunk, true) })
+		}
+	}
+}
+
+// 1, 2, 4 ... 直到 GOMAXPROCS
+func benchConcurrency() []int {
+	maxProcs := runtime.GOMAXPROCS(0)
+	var levels []int
+	for n := 1; n < maxProcs; n *= 2 {
+		levels = append(levels, n)
+	}
+	return append(levels, maxProcs)
+}
+
+// 把 b.N 次调用分给 workers 个 goroutine，实例创建和销毁不计时
+func runBench(name string, chunk, workers int, newWorker func() benchWorker) {
+	result := testing.Benchmark(func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(int64(chunk))
+		ws := make([]benchWorker, workers)
+		for w := range ws {
+			ws[w] = newWorker()
+		}
+		var copied int64
+		var wg sync.WaitGroup
+		b.ResetTimer()
+		for w := range ws {
+			ops := b.N / workers
+			if w < b.N%workers {
+				ops++
+			}
+			wg.Add(1)
+			go func(worker benchWorker, ops int) {
+				defer wg.Done()
+				atomic.AddInt64(&copied, worker.run(ops))
+			}(ws[w], ops)
+		}
+		wg.Wait()
+		b.StopTimer()
+		for _, worker := range ws {
+			worker.close()
+		}
+		b.ReportMetric(float64(copied)/float64(b.N), "copiedB/op")
+	})
+	fmt.Fprintf(os.Stderr, "%-60s %s %s\n", name, result.String(), result.MemString())
+}
+
+func newEncodeWorker(pcm []byte, chunk int, into bool) benchWorker {
+	var inst unsafe.Pointer
+	if C.OpusOggCodecStart(&inst, C.int(benchSampleRate)) != 0 {
+		panic("OpusOggCodecStart failed")
+	}
+	output := make([]byte, int(C.OpusOggCodecEncodeBound(inst, C.int(chunk), C.bool(false))))
+	pos := 0
+	// 传给 C 的输出参数会逃逸到堆上，放在循环外只分配一次
+	var cOutput *C.char
+	var cOutputLen C.int
+	run := func(ops int) int64 {
+		var copied int64
+		for i := 0; i < ops; i++ {
+			if pos+chunk > len(pcm) {
+				pos = 0
+			}
+			input := (*C.char)(unsafe.Pointer(&pcm[pos]))
+			pos += chunk
+			if into {
+				result := C.OpusOggCodecEncodeInto(inst, input, C.int(chunk), (*C.char)(unsafe.Pointer(&output[0])), C.int(len(output)), &cOutputLen, C.bool(false))
+				if result == C.OPUS_OGG_ERR_BUFFER_TOO_SMALL {
+					// Ogg 流里积压的数据也算在上界内，不够时按返回的大小扩容后重试
+					output = make([]byte, int(cOutputLen))
+					result = C.OpusOggCodecEncodeInto(inst, input, C.int(chunk), (*C.char)(unsafe.Pointer(&output[0])), C.int(len(output)), &cOutputLen, C.bool(false))
+				}
+				if result != C.OPUS_OGG_OK {
+					panic("OpusOggCodecEncodeInto failed")
+				}
+				continue
+			}
+			if C.OpusOggCodecEncode(inst, input, C.int(chunk), &cOutput, &cOutputLen, C.bool(false)) != 0 {
+				panic("OpusOggCodecEncode failed")
+			}
+			_ = C.GoBytes(unsafe.Pointer(cOutput), cOutputLen)
+			C.free(unsafe.Pointer(cOutput))
+			copied += 2 * int64(cOutputLen)
+		}
+		return copied
+	}
+	return benchWorker{run: run, close: func() { C.OpusOggCodecEnd(&inst) }}
+}
+
+func newDecodeWorker(ogg []byte, chunk int, into bool) benchWorker {
+	var inst unsafe.Pointer
+	if C.OpusOggCodecStart(&inst, C.int(benchSampleRate)) != 0 {
+		panic("OpusOggCodecStart failed")
+	}
+	output := make([]byte, 64*1024)
+	pos := 0
+	// 传给 C 的输出参数会逃逸到堆上，放在循环外只分配一次
+	var cOutput *C.char
+	var cOutputLen C.int
+	run := func(ops int) int64 {
+		var copied int64
+		for i := 0; i < ops; i++ {
+			if pos >= len(ogg) {
+				// 一条流解完，换新的会话从头再解，实例池使这一步只是重置状态
+				C.OpusOggCodecEnd(&inst)
+				if C.OpusOggCodecStart(&inst, C.int(benchSampleRate)) != 0 {
+					panic("OpusOggCodecStart failed")
+				}
+				pos = 0
+			}
+			n := chunk
+			if pos+n > len(ogg) {
+				n = len(ogg) - pos
+			}
+			input := (*C.char)(unsafe.Pointer(&ogg[pos]))
+			inputLen := C.int(n)
+			pos += n
+			last := C.bool(pos == len(ogg))
+			if into {
+				for {
+					result := C.OpusOggCodecDecodeInto(inst, input, inputLen, (*C.char)(unsafe.Pointer(&output[0])), C.int(len(output)), &cOutputLen, last)
+					if result < 0 {
+						panic("OpusOggCodecDecodeInto failed")
+					}
+					if result == C.OPUS_OGG_OK {
+						break
+					}
+					input, inputLen = nil, 0
+				}
+				continue
+			}
+			if C.OpusOggCodecDecode(inst, input, inputLen, &cOutput, &cOutputLen, last) != 0 {
+				panic("OpusOggCodecDecode failed")
+			}
+			_ = C.GoBytes(unsafe.Pointer(cOutput), cOutputLen)
+			C.free(unsafe.Pointer(cOutput))
+			copied += 2 * int64(cOutputLen)
+		}
+		return copied
+	}
+	return benchWorker{run: run, close: func() { C.OpusOggCodecEnd(&inst) }}
+}
+
+// 异步引擎的完成事件按 userData 分发给等待的 goroutine
+var (
+	asyncWaiters sync.Map // uint64 -> chan C.OpusOggCodecCompletion
+	asyncNextID  uint64
+)
+
+// 每个 goroutine 提交一个编码任务后等待完成事件，编解码在引擎的工作线程上执行，
+// 只有一个 goroutine 阻塞在 OpusOggCodecAsyncPoll 上，与同步接口的 ns/op 对比即为异步的调度开销
+func runAsyncBenchmarks(pcm []byte) {
+	if C.OpusOggCodecAsyncStart(0, 0, C.bool(true)) < 0 {
+		fmt.Fprintln(os.Stderr, "OpusOggCodecAsyncStart failed")
+		return
+	}
+	stop := make(chan struct{})
+	stopped := make(chan struct{})
+	go func() {
+		defer close(stopped)
+		completions := make([]C.OpusOggCodecCompletion, 64)
+		for {
+			select {
+			case <-stop:
+				return
+			default:
+			}
+			n := int(C.OpusOggCodecAsyncPoll(&completions[0], C.int(len(completions)), 10))
+			for _, c := range completions[:max(n, 0)] {
+				if ch, ok := asyncWaiters.Load(uint64(c.userData)); ok {
+					ch.(chan C.OpusOggCodecCompletion) <- c
+				}
+			}
+		}
+	}()
+
+	// 任务执行期间 C 侧持有输入输出指针，必须用 C 内存
+	cPCM := C.CBytes(pcm)
+	for _, chunk := range benchEncodeChunks {
+		for _, workers := range benchConcurrency() {
+			chunk := chunk
+			runBench(fmt.Sprintf("OpusOggCodecAsyncSubmit/chunk=%d/goroutines=%d", chunk, workers), chunk, workers,
+				func() benchWorker { return newAsyncEncodeWorker(cPCM, len(pcm), chunk) })
+		}
+	}
+	close(stop)
+	<-stopped
+	C.OpusOggCodecAsyncStop()
+	C.free(cPCM)
+}
+
+func newAsyncEncodeWorker(pcm unsafe.Pointer, pcmLen, chunk int) benchWorker {
+	var inst unsafe.Pointer
+	if C.OpusOggCodecStart(&inst, C.int(benchSampleRate)) != 0 {
+		panic("OpusOggCodecStart failed")
+	}
+	outputCap := int(C.OpusOggCodecEncodeBound(inst, C.int(chunk), C.bool(false)))
+	output := C.malloc(C.size_t(outputCap))
+	id := atomic.AddUint64(&asyncNextID, 1)
+	done := make(chan C.OpusOggCodecCompletion, 1)
+	asyncWaiters.Store(id, done)
+	pos := 0
+	run := func(ops int) int64 {
+		for i := 0; i < ops; i++ {
+			if pos+chunk > pcmLen {
+				pos = 0
+			}
+			input := (*C.char)(unsafe.Add(pcm, pos))
+			pos += chunk
+			for {
+				result := C.OpusOggCodecAsyncSubmit(inst, C.OPUS_OGG_JOB_ENCODE, input, C.int(chunk), (*C.char)(output), C.int(outputCap), C.bool(false), C.ulonglong(id))
+				if result == C.OPUS_OGG_ERR_QUEUE_FULL {
+					runtime.Gosched()
+					continue
+				}
+				if result != C.OPUS_OGG_OK {
+					panic("OpusOggCodecAsyncSubmit failed")
+				}
+				c := <-done
+				if c.status == C.OPUS_OGG_ERR_BUFFER_TOO_SMALL {
+					// 与同步接口相同，输入没有被消费，按返回的大小扩容后重新提交
+					C.free(output)
+					outputCap = int(c.outputLen)
+					output = C.malloc(C.size_t(outputCap))
+					continue
+				}
+				if c.status != C.OPUS_OGG_OK {
+					panic("async encode failed")
+				}
+				break
+			}
+		}
+		return 0
+	}
+	return benchWorker{run: run, close: func() {
+		asyncWaiters.Delete(id)
+		C.free(output)
+		C.OpusOggCodecEnd(&inst)
+	}}
+}
+
+// 确定性的测试信号，与 bench.cpp 相同的几个正弦叠加
+func makeBenchPCM(sampleRate, seconds int) []byte {
+	samples := sampleRate * seconds
+	pcm := make([]byte, samples*2)
+	for i := 0; i < samples; i++ {
+		t := float64(i) / float64(sampleRate)
+		v := 0.3*math.Sin(2*math.Pi*(220+40*math.Sin(t))*t) +
+			0.2*math.Sin(2*math.Pi*1375*t) +
+			0.1*math.Sin(2*math.Pi*3000*t*(1+0.1*math.Sin(3*t)))
+		s := int16(v * 32767 * 0.8)
+		pcm[2*i] = byte(s)
+		pcm[2*i+1] = byte(s >> 8)
+	}
+	return pcm
+}
+
+// 一次编码整段 PCM，作为解码测试的输入
+func encodeBenchOgg(pcm []byte) ([]byte, error) {
+	var inst unsafe.Pointer
+	if ret := C.OpusOggCodecStart(&inst, C.int(benchSampleRate)); ret != 0 {
+		return nil, fmt.Errorf("start error %d", int(ret))
+	}
+	defer C.OpusOggCodecEnd(&inst)
+	output := make([]byte, int(C.OpusOggCodecEncodeBound(inst, C.int(len(pcm)), C.bool(true))))
+	var cOutputLen C.int
+	if ret := C.OpusOggCodecEncodeInto(inst, (*C.char)(unsafe.Pointer(&pcm[0])), C.int(len(pcm)), (*C.char)(unsafe.Pointer(&output[0])), C.int(len(output)), &cOutputLen, C.bool(true)); ret != C.OPUS_OGG_OK {
+		return nil, fmt.Errorf("encode error %d", int(ret))
+	}
+	return output[:cOutputLen], nil
+}
@@ -0,0 +1,4 @@
+g++ -O2 -std=c++11 -o alloc_check alloc_check.cpp interface.cpp opus_ogg.cpp encoder.cpp decoder.cpp page_sink.cpp thread_pool.cpp async_engine.cpp codec_client.cpp codec_stats.cpp governor.cpp trace.cpp sample_format.cpp resampler.cpp -pthread -L ./lib -lopus -logg -lrt
+./alloc_check || exit 1
+g++ -O2 -std=c++11 -o bench bench.cpp opus_ogg.cpp encoder.cpp decoder.cpp page_sink.cpp thread_pool.cpp codec_stats.cpp governor.cpp trace.cpp sample_format.cpp resampler.cpp -pthread -L ./lib -lopus -logg -lrt
+./bench -o bench_result.json -b bench_baseline.json "$@"
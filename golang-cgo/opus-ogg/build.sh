@@ -1,2 +1,3 @@
-g++ -g -std=c++11 -shared -o libopus_ogg.so interface.cpp opus_ogg.cpp encoder.cpp decoder.cpp -fPIC -L ./lib -lopus -logg
-go build main.go
\ No newline at end of file
+g++ -g -std=c++11 -shared -o libopus_ogg.so interface.cpp opus_ogg.cpp encoder.cpp decoder.cpp page_sink.cpp thread_pool.cpp async_engine.cpp codec_client.cpp codec_stats.cpp governor.cpp trace.cpp sample_format.cpp resampler.cpp -fPIC -pthread -L ./lib -lopus -logg -lrt
+g++ -g -std=c++11 -o codec_server codec_server.cpp interface.cpp opus_ogg.cpp encoder.cpp decoder.cpp page_sink.cpp thread_pool.cpp async_engine.cpp codec_stats.cpp governor.cpp trace.cpp sample_format.cpp resampler.cpp -pthread -L ./lib -lopus -logg -lrt
+go build main.go bench.go remote.go
\ No newline at end of file
@@ -0,0 +1,354 @@
+#include "interface.h"
+#include "codec_server.h"
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <set>
+#include <poll.h>
+#include <sys/un.h>
+
+// codec_server 的客户端：控制消息走 socket，数据直接读写共享内存环，不经过内核拷贝
+
+struct RemoteSession;
+
+struct RemoteConnection
+{
+    int fd = -1;
+    std::set<RemoteSession *> sessions;
+
+    ~RemoteConnection()
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+
+    // 发送请求并等待回复，期间收到的 EVENT 直接丢弃
+    bool Request(const CodecMessage &request, CodecMessage &reply, int *passedFd);
+};
+
+struct RemoteSession
+{
+    RemoteConnection *conn;
+    uint64_t id;
+    uint64_t token;
+    size_t ringBytes;
+    CodecSharedMemory shm;
+};
+
+bool RemoteConnection::Request(const CodecMessage &request, CodecMessage &reply, int *passedFd)
+{
+    if (!codecSendMessage(fd, request, -1, false))
+    {
+        std::cerr << "Failed to send request: " << std::strerror(errno) << std::endl;
+        return false;
+    }
+    while (true)
+    {
+        int ret = codecRecvMessage(fd, reply, passedFd, false);
+        if (ret <= 0)
+        {
+            std::cerr << "Connection to codec server lost" << std::endl;
+            return false;
+        }
+        if (reply.type == CODEC_MSG_REPLY)
+        {
+            return true;
+        }
+        if (passedFd && *passedFd >= 0)
+        {
+            close(*passedFd);
+        }
+    }
+}
+
+// 映射回复里带回的共享内存，成功后 fd 不再需要
+static int mapSession(RemoteConnection *conn, const CodecMessage &reply, int fd, void **session)
+{
+    if (reply.status != CODEC_STATUS_OK)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return reply.status;
+    }
+    if (fd < 0)
+    {
+        return OPUS_OGG_ERR;
+    }
+    std::unique_ptr<RemoteSession> rs(new RemoteSession());
+    rs->conn = conn;
+    rs->id = reply.sessionId;
+    rs->token = reply.token;
+    rs->ringBytes = reply.ringBytes;
+    bool ok = rs->shm.Map(fd, rs->ringBytes);
+    close(fd);
+    if (!ok || rs->shm.header->magic != CODEC_SHM_MAGIC || rs->shm.header->version != CODEC_SHM_VERSION ||
+        rs->shm.header->ringBytes != rs->ringBytes)
+    {
+        std::cerr << "Invalid shared memory for session " << rs->id << std::endl;
+        return OPUS_OGG_ERR;
+    }
+    conn->sessions.insert(rs.get());
+    *session = rs.release();
+    return OPUS_OGG_OK;
+}
+
+static void kick(RemoteSession *rs)
+{
+    CodecMessage message = {};
+    message.type = CODEC_MSG_KICK;
+    message.sessionId = rs->id;
+    codecSendMessage(rs->conn->fd, message, -1, false);
+}
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+    int OpusOggRemoteConnect(const char *socketPath, void **conn)
+    {
+        if (!conn)
+        {
+            return OPUS_OGG_ERR;
+        }
+        const char *path = socketPath ? socketPath : CODEC_SERVER_SOCKET;
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (std::strlen(path) >= sizeof(addr.sun_path))
+        {
+            return OPUS_OGG_ERR;
+        }
+        std::strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+        std::unique_ptr<RemoteConnection> rc(new RemoteConnection());
+        rc->fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if (rc->fd < 0 || connect(rc->fd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0)
+        {
+            std::cerr << "Failed to connect to " << path << ": " << std::strerror(errno) << std::endl;
+            return OPUS_OGG_ERR;
+        }
+        *conn = rc.release();
+        return OPUS_OGG_OK;
+    }
+
+    int OpusOggRemoteDisconnect(void **conn)
+    {
+        if (!conn || !*conn)
+        {
+            return OPUS_OGG_OK;
+        }
+        RemoteConnection *rc = static_cast<RemoteConnection *>(*conn);
+        for (RemoteSession *rs : rc->sessions)
+        {
+            delete rs;
+        }
+        delete rc;
+        *conn = nullptr;
+        return OPUS_OGG_OK;
+    }
+
+    int OpusOggRemoteOpen(void *conn, int op, int sampleRate, int channels, int mappingFamily, int pagePolicy, int pageValue, int ringBytes, void **session)
+    {
+        if (!conn || !session || ringBytes < 0)
+        {
+            return OPUS_OGG_ERR;
+        }
+        RemoteConnection *rc = static_cast<RemoteConnection *>(conn);
+        CodecMessage request = {};
+        request.type = CODEC_MSG_OPEN;
+        request.op = op;
+        request.sampleRate = sampleRate;
+        request.channels = channels;
+        request.mappingFamily = mappingFamily;
+        request.pagePolicy = pagePolicy;
+        request.pageValue = pageValue;
+        request.ringBytes = ringBytes;
+        CodecMessage reply;
+        int fd = -1;
+        if (!rc->Request(request, reply, &fd))
+        {
+            return OPUS_OGG_ERR;
+        }
+        return mapSession(rc, reply, fd, session);
+    }
+
+    int OpusOggRemoteAttach(void *conn, unsigned long long id, unsigned long long token, void **session)
+    {
+        if (!conn || !session)
+        {
+            return OPUS_OGG_ERR;
+        }
+        RemoteConnection *rc = static_cast<RemoteConnection *>(conn);
+        CodecMessage request = {};
+        request.type = CODEC_MSG_ATTACH;
+        request.sessionId = id;
+        request.token = token;
+        CodecMessage reply;
+        int fd = -1;
+        if (!rc->Request(request, reply, &fd))
+        {
+            return OPUS_OGG_ERR;
+        }
+        return mapSession(rc, reply, fd, session);
+    }
+
+    int OpusOggRemoteSessionInfo(void *session, unsigned long long *id, unsigned long long *token)
+    {
+        if (!session || !id || !token)
+        {
+            return OPUS_OGG_ERR;
+        }
+        RemoteSession *rs = static_cast<RemoteSession *>(session);
+        *id = rs->id;
+        *token = rs->token;
+        return OPUS_OGG_OK;
+    }
+
+    int OpusOggRemoteWrite(void *session, const char *input, int inputLen, bool last)
+    {
+        if (!session || inputLen < 0 || (inputLen > 0 && !input))
+        {
+            return OPUS_OGG_ERR;
+        }
+        RemoteSession *rs = static_cast<RemoteSession *>(session);
+        CodecSharedHeader *header = rs->shm.header;
+        CodecRing &ring = header->input;
+        if (codecLoad(reinterpret_cast<uint32_t *>(&header->status)) != 0)
+        {
+            return static_cast<int32_t>(codecLoad(reinterpret_cast<uint32_t *>(&header->status)));
+        }
+        if (ring.closed)
+        {
+            return OPUS_OGG_ERR;
+        }
+
+        uint64_t head = ring.head;
+        size_t space = rs->ringBytes - (head - codecLoad(&ring.tail));
+        size_t n = std::min(space, static_cast<size_t>(inputLen));
+        // 环映射了两次，跨过环尾的写入也是一次连续拷贝
+        std::memcpy(rs->shm.input + head % rs->ringBytes, input, n);
+        codecStore(&ring.head, head + n);
+        if (last && n == static_cast<size_t>(inputLen))
+        {
+            codecStore(&ring.closed, 1);
+        }
+        if ((n > 0 || ring.closed) && codecLoad(&header->waitInput))
+        {
+            kick(rs);
+        }
+        return static_cast<int>(n);
+    }
+
+    int OpusOggRemoteRead(void *session, char *output, int outputCap, int timeoutMs, bool *finished)
+    {
+        if (!session || !output || outputCap < 0 || !finished)
+        {
+            return OPUS_OGG_ERR;
+        }
+        RemoteSession *rs = static_cast<RemoteSession *>(session);
+        CodecSharedHeader *header = rs->shm.header;
+        CodecRing &ring = header->output;
+        *finished = false;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+        while (true)
+        {
+            uint64_t tail = ring.tail;
+            bool closed = codecLoad(&ring.closed) != 0;
+            size_t available = codecLoad(&ring.head) - tail;
+            if (available > 0)
+            {
+                size_t n = std::min(available, static_cast<size_t>(outputCap));
+                std::memcpy(output, rs->shm.output + tail % rs->ringBytes, n);
+                codecStore(&ring.tail, tail + n);
+                if (codecLoad(&header->waitOutput))
+                {
+                    kick(rs);
+                }
+                *finished = closed && n == available;
+                return static_cast<int>(n);
+            }
+            int32_t status = static_cast<int32_t>(codecLoad(reinterpret_cast<uint32_t *>(&header->status)));
+            if (status != 0)
+            {
+                return status;
+            }
+            if (closed)
+            {
+                *finished = true;
+                return 0;
+            }
+
+            int wait = 0;
+            if (timeoutMs < 0)
+            {
+                wait = -1;
+            }
+            else
+            {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now()).count();
+                if (left <= 0)
+                {
+                    return 0;
+                }
+                wait = static_cast<int>(left);
+            }
+
+            // 置标志后重新检查，服务端在这之前产生的输出不会漏掉；之后的输出会带来 EVENT
+            codecStore(&header->clientWaiting, 1);
+            if (codecLoad(&ring.head) == tail && !codecLoad(&ring.closed) && codecLoad(reinterpret_cast<uint32_t *>(&header->status)) == 0)
+            {
+                struct pollfd pfd = {rs->conn->fd, POLLIN, 0};
+                if (poll(&pfd, 1, wait) < 0 && errno != EINTR)
+                {
+                    codecStore(&header->clientWaiting, 0);
+                    return OPUS_OGG_ERR;
+                }
+                if (pfd.revents & (POLLHUP | POLLERR))
+                {
+                    codecStore(&header->clientWaiting, 0);
+                    return OPUS_OGG_ERR;
+                }
+            }
+            codecStore(&header->clientWaiting, 0);
+
+            // EVENT 只是唤醒，取完即可；同一连接上其他会话的 EVENT 也一起清掉，它们的状态都在共享内存里
+            CodecMessage event;
+            int fd;
+            while (codecRecvMessage(rs->conn->fd, event, &fd, true) > 0)
+            {
+                if (fd >= 0)
+                {
+                    close(fd);
+                }
+            }
+        }
+    }
+
+    int OpusOggRemoteClose(void **session)
+    {
+        if (!session || !*session)
+        {
+            return OPUS_OGG_OK;
+        }
+        RemoteSession *rs = static_cast<RemoteSession *>(*session);
+        RemoteConnection *rc = rs->conn;
+        CodecMessage request = {};
+        request.type = CODEC_MSG_CLOSE;
+        request.sessionId = rs->id;
+        CodecMessage reply;
+        int ret = rc->Request(request, reply, nullptr) ? reply.status : OPUS_OGG_ERR;
+        rc->sessions.erase(rs);
+        delete rs;
+        *session = nullptr;
+        return ret;
+    }
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,738 @@
+#include "codec_server.h"
+#include "opus_ogg.h"
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <thread>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/un.h>
+
+// 本机编解码服务：多个进程通过 Unix socket 打开会话，PCM 和 Ogg 经共享内存环传递，
+// 编解码实例来自进程内共享的 OpusOggCodecPool，连接断开后会话保留一段时间，重启的进程可以 ATTACH 接管
+//
+// 用法: codec_server [-socket path] [-workers n] [-pin] [-maxSessions n] [-maxMemoryMB n] [-linger seconds] [-cpuBudget percent]
+// -cpuBudget 开启复杂度调节器，会话在负载高时逐级降低编码复杂度
+
+struct ServerConfig
+{
+    std::string socketPath = CODEC_SERVER_SOCKET;
+    int workers = 0;               // 0 表示按可用核数
+    bool pin = false;              // 第i个工作线程绑定到第i个可用核
+    int maxSessions = 256;         // 每个用户同时打开的会话数
+    size_t maxMemoryBytes = 1024u * 1024 * 1024; // 每个用户所有会话的共享内存总量
+    int lingerSeconds = 30;        // 连接断开后会话保留的秒数，0 表示立即结束
+    int cpuBudget = 0;             // 复杂度调节器的进程 CPU 预算百分比，0 表示不调节
+};
+
+struct Connection;
+
+struct Session
+{
+    uint64_t id;
+    uint64_t token;
+    uid_t uid;
+    int op;
+    int memfd = -1;
+    size_t ringBytes;
+    size_t memoryBytes;
+    CodecSharedMemory shm;
+    OpusOggCodec *codec = nullptr;
+    Connection *owner = nullptr; // 为空表示连接已断开，等待 ATTACH
+    std::chrono::steady_clock::time_point detachedAt;
+    bool pendingOutput = false;  // 解码输出没取完，下次以空输入继续
+    bool pendingLast = false;    // 上一次解码调用的 last
+    bool finished = false;
+    // 服务端自己推进的位置，共享内存里的只是发布给客户端的副本，客户端能改写，不能读回来用
+    uint64_t inTail = 0;
+    uint64_t outHead = 0;
+
+    ~Session()
+    {
+        OpusOggCodecPool::GetInstance()->Release(codec);
+        if (memfd >= 0)
+        {
+            close(memfd);
+        }
+    }
+
+    bool Process();
+
+private:
+    bool inputAvailable(size_t &available);
+    bool outputSpace(size_t &space);
+    void fail(int status);
+};
+
+struct Connection
+{
+    int fd;
+    uid_t uid;
+    pid_t pid;
+    std::map<uint64_t, std::shared_ptr<Session>> sessions;
+};
+
+// 客户端写的 in.head、out.tail 不可信，超出环大小时会话出错，不会越界读写
+bool Session::inputAvailable(size_t &available)
+{
+    uint64_t used = codecLoad(&shm.header->input.head) - inTail;
+    if (used > ringBytes)
+    {
+        return false;
+    }
+    available = used;
+    return true;
+}
+
+bool Session::outputSpace(size_t &space)
+{
+    uint64_t used = outHead - codecLoad(&shm.header->output.tail);
+    if (used > ringBytes)
+    {
+        return false;
+    }
+    space = ringBytes - used;
+    return true;
+}
+
+void Session::fail(int status)
+{
+    CodecSharedHeader *header = shm.header;
+    std::cerr << "Session " << id << " failed: " << status << std::endl;
+    codecStore(reinterpret_cast<uint32_t *>(&header->status), static_cast<uint32_t>(status));
+    finished = true;
+    codecStore(&header->output.closed, 1);
+    codecStore(&header->finished, 1);
+}
+
+// 处理能处理的全部输入，直到缺输入或缺输出空间；返回是否有进展
+bool Session::Process()
+{
+    CodecSharedHeader *header = shm.header;
+    CodecRing &in = header->input;
+    CodecRing &out = header->output;
+    bool progress = false;
+    while (!finished)
+    {
+        bool closed = codecLoad(&in.closed) != 0; // 先读 closed 再读 head，closed 时 head 已是最终值
+        size_t available = 0;
+        size_t space = 0;
+        if (!inputAvailable(available) || !outputSpace(space))
+        {
+            fail(OPUS_OGG_ERR);
+            return true;
+        }
+        // 到这里 available、space 都不超过 ringBytes(最大 CODEC_MAX_RING_BYTES)，传给接口时转成 int 不会溢出
+        const char *src = shm.input + inTail % ringBytes;
+        char *dst = shm.output + outHead % ringBytes;
+
+        size_t consumed = 0;
+        int outputLen = 0;
+        int ret = OPUS_OGG_OK;
+        bool last = false;
+        bool needOutput = false;
+        if (op == CODEC_SESSION_ENCODE)
+        {
+            // 输出空间放不下最坏情况时减少本次的输入，EncodeInto 不会因为容量失败
+            size_t n = available;
+            last = closed;
+            while (n > 0 && codec->EncodeBound(n, last) > space)
+            {
+                n /= 2;
+                last = false;
+            }
+            if (n == 0 && last && codec->EncodeBound(0, true) > space)
+            {
+                last = false; // 结尾的页面也要等输出空间
+            }
+            if (n == 0 && !last)
+            {
+                needOutput = available > 0 || closed;
+                if (!needOutput)
+                {
+                    codecStore(&header->waitInput, 1);
+                    // 置标志后重新检查，客户端在这之前写入的数据不会被漏掉
+                    if (codecLoad(&in.head) != inTail || codecLoad(&in.closed) != static_cast<uint32_t>(closed))
+                    {
+                        codecStore(&header->waitInput, 0);
+                        continue;
+                    }
+                    break;
+                }
+            }
+            else
+            {
+                ret = OpusOggCodecEncodeInto(codec, src, static_cast<int>(n), dst, static_cast<int>(space), &outputLen, last);
+                consumed = n;
+            }
+        }
+        else
+        {
+            if (space < codec->DecodeBound())
+            {
+                needOutput = true;
+            }
+            else
+            {
+                size_t n = pendingOutput ? 0 : available;
+                last = pendingOutput ? pendingLast : closed;
+                if (n == 0 && !pendingOutput && !last)
+                {
+                    codecStore(&header->waitInput, 1);
+                    if (codecLoad(&in.head) != inTail || codecLoad(&in.closed) != static_cast<uint32_t>(closed))
+                    {
+                        codecStore(&header->waitInput, 0);
+                        continue;
+                    }
+                    break;
+                }
+                ret = OpusOggCodecDecodeInto(codec, src, static_cast<int>(n), dst, static_cast<int>(space), &outputLen, last);
+                if (ret == OPUS_OGG_ERR_BUFFER_TOO_SMALL)
+                {
+                    outputLen = 0;
+                }
+                pendingOutput = ret == OPUS_OGG_MORE_OUTPUT || ret == OPUS_OGG_ERR_BUFFER_TOO_SMALL;
+                pendingLast = last;
+                consumed = n;
+                if (pendingOutput)
+                {
+                    ret = OPUS_OGG_OK;
+                    last = false; // 输出取完之前还不算结束
+                }
+            }
+        }
+
+        if (needOutput)
+        {
+            codecStore(&header->waitOutput, 1);
+            size_t now = 0;
+            if (!outputSpace(now) || now != space)
+            {
+                codecStore(&header->waitOutput, 0);
+                continue;
+            }
+            break;
+        }
+        codecStore(&header->waitInput, 0);
+        codecStore(&header->waitOutput, 0);
+        if (ret < 0)
+        {
+            fail(ret);
+            return true;
+        }
+        inTail += consumed;
+        outHead += outputLen;
+        codecStore(&in.tail, inTail);
+        codecStore(&out.head, outHead);
+        progress = progress || consumed > 0 || outputLen > 0;
+        if (last)
+        {
+            finished = true;
+            codecStore(&out.closed, 1);
+            codecStore(&header->finished, 1);
+            progress = true;
+        }
+    }
+    return progress;
+}
+
+class CodecServer
+{
+private:
+    struct Usage
+    {
+        int sessions = 0;
+        size_t memoryBytes = 0;
+    };
+
+    struct Worker
+    {
+        int epollFd = -1;
+        int wakeFd = -1; // 主线程交给工作线程新连接时写入
+        std::mutex mutex;
+        std::vector<Connection *> incoming;
+        std::map<int, std::unique_ptr<Connection>> connections;
+        std::thread thread;
+    };
+
+    ServerConfig config;
+    int listenFd = -1;
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<bool> stopping;
+
+    // 所有会话和每个用户的用量，OPEN/ATTACH/CLOSE/断开和回收时加锁
+    std::mutex registryMutex;
+    std::map<uint64_t, std::shared_ptr<Session>> registry;
+    std::map<uid_t, Usage> usage;
+    std::mt19937_64 random;
+    uint64_t nextSessionId = 1;
+
+    void workerLoop(Worker *worker, int cpu);
+    void handleMessage(Connection *conn, const CodecMessage &message);
+    void openSession(Connection *conn, const CodecMessage &message);
+    void attachSession(Connection *conn, const CodecMessage &message);
+    void closeSession(Connection *conn, const CodecMessage &message);
+    void disconnect(Worker *worker, Connection *conn);
+    void removeSession(const std::shared_ptr<Session> &session);
+    void process(Connection *conn, Session *session);
+    void reapDetached();
+
+public:
+    explicit CodecServer(const ServerConfig &config) : config(config), stopping(false), random(std::random_device()()) {}
+    int Run();
+    void Stop()
+    {
+        stopping.store(true);
+    }
+};
+
+static CodecServer *serverInst = nullptr;
+
+static void onSignal(int)
+{
+    if (serverInst)
+    {
+        serverInst->Stop();
+    }
+}
+
+void CodecServer::process(Connection *conn, Session *session)
+{
+    // 客户端在等待时才发 EVENT，发不出去说明它的接收缓冲区里已有未读的 EVENT，同样会被唤醒
+    if (session->Process() && codecLoad(&session->shm.header->clientWaiting))
+    {
+        CodecMessage event = {};
+        event.type = CODEC_MSG_EVENT;
+        event.sessionId = session->id;
+        codecSendMessage(conn->fd, event, -1, true);
+    }
+}
+
+void CodecServer::openSession(Connection *conn, const CodecMessage &message)
+{
+    CodecMessage reply = {};
+    reply.type = CODEC_MSG_REPLY;
+    reply.status = OPUS_OGG_ERR;
+
+    size_t page = codecPageSize();
+    size_t ringBytes = message.ringBytes ? message.ringBytes : CODEC_DEFAULT_RING_BYTES;
+    ringBytes = (ringBytes + page - 1) / page * page;
+    if ((message.op != CODEC_SESSION_ENCODE && message.op != CODEC_SESSION_DECODE) || ringBytes > CODEC_MAX_RING_BYTES ||
+        message.channels < 1 || message.channels > MAX_CHANNELS)
+    {
+        codecSendMessage(conn->fd, reply, -1, false);
+        return;
+    }
+
+    std::shared_ptr<Session> session(new Session());
+    session->uid = conn->uid;
+    session->op = message.op;
+    session->ringBytes = ringBytes;
+    session->memoryBytes = CodecSharedMemory::FileSize(ringBytes);
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        Usage &used = usage[conn->uid];
+        if (used.sessions >= config.maxSessions || used.memoryBytes + session->memoryBytes > config.maxMemoryBytes)
+        {
+            reply.status = CODEC_STATUS_QUOTA;
+            codecSendMessage(conn->fd, reply, -1, false);
+            return;
+        }
+        used.sessions++;
+        used.memoryBytes += session->memoryBytes;
+        session->id = nextSessionId++;
+        session->token = random();
+    }
+
+    session->codec = OpusOggCodecPool::GetInstance()->Acquire(message.sampleRate, message.channels, 480, message.mappingFamily);
+    session->memfd = memfd_create("opus_ogg_session", MFD_CLOEXEC);
+    bool ok = session->codec && session->memfd >= 0 && ftruncate(session->memfd, session->memoryBytes) == 0 &&
+              session->shm.Map(session->memfd, ringBytes);
+    if (ok && message.op == CODEC_SESSION_ENCODE)
+    {
+        ok = session->codec->SetPagePolicy(static_cast<PagePolicy>(message.pagePolicy), message.pageValue);
+    }
+    if (!ok)
+    {
+        std::cerr << "Failed to open session for pid " << conn->pid << std::endl;
+        std::lock_guard<std::mutex> lock(registryMutex);
+        Usage &used = usage[conn->uid];
+        used.sessions--;
+        used.memoryBytes -= session->memoryBytes;
+        codecSendMessage(conn->fd, reply, -1, false);
+        return;
+    }
+
+    CodecSharedHeader *header = session->shm.header;
+    header->magic = CODEC_SHM_MAGIC;
+    header->version = CODEC_SHM_VERSION;
+    header->headerBytes = page;
+    header->ringBytes = ringBytes;
+    header->waitInput = 1; // 还没有输入，客户端第一次写入就发 KICK
+    session->owner = conn;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry[session->id] = session;
+    }
+    conn->sessions[session->id] = session;
+
+    reply.status = CODEC_STATUS_OK;
+    reply.sessionId = session->id;
+    reply.token = session->token;
+    reply.ringBytes = ringBytes;
+    codecSendMessage(conn->fd, reply, session->memfd, false);
+}
+
+void CodecServer::attachSession(Connection *conn, const CodecMessage &message)
+{
+    CodecMessage reply = {};
+    reply.type = CODEC_MSG_REPLY;
+    reply.status = CODEC_STATUS_NOT_FOUND;
+    std::shared_ptr<Session> session;
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        auto it = registry.find(message.sessionId);
+        // 只能接管同一用户、已经断开连接的会话
+        if (it != registry.end() && it->second->token == message.token && it->second->uid == conn->uid && !it->second->owner)
+        {
+            session = it->second;
+            session->owner = conn;
+        }
+    }
+    if (!session)
+    {
+        codecSendMessage(conn->fd, reply, -1, false);
+        return;
+    }
+    conn->sessions[session->id] = session;
+    reply.status = CODEC_STATUS_OK;
+    reply.sessionId = session->id;
+    reply.token = session->token;
+    reply.ringBytes = session->ringBytes;
+    codecSendMessage(conn->fd, reply, session->memfd, false);
+    // 断开期间客户端可能已经写入，接管后继续处理
+    process(conn, session.get());
+}
+
+void CodecServer::removeSession(const std::shared_ptr<Session> &session)
+{
+    std::lock_guard<std::mutex> lock(registryMutex);
+    registry.erase(session->id);
+    Usage &used = usage[session->uid];
+    used.sessions--;
+    used.memoryBytes -= session->memoryBytes;
+}
+
+void CodecServer::closeSession(Connection *conn, const CodecMessage &message)
+{
+    CodecMessage reply = {};
+    reply.type = CODEC_MSG_REPLY;
+    reply.sessionId = message.sessionId;
+    reply.status = CODEC_STATUS_NOT_FOUND;
+    auto it = conn->sessions.find(message.sessionId);
+    if (it != conn->sessions.end())
+    {
+        removeSession(it->second);
+        conn->sessions.erase(it);
+        reply.status = CODEC_STATUS_OK;
+    }
+    codecSendMessage(conn->fd, reply, -1, false);
+}
+
+void CodecServer::handleMessage(Connection *conn, const CodecMessage &message)
+{
+    switch (message.type)
+    {
+    case CODEC_MSG_OPEN:
+        openSession(conn, message);
+        break;
+    case CODEC_MSG_ATTACH:
+        attachSession(conn, message);
+        break;
+    case CODEC_MSG_KICK:
+    {
+        auto it = conn->sessions.find(message.sessionId);
+        if (it != conn->sessions.end())
+        {
+            process(conn, it->second.get());
+        }
+        break;
+    }
+    case CODEC_MSG_CLOSE:
+        closeSession(conn, message);
+        break;
+    default:
+        std::cerr << "Unknown message " << message.type << " from pid " << conn->pid << std::endl;
+        break;
+    }
+}
+
+void CodecServer::disconnect(Worker *worker, Connection *conn)
+{
+    // 会话不随连接结束，保留 linger 秒等待重启的进程接管
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        for (auto &entry : conn->sessions)
+        {
+            entry.second->owner = nullptr;
+            entry.second->detachedAt = std::chrono::steady_clock::now();
+        }
+    }
+    if (config.lingerSeconds <= 0)
+    {
+        for (auto &entry : conn->sessions)
+        {
+            removeSession(entry.second);
+        }
+    }
+    epoll_ctl(worker->epollFd, EPOLL_CTL_DEL, conn->fd, nullptr);
+    close(conn->fd);
+    worker->connections.erase(conn->fd);
+}
+
+void CodecServer::reapDetached()
+{
+    std::vector<std::shared_ptr<Session>> expired; // 在锁外释放，归还编解码实例
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    for (auto it = registry.begin(); it != registry.end();)
+    {
+        Session *session = it->second.get();
+        if (!session->owner && now - session->detachedAt >= std::chrono::seconds(config.lingerSeconds))
+        {
+            Usage &used = usage[session->uid];
+            used.sessions--;
+            used.memoryBytes -= session->memoryBytes;
+            expired.push_back(it->second);
+            it = registry.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+}
+
+void CodecServer::workerLoop(Worker *worker, int cpu)
+{
+    if (cpu >= 0)
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+        {
+            std::cerr << "Failed to pin worker to cpu " << cpu << std::endl;
+        }
+    }
+
+    struct epoll_event events[64];
+    while (!stopping.load())
+    {
+        int n = epoll_wait(worker->epollFd, events, 64, 500);
+        for (int i = 0; i < n; i++)
+        {
+            int fd = events[i].data.fd;
+            if (fd == worker->wakeFd)
+            {
+                uint64_t counter;
+                if (read(worker->wakeFd, &counter, sizeof(counter)) < 0 && errno != EAGAIN)
+                {
+                    std::cerr << "Failed to read eventfd" << std::endl;
+                }
+                std::vector<Connection *> incoming;
+                {
+                    std::lock_guard<std::mutex> lock(worker->mutex);
+                    incoming.swap(worker->incoming);
+                }
+                for (Connection *conn : incoming)
+                {
+                    worker->connections[conn->fd].reset(conn);
+                    struct epoll_event event = {};
+                    event.events = EPOLLIN;
+                    event.data.fd = conn->fd;
+                    epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, conn->fd, &event);
+                }
+                continue;
+            }
+
+            auto it = worker->connections.find(fd);
+            if (it == worker->connections.end())
+            {
+                continue;
+            }
+            Connection *conn = it->second.get();
+            while (true)
+            {
+                CodecMessage message;
+                int passedFd;
+                int ret = codecRecvMessage(fd, message, &passedFd, true);
+                if (passedFd >= 0)
+                {
+                    close(passedFd); // 客户端不应该传 fd 过来
+                }
+                if (ret > 0)
+                {
+                    handleMessage(conn, message);
+                    continue;
+                }
+                if (ret == 0 || (errno != EAGAIN && errno != EWOULDBLOCK))
+                {
+                    disconnect(worker, conn);
+                }
+                break;
+            }
+        }
+    }
+
+    for (auto &entry : worker->connections)
+    {
+        close(entry.first);
+    }
+    worker->connections.clear();
+}
+
+int CodecServer::Run()
+{
+    listenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (listenFd < 0 || config.socketPath.size() >= sizeof(addr.sun_path))
+    {
+        std::cerr << "Invalid socket path: " << config.socketPath << std::endl;
+        return 1;
+    }
+    std::strncpy(addr.sun_path, config.socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    unlink(config.socketPath.c_str());
+    if (bind(listenFd, reinterpret_cast<struct sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listenFd, 128) != 0)
+    {
+        std::cerr << "Failed to listen on " << config.socketPath << ": " << std::strerror(errno) << std::endl;
+        return 1;
+    }
+
+    std::vector<int> cpus;
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        {
+            if (CPU_ISSET(cpu, &allowed))
+            {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+    int workerCount = config.workers > 0 ? config.workers : std::max<int>(1, cpus.size());
+    for (int i = 0; i < workerCount; i++)
+    {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->epollFd = epoll_create1(EPOLL_CLOEXEC);
+        worker->wakeFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.fd = worker->wakeFd;
+        epoll_ctl(worker->epollFd, EPOLL_CTL_ADD, worker->wakeFd, &event);
+        int cpu = config.pin && !cpus.empty() ? cpus[i % cpus.size()] : -1;
+        worker->thread = std::thread(&CodecServer::workerLoop, this, worker.get(), cpu);
+        workers.push_back(std::move(worker));
+    }
+    std::cerr << "Listening on " << config.socketPath << " with " << workerCount << " workers" << std::endl;
+
+    // 主线程接受连接，按轮转交给工作线程，连接上的消息和会话都由该线程处理；每秒回收一次过期的会话
+    size_t next = 0;
+    while (!stopping.load())
+    {
+        struct pollfd pfd = {listenFd, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) > 0)
+        {
+            int fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd >= 0)
+            {
+                struct ucred cred = {};
+                socklen_t len = sizeof(cred);
+                getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len);
+                Connection *conn = new Connection{fd, cred.uid, cred.pid, {}};
+                Worker *worker = workers[next++ % workers.size()].get();
+                {
+                    std::lock_guard<std::mutex> lock(worker->mutex);
+                    worker->incoming.push_back(conn);
+                }
+                uint64_t one = 1;
+                if (write(worker->wakeFd, &one, sizeof(one)) < 0)
+                {
+                    std::cerr << "Failed to wake worker" << std::endl;
+                }
+            }
+        }
+        reapDetached();
+    }
+
+    for (auto &worker : workers)
+    {
+        worker->thread.join();
+        close(worker->epollFd);
+        close(worker->wakeFd);
+        for (Connection *conn : worker->incoming)
+        {
+            close(conn->fd);
+            delete conn;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(registryMutex);
+        registry.clear();
+    }
+    close(listenFd);
+    unlink(config.socketPath.c_str());
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    ServerConfig config;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg(argv[i]);
+        bool hasValue = i + 1 < argc;
+        if (arg == "-socket" && hasValue)
+            config.socketPath = argv[++i];
+        else if (arg == "-workers" && hasValue)
+            config.workers = std::atoi(argv[++i]);
+        else if (arg == "-pin")
+            config.pin = true;
+        else if (arg == "-maxSessions" && hasValue)
+            config.maxSessions = std::atoi(argv[++i]);
+        else if (arg == "-maxMemoryMB" && hasValue)
+            config.maxMemoryBytes = static_cast<size_t>(std::atoi(argv[++i])) * 1024 * 1024;
+        else if (arg == "-linger" && hasValue)
+            config.lingerSeconds = std::atoi(argv[++i]);
+        else if (arg == "-cpuBudget" && hasValue)
+            config.cpuBudget = std::atoi(argv[++i]);
+        else
+        {
+            std::cerr << "Usage: " << argv[0] << " [-socket path] [-workers n] [-pin] [-maxSessions n] [-maxMemoryMB n] [-linger seconds] [-cpuBudget percent]" << std::endl;
+            return 1;
+        }
+    }
+    // 单帧耗时上限为帧时长的 20%，最低降到复杂度 2，再不够时关闭 FEC/DRED
+    if (config.cpuBudget > 0 && !ComplexityGovernor::GetInstance()->Start(config.cpuBudget, 20, 2, true, 200))
+    {
+        std::cerr << "Invalid cpu budget: " << config.cpuBudget << std::endl;
+        return 1;
+    }
+
+    CodecServer server(config);
+    serverInst = &server;
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+    signal(SIGPIPE, SIG_IGN);
+    return server.Run();
+}
@@ -0,0 +1,250 @@
+#ifndef CODEC_SERVER_H
+#define CODEC_SERVER_H
+
+// 本机编解码服务的协议，服务端 codec_server 和客户端接口 OpusOggRemote* 共用
+//
+// 控制消息走 Unix SOCK_SEQPACKET，每条消息是一个 CodecMessage；PCM 和 Ogg 数据不经过 socket，
+// 而是放在每个会话一块的共享内存里，OPEN/ATTACH 的回复用 SCM_RIGHTS 带上这块内存的 memfd
+//
+// 共享内存布局: [CodecSharedHeader，占一页][输入环 ringBytes][输出环 ringBytes]
+// 两个环都被连续映射两次，跨过环尾的读写在地址上也是连续的，编解码可以直接读写环内数据
+// 输入环由客户端写、服务端读，输出环由服务端写、客户端读，head/tail 是累计字节数，只由各自一方修改
+// 服务端自己的位置保存在进程内，不从共享内存读回；客户端写的位置与服务端相差超过环大小时会话以 OPUS_OGG_ERR 结束
+//
+// 流控:
+// - 输出环放不下最坏情况的输出时服务端不再消费输入，输入环写满后客户端的 Write 返回 0，形成背压
+// - 服务端因缺输入或缺输出空间停下时置 waitInput/waitOutput，客户端写入或读出后看到标志才发 KICK
+// - 客户端阻塞等待前置 clientWaiting，服务端有进展时看到标志才发 EVENT
+// 标志和位置都用顺序一致的原子操作，设置标志后重新检查一次条件，不会漏掉通知
+
+#include <cstddef>
+#include <cstdint>
+#include <cerrno>
+#include <string>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#define CODEC_SERVER_SOCKET "/tmp/opus_ogg_codec.sock"
+#define CODEC_SHM_MAGIC 0x4F4F5348 // "OOSH"
+#define CODEC_SHM_VERSION 1
+#define CODEC_DEFAULT_RING_BYTES (256 * 1024)
+#define CODEC_MAX_RING_BYTES (64 * 1024 * 1024)
+
+// 消息类型
+#define CODEC_MSG_OPEN 1   // 客户端: 新建会话，回复带 memfd
+#define CODEC_MSG_ATTACH 2 // 客户端: 按 sessionId/token 接管已断开连接的会话，回复带 memfd
+#define CODEC_MSG_KICK 3   // 客户端: 有新输入或腾出了输出空间
+#define CODEC_MSG_CLOSE 4  // 客户端: 结束会话
+#define CODEC_MSG_REPLY 5  // 服务端: OPEN/ATTACH/CLOSE 的回复，status 为结果
+#define CODEC_MSG_EVENT 6  // 服务端: 会话有进展，只是唤醒，状态在共享内存里
+
+// 会话类型
+#define CODEC_SESSION_ENCODE 0 // 输入 PCM，输出 Ogg Opus
+#define CODEC_SESSION_DECODE 1 // 输入 Ogg Opus，输出 PCM
+
+// REPLY 的 status，其余为 OPUS_OGG_ERR
+#define CODEC_STATUS_OK 0
+#define CODEC_STATUS_QUOTA -10     // 超过该用户的会话数或共享内存配额
+#define CODEC_STATUS_NOT_FOUND -11 // ATTACH 的会话不存在、token 不对或仍被其他连接持有
+
+struct CodecMessage
+{
+    uint32_t type;
+    uint32_t op; // OPEN: CODEC_SESSION_*
+    uint64_t sessionId;
+    uint64_t token; // OPEN 的回复里生成，ATTACH 时需要
+    int32_t sampleRate;
+    int32_t channels;
+    int32_t mappingFamily;
+    int32_t pagePolicy; // OPEN: 编码会话的 OPUS_OGG_PAGE_*，流式场景用 OPUS_OGG_PAGE_PER_PACKET
+    int32_t pageValue;
+    int32_t status;
+    uint32_t ringBytes; // OPEN: 每个环的大小，按页向上取整；回复里是实际大小
+    uint32_t reserved;
+};
+
+struct CodecRing
+{
+    uint64_t head; // 写入方累计写入的字节数
+    char pad0[56];
+    uint64_t tail; // 读取方累计读走的字节数
+    char pad1[56];
+    uint32_t closed; // 写入方不再写入
+    char pad2[60];
+};
+
+struct CodecSharedHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t headerBytes;
+    uint32_t ringBytes;
+    int32_t status;         // 服务端编解码出错时写入错误码，会话不再处理
+    uint32_t finished;      // 服务端已处理完全部输入，输出环也已关闭
+    uint32_t waitInput;     // 服务端在等输入
+    uint32_t waitOutput;    // 服务端在等输出空间
+    uint32_t clientWaiting; // 客户端在等 EVENT
+    char pad[28];
+    CodecRing input;
+    CodecRing output;
+};
+
+inline uint64_t codecLoad(const uint64_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+inline uint32_t codecLoad(const uint32_t *p)
+{
+    return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+}
+
+inline void codecStore(uint64_t *p, uint64_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+inline void codecStore(uint32_t *p, uint32_t v)
+{
+    __atomic_store_n(p, v, __ATOMIC_SEQ_CST);
+}
+
+inline size_t codecPageSize()
+{
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+}
+
+// 会话共享内存的一次映射，两个环各自连续映射两次
+class CodecSharedMemory
+{
+private:
+    void *base;
+    size_t length; // 保留的地址空间大小
+
+public:
+    CodecSharedHeader *header;
+    char *input;
+    char *output;
+
+    CodecSharedMemory() : base(MAP_FAILED), length(0), header(nullptr), input(nullptr), output(nullptr) {}
+    ~CodecSharedMemory()
+    {
+        Unmap();
+    }
+
+    CodecSharedMemory(const CodecSharedMemory &) = delete;
+    CodecSharedMemory &operator=(const CodecSharedMemory &) = delete;
+
+    static size_t FileSize(size_t ringBytes)
+    {
+        return codecPageSize() + 2 * ringBytes;
+    }
+
+    // ringBytes 必须是页大小的倍数
+    bool Map(int fd, size_t ringBytes)
+    {
+        Unmap();
+        size_t page = codecPageSize();
+        length = page + 4 * ringBytes;
+        // 先保留整段地址空间，再用 MAP_FIXED 把文件的各部分映射到固定位置
+        base = mmap(nullptr, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (base == MAP_FAILED)
+        {
+            return false;
+        }
+        char *p = static_cast<char *>(base);
+        const off_t offsets[] = {0, static_cast<off_t>(page), static_cast<off_t>(page), static_cast<off_t>(page + ringBytes), static_cast<off_t>(page + ringBytes)};
+        const size_t sizes[] = {page, ringBytes, ringBytes, ringBytes, ringBytes};
+        size_t position = 0;
+        for (int i = 0; i < 5; i++)
+        {
+            if (mmap(p + position, sizes[i], PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, offsets[i]) == MAP_FAILED)
+            {
+                Unmap();
+                return false;
+            }
+            position += sizes[i];
+        }
+        header = reinterpret_cast<CodecSharedHeader *>(p);
+        input = p + page;
+        output = p + page + 2 * ringBytes;
+        return true;
+    }
+
+    void Unmap()
+    {
+        if (base != MAP_FAILED)
+        {
+            munmap(base, length);
+            base = MAP_FAILED;
+            length = 0;
+        }
+        header = nullptr;
+        input = nullptr;
+        output = nullptr;
+    }
+};
+
+// 发送一条控制消息，fd>=0 时用 SCM_RIGHTS 一起发送；nonblock 时对方缓冲区满直接返回 false
+inline bool codecSendMessage(int sock, const CodecMessage &message, int fd, bool nonblock)
+{
+    struct iovec iov;
+    iov.iov_base = const_cast<CodecMessage *>(&message);
+    iov.iov_len = sizeof(message);
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    if (fd >= 0)
+    {
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+        *reinterpret_cast<int *>(CMSG_DATA(cmsg)) = fd;
+    }
+    ssize_t n;
+    do
+    {
+        n = sendmsg(sock, &msg, MSG_NOSIGNAL | (nonblock ? MSG_DONTWAIT : 0));
+    } while (n < 0 && errno == EINTR);
+    return n == static_cast<ssize_t>(sizeof(message));
+}
+
+// 接收一条控制消息，带 fd 时写入 *fd，否则 *fd 为 -1；返回 0 表示对方关闭，-1 出错或暂时没有消息
+inline int codecRecvMessage(int sock, CodecMessage &message, int *fd, bool nonblock)
+{
+    struct iovec iov;
+    iov.iov_base = &message;
+    iov.iov_len = sizeof(message);
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    char control[CMSG_SPACE(sizeof(int))] = {};
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    ssize_t n;
+    do
+    {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC | (nonblock ? MSG_DONTWAIT : 0));
+    } while (n < 0 && errno == EINTR);
+    if (fd)
+    {
+        *fd = -1;
+        struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+        if (n > 0 && cmsg && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            *fd = *reinterpret_cast<int *>(CMSG_DATA(cmsg));
+        }
+    }
+    if (n == 0)
+    {
+        return 0;
+    }
+    return n == static_cast<ssize_t>(sizeof(message)) ? 1 : -1;
+}
+
+#endif // CODEC_SERVER_H
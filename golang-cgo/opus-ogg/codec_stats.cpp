@@ -0,0 +1,308 @@
+#include "codec_stats.h"
+#include <cstring>
+#include <iostream>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/**** HistogramSnapshot ****/
+
+void HistogramSnapshot::Add(const LatencyHistogram &h)
+{
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        buckets[i] += h.buckets[i].load(std::memory_order_relaxed);
+    }
+    count += h.count.load(std::memory_order_relaxed);
+    sum += h.sum.load(std::memory_order_relaxed);
+    max = std::max<uint64_t>(max, h.max.load(std::memory_order_relaxed));
+}
+
+void HistogramSnapshot::Add(const HistogramSnapshot &h)
+{
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        buckets[i] += h.buckets[i];
+    }
+    count += h.count;
+    sum += h.sum;
+    max = std::max(max, h.max);
+}
+
+uint64_t HistogramSnapshot::Percentile(double p) const
+{
+    // 读取时写者可能还在更新，按各桶之和计算，避免与count不一致
+    uint64_t total = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        total += buckets[i];
+    }
+    if (total == 0)
+    {
+        return 0;
+    }
+    uint64_t rank = static_cast<uint64_t>(p * total);
+    uint64_t seen = 0;
+    for (int i = 0; i < LATENCY_BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if (seen > rank)
+        {
+            return std::min(LatencyHistogram::BucketUpperBound(i), max);
+        }
+    }
+    return max;
+}
+
+void HistogramSnapshot::Fill(OpusOggLatencyStats &out) const
+{
+    out.count = count;
+    out.sumNs = sum;
+    out.maxNs = max;
+    out.p50Ns = Percentile(0.5);
+    out.p90Ns = Percentile(0.9);
+    out.p99Ns = Percentile(0.99);
+    out.p999Ns = Percentile(0.999);
+}
+
+/**** CodecStats ****/
+
+void CodecStats::Clear()
+{
+    for (auto &counter : counters)
+    {
+        counter.store(0, std::memory_order_relaxed);
+    }
+    cachedBytes.store(0, std::memory_order_relaxed);
+    for (auto &latency : latencies)
+    {
+        latency.Clear();
+    }
+}
+
+/**** StatsSnapshot ****/
+
+void StatsSnapshot::Add(const CodecStats &stats, bool live)
+{
+    for (int i = 0; i < CodecStats::CounterCount; i++)
+    {
+        counters[i] += stats.counters[i].load(std::memory_order_relaxed);
+    }
+    for (int i = 0; i < CodecStats::LatencyCount; i++)
+    {
+        latencies[i].Add(stats.latencies[i]);
+    }
+    if (live)
+    {
+        sessions++;
+        cachedBytes += stats.cachedBytes.load(std::memory_order_relaxed);
+    }
+}
+
+void StatsSnapshot::Add(const StatsSnapshot &other)
+{
+    sessions += other.sessions;
+    for (int i = 0; i < CodecStats::CounterCount; i++)
+    {
+        counters[i] += other.counters[i];
+    }
+    cachedBytes += other.cachedBytes;
+    for (int i = 0; i < CodecStats::LatencyCount; i++)
+    {
+        latencies[i].Add(other.latencies[i]);
+    }
+}
+
+void StatsSnapshot::Fill(OpusOggCodecStatsData &out) const
+{
+    out.sessions = sessions;
+    out.framesEncoded = counters[CodecStats::FramesEncoded];
+    out.framesDecoded = counters[CodecStats::FramesDecoded];
+    out.encodeInputBytes = counters[CodecStats::EncodeInputBytes];
+    out.encodeOutputBytes = counters[CodecStats::EncodeOutputBytes];
+    out.decodeInputBytes = counters[CodecStats::DecodeInputBytes];
+    out.decodeOutputBytes = counters[CodecStats::DecodeOutputBytes];
+    out.cachedBytes = cachedBytes;
+    out.pagesEmitted = counters[CodecStats::PagesEmitted];
+    out.encodeErrors = counters[CodecStats::EncodeErrors];
+    out.decodeErrors = counters[CodecStats::DecodeErrors];
+    latencies[CodecStats::OpusEncode].Fill(out.opusEncode);
+    latencies[CodecStats::OpusDecode].Fill(out.opusDecode);
+    latencies[CodecStats::EncodeCall].Fill(out.encodeCall);
+    latencies[CodecStats::DecodeCall].Fill(out.decodeCall);
+}
+
+/**** CodecStatsRegistry ****/
+CodecStatsRegistry *CodecStatsRegistry::inst = new CodecStatsRegistry();
+
+CodecStatsRegistry *CodecStatsRegistry::GetInstance()
+{
+    return inst;
+}
+
+void CodecStatsRegistry::Begin(CodecStats *stats)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stats->registered)
+    {
+        // 上一个会话没有结束就重新开始，先把旧数据并入汇总
+        retired.Add(*stats, false);
+    }
+    stats->Clear();
+    stats->registered = true;
+    live.insert(stats);
+}
+
+void CodecStatsRegistry::End(CodecStats *stats)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (!stats->registered)
+    {
+        return;
+    }
+    retired.Add(*stats, false);
+    stats->SetCachedBytes(0);
+    stats->registered = false;
+    live.erase(stats);
+}
+
+void CodecStatsRegistry::Aggregate(StatsSnapshot &out)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    out.Add(retired);
+    for (auto stats : live)
+    {
+        out.Add(*stats, true);
+    }
+}
+
+bool CodecStatsRegistry::OpenShm(const std::string &name, int intervalMs)
+{
+    CloseShm();
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        std::cerr << "Failed to open shared memory " << name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+    if (ftruncate(fd, sizeof(OpusOggCodecStatsPage)) != 0)
+    {
+        std::cerr << "Failed to resize shared memory " << name << ": " << strerror(errno) << std::endl;
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, sizeof(OpusOggCodecStatsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        std::cerr << "Failed to map shared memory " << name << ": " << strerror(errno) << std::endl;
+        return false;
+    }
+
+    OpusOggCodecStatsPage *page = static_cast<OpusOggCodecStatsPage *>(p);
+    std::memset(page, 0, sizeof(*page));
+    page->size = sizeof(OpusOggCodecStatsPage);
+    page->pid = getpid();
+
+    std::lock_guard<std::mutex> lock(shmMutex);
+    shmPage = page;
+    shmName = name;
+    shmStopping = false;
+    publish();
+    // magic最后写入，读者看到magic时页面已经完整
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    std::memcpy(page->magic, OPUS_OGG_STATS_MAGIC, sizeof(page->magic));
+    shmThread = std::thread(&CodecStatsRegistry::publishLoop, this, std::max(1, intervalMs));
+    return true;
+}
+
+void CodecStatsRegistry::CloseShm()
+{
+    {
+        std::lock_guard<std::mutex> lock(shmMutex);
+        shmStopping = true;
+    }
+    shmCond.notify_all();
+    if (shmThread.joinable())
+    {
+        shmThread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(shmMutex);
+    if (shmPage)
+    {
+        munmap(shmPage, sizeof(OpusOggCodecStatsPage));
+        shm_unlink(shmName.c_str());
+        shmPage = nullptr;
+    }
+}
+
+void CodecStatsRegistry::publishLoop(int intervalMs)
+{
+    std::unique_lock<std::mutex> lock(shmMutex);
+    while (!shmCond.wait_for(lock, std::chrono::milliseconds(intervalMs), [this] { return shmStopping; }))
+    {
+        publish();
+    }
+    publish(); // 停止前写入最终结果
+}
+
+// 调用时持有shmMutex
+void CodecStatsRegistry::publish()
+{
+    StatsSnapshot snapshot;
+    Aggregate(snapshot);
+    OpusOggCodecStatsData data;
+    snapshot.Fill(data);
+
+    // seqlock: 写入期间seq为奇数
+    unsigned long long seq = __atomic_load_n(&shmPage->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&shmPage->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    shmPage->data = data;
+    shmPage->updatedMs = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    __atomic_store_n(&shmPage->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+bool CodecStatsRegistry::ReadShm(const std::string &name, OpusOggCodecStatsData &out)
+{
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(OpusOggCodecStatsPage))
+    {
+        ::close(fd);
+        return false;
+    }
+    void *p = mmap(nullptr, sizeof(OpusOggCodecStatsPage), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED)
+    {
+        return false;
+    }
+
+    const OpusOggCodecStatsPage *page = static_cast<const OpusOggCodecStatsPage *>(p);
+    bool ok = false;
+    if (std::memcmp(page->magic, OPUS_OGG_STATS_MAGIC, sizeof(page->magic)) == 0 && page->size == sizeof(OpusOggCodecStatsPage))
+    {
+        // 写者正在更新或读的过程中发生了更新时重读
+        for (int retry = 0; retry < 1000 && !ok; retry++)
+        {
+            unsigned long long before = __atomic_load_n(&page->seq, __ATOMIC_ACQUIRE);
+            if (before & 1)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            std::memcpy(&out, const_cast<const OpusOggCodecStatsData *>(&page->data), sizeof(out));
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            ok = __atomic_load_n(&page->seq, __ATOMIC_RELAXED) == before;
+        }
+    }
+    munmap(p, sizeof(OpusOggCodecStatsPage));
+    return ok;
+}
@@ -0,0 +1,239 @@
+#ifndef CODEC_STATS_H
+#define CODEC_STATS_H
+
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <set>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include "interface.h"
+
+#define LATENCY_SUB_BUCKET_BITS 3 // 每个2的幂区间再分成8个桶
+#define LATENCY_MAX_EXPONENT 36   // 最大记录约68秒，更大的值计入最后一个桶
+#define LATENCY_BUCKETS ((LATENCY_MAX_EXPONENT - LATENCY_SUB_BUCKET_BITS + 1) << LATENCY_SUB_BUCKET_BITS)
+
+// 单写者计数：只由会话所在的线程修改，不需要加锁的读改写，其他线程随时可以读
+inline void statAdd(std::atomic<uint64_t> &counter, uint64_t n)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline uint64_t statNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// HDR风格的延迟直方图，对数分段再线性细分，相对误差不超过12.5%
+class LatencyHistogram
+{
+private:
+    std::atomic<uint64_t> buckets[LATENCY_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> max;
+
+public:
+    LatencyHistogram()
+    {
+        Clear();
+    }
+
+    static int BucketIndex(uint64_t ns)
+    {
+        if (ns < (1u << LATENCY_SUB_BUCKET_BITS))
+        {
+            return static_cast<int>(ns);
+        }
+        int exponent = 63 - __builtin_clzll(ns);
+        if (exponent >= LATENCY_MAX_EXPONENT)
+        {
+            return LATENCY_BUCKETS - 1;
+        }
+        int sub = static_cast<int>(ns >> (exponent - LATENCY_SUB_BUCKET_BITS)) & ((1 << LATENCY_SUB_BUCKET_BITS) - 1);
+        return ((exponent - LATENCY_SUB_BUCKET_BITS + 1) << LATENCY_SUB_BUCKET_BITS) + sub;
+    }
+
+    // 桶内的最大值
+    static uint64_t BucketUpperBound(int index)
+    {
+        if (index < (1 << LATENCY_SUB_BUCKET_BITS))
+        {
+            return index;
+        }
+        int exponent = (index >> LATENCY_SUB_BUCKET_BITS) + LATENCY_SUB_BUCKET_BITS - 1;
+        uint64_t sub = index & ((1 << LATENCY_SUB_BUCKET_BITS) - 1);
+        uint64_t width = 1ull << (exponent - LATENCY_SUB_BUCKET_BITS);
+        return (((1ull << LATENCY_SUB_BUCKET_BITS) + sub) << (exponent - LATENCY_SUB_BUCKET_BITS)) + width - 1;
+    }
+
+    void Record(uint64_t ns)
+    {
+        statAdd(buckets[BucketIndex(ns)], 1);
+        statAdd(count, 1);
+        statAdd(sum, ns);
+        if (ns > max.load(std::memory_order_relaxed))
+        {
+            max.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    void Clear()
+    {
+        for (auto &bucket : buckets)
+        {
+            bucket.store(0, std::memory_order_relaxed);
+        }
+        count.store(0, std::memory_order_relaxed);
+        sum.store(0, std::memory_order_relaxed);
+        max.store(0, std::memory_order_relaxed);
+    }
+
+    friend struct HistogramSnapshot;
+};
+
+// 直方图的普通拷贝，用于汇总多个会话
+struct HistogramSnapshot
+{
+    uint64_t buckets[LATENCY_BUCKETS];
+    uint64_t count;
+    uint64_t sum;
+    uint64_t max;
+
+    HistogramSnapshot()
+    {
+        std::fill(buckets, buckets + LATENCY_BUCKETS, 0);
+        count = sum = max = 0;
+    }
+
+    void Add(const LatencyHistogram &h);
+    void Add(const HistogramSnapshot &h);
+    uint64_t Percentile(double p) const;
+    void Fill(OpusOggLatencyStats &out) const;
+};
+
+// 一个编解码实例当前会话的统计，由OpusOggCodec持有，编码器和解码器通过指针更新
+class CodecStats
+{
+public:
+    enum Counter
+    {
+        FramesEncoded,
+        FramesDecoded,
+        EncodeInputBytes,
+        EncodeOutputBytes,
+        DecodeInputBytes,
+        DecodeOutputBytes,
+        PagesEmitted,
+        EncodeErrors,
+        DecodeErrors,
+        GovernorDowngrades,       // 以下由ComplexityGovernor::Next记录，见OpusOggGovernorStatsData
+        GovernorUpgrades,
+        GovernorFeatureSheds,
+        GovernorFeatureRestores,
+        GovernorOverBudgetFrames,
+        CounterCount
+    };
+
+    enum Latency
+    {
+        OpusEncode,
+        OpusDecode,
+        EncodeCall,
+        DecodeCall,
+        LatencyCount
+    };
+
+    CodecStats() : registered(false)
+    {
+        Clear();
+    }
+
+    void Add(Counter counter, uint64_t n = 1)
+    {
+        statAdd(counters[counter], n);
+    }
+
+    void SetCachedBytes(uint64_t n)
+    {
+        cachedBytes.store(n, std::memory_order_relaxed);
+    }
+
+    void Record(Latency latency, uint64_t ns)
+    {
+        latencies[latency].Record(ns);
+    }
+
+    void Clear();
+
+private:
+    std::atomic<uint64_t> counters[CounterCount];
+    std::atomic<uint64_t> cachedBytes;
+    LatencyHistogram latencies[LatencyCount];
+    bool registered; // 由CodecStatsRegistry在持锁时修改
+
+    friend struct StatsSnapshot;
+    friend class CodecStatsRegistry;
+};
+
+// 若干会话统计的汇总
+struct StatsSnapshot
+{
+    uint64_t sessions;
+    uint64_t counters[CodecStats::CounterCount];
+    uint64_t cachedBytes;
+    HistogramSnapshot latencies[CodecStats::LatencyCount];
+
+    StatsSnapshot() : sessions(0), cachedBytes(0)
+    {
+        std::fill(counters, counters + CodecStats::CounterCount, 0);
+    }
+
+    // 累计一个会话，cachedBytes是瞬时值，只对进行中的会话累计
+    void Add(const CodecStats &stats, bool live);
+    void Add(const StatsSnapshot &other);
+    void Fill(OpusOggCodecStatsData &out) const;
+};
+
+// 进程内所有会话的统计: 进行中的会话登记在live中，会话结束时并入retired
+// 热路径只写各实例自己的计数，只有会话开始/结束和读取汇总时加锁
+class CodecStatsRegistry
+{
+private:
+    static CodecStatsRegistry *inst;
+    std::mutex mutex;
+    std::set<CodecStats *> live;
+    StatsSnapshot retired;
+
+    // 共享内存统计页
+    std::mutex shmMutex;
+    std::condition_variable shmCond;
+    std::thread shmThread;
+    std::string shmName;
+    OpusOggCodecStatsPage *shmPage;
+    bool shmStopping;
+
+    CodecStatsRegistry() : shmPage(nullptr), shmStopping(false) {}
+    ~CodecStatsRegistry() = default;
+
+    void publishLoop(int intervalMs);
+    void publish();
+
+public:
+    static CodecStatsRegistry *GetInstance();
+
+    // 会话开始时清零并登记
+    void Begin(CodecStats *stats);
+    // 会话结束时并入汇总，未登记时什么也不做
+    void End(CodecStats *stats);
+    void Aggregate(StatsSnapshot &out);
+
+    bool OpenShm(const std::string &name, int intervalMs);
+    void CloseShm();
+    static bool ReadShm(const std::string &name, OpusOggCodecStatsData &out);
+};
+
+#endif // CODEC_STATS_H
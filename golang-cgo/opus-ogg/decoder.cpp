@@ -1,242 +1,430 @@
 #include "opus_ogg.h"
 
-// 从input读取页面，返回实际读取的字节长度
-int OpusOggDecoder::readPage(const std::vector<char> &input, int *index, ogg_page &page)
+// 从ogg_sync中取出一个完整页面，数据不足时返回false，不完整的页面留在ogg_sync里等待后续输入
+bool OpusOggDecoder::readPage(ogg_page &page)
 {
-    int totalLength = input.size();
-    if (*index > totalLength)
+    int result;
+    while ((result = ogg_sync_pageout(&oggSyncState, &page)) != 1)
     {
-        printf("%d > %d\n", *index, totalLength);
-        return 0;
-    }
-    size_t bytesRead = std::min(4096, totalLength - *index);
-    while (ogg_sync_pageout(&oggSyncState, &page) != 1)
-    {
-        char *buffer = ogg_sync_buffer(&oggSyncState, 4096);
-        std::memcpy(buffer, input.data() + *index, bytesRead);
-        *index += bytesRead;
-        ogg_sync_wrote(&oggSyncState, bytesRead);
+        if (result == 0)
+        {
+            return false;
+        }
+        // result < 0: 跳过了失去同步的字节，继续找下一页
     }
-    return bytesRead;
+    return true;
 }
 
-bool OpusOggDecoder::initializeDecoder()
+// 只取当前逻辑流的页面，复用或串接在同一个Ogg文件里的其他流的页面跳过
+bool OpusOggDecoder::readStreamPage(ogg_page &page)
 {
-    int err;
-    OpusDecoder *dec = opus_decoder_create(sampleRate, channels, &err);
-    if (!dec)
+    while (readPage(page))
     {
-        std::cerr << "Failed to create Opus decoder: " << opus_strerror(err) << std::endl;
-        return false;
+        if (ogg_page_serialno(&page) == oggStreamState.serialno)
+        {
+            return true;
+        }
     }
-    decoder.reset(dec);
-    return true;
+    return false;
 }
 
-bool OpusOggDecoder::parseOpusHeader(const unsigned char *data, size_t len, OpusHeader &header)
+int OpusOggDecoder::readHeader()
 {
-    if (len < 19)
-        return false;
+    ogg_page page;
+    ogg_packet packet;
+    if (step == 0)
+    {
+        // 第一个页面只有OpusHead一个包，以BOS标记开始一个逻辑流，之前的字节跳过
+        do
+        {
+            if (!readPage(page))
+            {
+                return 0;
+            }
+        } while (!ogg_page_bos(&page));
 
-    // 验证 "OpusHead" 标识
-    if (std::memcmp(data, "OpusHead", 8) != 0)
-        return false;
+        // 初始化Ogg流，复用的实例只需更换serialno
+        int ret = streamInitialized ? ogg_stream_reset_serialno(&oggStreamState, ogg_page_serialno(&page))
+                                    : ogg_stream_init(&oggStreamState, ogg_page_serialno(&page));
+        if (ret != 0)
+        {
+            std::cerr << "Failed to initialize Ogg stream" << std::endl;
+            return -1;
+        }
+        streamInitialized = true;
 
-    header.version = data[8];
-    header.channels = data[9];
-    header.preSkip = (data[10] | (data[11] << 8));
-    header.sampleRate = (data[12] | (data[13] << 8) | (data[14] << 16) | (data[15] << 24));
-    header.outputGain = (data[16] | (data[17] << 8));
-    header.channelMappingFamily = data[18];
+        // 读取ID Header包
+        if (ogg_stream_pagein(&oggStreamState, &page) < 0 || ogg_stream_packetout(&oggStreamState, &packet) != 1)
+        {
+            std::cerr << "Error reading initial header packet" << std::endl;
+            return -1;
+        }
 
-    return true;
+        // 解析Opus头部
+        if (!parseOpusHeader(packet.packet, packet.bytes, opusHeader))
+        {
+            std::cerr << "Failed to parse Opus header" << std::endl;
+            return -1;
+        }
+
+        channels = opusHeader.channels;
+        // OpusHead里的是编码前的原始采样率，opus不支持的采样率按48kHz解码再重采样
+        int rate = outputRate > 0 ? outputRate : (opusHeader.sampleRate > 0 ? opusHeader.sampleRate : 48000);
+        sampleRate = (rate == 8000 || rate == 12000 || rate == 16000 || rate == 24000 || rate == 48000) ? rate : 48000;
+        // preSkip按48kHz计，换算到解码采样率
+        skipSamples = static_cast<int64_t>(opusHeader.preSkip) * sampleRate / 48000;
+
+        // 初始化解码器
+        if (!initializeDecoder() || !initializeResampler(rate))
+        {
+            return -1;
+        }
+        step++;
+        return 1;
+    }
+
+    // 读取Comment Header包，OpusTags可能跨多个页面
+    int ret;
+    while ((ret = ogg_stream_packetout(&oggStreamState, &packet)) == 0)
+    {
+        if (!readStreamPage(page))
+        {
+            return 0;
+        }
+        if (ogg_stream_pagein(&oggStreamState, &page) < 0)
+        {
+            std::cerr << "Error reading comment header" << std::endl;
+            return -1;
+        }
+    }
+    if (ret < 0 || !skipOpusComments(packet))
+    {
+        std::cerr << "Error reading comment header" << std::endl;
+        return -1;
+    }
+    step++;
+    return 1;
 }
 
-bool OpusOggDecoder::skipOpusComments(ogg_packet &packet)
+bool OpusOggDecoder::sameLayout(const OpusHeader &a, const OpusHeader &b) const
 {
-    // 验证 "OpusTags" 标识
-    if (packet.bytes < 8 || std::memcmp(packet.packet, "OpusTags", 8) != 0)
+    if (a.channels != b.channels || a.channelMappingFamily != b.channelMappingFamily)
     {
         return false;
     }
-    return true; // 我们只需验证标识，不需要解析注释内容
+    return a.channelMappingFamily == 0 ||
+           (a.streamCount == b.streamCount && a.coupledCount == b.coupledCount && std::memcmp(a.mapping, b.mapping, a.channels) == 0);
 }
 
-bool OpusOggDecoder::readOpusHeader(const std::vector<char> &input, int* index)
+bool OpusOggDecoder::initializeDecoder()
 {
-    ogg_page page;
-    if (readPage(input, index, page) <= 0)
+    // 复用的实例参数相同时只需重置解码器状态
+    if (decoder && decoderSampleRate == sampleRate && sameLayout(decoderHeader, opusHeader))
     {
-        std::cerr << "Failed to read first page" << std::endl;
-        return false;
+        return opus_decoder_ctl(decoder.get(), OPUS_RESET_STATE) == OPUS_OK;
     }
-
-    // 初始化Ogg流
-    if (ogg_stream_init(&oggStreamState, ogg_page_serialno(&page)) != 0)
+    if (msDecoder && decoderSampleRate == sampleRate && sameLayout(decoderHeader, opusHeader))
     {
-        std::cerr << "Failed to initialize Ogg stream" << std::endl;
-        return false;
+        return opus_multistream_decoder_ctl(msDecoder.get(), OPUS_RESET_STATE) == OPUS_OK;
     }
-    streamInitialized = true;
 
-    if (ogg_stream_pagein(&oggStreamState, &page) < 0)
+    int err;
+    decoder.reset();
+    msDecoder.reset();
+    if (opusHeader.channelMappingFamily == 0)
     {
-        std::cerr << "Error reading first page" << std::endl;
-        return false;
+        OpusDecoder *dec = opus_decoder_create(sampleRate, channels, &err);
+        if (!dec)
+        {
+            std::cerr << "Failed to create Opus decoder: " << opus_strerror(err) << std::endl;
+            return false;
+        }
+        decoder.reset(dec);
     }
-
-    ogg_packet packet;
-    if (ogg_stream_packetout(&oggStreamState, &packet) != 1)
+    else
     {
-        std::cerr << "Error reading initial header packet" << std::endl;
-        return false;
+        OpusMSDecoder *dec = opus_multistream_decoder_create(sampleRate, channels, opusHeader.streamCount, opusHeader.coupledCount,
+                                                             opusHeader.mapping, &err);
+        if (!dec)
+        {
+            std::cerr << "Failed to create Opus multistream decoder: " << opus_strerror(err) << std::endl;
+            return false;
+        }
+        msDecoder.reset(dec);
     }
+    decoderSampleRate = sampleRate;
+    decoderHeader = opusHeader;
+    return true;
+}
 
-    OpusHeader opusHeader;
-    // 解析Opus头部
-    if (!parseOpusHeader(packet.packet, packet.bytes, opusHeader))
+int OpusOggDecoder::decodePacket(const ogg_packet &packet, opus_int16 *pcm, float *pcmFloat, int samples)
+{
+    // packet为空时做丢包补偿
+    const unsigned char *data = packet.packet;
+    opus_int32 len = packet.bytes;
+    if (msDecoder)
     {
-        std::cerr << "Failed to parse Opus header" << std::endl;
-        return false;
+        return pcmFloat ? opus_multistream_decode_float(msDecoder.get(), data, len, pcmFloat, samples, 0)
+                        : opus_multistream_decode(msDecoder.get(), data, len, pcm, samples, 0);
     }
+    return pcmFloat ? opus_decode_float(decoder.get(), data, len, pcmFloat, samples, 0)
+                    : opus_decode(decoder.get(), data, len, pcm, samples, 0);
+}
 
-    channels = opusHeader.channels;
-    sampleRate = opusHeader.sampleRate;
-
-    // 读取Comment Header包
-    if (readPage(input, index, page) <= 0 ||
-        ogg_stream_pagein(&oggStreamState, &page) < 0 ||
-        ogg_stream_packetout(&oggStreamState, &packet) != 1 ||
-        !skipOpusComments(packet))
+bool OpusOggDecoder::GetLayout(OpusOggChannelLayout &layout) const
+{
+    if (step == 0)
     {
-        std::cerr << "Error reading comment header" << std::endl;
         return false;
     }
+    layout.channels = opusHeader.channels;
+    layout.mappingFamily = opusHeader.channelMappingFamily;
+    layout.streams = opusHeader.streamCount;
+    layout.coupledStreams = opusHeader.coupledCount;
+    std::memcpy(layout.mapping, opusHeader.mapping, sizeof(layout.mapping));
+    return true;
+}
 
-    if (!initializeDecoder())
+bool OpusOggDecoder::SetOutputRate(int rate)
+{
+    if (step != 0 || (rate != 0 && (rate < RESAMPLER_MIN_RATE || rate > RESAMPLER_MAX_RATE)))
     {
-        std::cerr << "Error initialize decoder" << std::endl;
+        std::cerr << "Invalid output rate " << rate << std::endl;
         return false;
     }
+    outputRate = rate;
+    return true;
+}
 
-    // 处理预跳过采样
-    std::vector<opus_int16> skipBuffer(opusHeader.preSkip * channels);
-    if (opusHeader.preSkip > 0)
+bool OpusOggDecoder::initializeResampler(int rate)
+{
+    if (rate == sampleRate)
     {
-        int ret = opus_decode(decoder.get(), nullptr, 0, skipBuffer.data(), opusHeader.preSkip, 0);
-        if (ret < 0)
+        resampler.reset();
+        return true;
+    }
+    // 复用的实例倍率和声道数相同时只需清空延迟线
+    if (resampler && resampler->InputRate() == sampleRate && resampler->OutputRate() == rate && resampler->Channels() == channels)
+    {
+        resampler->Reset();
+    }
+    else
+    {
+        resampler = Resampler::Create(sampleRate, rate, channels);
+        if (!resampler)
         {
-            std::cerr << "Decoding opusHeader.preSkip error: " << opus_strerror(ret) << std::endl;
             return false;
         }
     }
+    floatBuffer.resize(MAX_FRAME_SIZE * channels);
+    resampled.reserve(resampler->OutputBound(MAX_FRAME_SIZE, true) * channels);
     return true;
 }
 
-int OpusOggDecoder::Decode(const std::vector<char> &input, std::vector<char> &output, bool last)
+void OpusOggDecoder::resampleOutput(const float *pcm, size_t frames, bool flush, OutputSpan &output)
 {
-    int index = 0;
-    if (step == 0)
+    TRACE_SPAN("decode.resample");
+    resampled.clear();
+    resampler->Process(pcm, frames, resampled, flush);
+    convertFromFloat(resampled.data(), reinterpret_cast<opus_int16 *>(output.data + output.size), resampled.size());
+    output.size += resampled.size() * sizeof(opus_int16);
+}
+
+bool OpusOggDecoder::parseOpusHeader(const unsigned char *data, size_t len, OpusHeader &header)
+{
+    if (len < 19)
+        return false;
+
+    // 验证 "OpusHead" 标识
+    if (std::memcmp(data, "OpusHead", 8) != 0)
+        return false;
+
+    header.version = data[8];
+    header.channels = data[9];
+    header.preSkip = (data[10] | (data[11] << 8));
+    header.sampleRate = (data[12] | (data[13] << 8) | (data[14] << 16) | (data[15] << 24));
+    header.outputGain = (data[16] | (data[17] << 8));
+    header.channelMappingFamily = data[18];
+
+    if (header.channels == 0)
+        return false;
+    if (header.channelMappingFamily == 0)
     {
-        ogg_page page;
-        if (readPage(input, &index, page) <= 0)
-        {
-            std::cerr << "Failed to read first page" << std::endl;
-            return -1;
-        }
+        // 单流，声道按左右顺序
+        if (header.channels > 2)
+            return false;
+        header.streamCount = 1;
+        header.coupledCount = header.channels - 1;
+        header.mapping[0] = 0;
+        header.mapping[1] = 1;
+        return true;
+    }
 
-        // 初始化Ogg流
-        if (ogg_stream_init(&oggStreamState, ogg_page_serialno(&page)) != 0)
-        {
-            std::cerr << "Failed to initialize Ogg stream" << std::endl;
-            return -1;
-        }
-        streamInitialized = true;
+    // 映射表: 流数、配对流数，以及每个输出声道对应的解码声道
+    if (len < 21u + header.channels)
+        return false;
+    header.streamCount = data[19];
+    header.coupledCount = data[20];
+    if (header.streamCount == 0 || header.coupledCount > header.streamCount || header.streamCount + header.coupledCount > MAX_CHANNELS)
+        return false;
+    std::memcpy(header.mapping, data + 21, header.channels);
+    for (int i = 0; i < header.channels; i++)
+    {
+        if (header.mapping[i] != 255 && header.mapping[i] >= header.streamCount + header.coupledCount)
+            return false;
+    }
+    return true;
+}
 
-        // 提交第一个页面
-        if (ogg_stream_pagein(&oggStreamState, &page) < 0)
-        {
-            std::cerr << "Error reading first page" << std::endl;
-            return -1;
-        }
+bool OpusOggDecoder::skipOpusComments(ogg_packet &packet)
+{
+    // 验证 "OpusTags" 标识
+    if (packet.bytes < 8 || std::memcmp(packet.packet, "OpusTags", 8) != 0)
+    {
+        return false;
+    }
+    return true; // 我们只需验证标识，不需要解析注释内容
+}
 
-        // 读取ID Header包
-        ogg_packet packet;
-        if (ogg_stream_packetout(&oggStreamState, &packet) != 1)
+size_t OpusOggDecoder::DecodeBound() const
+{
+    // 头部解析之前声道数未知，按映射族0的最大声道数2估计；多声道的流在解析头部后返回实际大小，
+    // 之前用较小的缓冲区解码会返回-2和实际需要的字节数
+    size_t frames = resampler ? resampler->OutputBound(MAX_FRAME_SIZE, true) : MAX_FRAME_SIZE;
+    return frames * (channels > 0 ? channels : 2) * sizeof(opus_int16);
+}
+
+void OpusOggDecoder::recordCall(uint64_t begin, size_t inputLength, size_t outputBytes, int ret)
+{
+    stats->Record(CodecStats::DecodeCall, statNowNs() - begin);
+    stats->Add(CodecStats::DecodeInputBytes, inputLength);
+    stats->Add(CodecStats::DecodeOutputBytes, outputBytes);
+    if (ret == -1)
+    {
+        stats->Add(CodecStats::DecodeErrors);
+    }
+}
+
+int OpusOggDecoder::Decode(const char *input, size_t inputLength, std::vector<char> &output, bool last)
+{
+    TRACE_SPAN("Decode");
+    uint64_t begin = stats ? statNowNs() : 0;
+    size_t outputBefore = output.size();
+    int ret = decodeVector(input, inputLength, output, last);
+    if (stats)
+    {
+        recordCall(begin, inputLength, output.size() - outputBefore, ret);
+    }
+    return ret;
+}
+
+int OpusOggDecoder::decodeVector(const char *input, size_t inputLength, std::vector<char> &output, bool last)
+{
+    const char *data = input;
+    size_t length = inputLength;
+    while (true)
+    {
+        size_t offset = output.size();
+        size_t bound = DecodeBound();
         {
-            std::cerr << "Error reading initial header packet" << std::endl;
-            return -1;
+            TRACE_SPAN("decode.output_resize");
+            output.resize(offset + bound);
         }
-
-        // 解析Opus头部
-        // OpusHeader opusHeader;
-        if (!parseOpusHeader(packet.packet, packet.bytes, opusHeader))
+        OutputSpan span(output.data() + offset, bound);
+        size_t needed = 0;
+        int ret = decodeSpan(data, length, span, last, &needed);
+        output.resize(offset + span.size);
+        if (ret != 1)
         {
-            std::cerr << "Failed to parse Opus header" << std::endl;
-            return -1;
+            return ret;
         }
+        // 输入已经全部交给ogg_sync，继续取出剩余的包
+        length = 0;
+    }
+}
 
-        channels = opusHeader.channels;
-        sampleRate = opusHeader.sampleRate;
+int OpusOggDecoder::Decode(const char *input, size_t inputLength, OutputSpan &output, bool last, size_t *needed)
+{
+    TRACE_SPAN("Decode");
+    if (!stats)
+    {
+        return decodeSpan(input, inputLength, output, last, needed);
+    }
+    uint64_t begin = statNowNs();
+    size_t outputBefore = output.size;
+    int ret = decodeSpan(input, inputLength, output, last, needed);
+    recordCall(begin, inputLength, output.size - outputBefore, ret);
+    return ret;
+}
 
-        // 初始化解码器
-        if (!initializeDecoder())
-        {
-            return -1;
-        }
-        step++;
-        return 0;
+int OpusOggDecoder::decodeSpan(const char *input, size_t inputLength, OutputSpan &output, bool last, size_t *needed)
+{
+    // 输入一次性交给ogg_sync，后续页面都从ogg_sync中取
+    if (inputLength > 0)
+    {
+        TRACE_SPAN("decode.input_copy");
+        char *buffer = ogg_sync_buffer(&oggSyncState, inputLength);
+        std::memcpy(buffer, input, inputLength);
+        ogg_sync_wrote(&oggSyncState, inputLength);
     }
-    if (step == 1)
+
+    // 头部可能分散在任意多次输入里，页面不完整时先返回，等待后续输入
+    while (step < 2)
     {
-        ogg_page page;
-        ogg_packet packet;
-        // 读取Comment Header包
-        printf("--- 1 ---\n");
-        if (readPage(input, &index, page) <= 0 ||
-            ogg_stream_pagein(&oggStreamState, &page) < 0 ||
-            ogg_stream_packetout(&oggStreamState, &packet) != 1 ||
-            !skipOpusComments(packet))
+        TRACE_SPAN("decode.headers");
+        int ret = readHeader();
+        if (ret < 0)
         {
-            std::cerr << "Error reading comment header" << std::endl;
-            return false;
+            return -1;
         }
-
-        // 处理预跳过采样
-        std::vector<opus_int16> skipBuffer(opusHeader.preSkip * channels);
-        if (opusHeader.preSkip > 0)
+        if (ret == 0)
         {
-            int ret = opus_decode(decoder.get(), nullptr, 0, skipBuffer.data(), opusHeader.preSkip, 0);
-            if (ret < 0)
+            if (last)
             {
-                std::cerr << "Decoding opusHeader.preSkip error: " << opus_strerror(ret) << std::endl;
+                std::cerr << "Stream ended before Opus headers" << std::endl;
+                return -1;
             }
+            return 0;
         }
     }
-    printf("step: %d\n", step++);
 
     // 开始解码音频数据
     ogg_packet packet;
     ogg_page page;
-    std::vector<unsigned char> pcmBuffer(MAX_FRAME_SIZE * channels * sizeof(opus_int16) * 2); // pcm音频数据缓冲区，适当大小
-    int64_t totalSamples = 0;
+    size_t bytesPerSample = channels * sizeof(opus_int16);
 
     while (true)
     {
-        // 读取一个音频包
-        int result = ogg_stream_packetout(&oggStreamState, &packet);
+        // 先看一眼下一个音频包，确认输出缓冲区放得下再取出
+        int result = ogg_stream_packetpeek(&oggStreamState, &packet);
 
         if (result == 0)
         {
             // 需要更多数据
-            if (readPage(input, &index, page) <= 0)
+            TRACE_SPAN("ogg_sync_pageout");
+            if (!readStreamPage(page))
             {
-                break; // 文件结束
+                if (last && resampler)
+                {
+                    // 流结束，输出重采样延迟线里剩余的样本
+                    size_t bytes = resampler->OutputBound(0, true) * bytesPerSample;
+                    if (bytes > output.remaining())
+                    {
+                        if (output.size == 0)
+                        {
+                            *needed = bytes;
+                            return -2;
+                        }
+                        return 1;
+                    }
+                    resampleOutput(nullptr, 0, true, output);
+                }
+                break; // 本次输入已用完
             }
             if (ogg_stream_pagein(&oggStreamState, &page) < 0)
             {
                 std::cerr << "Error reading page" << std::endl;
-                return false;
+                return -1;
             }
             continue;
         }
@@ -244,11 +432,50 @@ int OpusOggDecoder::Decode(const std::vector<char> &input, std::vector<char> &ou
         if (result < 0)
         {
             std::cerr << "Corrupt or missing data in bitstream" << std::endl;
+            if (stats)
+            {
+                stats->Add(CodecStats::DecodeErrors);
+            }
+            continue;
+        }
+
+        int samples = opus_packet_get_nb_samples(packet.packet, packet.bytes, sampleRate);
+        if (samples < 0)
+        {
+            std::cerr << "Invalid packet: " << opus_strerror(samples) << std::endl;
+            if (stats)
+            {
+                stats->Add(CodecStats::DecodeErrors);
+            }
+            ogg_stream_packetout(&oggStreamState, &packet);
             continue;
         }
 
-        // 解码音频包
-        int samplesDecoded = opus_decode(decoder.get(), packet.packet, packet.bytes, reinterpret_cast<opus_int16 *>(pcmBuffer.data()), MAX_FRAME_SIZE, 0);
+        size_t bytes = (resampler ? resampler->OutputBound(samples, false) : samples) * bytesPerSample;
+        if (bytes > output.remaining())
+        {
+            if (output.size == 0)
+            {
+                *needed = bytes;
+                return -2;
+            }
+            return 1; // 输出缓冲区已满，包留在Ogg流里
+        }
+        ogg_stream_packetout(&oggStreamState, &packet);
+
+        // 解码音频包，PCM直接写入输出缓冲区
+        opus_int16 *pcm = reinterpret_cast<opus_int16 *>(output.data + output.size);
+        int samplesDecoded;
+        {
+            TRACE_SPAN("opus_decode");
+            uint64_t decodeBegin = stats ? statNowNs() : 0;
+            samplesDecoded = decodePacket(packet, pcm, resampler ? floatBuffer.data() : nullptr, samples);
+            if (stats)
+            {
+                stats->Record(CodecStats::OpusDecode, statNowNs() - decodeBegin);
+                stats->Add(samplesDecoded < 0 ? CodecStats::DecodeErrors : CodecStats::FramesDecoded);
+            }
+        }
 
         if (samplesDecoded < 0)
         {
@@ -256,18 +483,47 @@ int OpusOggDecoder::Decode(const std::vector<char> &input, std::vector<char> &ou
             continue;
         }
 
-        // 写入PCM数据
-        std::memcpy(output.data(), reinterpret_cast<const char *>(pcmBuffer.data()), samplesDecoded * channels * sizeof(opus_int16));
+        // 丢弃流开头的预跳过样本
+        if (skipSamples > 0)
+        {
+            int skip = std::min(skipSamples, samplesDecoded);
+            skipSamples -= skip;
+            samplesDecoded -= skip;
+            if (resampler)
+            {
+                std::memmove(floatBuffer.data(), floatBuffer.data() + skip * channels, samplesDecoded * channels * sizeof(float));
+            }
+            else
+            {
+                std::memmove(pcm, pcm + skip * channels, samplesDecoded * bytesPerSample);
+            }
+        }
 
-        totalSamples += samplesDecoded;
+        if (resampler)
+        {
+            resampleOutput(floatBuffer.data(), samplesDecoded, false, output);
+        }
+        else
+        {
+            output.size += samplesDecoded * bytesPerSample;
+        }
     }
 
-    // printf("Decoding channels: %d, sampleRate:%d\n", channels, sampleRate);
-    // std::cout << "Decoding completed successfully" << std::endl;
-    // std::cout << "Total decoded samples: " << totalSamples << std::endl;
-    // std::cout << "Audio duration: " << static_cast<double>(totalSamples) / sampleRate << " seconds" << std::endl;
+    return 0;
+}
 
-    return true;
+void OpusOggDecoder::Reset()
+{
+    ogg_sync_reset(&oggSyncState);
+    if (streamInitialized)
+    {
+        ogg_stream_reset(&oggStreamState);
+    }
+    channels = 0;
+    sampleRate = 0;
+    outputRate = 0;
+    skipSamples = 0;
+    step = 0;
 }
 
 void OpusOggDecoder::end()
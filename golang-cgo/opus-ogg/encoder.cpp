@@ -2,23 +2,317 @@
 bool OpusOggEncoder::initializeEncoder()
 {
     int err;
-    OpusEncoder *enc = opus_encoder_create(sampleRate, channels, OPUS_APPLICATION_AUDIO, &err);
-    if (!enc)
+    if (mappingFamily == 0)
     {
-        std::cerr << "Failed to create Opus encoder: " << opus_strerror(err) << std::endl;
+        OpusEncoder *enc = opus_encoder_create(sampleRate, channels, OPUS_APPLICATION_AUDIO, &err);
+        if (!enc)
+        {
+            std::cerr << "Failed to create Opus encoder: " << opus_strerror(err) << std::endl;
+            return false;
+        }
+        encoder.reset(enc);
+    }
+    else
+    {
+        // 按映射族生成流数和映射表: 族1按Vorbis声道顺序把前后左右配对成立体声流，族255每个声道一个单声道流
+        OpusMSEncoder *enc = opus_multistream_surround_encoder_create(sampleRate, channels, mappingFamily, &streamCount, &coupledCount,
+                                                                      mapping, OPUS_APPLICATION_AUDIO, &err);
+        if (!enc)
+        {
+            std::cerr << "Failed to create Opus multistream encoder with " << channels << " channels, mapping family "
+                      << mappingFamily << ": " << opus_strerror(err) << std::endl;
+            return false;
+        }
+        msEncoder.reset(enc);
+    }
+
+    // 设置编码器参数，多流时码率按流数分配
+    encoderCtl(OPUS_SET_VBR(0)); // 0:CBR, 1:VBR
+    encoderCtl(OPUS_SET_BITRATE(48000 * streamCount));
+    encoderCtl(OPUS_SET_COMPLEXITY(baseComplexity));
+    complexity = baseComplexity;
+    encoderCtl(OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
+    encoderCtl(OPUS_SET_LSB_DEPTH(16));
+
+    updateMaxPacketBytes();
+    return true;
+}
+
+void OpusOggEncoder::updateMaxPacketBytes()
+{
+    // 按码率估算单包大小上限，CBR下每包大小固定，留一倍余量给VBR，输出缓冲区据此预留
+    opus_int32 bitrate = 0;
+    encoderCtl(OPUS_GET_BITRATE(&bitrate));
+    size_t nominalBytes = static_cast<int64_t>(bitrate) * frameSize / sampleRate / 8;
+    maxPacketBytes = std::min<size_t>(opusData.size(), std::max<size_t>(nominalBytes * 2, 256 * streamCount));
+}
+
+bool OpusOggEncoder::SetBitrate(opus_int32 bitrate)
+{
+    if (!started() || encoderCtl(OPUS_SET_BITRATE(bitrate)) != OPUS_OK)
+    {
+        return false;
+    }
+    updateMaxPacketBytes();
+    return true;
+}
+
+bool OpusOggEncoder::SetComplexity(int level)
+{
+    if (level < 0 || level > GOVERNOR_MAX_COMPLEXITY || !applyComplexity(level))
+    {
+        return false;
+    }
+    baseComplexity = level;
+    return true;
+}
+
+bool OpusOggEncoder::SetFec(int packetLossPercent)
+{
+    if (!started() || packetLossPercent < 0 || packetLossPercent > 100)
+    {
+        return false;
+    }
+    if (featuresShed)
+    {
+        // 调节器关闭期间只记下设置，恢复时生效
+        savedFec = packetLossPercent > 0;
+    }
+    else if (encoderCtl(OPUS_SET_INBAND_FEC(packetLossPercent > 0 ? 1 : 0)) != OPUS_OK)
+    {
+        return false;
+    }
+    return encoderCtl(OPUS_SET_PACKET_LOSS_PERC(packetLossPercent)) == OPUS_OK;
+}
+
+bool OpusOggEncoder::applyComplexity(int level)
+{
+    if (!started() || encoderCtl(OPUS_SET_COMPLEXITY(level)) != OPUS_OK)
+    {
+        return false;
+    }
+    complexity = level;
+    framesSinceChange = 0;
+    return true;
+}
+
+void OpusOggEncoder::setFeaturesShed(bool shed)
+{
+    if (shed)
+    {
+        // libopus没有编译DRED时GET会失败，当作没有开启
+        savedFec = 0;
+        savedDred = 0;
+        encoderCtl(OPUS_GET_INBAND_FEC(&savedFec));
+        if (encoderCtl(OPUS_GET_DRED_DURATION(&savedDred)) != OPUS_OK)
+        {
+            savedDred = 0;
+        }
+        if (savedFec)
+        {
+            encoderCtl(OPUS_SET_INBAND_FEC(0));
+        }
+        if (savedDred)
+        {
+            encoderCtl(OPUS_SET_DRED_DURATION(0));
+        }
+    }
+    else
+    {
+        if (savedFec)
+        {
+            encoderCtl(OPUS_SET_INBAND_FEC(savedFec));
+        }
+        if (savedDred)
+        {
+            encoderCtl(OPUS_SET_DRED_DURATION(savedDred));
+        }
+    }
+    featuresShed = shed;
+    framesSinceChange = 0;
+}
+
+void OpusOggEncoder::govern(uint64_t encodeNs)
+{
+    ComplexityGovernor *governor = ComplexityGovernor::GetInstance();
+    if (!governor->Enabled())
+    {
+        // 调节器停止后恢复调用方的设置
+        if (complexity != baseComplexity)
+        {
+            applyComplexity(baseComplexity);
+        }
+        if (featuresShed)
+        {
+            setFeaturesShed(false);
+        }
+        return;
+    }
+    // 滑动平均，新样本的权重为1/8
+    avgEncodeNs = avgEncodeNs ? avgEncodeNs - avgEncodeNs / 8 + encodeNs / 8 : encodeNs;
+    framesSinceChange++;
+    uint64_t frameNs = static_cast<uint64_t>(frameSize) * 1000000000ull / sampleRate;
+    GovernorDecision decision = governor->Next(complexity, baseComplexity, avgEncodeNs, frameNs, framesSinceChange, featuresShed, stats);
+    if (decision.complexity != complexity)
+    {
+        applyComplexity(decision.complexity);
+    }
+    if (decision.shedFeatures != featuresShed)
+    {
+        setFeaturesShed(decision.shedFeatures);
+    }
+}
+
+void OpusOggEncoder::GetLayout(OpusOggChannelLayout &layout) const
+{
+    layout.channels = channels;
+    layout.mappingFamily = mappingFamily;
+    layout.streams = streamCount;
+    layout.coupledStreams = coupledCount;
+    std::memcpy(layout.mapping, mapping, sizeof(layout.mapping));
+}
+
+bool OpusOggEncoder::SetInputFormat(SampleFormat format, int inputChannels)
+{
+    if (!started() || !sampleFormatValid(format) || !(inputChannels == channels || (inputChannels == 2 && channels == 1)))
+    {
+        std::cerr << "Invalid input format " << format << " with " << inputChannels << " channels" << std::endl;
+        return false;
+    }
+    if (cachedBytes != 0)
+    {
+        std::cerr << "Cannot change input format with cached input" << std::endl;
+        return false;
+    }
+    this->inputFormat = format;
+    this->inputChannels = inputChannels;
+    updateFrameLayout();
+    // 高于16位的输入让编码器按24位精度分配比特
+    return encoderCtl(OPUS_SET_LSB_DEPTH(format == SAMPLE_FORMAT_S16 ? 16 : 24)) == OPUS_OK;
+}
+
+bool OpusOggEncoder::SetInputRate(int rate)
+{
+    if (!started() || !headersPending || cachedBytes != 0)
+    {
+        std::cerr << "Input rate can only be set before encoding" << std::endl;
+        return false;
+    }
+    if (rate == sampleRate)
+    {
+        resampler.reset();
+    }
+    else if (resampler && resampler->InputRate() == rate)
+    {
+        resampler->Reset();
+    }
+    else
+    {
+        std::unique_ptr<Resampler> r = Resampler::Create(rate, sampleRate, channels);
+        if (!r)
+        {
+            return false;
+        }
+        resampler = std::move(r);
+    }
+    inputRate = rate;
+    resampled.clear();
+    updateFrameLayout();
+    // OpusHead记录的原始采样率变了，重新生成头部页面
+    return writeHeaders();
+}
+
+bool OpusOggEncoder::SetPagePolicy(PagePolicy policy, int value)
+{
+    if ((policy == PAGE_POLICY_DURATION || policy == PAGE_POLICY_SIZE) ? value <= 0 : (policy != PAGE_POLICY_DEFAULT && policy != PAGE_POLICY_PACKET))
+    {
+        std::cerr << "Invalid page policy " << policy << " with value " << value << std::endl;
         return false;
     }
-    encoder.reset(enc);
+    pagePolicy = policy;
+    pageValue = value;
+    return true;
+}
+
+void OpusOggEncoder::updateFrameLayout()
+{
+    // 重采样时每次从输入读取约一帧时长的样本，凑满后整块转换、重采样
+    size_t framesPerRead = resampler ? (static_cast<int64_t>(frameSize) * inputRate + sampleRate - 1) / sampleRate : frameSize;
+    bytesReadPerFrame = framesPerRead * inputChannels * sampleFormatBytes(inputFormat);
+    // 格式确定后一次分配好，编码过程中不再分配内存
+    frameBuffer.resize(bytesReadPerFrame);
+    pcmBuffer.resize(inputFormat == SAMPLE_FORMAT_S16 && inputChannels != channels && !resampler ? frameSize * channels : 0);
+    floatBuffer.resize(inputFormat != SAMPLE_FORMAT_S16 || resampler ? framesPerRead * inputChannels : 0);
+    if (resampler)
+    {
+        resampled.reserve((frameSize + resampler->OutputBound(framesPerRead, true)) * channels);
+    }
+}
 
-    // 设置编码器参数
-    opus_encoder_ctl(encoder.get(), OPUS_SET_VBR(0)); // 0:CBR, 1:VBR
-    opus_encoder_ctl(encoder.get(), OPUS_SET_BITRATE(48000));
-    opus_encoder_ctl(encoder.get(), OPUS_SET_COMPLEXITY(8));
-    opus_encoder_ctl(encoder.get(), OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
-    opus_encoder_ctl(encoder.get(), OPUS_SET_LSB_DEPTH(16));
+bool OpusOggEncoder::directInput(const char *frame) const
+{
+    // 与编码器格式相同且对齐时直接把调用方内存交给opus，否则转换时会读取输入，不要求对齐
+    if (inputChannels != channels)
+    {
+        return true;
+    }
+    if (inputFormat == SAMPLE_FORMAT_S16)
+    {
+        return reinterpret_cast<uintptr_t>(frame) % alignof(opus_int16) == 0;
+    }
+    if (inputFormat == SAMPLE_FORMAT_F32)
+    {
+        return reinterpret_cast<uintptr_t>(frame) % alignof(float) == 0;
+    }
     return true;
 }
 
+const void *OpusOggEncoder::convertFrame(const unsigned char *frame)
+{
+    if (inputFormat == SAMPLE_FORMAT_S16)
+    {
+        if (inputChannels == channels)
+        {
+            return frame;
+        }
+        TRACE_SPAN("encode.convert");
+        downmixS16(frame, pcmBuffer.data(), frameSize);
+        return pcmBuffer.data();
+    }
+    if (inputFormat == SAMPLE_FORMAT_F32 && inputChannels == channels)
+    {
+        return frame;
+    }
+    TRACE_SPAN("encode.convert");
+    const float *pcm = reinterpret_cast<const float *>(frame);
+    if (inputFormat != SAMPLE_FORMAT_F32)
+    {
+        convertToFloat(inputFormat, frame, floatBuffer.data(), frameSize * inputChannels);
+        pcm = floatBuffer.data();
+    }
+    if (inputChannels != channels)
+    {
+        downmixFloat(pcm, floatBuffer.data(), frameSize);
+    }
+    return floatBuffer.data();
+}
+
+const float *OpusOggEncoder::convertBlock(const unsigned char *block, size_t frames)
+{
+    // 重采样前统一转成float，声道数与编码器一致
+    if (inputFormat == SAMPLE_FORMAT_F32 && inputChannels == channels)
+    {
+        return reinterpret_cast<const float *>(block);
+    }
+    TRACE_SPAN("encode.convert");
+    convertToFloat(inputFormat, block, floatBuffer.data(), frames * inputChannels);
+    if (inputChannels != channels)
+    {
+        downmixFloat(floatBuffer.data(), floatBuffer.data(), frames);
+    }
+    return floatBuffer.data();
+}
+
 bool OpusOggEncoder::initializeOggStream()
 {
     std::srand(std::time(nullptr));
@@ -31,9 +325,78 @@ bool OpusOggEncoder::initializeOggStream()
     return true;
 }
 
-bool OpusOggEncoder::writeOpusHeader(std::vector<char> &output)
+bool OpusOggEncoder::writePage(const ogg_page &og, PageSink &sink)
+{
+    if (!sink.WritePage(og))
+    {
+        return false;
+    }
+    // 没有包在本页结束时granulepos为-1，下一页仍从原来的位置算起
+    if (ogg_page_granulepos(&og) >= 0)
+    {
+        pageStart = ogg_page_granulepos(&og);
+    }
+    if (stats)
+    {
+        stats->Add(CodecStats::PagesEmitted);
+    }
+    return true;
+}
+
+bool OpusOggEncoder::writeHeaders()
+{
+    // 头部页面在Start时生成，调用方在编码之前就可以用Flush取走；
+    // OpusHead的内容在第一次输出之前还可能变化，每次都从第0页重新生成
+    if (ogg_stream_reset_serialno(&oggStreamState, oggStreamState.serialno) != 0)
+    {
+        std::cerr << "Failed to reset Ogg stream" << std::endl;
+        return false;
+    }
+    headerPages.clear();
+    headerPageCount = 0;
+    if (!writeOpusHeader() || !writeOpusComments())
+    {
+        std::cerr << "Failed to write Opus headers" << std::endl;
+        return false;
+    }
+    packetno = 2;
+    headersPending = true;
+    return true;
+}
+
+void OpusOggEncoder::appendHeaderPages()
+{
+    // OpusHead单独一页，OpusTags从新的一页开始，每个头部包写入后都冲刷
+    ogg_page og;
+    while (ogg_stream_flush(&oggStreamState, &og) != 0)
+    {
+        headerPages.insert(headerPages.end(), og.header, og.header + og.header_len);
+        headerPages.insert(headerPages.end(), og.body, og.body + og.body_len);
+        headerPageCount++;
+    }
+}
+
+bool OpusOggEncoder::emitHeaders(PageSink &sink)
+{
+    TRACE_SPAN("encode.headers");
+    // 头部页面已经连续存放，作为一条记录写入
+    if (!sink.Write(headerPages.data(), headerPages.size(), nullptr, 0))
+    {
+        std::cerr << "Failed to write pages" << std::endl;
+        return false;
+    }
+    if (stats)
+    {
+        stats->Add(CodecStats::PagesEmitted, headerPageCount);
+    }
+    headersPending = false;
+    return true;
+}
+
+bool OpusOggEncoder::writeOpusHeader()
 {
-    std::vector<unsigned char> header(19);
+    // 映射族不为0时在末尾附加流数、配对流数和映射表
+    std::vector<unsigned char> header(mappingFamily == 0 ? 19 : 21 + channels);
 
     // 填充OpusHead
     std::memcpy(header.data(), "OpusHead", 8);
@@ -42,16 +405,22 @@ bool OpusOggEncoder::writeOpusHeader(std::vector<char> &output)
     // 预跳过采样数 (16bit)
     header[10] = 0;
     header[11] = 0;
-    // 采样率 (32bit)
-    header[12] = sampleRate & 0xFF;
-    header[13] = (sampleRate >> 8) & 0xFF;
-    header[14] = (sampleRate >> 16) & 0xFF;
-    header[15] = (sampleRate >> 24) & 0xFF;
+    // 原始输入采样率 (32bit)
+    header[12] = inputRate & 0xFF;
+    header[13] = (inputRate >> 8) & 0xFF;
+    header[14] = (inputRate >> 16) & 0xFF;
+    header[15] = (inputRate >> 24) & 0xFF;
     // 输出增益 (16bit)
     header[16] = 0;
     header[17] = 0;
     // 声道映射族
-    header[18] = 0;
+    header[18] = mappingFamily;
+    if (mappingFamily != 0)
+    {
+        header[19] = streamCount;
+        header[20] = coupledCount;
+        std::memcpy(header.data() + 21, mapping, channels);
+    }
 
     ogg_packet op;
     op.packet = header.data();
@@ -65,20 +434,11 @@ bool OpusOggEncoder::writeOpusHeader(std::vector<char> &output)
     {
         return false;
     }
-
-    ogg_page og;
-    while (ogg_stream_flush(&oggStreamState, &og) != 0)
-    {
-        const char *srcHead = reinterpret_cast<const char *>(og.header);
-        output.insert(output.end(), srcHead, srcHead + og.header_len);
-        const char *srcBody = reinterpret_cast<const char *>(og.body);
-        output.insert(output.end(), srcBody, srcBody + og.body_len);
-    }
-
+    appendHeaderPages();
     return true;
 }
 
-bool OpusOggEncoder::writeOpusComments(std::vector<char> &output)
+bool OpusOggEncoder::writeOpusComments()
 {
     std::string vendor = "pcm2opusogg encoder";
     std::vector<std::string> comments; // 可以添加额外的注释
@@ -139,164 +499,417 @@ bool OpusOggEncoder::writeOpusComments(std::vector<char> &output)
     {
         return false;
     }
+    appendHeaderPages();
+    return true;
+}
 
-    ogg_page og;
-    while (ogg_stream_flush(&oggStreamState, &og) != 0)
+bool OpusOggEncoder::Start()
+{
+    return initializeEncoder() && initializeOggStream() && writeHeaders();
+}
+
+bool OpusOggEncoder::Reset()
+{
+    if (!started() || !streamInitialized)
+    {
+        return Start();
+    }
+    // OPUS_RESET_STATE 只清空编码历史，VBR/码率/复杂度等参数保持不变
+    int ret = encoderCtl(OPUS_RESET_STATE);
+    if (ret != OPUS_OK)
+    {
+        std::cerr << "Failed to reset Opus encoder: " << opus_strerror(ret) << std::endl;
+        return false;
+    }
+    // 换一个新的serialno，Ogg流已分配的缓冲区保留复用
+    if (ogg_stream_reset_serialno(&oggStreamState, std::rand()) != 0)
+    {
+        std::cerr << "Failed to reset Ogg stream" << std::endl;
+        return false;
+    }
+    // 池里的实例会交给无关的会话，C接口能设置的复杂度和FEC恢复默认值，调节器的状态清空
+    if (encoderCtl(OPUS_SET_COMPLEXITY(DEFAULT_COMPLEXITY)) != OPUS_OK || encoderCtl(OPUS_SET_INBAND_FEC(0)) != OPUS_OK ||
+        encoderCtl(OPUS_SET_PACKET_LOSS_PERC(0)) != OPUS_OK)
+    {
+        std::cerr << "Failed to reset Opus encoder settings" << std::endl;
+        return false;
+    }
+    if (featuresShed && savedDred)
+    {
+        encoderCtl(OPUS_SET_DRED_DURATION(savedDred));
+    }
+    baseComplexity = DEFAULT_COMPLEXITY;
+    complexity = DEFAULT_COMPLEXITY;
+    avgEncodeNs = 0;
+    framesSinceChange = 0;
+    featuresShed = false;
+    savedFec = 0;
+    savedDred = 0;
+    cachedBytes = 0;
+    granulepos = 0;
+    pageStart = 0;
+    pagePolicy = PAGE_POLICY_DEFAULT;
+    pageValue = 0;
+    headersPending = true;
+    if (resampler && !SetInputRate(sampleRate))
+    {
+        return false;
+    }
+    if ((inputFormat != SAMPLE_FORMAT_S16 || inputChannels != channels) && !SetInputFormat(SAMPLE_FORMAT_S16, channels))
     {
-        const char *srcHead = reinterpret_cast<const char *>(og.header);
-        output.insert(output.end(), srcHead, srcHead + og.header_len);
-        const char *srcBody = reinterpret_cast<const char *>(og.body);
-        output.insert(output.end(), srcBody, srcBody + og.body_len);
+        return false;
     }
+    return writeHeaders();
+}
 
-    return true;
+size_t OpusOggEncoder::EncodeBound(size_t inputLength, bool last) const
+{
+    // 本次最多编码的帧数，last时末尾不足一帧也会补0编码一帧
+    size_t frames = (cachedBytes + inputLength) / bytesReadPerFrame + (last ? 1 : 0);
+    if (resampler)
+    {
+        size_t inputFrames = (cachedBytes + inputLength) / (inputChannels * sampleFormatBytes(inputFormat));
+        frames = (resampled.size() / channels + resampler->OutputBound(inputFrames, last)) / frameSize + (last ? 1 : 0);
+    }
+    // 每个包最多maxPacketBytes字节，需要 maxPacketBytes/255+1 个lacing值
+    size_t lacings = frames * (maxPacketBytes / 255 + 1);
+    size_t bodyBytes = frames * maxPacketBytes;
+    if (streamInitialized)
+    {
+        // Ogg流里还没有输出成页面的数据
+        bodyBytes += oggStreamState.body_fill - oggStreamState.body_returned;
+        lacings += oggStreamState.lacing_fill - oggStreamState.lacing_returned;
+    }
+    // 每页至少一个lacing值，页数不会超过lacing值个数
+    size_t bound = bodyBytes + lacings * (1 + 27);
+    if (headersPending)
+    {
+        bound += headerPages.size();
+    }
+    return bound;
 }
 
-bool OpusOggEncoder::Start()
+int OpusOggEncoder::Encode(const char *input, size_t inputLength, std::vector<char> &output, bool last)
 {
-    return initializeEncoder() && initializeOggStream();
+    // output的容量会被保留，调用方复用同一个vector时稳定后不再分配内存
+    size_t offset = output.size();
+    {
+        TRACE_SPAN("encode.output_resize");
+        output.resize(offset + EncodeBound(inputLength, last));
+    }
+    OutputSpan span(output.data() + offset, output.size() - offset);
+    int ret = Encode(input, inputLength, span, last);
+    output.resize(offset + span.size);
+    return ret;
 }
 
-int OpusOggEncoder::Encode(const std::vector<char> &input, std::vector<char> &output, bool last)
+int OpusOggEncoder::Encode(const char *input, size_t inputLength, OutputSpan &output, bool last)
 {
-    if (granulepos == 0)
+    SpanPageSink sink(output);
+    return Encode(input, inputLength, sink, last);
+}
+
+int OpusOggEncoder::Encode(const char *input, size_t inputLength, PageSink &sink, bool last)
+{
+    TRACE_SPAN("Encode");
+    if (!stats)
     {
-        // 写入头部信息
-        if (!writeOpusHeader(output) || !writeOpusComments(output))
-        {
-            std::cerr << "Failed to write Opus headers" << std::endl;
-            return -1;
-        }
-        packetno += 2;
+        int ret = encodeFrames(input, inputLength, sink, last);
+        return sink.Finish() ? ret : -1;
     }
+    uint64_t begin = statNowNs();
+    size_t outputBefore = sink.bytes;
+    int ret = encodeFrames(input, inputLength, sink, last);
+    if (!sink.Finish())
+    {
+        ret = -1;
+    }
+    stats->Record(CodecStats::EncodeCall, statNowNs() - begin);
+    stats->Add(CodecStats::EncodeInputBytes, inputLength);
+    stats->Add(CodecStats::EncodeOutputBytes, sink.bytes - outputBefore);
+    stats->SetCachedBytes(cachedBytes);
+    if (ret < 0)
+    {
+        stats->Add(CodecStats::EncodeErrors);
+    }
+    return ret;
+}
 
-    int inputLength = input.size();                              // 本次输入数据的总长度
-    std::vector<unsigned char> pcmBuffer(bytesReadPerFrame * 2); // pcm音频数据缓冲区，适当大小
-    std::vector<unsigned char> opusData(MAX_PACKET_SIZE);        // opus 数据缓冲区
+int OpusOggEncoder::encodeFrames(const char *input, size_t inputLength, PageSink &sink, bool last)
+{
+    // 写入头部信息
+    if (headersPending && !emitHeaders(sink))
+    {
+        return -1;
+    }
+
+    if (resampler)
+    {
+        return resampleFrames(input, inputLength, sink, last);
+    }
 
-    for (int index = 0; (inputLength == 0 && last) || index < inputLength;)
+    size_t index = 0;
+    bool flushCached = last && inputLength == 0; // 最后一次调用没有新数据时，把缓存(可能为空)补0编码成最后一帧
+    while (index < inputLength || flushCached)
     {
-        size_t bytesRead;
-        if (index == 0)
+        flushCached = false;
+        const unsigned char *frame;
+        if (cachedBytes == 0 && inputLength - index >= bytesReadPerFrame && directInput(input + index))
         {
-            size_t cachedBytes = internalBuffer.size();
-            // 算上缓存，长度满足一帧
-            if (inputLength + cachedBytes >= bytesReadPerFrame)
-            {
-                std::memcpy(pcmBuffer.data(), internalBuffer.data(), cachedBytes);
-                internalBuffer.clear();
-                bytesRead = bytesReadPerFrame - cachedBytes;
-                std::memcpy(pcmBuffer.data() + cachedBytes, input.data(), bytesRead);
-                index += bytesRead;
-            }
-            else // 算上缓存，长度不满足一帧
-            {
-                if (last)
-                { // 最后一帧了，不缓存了，梭哈
-                    std::memcpy(pcmBuffer.data(), internalBuffer.data(), cachedBytes);
-                    internalBuffer.clear();
-                    bytesRead = inputLength;
-                    std::memcpy(pcmBuffer.data() + cachedBytes, input.data(), bytesRead);
-                    index += bytesRead;
-                    // 填充0
-                    std::fill(pcmBuffer.begin() + bytesRead + cachedBytes, pcmBuffer.end(), 0);
-                }
-                else
-                { // 还没结束，继续缓存，等待满足1帧
-                    printf("continue cached %d\n", inputLength);
-                    internalBuffer.insert(internalBuffer.end(), input.begin(), input.end());
-                    break;
-                }
-            }
+            // 没有缓存且剩余长度满足一帧，直接从调用方内存编码或转换
+            frame = reinterpret_cast<const unsigned char *>(input + index);
+            index += bytesReadPerFrame;
         }
         else
         {
-            // 剩余长度满足一帧
-            if (inputLength - index >= bytesReadPerFrame)
-            {
-                bytesRead = bytesReadPerFrame;
-                std::memcpy(pcmBuffer.data(), input.data() + index, bytesRead);
-                index += bytesRead;
-            }
-            else
+            // 先凑满frameBuffer
+            TRACE_SPAN("encode.buffer");
+            size_t bytesRead = std::min(bytesReadPerFrame - cachedBytes, inputLength - index);
+            std::memcpy(frameBuffer.data() + cachedBytes, input + index, bytesRead);
+            cachedBytes += bytesRead;
+            index += bytesRead;
+            if (cachedBytes < bytesReadPerFrame)
             {
-                if (last) // 最后一帧了，梭哈
-                {
-                    bytesRead = inputLength - index;
-                    std::memcpy(pcmBuffer.data(), input.data() + index, bytesRead);
-                    index += bytesRead;
-                    // 填充0
-                    std::fill(pcmBuffer.begin() + bytesRead, pcmBuffer.end(), 0);
-                }
-                else // 不够1帧，缓存起来
-                {
-                    printf("cached %d\n", inputLength - index);
-                    internalBuffer.insert(internalBuffer.end(), input.begin() + index, input.end());
+                if (!last)
+                { // 不够1帧，留在frameBuffer里等待下次输入
                     break;
                 }
+                // 最后一帧了，填充0
+                std::fill(frameBuffer.begin() + cachedBytes, frameBuffer.end(), 0);
             }
+            cachedBytes = 0;
+            frame = frameBuffer.data();
         }
 
-        // 编码
-        int encodedBytes = opus_encode(encoder.get(), reinterpret_cast<const opus_int16 *>(pcmBuffer.data()), frameSize, opusData.data(), MAX_PACKET_SIZE);
-        if (encodedBytes < 0)
+        // 编码，S16以外的格式转换成float编码
+        if (!encodePacket(convertFrame(frame), inputFormat != SAMPLE_FORMAT_S16, last && (index >= inputLength), sink))
         {
-            std::cerr << "Encoding failed: " << opus_strerror(encodedBytes) << std::endl;
             return -1;
         }
+    }
 
-        // 创建Ogg包
-        ogg_packet op;
-        op.packet = opusData.data();
-        op.bytes = encodedBytes;
-        op.b_o_s = 0;
-        op.e_o_s = last && (index >= inputLength) ? 1 : 0;
-        op.granulepos = granulepos;
-        op.packetno = packetno++;
-
-        printf("granulepos %d, packetno %d, e_o_s %d, index: %d, encodedBytes: %d\n", granulepos, packetno, op.e_o_s, index, encodedBytes);
-        // 写入包
-        if (ogg_stream_packetin(&oggStreamState, &op) != 0)
+    if (last && !flushPages(sink))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+int OpusOggEncoder::Flush(std::vector<char> &output)
+{
+    size_t offset = output.size();
+    output.resize(offset + FlushBound());
+    OutputSpan span(output.data() + offset, output.size() - offset);
+    int ret = Flush(span);
+    output.resize(offset + span.size);
+    return ret;
+}
+
+int OpusOggEncoder::Flush(OutputSpan &output)
+{
+    SpanPageSink sink(output);
+    return Flush(sink);
+}
+
+int OpusOggEncoder::Flush(PageSink &sink)
+{
+    TRACE_SPAN("Flush");
+    if (!started() || !streamInitialized)
+    {
+        return -1;
+    }
+    size_t outputBefore = sink.bytes;
+    bool ok = (!headersPending || emitHeaders(sink)) && flushPages(sink);
+    if (!sink.Finish() || !ok)
+    {
+        return -1;
+    }
+    if (stats)
+    {
+        stats->Add(CodecStats::EncodeOutputBytes, sink.bytes - outputBefore);
+    }
+    return 0;
+}
+
+bool OpusOggEncoder::emitPages(PageSink &sink)
+{
+    TRACE_SPAN("ogg_stream_pageout");
+    // 每个包写入后按策略决定是否立即成页，pageout在积累够libogg的阈值之前不输出
+    bool flush = pagePolicy == PAGE_POLICY_PACKET ||
+                 (pagePolicy == PAGE_POLICY_DURATION && granulepos - pageStart >= static_cast<int64_t>(pageValue) * 48);
+    ogg_page og;
+    while (true)
+    {
+        int ret;
+        if (flush)
         {
-            std::cerr << "Error while writing packet to Ogg stream" << std::endl;
-            return -1;
+            ret = ogg_stream_flush(&oggStreamState, &og);
+        }
+        else if (pagePolicy == PAGE_POLICY_SIZE)
+        {
+            ret = ogg_stream_pageout_fill(&oggStreamState, &og, pageValue);
+        }
+        else
+        {
+            ret = ogg_stream_pageout(&oggStreamState, &og);
         }
+        if (ret == 0)
+        {
+            return true;
+        }
+        if (!writePage(og, sink))
+        {
+            std::cerr << "Failed to write pages" << std::endl;
+            return false;
+        }
+    }
+}
+
+bool OpusOggEncoder::flushPages(PageSink &sink)
+{
+    // 冲刷最后的数据
+    TRACE_SPAN("ogg_stream_flush");
+    ogg_page og;
+    while (ogg_stream_flush(&oggStreamState, &og) != 0)
+    {
+        if (!writePage(og, sink))
+        {
+            std::cerr << "Failed to write pages" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
 
-        // 写入页面
-        ogg_page og;
-        while (ogg_stream_pageout(&oggStreamState, &og) != 0)
+int OpusOggEncoder::resampleFrames(const char *input, size_t inputLength, PageSink &sink, bool last)
+{
+    size_t inputFrameBytes = inputChannels * sampleFormatBytes(inputFormat);
+    size_t index = 0;
+    while (true)
+    {
+        // 先凑满一块输入，最后一块可以不满
+        {
+            TRACE_SPAN("encode.buffer");
+            size_t bytesRead = std::min(bytesReadPerFrame - cachedBytes, inputLength - index);
+            std::memcpy(frameBuffer.data() + cachedBytes, input + index, bytesRead);
+            cachedBytes += bytesRead;
+            index += bytesRead;
+        }
+        bool final = last && index >= inputLength;
+        if (cachedBytes < bytesReadPerFrame && !final)
         {
-            const char *srcHead = reinterpret_cast<const char *>(og.header);
-            output.insert(output.end(), srcHead, srcHead + og.header_len);
-            const char *srcBody = reinterpret_cast<const char *>(og.body);
-            output.insert(output.end(), srcBody, srcBody + og.body_len);
+            break; // 不够一块，留在frameBuffer里等待下次输入
         }
-        granulepos += granule_increment;
 
-        if (inputLength == 0 && last)
-        { // 防止无限循环
+        // 不完整的采样丢弃
+        size_t frames = cachedBytes / inputFrameBytes;
+        cachedBytes = 0;
+        {
+            TRACE_SPAN("encode.resample");
+            resampler->Process(convertBlock(frameBuffer.data(), frames), frames, resampled, final);
+        }
+
+        // 凑满的帧依次编码，最后一块把剩余的样本补0编码成最后一帧
+        size_t frameSamples = frameSize * channels;
+        size_t offset = 0;
+        while (resampled.size() - offset >= frameSamples || (final && (offset < resampled.size() || offset == 0)))
+        {
+            if (resampled.size() - offset < frameSamples)
+            {
+                resampled.resize(offset + frameSamples, 0.0f);
+            }
+            offset += frameSamples;
+            if (!encodePacket(resampled.data() + offset - frameSamples, true, final && offset >= resampled.size(), sink))
+            {
+                return -1;
+            }
+        }
+        resampled.erase(resampled.begin(), resampled.begin() + offset);
+        if (final || index >= inputLength)
+        {
             break;
         }
     }
 
-    if (last)
+    if (last && !flushPages(sink))
+    {
+        return -1;
+    }
+    return 0;
+}
+
+bool OpusOggEncoder::encodePacket(const void *pcm, bool isFloat, bool eos, PageSink &sink)
+{
+    int encodedBytes;
+    uint64_t encodeNs = 0;
+    // 调节器停止后还要走一次govern恢复调用方的设置
+    bool governed = ComplexityGovernor::GetInstance()->Enabled() || complexity != baseComplexity || featuresShed;
     {
-        // 冲刷最后的数据
-        ogg_page og;
-        while (ogg_stream_flush(&oggStreamState, &og) != 0)
+        TRACE_SPAN("opus_encode");
+        uint64_t encodeBegin = stats || governed ? statNowNs() : 0;
+        if (msEncoder)
         {
-            const char *srcHead = reinterpret_cast<const char *>(og.header);
-            output.insert(output.end(), srcHead, srcHead + og.header_len);
-            const char *srcBody = reinterpret_cast<const char *>(og.body);
-            output.insert(output.end(), srcBody, srcBody + og.body_len);
+            encodedBytes = isFloat ? opus_multistream_encode_float(msEncoder.get(), static_cast<const float *>(pcm), frameSize, opusData.data(), maxPacketBytes)
+                                   : opus_multistream_encode(msEncoder.get(), static_cast<const opus_int16 *>(pcm), frameSize, opusData.data(), maxPacketBytes);
+        }
+        else if (isFloat)
+        {
+            encodedBytes = opus_encode_float(encoder.get(), static_cast<const float *>(pcm), frameSize, opusData.data(), maxPacketBytes);
+        }
+        else
+        {
+            encodedBytes = opus_encode(encoder.get(), static_cast<const opus_int16 *>(pcm), frameSize, opusData.data(), maxPacketBytes);
+        }
+        if (encodeBegin)
+        {
+            encodeNs = statNowNs() - encodeBegin;
+        }
+        if (stats)
+        {
+            stats->Record(CodecStats::OpusEncode, encodeNs);
+            stats->Add(CodecStats::FramesEncoded);
         }
     }
-    return 0;
+    if (encodedBytes < 0)
+    {
+        std::cerr << "Encoding failed: " << opus_strerror(encodedBytes) << std::endl;
+        return false;
+    }
+    if (governed)
+    {
+        govern(encodeNs);
+    }
+
+    // 创建Ogg包
+    ogg_packet op;
+    op.packet = opusData.data();
+    op.bytes = encodedBytes;
+    op.b_o_s = 0;
+    op.e_o_s = eos ? 1 : 0;
+    op.granulepos = granulepos + granule_increment; // 页面granulepos为最后一个完成的包的结束位置
+    op.packetno = packetno++;
+
+    // 写入包，packetin会移动libogg缓冲区里之前页面的页体，sink先处理掉对它们的引用
+    if (!sink.Release())
+    {
+        return false;
+    }
+    {
+        TRACE_SPAN("ogg_stream_packetin");
+        if (ogg_stream_packetin(&oggStreamState, &op) != 0)
+        {
+            std::cerr << "Error while writing packet to Ogg stream" << std::endl;
+            return false;
+        }
+    }
+
+    // 写入页面，granulepos先前进到本包结束的位置，页面时长按它计算
+    granulepos += granule_increment;
+    return emitPages(sink);
 }
 
 void OpusOggEncoder::end()
 {
-    printf("Encoding completed! channels: %d, sampleRate:%d, audio duration: %f s\n", channels, sampleRate, static_cast<double>(granulepos) / 48000.0);
     if (streamInitialized)
     {
         ogg_stream_clear(&oggStreamState);
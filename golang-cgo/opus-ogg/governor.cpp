@@ -0,0 +1,188 @@
+#include "governor.h"
+#include "codec_stats.h"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sched.h>
+#include <time.h>
+
+ComplexityGovernor *ComplexityGovernor::inst = new ComplexityGovernor();
+
+ComplexityGovernor *ComplexityGovernor::GetInstance()
+{
+    return inst;
+}
+
+ComplexityGovernor::ComplexityGovernor()
+    : enabled(false), cpuBudgetPercent(0), frameBudgetPercent(0), minComplexity(0), shedFeatures(false),
+      ceiling(GOVERNOR_MAX_COMPLEXITY), cpuPermille(0), overloaded(false), ceilingDowngrades(0), ceilingUpgrades(0),
+      stopping(false)
+{
+}
+
+bool ComplexityGovernor::Start(int cpuBudget, int frameBudget, int minLevel, bool shed, int intervalMs)
+{
+    if (cpuBudget <= 0 || cpuBudget > 100 || frameBudget <= 0 || minLevel < 0 || minLevel > GOVERNOR_MAX_COMPLEXITY)
+    {
+        return false;
+    }
+    Stop();
+    cpuBudgetPercent.store(cpuBudget);
+    frameBudgetPercent.store(frameBudget);
+    minComplexity.store(minLevel);
+    shedFeatures.store(shed);
+    ceiling.store(GOVERNOR_MAX_COMPLEXITY);
+    overloaded.store(false);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = false;
+    }
+    sampler = std::thread(&ComplexityGovernor::sampleLoop, this, std::max(10, intervalMs));
+    enabled.store(true, std::memory_order_release);
+    return true;
+}
+
+void ComplexityGovernor::Stop()
+{
+    // 停止后各会话在下一帧恢复调用方设置的复杂度和特性
+    enabled.store(false, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cond.notify_all();
+    if (sampler.joinable())
+    {
+        sampler.join();
+    }
+}
+
+static uint64_t processCpuNs()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ull + ts.tv_nsec;
+}
+
+void ComplexityGovernor::sampleLoop(int intervalMs)
+{
+    // 按进程允许运行的核数换算，容器里可能只分到一部分
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    int cpus = sched_getaffinity(0, sizeof(allowed), &allowed) == 0 ? CPU_COUNT(&allowed) : 1;
+    cpus = std::max(1, cpus);
+
+    uint64_t lastCpu = processCpuNs();
+    uint64_t lastWall = statNowNs();
+    int calm = 0; // 连续处于回升区间的采样次数
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!cond.wait_for(lock, std::chrono::milliseconds(intervalMs), [this] { return stopping; }))
+    {
+        uint64_t cpu = processCpuNs();
+        uint64_t wall = statNowNs();
+        uint64_t permille = wall > lastWall ? (cpu - lastCpu) * 1000 / ((wall - lastWall) * cpus) : 0;
+        lastCpu = cpu;
+        lastWall = wall;
+        cpuPermille.store(permille, std::memory_order_relaxed);
+
+        uint64_t budget = cpuBudgetPercent.load(std::memory_order_relaxed) * 10;
+        int current = ceiling.load(std::memory_order_relaxed);
+        overloaded.store(permille > budget, std::memory_order_relaxed);
+        if (permille > budget)
+        {
+            calm = 0;
+            if (current > minComplexity.load(std::memory_order_relaxed))
+            {
+                ceiling.store(current - 1, std::memory_order_relaxed);
+                statAdd(ceilingDowngrades, 1);
+            }
+        }
+        else if (permille * 100 < budget * GOVERNOR_RECOVER_PERCENT)
+        {
+            if (++calm >= GOVERNOR_RECOVER_INTERVALS && current < GOVERNOR_MAX_COMPLEXITY)
+            {
+                ceiling.store(current + 1, std::memory_order_relaxed);
+                statAdd(ceilingUpgrades, 1);
+                calm = 0;
+            }
+        }
+        else
+        {
+            calm = 0;
+        }
+    }
+}
+
+GovernorDecision ComplexityGovernor::Next(int current, int base, uint64_t avgNs, uint64_t frameNs, int framesSinceChange, bool shed, CodecStats *stats)
+{
+    GovernorDecision decision{current, shed};
+    int minLevel = std::min(base, minComplexity.load(std::memory_order_relaxed));
+    int limit = std::min(base, ceiling.load(std::memory_order_relaxed));
+    uint64_t budget = frameNs * frameBudgetPercent.load(std::memory_order_relaxed) / 100;
+    bool overBudget = avgNs > budget;
+    if (overBudget && stats)
+    {
+        stats->Add(CodecStats::GovernorOverBudgetFrames);
+    }
+
+    if (current > limit)
+    {
+        // 全局上限下降时立即跟随，不等保持期
+        decision.complexity = limit;
+    }
+    else if (framesSinceChange >= GOVERNOR_HOLD_FRAMES)
+    {
+        if (overBudget && current > minLevel)
+        {
+            decision.complexity = current - 1;
+        }
+        else if (avgNs * 2 < budget && current < limit)
+        {
+            decision.complexity = current + 1;
+        }
+    }
+    if (stats && decision.complexity != current)
+    {
+        stats->Add(decision.complexity < current ? CodecStats::GovernorDowngrades : CodecStats::GovernorUpgrades);
+    }
+
+    // 已经在最低档仍然超预算时关闭 FEC/DRED，升回最低档以上再恢复
+    if (shedFeatures.load(std::memory_order_relaxed))
+    {
+        if (!shed && decision.complexity <= minLevel && (overBudget || overloaded.load(std::memory_order_relaxed)) &&
+            framesSinceChange >= GOVERNOR_HOLD_FRAMES)
+        {
+            decision.shedFeatures = true;
+            if (stats)
+            {
+                stats->Add(CodecStats::GovernorFeatureSheds);
+            }
+        }
+        else if (shed && decision.complexity > minLevel)
+        {
+            decision.shedFeatures = false;
+            if (stats)
+            {
+                stats->Add(CodecStats::GovernorFeatureRestores);
+            }
+        }
+    }
+    return decision;
+}
+
+void ComplexityGovernor::Fill(OpusOggGovernorStatsData &out) const
+{
+    out.enabled = Enabled();
+    out.ceiling = ceiling.load(std::memory_order_relaxed);
+    out.cpuPermille = cpuPermille.load(std::memory_order_relaxed);
+    out.ceilingDowngrades = ceilingDowngrades.load(std::memory_order_relaxed);
+    out.ceilingUpgrades = ceilingUpgrades.load(std::memory_order_relaxed);
+    // 会话的指标在各自的统计里，和其他统计一样汇总进行中和已结束的会话
+    StatsSnapshot snapshot;
+    CodecStatsRegistry::GetInstance()->Aggregate(snapshot);
+    out.downgrades = snapshot.counters[CodecStats::GovernorDowngrades];
+    out.upgrades = snapshot.counters[CodecStats::GovernorUpgrades];
+    out.featureSheds = snapshot.counters[CodecStats::GovernorFeatureSheds];
+    out.featureRestores = snapshot.counters[CodecStats::GovernorFeatureRestores];
+    out.overBudgetFrames = snapshot.counters[CodecStats::GovernorOverBudgetFrames];
+}
@@ -0,0 +1,75 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "interface.h"
+
+class CodecStats;
+
+#define GOVERNOR_MAX_COMPLEXITY 10
+#define GOVERNOR_HOLD_FRAMES 50        // 会话调整复杂度后至少编码这么多帧再调整，等耗时按新复杂度稳定
+#define GOVERNOR_RECOVER_PERCENT 80    // 进程 CPU 低于预算的这个比例才开始回升，和超预算之间留出滞回区间
+#define GOVERNOR_RECOVER_INTERVALS 5   // 连续这么多次采样都在回升区间内，全局上限才升一级
+
+// 会话每帧之后的决定
+struct GovernorDecision
+{
+    int complexity;    // 下一帧的复杂度
+    bool shedFeatures; // 是否关闭 FEC/DRED
+};
+
+// 编码复杂度调节器：负载上升时逐级降低编码复杂度，用音质换 CPU，而不是等到帧赶不上实时
+// 两层控制:
+// - 全局: 采样线程每隔 intervalMs 测一次进程 CPU 占可用核的比例，超过预算时全局上限降一级，
+//   连续几次低于预算的 80% 才升一级
+// - 会话: 每帧记录 opus_encode 耗时的滑动平均，超过帧时长的 frameBudget 时自己降一级，
+//   低于一半时回升，但不超过全局上限和调用方设置的复杂度；每次调整后保持 GOVERNOR_HOLD_FRAMES 帧
+// 降到 minComplexity 仍超预算时可以再关闭 FEC/DRED，回升到最低档以上时恢复
+class ComplexityGovernor
+{
+private:
+    static ComplexityGovernor *inst;
+
+    std::atomic<bool> enabled;
+    std::atomic<int> cpuBudgetPercent;
+    std::atomic<int> frameBudgetPercent;
+    std::atomic<int> minComplexity;
+    std::atomic<bool> shedFeatures;
+    std::atomic<int> ceiling;     // 全局复杂度上限
+    std::atomic<int> cpuPermille; // 最近一次采样的进程 CPU 使用率
+    std::atomic<bool> overloaded; // 最近一次采样超过预算
+
+    // 全局上限的指标，只由采样线程修改；会话的指标记在各自的CodecStats里，读取时汇总
+    std::atomic<uint64_t> ceilingDowngrades;
+    std::atomic<uint64_t> ceilingUpgrades;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::thread sampler;
+    bool stopping;
+
+    ComplexityGovernor();
+    ~ComplexityGovernor() = default;
+
+    void sampleLoop(int intervalMs);
+
+public:
+    static ComplexityGovernor *GetInstance();
+
+    bool Start(int cpuBudget, int frameBudget, int minLevel, bool shed, int intervalMs);
+    void Stop();
+    bool Enabled() const
+    {
+        return enabled.load(std::memory_order_acquire);
+    }
+    // current 为会话当前的复杂度，base 为调用方设置的复杂度，avgNs 为每帧编码耗时的滑动平均，
+    // frameNs 为帧时长，framesSinceChange 为上次调整后编码的帧数；调整和超预算的次数记入会话自己的 stats，为空时不计
+    GovernorDecision Next(int current, int base, uint64_t avgNs, uint64_t frameNs, int framesSinceChange, bool shed, CodecStats *stats);
+    void Fill(OpusOggGovernorStatsData &out) const;
+};
+
+#endif // GOVERNOR_H
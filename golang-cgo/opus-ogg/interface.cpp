@@ -1,5 +1,7 @@
 #include "interface.h"
 #include "opus_ogg.h"
+#include "thread_pool.h"
+#include "async_engine.h"
 
 #ifdef __cplusplus
 extern "C"
@@ -10,41 +12,95 @@ extern "C"
 
     int OpusOggCodecStart(void **inst, int sampleRate)
     {
-        OpusOggCodec *ooc = new OpusOggCodec(sampleRate);
-        if (!ooc->Start())
+        return OpusOggCodecStartMultichannel(inst, sampleRate, 1, OPUS_OGG_MAPPING_MONO_STEREO);
+    }
+    int OpusOggCodecStartMultichannel(void **inst, int sampleRate, int channels, int mappingFamily)
+    {
+        TRACE_SPAN("OpusOggCodecStart");
+        if (!inst || channels < 1 || channels > MAX_CHANNELS)
+        {
+            return -1;
+        }
+        // 优先从池中借出已初始化的实例
+        OpusOggCodec *ooc = OpusOggCodecPool::GetInstance()->Acquire(sampleRate, channels, 480, mappingFamily);
+        if (!ooc)
         {
             return -1;
         }
         *inst = static_cast<void *>(ooc);
         return 0;
     }
+    int OpusOggCodecEncoderLayout(void *inst, OpusOggChannelLayout *layout)
+    {
+        if (!inst || !layout)
+        {
+            return -1;
+        }
+        static_cast<OpusOggCodec *>(inst)->EncoderLayout(*layout);
+        return 0;
+    }
+    int OpusOggCodecDecoderLayout(void *inst, OpusOggChannelLayout *layout)
+    {
+        if (!inst || !layout)
+        {
+            return -1;
+        }
+        return static_cast<OpusOggCodec *>(inst)->DecoderLayout(*layout) ? 0 : -1;
+    }
     int OpusOggCodecEnd(void **inst)
     {
+        TRACE_SPAN("OpusOggCodecEnd");
         if (!inst)
         {
             return 0;
         }
         OpusOggCodec *ooc = static_cast<OpusOggCodec *>(*inst);
-        delete ooc;
-        ooc = nullptr;
+        OpusOggCodecPool::GetInstance()->Release(ooc);
+        *inst = nullptr;
         return 0;
     }
 
+    int OpusOggCodecPoolConfig(int maxIdle)
+    {
+        if (maxIdle < 0)
+        {
+            return OPUS_OGG_ERR;
+        }
+        OpusOggCodecPool::GetInstance()->SetMaxIdle(maxIdle);
+        return OPUS_OGG_OK;
+    }
+
+    int OpusOggCodecPoolPrewarm(int sampleRate, int count)
+    {
+        if (count < 0)
+        {
+            return OPUS_OGG_ERR;
+        }
+        return OpusOggCodecPool::GetInstance()->Prewarm(sampleRate, 1, 480, count);
+    }
+
+    void OpusOggCodecPoolClear()
+    {
+        OpusOggCodecPool::GetInstance()->Clear();
+    }
+
     int OpusOggCodecEncode(void *inst, const char *input, int inputLen, char **output, int *outputLen, bool last)
     {
+        TRACE_SPAN("OpusOggCodecEncode");
         if (!inst || (inputLen>0 && !input) || !output || !outputLen)
         {
             return -1; // 参数错误
         }
 
         OpusOggCodec *ooc = static_cast<OpusOggCodec *>(inst);
-        std::vector<char> inputVec(input, input + inputLen);
-        std::vector<char> outputVec;
-        int ret = ooc->Encode(inputVec, outputVec, last);
+        // 直接读取input，结果先写入实例自带的缓冲区，只在返回给调用方时malloc一次
+        std::vector<char> &outputVec = ooc->Scratch();
+        int ret = ooc->Encode(input, inputLen, outputVec, last);
         if (ret != 0)
         {
             return ret;
         }
+        TRACE_SPAN("cgo.copy_out");
         *outputLen = outputVec.size();
         *output = (char *)malloc(*outputLen); // 使用 malloc, 外层go一定要注意 free 内存
         if (*output == nullptr)
@@ -62,19 +118,21 @@ extern "C"
     // }
     int OpusOggCodecDecode(void *inst, const char *input, int inputLen, char **output, int *outputLen, bool last)
     {
+        TRACE_SPAN("OpusOggCodecDecode");
         if (!inst || (inputLen>0 && !input)|| !output || !outputLen)
         {
             return -1; // 参数错误
         }
 
         OpusOggCodec *ooc = static_cast<OpusOggCodec *>(inst);
-        std::vector<char> inputVec(input, input + inputLen);
-        std::vector<char> outputVec;
-        int ret = ooc->Decode(inputVec, outputVec, last);
+        // 直接读取input，结果先写入实例自带的缓冲区，只在返回给调用方时malloc一次
+        std::vector<char> &outputVec = ooc->Scratch();
+        int ret = ooc->Decode(input, inputLen, outputVec, last);
         if (ret != 0)
         {
             return ret;
         }
+        TRACE_SPAN("cgo.copy_out");
         *outputLen = outputVec.size();
         *output = (char *)malloc(*outputLen); // 使用 malloc, 外层go一定要注意 free 内存
         if (*output == nullptr)
@@ -85,6 +143,364 @@ extern "C"
         return 0;
     }
 
+    int OpusOggCodecEncodeBound(void *inst, int inputLen, bool last)
+    {
+        if (!inst || inputLen < 0)
+        {
+            return OPUS_OGG_ERR;
+        }
+        OpusOggCodec *ooc = static_cast<OpusOggCodec *>(inst);
+        return ooc->EncodeBound(inputLen, last);
+    }
+
+    int OpusOggCodecSetInputFormat(void *inst, int format, int inputChannels)
+    {
+        if (!inst || !sampleFormatValid(format))
+        {
+            return OPUS_OGG_ERR;
+        }
+        OpusOggCodec *ooc = static_cast<OpusOggCodec *>(inst);
+        return ooc->SetInputFormat(static_cast<SampleFormat>(format), inputChannels) ? OPUS_OGG_OK : OPUS_OGG_ERR;
+    }
+
+    int OpusOggCodecSetInputRate(void *inst, int inputRate)
+    {
+        if (!inst)
+        {
+            return OPUS_OGG_ERR;
+        }
+        OpusOggCodec *ooc = static_cast<OpusOggCodec *>(inst);
+        return ooc->SetInputRate(inputRate) ? OPUS_OGG_OK : OPUS_OGG_ERR;
+    }
+
+    int OpusOggCodecSetOutputRate(void *inst, int outputRate)
+    {
+        if (!inst)
+        {
+            return OPUS_OGG_ERR;
+        }
+        OpusOggCodec *ooc = static_cast<OpusOggCodec *>(inst);
+        return ooc->SetOutputRate(outputRate) ? OPUS_OGG_OK : OPUS_OGG_ERR;
+    }
+
+    int OpusOggCodecEncodeInto(void *inst, const char *input, int inputLen, char *output, int outputCap, int *outputLen, bool last)
+    {
+        TRACE_SPAN("OpusOggCodecEncodeInto");
+        if (!inst || inputLen < 0 || (inputLen > 0 && !input) || outputCap < 0 || (outputCap > 0 && !output) || !outputLen)
+        {
+            return OPUS_OGG_ERR; // 参数错误
+        }
+
+        OpusOggCodec *ooc = static_cast<OpusOggCodec *>(inst);
+        // 先按最坏情况检查容量，不够时不消费输入，编码器状态保持不变
+        size_t bound = ooc->EncodeBound(inputLen, last);
+        if (static_cast<size_t>(outputCap) < bound)
+        {
+            *outputLen = bound;
+            return OPUS_OGG_ERR_BUFFER_TOO_SMALL;
+        }
+        OutputSpan span(output, outputCap);
+        int ret = ooc->Encode(input, inputLen, span, last);
+        *outputLen = span.size;
+        return ret;
+    }
+
+    int OpusOggCodecSetPagePolicy(void *inst, int policy, int value)
+    {
+        if (!inst)
+        {
+            return OPUS_OGG_ERR;
+        }
+        OpusOggCodec *ooc = static_cast<OpusOggCodec *>(inst);
+        return ooc->SetPagePolicy(static_cast<PagePolicy>(policy), value) ? OPUS_OGG_OK : OPUS_OGG_ERR;
+    }
+
+    int OpusOggCodecFlush(void *inst, char **output, int *outputLen)
+    {
+        TRACE_SPAN("OpusOggCodecFlush");
+        if (!inst || !output || !outputLen)
+        {
+            return OPUS_OGG_ERR; // 参数错误
+        }
+
+        OpusOggCodec *ooc = static_cast<OpusOggCodec *>(inst);
+        std::vector<char> &outputVec = ooc->Scratch();
+        int ret = ooc->Flush(outputVec);
+        if (ret != 0)
+        {
+            return ret;
+        }
+        *outputLen = outputVec.size();
+        *output = (char *)malloc(*outputLen); // 使用 malloc, 外层go一定要注意 free 内存
+        if (*output == nullptr)
+        {
+            return OPUS_OGG_ERR;
+        }
+        std::memcpy(*output, outputVec.data(), *outputLen);
+        return OPUS_OGG_OK;
+    }
+
+    int OpusOggCodecFlushInto(void *inst, char *output, int outputCap, int *outputLen)
+    {
+        TRACE_SPAN("OpusOggCodecFlushInto");
+        if (!inst || outputCap < 0 || (outputCap > 0 && !output) || !outputLen)
+        {
+            return OPUS_OGG_ERR; // 参数错误
+        }
+
+        OpusOggCodec *ooc = static_cast<OpusOggCodec *>(inst);
+        size_t bound = ooc->FlushBound();
+        if (static_cast<size_t>(outputCap) < bound)
+        {
+            *outputLen = bound;
+            return OPUS_OGG_ERR_BUFFER_TOO_SMALL;
+        }
+        OutputSpan span(output, outputCap);
+        int ret = ooc->Flush(span);
+        *outputLen = span.size;
+        return ret;
+    }
+
+    int OpusOggCodecEncodeToCallback(void *inst, const char *input, int inputLen, OpusOggPageCallback callback, void *userData, bool last)
+    {
+        TRACE_SPAN("OpusOggCodecEncodeToCallback");
+        if (!inst || inputLen < 0 || (inputLen > 0 && !input) || !callback)
+        {
+            return OPUS_OGG_ERR; // 参数错误
+        }
+        CallbackPageSink sink(callback, userData);
+        return static_cast<OpusOggCodec *>(inst)->Encode(input, inputLen, sink, last);
+    }
+
+    int OpusOggCodecEncodeToFd(void *inst, const char *input, int inputLen, int fd, bool last)
+    {
+        TRACE_SPAN("OpusOggCodecEncodeToFd");
+        if (!inst || inputLen < 0 || (inputLen > 0 && !input) || fd < 0)
+        {
+            return OPUS_OGG_ERR; // 参数错误
+        }
+        FdPageSink sink(fd);
+        return static_cast<OpusOggCodec *>(inst)->Encode(input, inputLen, sink, last);
+    }
+
+    int OpusOggCodecFlushToFd(void *inst, int fd)
+    {
+        TRACE_SPAN("OpusOggCodecFlushToFd");
+        if (!inst || fd < 0)
+        {
+            return OPUS_OGG_ERR; // 参数错误
+        }
+        FdPageSink sink(fd);
+        return static_cast<OpusOggCodec *>(inst)->Flush(sink);
+    }
+
+    int OpusOggCodecSetComplexity(void *inst, int complexity)
+    {
+        if (!inst)
+        {
+            return OPUS_OGG_ERR;
+        }
+        return static_cast<OpusOggCodec *>(inst)->SetComplexity(complexity) ? OPUS_OGG_OK : OPUS_OGG_ERR;
+    }
+
+    int OpusOggCodecComplexity(void *inst)
+    {
+        if (!inst)
+        {
+            return OPUS_OGG_ERR;
+        }
+        return static_cast<OpusOggCodec *>(inst)->Complexity();
+    }
+
+    int OpusOggCodecSetFec(void *inst, int packetLossPercent)
+    {
+        if (!inst)
+        {
+            return OPUS_OGG_ERR;
+        }
+        return static_cast<OpusOggCodec *>(inst)->SetFec(packetLossPercent) ? OPUS_OGG_OK : OPUS_OGG_ERR;
+    }
+
+    int OpusOggCodecGovernorStart(int cpuBudgetPercent, int frameBudgetPercent, int minComplexity, bool shedFeatures, int intervalMs)
+    {
+        return ComplexityGovernor::GetInstance()->Start(cpuBudgetPercent, frameBudgetPercent, minComplexity, shedFeatures, intervalMs) ? OPUS_OGG_OK : OPUS_OGG_ERR;
+    }
+
+    void OpusOggCodecGovernorStop()
+    {
+        ComplexityGovernor::GetInstance()->Stop();
+    }
+
+    int OpusOggCodecGovernorStats(OpusOggGovernorStatsData *stats)
+    {
+        if (!stats)
+        {
+            return OPUS_OGG_ERR;
+        }
+        ComplexityGovernor::GetInstance()->Fill(*stats);
+        return OPUS_OGG_OK;
+    }
+
+    int OpusOggCodecDecodeBound(void *inst)
+    {
+        if (!inst)
+        {
+            return OPUS_OGG_ERR;
+        }
+        OpusOggCodec *ooc = static_cast<OpusOggCodec *>(inst);
+        return ooc->DecodeBound();
+    }
+
+    int OpusOggCodecDecodeInto(void *inst, const char *input, int inputLen, char *output, int outputCap, int *outputLen, bool last)
+    {
+        TRACE_SPAN("OpusOggCodecDecodeInto");
+        if (!inst || inputLen < 0 || (inputLen > 0 && !input) || outputCap < 0 || (outputCap > 0 && !output) || !outputLen)
+        {
+            return OPUS_OGG_ERR; // 参数错误
+        }
+
+        OpusOggCodec *ooc = static_cast<OpusOggCodec *>(inst);
+        OutputSpan span(output, outputCap);
+        size_t needed = 0;
+        int ret = ooc->Decode(input, inputLen, span, last, &needed);
+        *outputLen = ret == OPUS_OGG_ERR_BUFFER_TOO_SMALL ? needed : span.size;
+        return ret;
+    }
+
+    static int runBatch(OpusOggCodecBatchItem *items, int count, int threads, bool encode)
+    {
+        if (!items || count < 0)
+        {
+            return OPUS_OGG_ERR;
+        }
+
+        std::atomic<int> failed(0);
+        std::function<void(int)> fn = [&](int i)
+        {
+            OpusOggCodecBatchItem &item = items[i];
+            int outputLen = 0;
+            if (encode)
+            {
+                item.status = OpusOggCodecEncodeInto(item.inst, item.input, item.inputLen, item.output, item.outputCap, &outputLen, item.last);
+            }
+            else
+            {
+                item.status = OpusOggCodecDecodeInto(item.inst, item.input, item.inputLen, item.output, item.outputCap, &outputLen, item.last);
+            }
+            item.outputLen = outputLen;
+            if (item.status < 0)
+            {
+                failed++;
+            }
+        };
+
+        if (threads <= 1)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                fn(i);
+            }
+        }
+        else
+        {
+            ThreadPool::Shared().ParallelFor(count, threads, fn);
+        }
+        return failed;
+    }
+
+    int OpusOggCodecEncodeBatch(OpusOggCodecBatchItem *items, int count, int threads)
+    {
+        TRACE_SPAN("OpusOggCodecEncodeBatch");
+        return runBatch(items, count, threads, true);
+    }
+
+    int OpusOggCodecDecodeBatch(OpusOggCodecBatchItem *items, int count, int threads)
+    {
+        TRACE_SPAN("OpusOggCodecDecodeBatch");
+        return runBatch(items, count, threads, false);
+    }
+
+    int OpusOggCodecAsyncStart(int workers, int queueDepth, bool pin)
+    {
+        return AsyncEngine::GetInstance()->Start(workers, queueDepth, pin);
+    }
+
+    void OpusOggCodecAsyncStop()
+    {
+        AsyncEngine::GetInstance()->Stop();
+    }
+
+    int OpusOggCodecAsyncSubmit(void *inst, int op, const char *input, int inputLen, char *output, int outputCap, bool last, unsigned long long userData)
+    {
+        if (!inst || inputLen < 0 || (inputLen > 0 && !input) || outputCap < 0 || (outputCap > 0 && !output))
+        {
+            return OPUS_OGG_ERR; // 参数错误
+        }
+        AsyncJob job = {static_cast<OpusOggCodec *>(inst), op, input, inputLen, output, outputCap, last, userData};
+        return AsyncEngine::GetInstance()->Submit(job);
+    }
+
+    int OpusOggCodecAsyncPoll(OpusOggCodecCompletion *completions, int max, int timeoutMs)
+    {
+        return AsyncEngine::GetInstance()->Poll(completions, max, timeoutMs);
+    }
+
+    int OpusOggCodecStats(void *inst, OpusOggCodecStatsData *stats)
+    {
+        if (!stats)
+        {
+            return OPUS_OGG_ERR;
+        }
+        StatsSnapshot snapshot;
+        if (inst)
+        {
+            snapshot.Add(static_cast<OpusOggCodec *>(inst)->Stats(), true);
+        }
+        else
+        {
+            CodecStatsRegistry::GetInstance()->Aggregate(snapshot);
+        }
+        snapshot.Fill(*stats);
+        return OPUS_OGG_OK;
+    }
+
+    int OpusOggCodecStatsShmOpen(const char *name, int intervalMs)
+    {
+        if (!name || intervalMs <= 0)
+        {
+            return OPUS_OGG_ERR;
+        }
+        return CodecStatsRegistry::GetInstance()->OpenShm(name, intervalMs) ? OPUS_OGG_OK : OPUS_OGG_ERR;
+    }
+
+    void OpusOggCodecStatsShmClose()
+    {
+        CodecStatsRegistry::GetInstance()->CloseShm();
+    }
+
+    int OpusOggCodecStatsShmRead(const char *name, OpusOggCodecStatsData *stats)
+    {
+        if (!name || !stats)
+        {
+            return OPUS_OGG_ERR;
+        }
+        return CodecStatsRegistry::ReadShm(name, *stats) ? OPUS_OGG_OK : OPUS_OGG_ERR;
+    }
+
+    int OpusOggCodecTraceDump(const char *path)
+    {
+#ifdef OPUS_OGG_TRACE
+        if (!path)
+        {
+            return OPUS_OGG_ERR;
+        }
+        return traceDump(path) ? OPUS_OGG_OK : OPUS_OGG_ERR;
+#else
+        (void)path;
+        return OPUS_OGG_ERR; // 编译时未开启追踪
+#endif
+    }
+
 #ifdef __cplusplus
 }
 #endif
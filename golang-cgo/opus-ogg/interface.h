@@ -9,11 +9,257 @@ extern "C"
 #include <stdlib.h>
 #include <stdbool.h> // Include this to support bool in C
 
+// 返回码
+#define OPUS_OGG_OK 0
+#define OPUS_OGG_ERR -1                  // 参数错误或编解码失败
+#define OPUS_OGG_ERR_BUFFER_TOO_SMALL -2 // 输出缓冲区不足，*outputLen 为需要的字节数
+#define OPUS_OGG_MORE_OUTPUT 1           // 输出缓冲区已写满，还有数据待取出，需以 inputLen=0 再次调用
+
     int OpusOggCodecStart(void **inst, int sampleRate);
     int OpusOggCodecEnd(void **inst);
+
+// 声道映射族，见 RFC 7845 5.1.1
+#define OPUS_OGG_MAPPING_MONO_STEREO 0 // 单流，1~2 声道，Start 的默认值
+#define OPUS_OGG_MAPPING_SURROUND 1    // Vorbis 声道顺序的环绕声，1~8 声道
+#define OPUS_OGG_MAPPING_DISCRETE 255  // 互不相关的声道，每个声道一个单声道流，1~255 声道
+    // 多声道编码实例，编码输入为 channels 个声道交错排列的 PCM
+    int OpusOggCodecStartMultichannel(void **inst, int sampleRate, int channels, int mappingFamily);
+
+    // 声道布局，与 OpusHead 的映射表一致
+    typedef struct
+    {
+        int channels;
+        int mappingFamily;
+        int streams;              // Opus 流数
+        int coupledStreams;       // 其中的立体声流数，排在前面
+        unsigned char mapping[255]; // 第 i 个输出声道来自的解码声道，255 表示静音
+    } OpusOggChannelLayout;
+
+    // 编码器的布局，Start 之后即可取得
+    int OpusOggCodecEncoderLayout(void *inst, OpusOggChannelLayout *layout);
+    // 解码得到的布局，解析到 OpusHead 之前返回 OPUS_OGG_ERR；解码输出按 layout->channels 个声道交错排列
+    int OpusOggCodecDecoderLayout(void *inst, OpusOggChannelLayout *layout);
+
+    // 实例池：Start 优先借出池中已初始化的实例并重置状态，End 归还实例而不是释放
+    // maxIdle 为每种采样率最多保留的空闲实例数，0 表示关闭池，默认 32
+    int OpusOggCodecPoolConfig(int maxIdle);
+    // 预先创建 count 个实例放入池中，返回实际放入的个数，用于应对建连高峰
+    int OpusOggCodecPoolPrewarm(int sampleRate, int count);
+    void OpusOggCodecPoolClear();
     int OpusOggCodecEncode(void *inst, const char *input, int inputLen, char **output, int *outputLen, bool last);
     int OpusOggCodecDecode(void *inst, const char *input, int inputLen, char **output, int *outputLen, bool last);
 
+    // 零拷贝接口：直接读取调用方的 input，结果直接写入调用方持有的 output(容量 outputCap)，内部不再 malloc
+    // EncodeBound 返回本次编码最坏情况下的输出字节数，output 不小于该值时编码一定成功；
+    // 容量不足时返回 OPUS_OGG_ERR_BUFFER_TOO_SMALL 且不消费本次输入，可直接用更大的缓冲区重试
+    int OpusOggCodecEncodeBound(void *inst, int inputLen, bool last);
+    int OpusOggCodecEncodeInto(void *inst, const char *input, int inputLen, char *output, int outputCap, int *outputLen, bool last);
+
+// 编码输入的采样格式，均为小端、多声道交错排列
+#define OPUS_OGG_FORMAT_S16 0 // 16位整数，默认
+#define OPUS_OGG_FORMAT_F32 1 // 32位浮点，满幅为[-1, 1]
+#define OPUS_OGG_FORMAT_S24 2 // 24位整数，每个采样3字节紧密排列
+#define OPUS_OGG_FORMAT_S32 3 // 32位整数
+    // Start 之后、第一次 Encode 之前调用，输入直接转换进编码帧，非 S16 格式以 float 编码
+    // inputChannels 为 2 而编码为单声道时先下混；End 归还到池后恢复为 S16
+    int OpusOggCodecSetInputFormat(void *inst, int format, int inputChannels);
+    // Start 之后、第一次 Encode 之前调用，inputRate 与 Start 的 sampleRate 不同时在编码器内重采样，
+    // OpusHead 记录 inputRate；End 归还到池后恢复为 sampleRate
+    int OpusOggCodecSetInputRate(void *inst, int inputRate);
+    // 第一次 Decode 之前调用，按 outputRate 输出 PCM，0 表示使用 OpusHead 记录的原始采样率(默认)
+    int OpusOggCodecSetOutputRate(void *inst, int outputRate);
+// Ogg 页面的切分策略
+#define OPUS_OGG_PAGE_DEFAULT 0    // libogg 默认，约 4KB 一页，48kbps 时积累接近一秒才输出
+#define OPUS_OGG_PAGE_PER_PACKET 1 // 每个包单独成页，首字节延迟最小，适合流式 TTS
+#define OPUS_OGG_PAGE_DURATION 2   // 页面时长达到 value 毫秒即输出
+#define OPUS_OGG_PAGE_SIZE 3       // 页面达到 value 字节才输出，批量任务用大页减少页头和 CRC 开销
+    // 随时可以调用，从下一个包开始生效；End 归还到池后恢复为 OPUS_OGG_PAGE_DEFAULT
+    int OpusOggCodecSetPagePolicy(void *inst, int policy, int value);
+    // 立即输出头部页面和已编码但还在 Ogg 流里的包，不足一帧的输入继续缓存，流不结束
+    // 头部页面在 Start 时生成，Start 之后马上调用 Flush 即可先取得头部
+    int OpusOggCodecFlush(void *inst, char **output, int *outputLen);
+    // 容量不足时返回 OPUS_OGG_ERR_BUFFER_TOO_SMALL，*outputLen 为需要的字节数，状态不变
+    int OpusOggCodecFlushInto(void *inst, char *output, int outputCap, int *outputLen);
+
+    // 编码结果不经过输出缓冲区，直接交给输出目标
+    // 回调：每个 Ogg 页面调用一次，header/body 为页头和页体；头部页面连在一起作为一次调用，body 为空
+    // 指针指向编码器内部，只在回调期间有效；回调返回非 0 时本次调用失败
+    typedef int (*OpusOggPageCallback)(void *userData, const unsigned char *header, int headerLen, const unsigned char *body, int bodyLen);
+    int OpusOggCodecEncodeToCallback(void *inst, const char *input, int inputLen, OpusOggPageCallback callback, void *userData, bool last);
+    // fd：文件、管道或 socket，本次调用产生的页面合并成尽量少的 writev，返回前全部写出；非阻塞的 fd 会等到可写
+    int OpusOggCodecEncodeToFd(void *inst, const char *input, int inputLen, int fd, bool last);
+    int OpusOggCodecFlushToFd(void *inst, int fd);
+
+    // DecodeBound 返回单个音频包解码后的最大字节数，output 不小于该值时每次调用至少能解出一个包；
+    // 解码时输入总是被全部接收，返回 OPUS_OGG_MORE_OUTPUT 或 OPUS_OGG_ERR_BUFFER_TOO_SMALL 后以 inputLen=0 继续取
+    int OpusOggCodecDecodeBound(void *inst);
+    int OpusOggCodecDecodeInto(void *inst, const char *input, int inputLen, char *output, int outputCap, int *outputLen, bool last);
+
+    // 批量接口的单项描述，字段含义与 OpusOggCodecEncodeInto/DecodeInto 的参数相同
+    typedef struct
+    {
+        void *inst;
+        const char *input;
+        int inputLen;
+        char *output;
+        int outputCap;
+        bool last;
+        int outputLen; // 输出: 写入的字节数，BUFFER_TOO_SMALL 时为需要的字节数
+        int status;    // 输出: 与单路接口的返回值相同
+    } OpusOggCodecBatchItem;
+
+    // 一次调用处理多路会话，摊薄每路每帧一次的 cgo 调用开销
+    // threads<=1 时在调用线程上顺序处理，否则最多用 threads 个线程(含调用线程)并行处理
+    // 同一个 inst 在一个批次里只能出现一次；返回失败的项数，每项结果见 status
+    int OpusOggCodecEncodeBatch(OpusOggCodecBatchItem *items, int count, int threads);
+    int OpusOggCodecDecodeBatch(OpusOggCodecBatchItem *items, int count, int threads);
+
+// 异步引擎，任务类型和返回码
+#define OPUS_OGG_JOB_ENCODE 0       // 同 OpusOggCodecEncodeInto
+#define OPUS_OGG_JOB_DECODE 1       // 同 OpusOggCodecDecodeInto
+#define OPUS_OGG_JOB_FLUSH 2        // 同 OpusOggCodecFlushInto，忽略 input 和 last
+#define OPUS_OGG_ERR_QUEUE_FULL -3  // 实例所在工作线程的队列已满，取走一些完成事件后重试
+
+    typedef struct
+    {
+        unsigned long long userData; // 提交时的 userData，原样带回
+        void *inst;
+        int op;
+        int status;    // 与对应同步接口的返回值相同
+        int outputLen; // 与对应同步接口的 *outputLen 相同
+    } OpusOggCodecCompletion;
+
+    // 启动异步引擎：每个实例第一次提交时固定分给一个工作线程，同一实例的任务按提交顺序执行，
+    // 编解码器状态一直留在该核的缓存里，调用线程只负责入队，不再阻塞在编解码上
+    // workers<=0 时按进程可用的核数；queueDepth 为每个工作线程的队列长度，<=0 时为 1024；
+    // pin 为 true 时第 i 个工作线程绑定到第 i 个可用核
+    // 返回 eventfd，有新的完成事件时可读，可以加入调用方自己的 epoll；失败返回 OPUS_OGG_ERR
+    int OpusOggCodecAsyncStart(int workers, int queueDepth, bool pin);
+    // 执行完已提交的任务后停止，未取走的完成事件丢弃，eventfd 关闭
+    // 调用方必须保证此时没有正在执行的 Submit/Poll(包括阻塞在 Poll 里的线程)，Stop 返回前也不能再调用，否则会访问已释放的队列
+    void OpusOggCodecAsyncStop();
+    // 提交一个任务，参数含义与同步的 Into 接口相同；input/output 在收到完成事件之前必须保持有效，
+    // Go 调用方需用 C.malloc 的内存或 runtime.Pinner 固定的内存；有任务未完成时不能对该实例调用同步接口
+    int OpusOggCodecAsyncSubmit(void *inst, int op, const char *input, int inputLen, char *output, int outputCap, bool last, unsigned long long userData);
+    // 取走最多 max 个完成事件，没有时最多等待 timeoutMs 毫秒(-1 一直等待，0 立即返回)，返回取到的个数
+    int OpusOggCodecAsyncPoll(OpusOggCodecCompletion *completions, int max, int timeoutMs);
+
+// 本机编解码服务 codec_server 的客户端，会话类型和额外的返回码
+#define OPUS_OGG_REMOTE_ENCODE 0      // 写入 PCM，读出 Ogg Opus
+#define OPUS_OGG_REMOTE_DECODE 1      // 写入 Ogg Opus，读出 PCM
+#define OPUS_OGG_ERR_QUOTA -10        // 超过该用户的会话数或共享内存配额
+#define OPUS_OGG_ERR_NOT_FOUND -11    // Attach 的会话不存在、token 不对或仍被其他连接持有
+
+    // 连接服务，socketPath 为 NULL 时用 /tmp/opus_ogg_codec.sock；一个连接同一时间只能由一个线程使用
+    int OpusOggRemoteConnect(const char *socketPath, void **conn);
+    // 断开连接并释放其上未 Close 的会话句柄，这些会话在服务端保留 -linger 秒，可用 Attach 接管
+    int OpusOggRemoteDisconnect(void **conn);
+    // 打开会话，pagePolicy/pageValue 同 OpusOggCodecSetPagePolicy，只对编码会话有效；
+    // ringBytes 为输入、输出环各自的大小，0 表示 256KB
+    int OpusOggRemoteOpen(void *conn, int op, int sampleRate, int channels, int mappingFamily, int pagePolicy, int pageValue, int ringBytes, void **session);
+    // 接管连接已断开的会话(如进程重启)，id 和 token 由 SessionInfo 取得，需与原会话同一用户
+    int OpusOggRemoteAttach(void *conn, unsigned long long id, unsigned long long token, void **session);
+    int OpusOggRemoteSessionInfo(void *session, unsigned long long *id, unsigned long long *token);
+    // 写入输入，返回实际写入的字节数，输入环满时可能小于 inputLen，需要先 Read 腾出服务端的输出空间再重试；
+    // last 在全部写入时才生效
+    int OpusOggRemoteWrite(void *session, const char *input, int inputLen, bool last);
+    // 读出输出，没有数据时最多等待 timeoutMs 毫秒(-1 一直等待，0 立即返回)，返回读到的字节数；
+    // *finished 为 true 表示输出已全部读完；服务端编解码出错时返回错误码
+    int OpusOggRemoteRead(void *session, char *output, int outputCap, int timeoutMs, bool *finished);
+    // 结束会话，服务端归还编解码实例
+    int OpusOggRemoteClose(void **session);
+
+    // 编码参数，Start 之后随时可以调用，只对本次会话有效；从池里取出的实例恢复为默认值
+    // complexity 为 0~10，默认 8，复杂度调节器运行时作为上限
+    int OpusOggCodecSetComplexity(void *inst, int complexity);
+    // 当前实际生效的复杂度，调节器可能已经把它降到 SetComplexity 的值以下
+    int OpusOggCodecComplexity(void *inst);
+    // 开启带内 FEC，按 packetLossPercent 的预期丢包率编码冗余，0 关闭
+    int OpusOggCodecSetFec(void *inst, int packetLossPercent);
+
+    // 复杂度调节器的指标
+    typedef struct
+    {
+        int enabled;
+        int ceiling;     // 当前的全局复杂度上限
+        int cpuPermille; // 最近一次采样的进程 CPU 使用率，千分比，相对于进程可用的核数
+        unsigned long long downgrades;        // 会话降低复杂度的次数
+        unsigned long long upgrades;          // 会话回升复杂度的次数
+        unsigned long long ceilingDowngrades; // 全局上限因 CPU 超预算下降的次数
+        unsigned long long ceilingUpgrades;
+        unsigned long long featureSheds;      // 会话在最低复杂度仍超预算、关闭 FEC/DRED 的次数
+        unsigned long long featureRestores;
+        unsigned long long overBudgetFrames;  // 编码耗时的滑动平均超过单帧预算的帧数
+    } OpusOggGovernorStatsData;
+
+    // 启动复杂度调节器：负载上升时逐级降低各会话的编码复杂度，用音质换 CPU，而不是等到帧赶不上实时
+    // cpuBudgetPercent: 进程 CPU 占可用核的百分比上限，每 intervalMs 毫秒采样一次，超过时全局上限降一级，
+    //   连续几次低于预算的 80% 才回升一级
+    // frameBudgetPercent: 单帧 opus_encode 耗时占帧时长的百分比上限，会话超过时自己降一级，低于一半时回升
+    // minComplexity: 最低降到的复杂度；shedFeatures 为 true 时在最低复杂度仍超预算时再关闭 FEC/DRED
+    // 每次调整后保持 50 帧再调整；停止后各会话在下一帧恢复原来的设置
+    int OpusOggCodecGovernorStart(int cpuBudgetPercent, int frameBudgetPercent, int minComplexity, bool shedFeatures, int intervalMs);
+    void OpusOggCodecGovernorStop();
+    int OpusOggCodecGovernorStats(OpusOggGovernorStatsData *stats);
+
+    // 延迟分布，单位纳秒；分位数取直方图桶的上界，相对误差不超过 12.5%
+    typedef struct
+    {
+        unsigned long long count;
+        unsigned long long sumNs;
+        unsigned long long maxNs;
+        unsigned long long p50Ns;
+        unsigned long long p90Ns;
+        unsigned long long p99Ns;
+        unsigned long long p999Ns;
+    } OpusOggLatencyStats;
+
+    // 编解码统计，字节数均为调用方视角：编码输入 PCM、输出 Ogg，解码输入 Ogg、输出 PCM
+    typedef struct
+    {
+        unsigned long long sessions; // 进行中的会话数
+        unsigned long long framesEncoded;
+        unsigned long long framesDecoded;
+        unsigned long long encodeInputBytes;
+        unsigned long long encodeOutputBytes;
+        unsigned long long decodeInputBytes;
+        unsigned long long decodeOutputBytes;
+        unsigned long long cachedBytes; // 进行中的会话里缓存的不足一帧的 PCM 字节数
+        unsigned long long pagesEmitted;
+        unsigned long long encodeErrors;
+        unsigned long long decodeErrors;
+        OpusOggLatencyStats opusEncode; // 单次 opus_encode
+        OpusOggLatencyStats opusDecode; // 单次 opus_decode
+        OpusOggLatencyStats encodeCall; // 单次 Encode/EncodeInto 调用
+        OpusOggLatencyStats decodeCall; // 单次 Decode/DecodeInto 调用
+    } OpusOggCodecStatsData;
+
+    // inst 不为 NULL 时返回该实例当前会话的统计；为 NULL 时返回进程内的汇总，包括已结束的会话
+    int OpusOggCodecStats(void *inst, OpusOggCodecStatsData *stats);
+
+// 共享内存统计页的布局，外部工具按此结构映射后读取
+#define OPUS_OGG_STATS_MAGIC "OOSTATS1"
+    typedef struct
+    {
+        char magic[8];
+        unsigned int size;       // sizeof(OpusOggCodecStatsPage)
+        int pid;
+        unsigned long long seq;  // 写入前后各加 1，奇数表示正在写入，读前后不一致时需重读
+        long long updatedMs;     // 最近一次写入的时间，Unix 毫秒
+        OpusOggCodecStatsData data;
+    } OpusOggCodecStatsPage;
+
+    // 创建共享内存统计页(shm_open 的名字，如 "/opus_ogg_stats")，后台线程每 intervalMs 毫秒写入一次进程汇总
+    int OpusOggCodecStatsShmOpen(const char *name, int intervalMs);
+    // 停止写入并删除统计页
+    void OpusOggCodecStatsShmClose();
+    // 读取其他进程的统计页，供外部工具轮询
+    int OpusOggCodecStatsShmRead(const char *name, OpusOggCodecStatsData *stats);
+
+    // 把各线程记录的编解码阶段耗时写成 Chrome trace JSON，可用 chrome://tracing 或 Perfetto 打开
+    // 需要编译时加 -DOPUS_OGG_TRACE，否则返回 OPUS_OGG_ERR
+    int OpusOggCodecTraceDump(const char *path);
+
 #ifdef __cplusplus
 }
 #endif
@@ -11,6 +11,7 @@ import (
 	"fmt"
 	"io"
 	"os"
+	"time"
 	"unsafe"
 )
 
@@ -18,6 +19,8 @@ type opusOggInst struct {
 	inst unsafe.Pointer
 }
 
+var pagePolicies = map[string]C.int{"default": C.OPUS_OGG_PAGE_DEFAULT, "packet": C.OPUS_OGG_PAGE_PER_PACKET, "duration": C.OPUS_OGG_PAGE_DURATION, "size": C.OPUS_OGG_PAGE_SIZE}
+
 func main() {
 	fmt.Println(">>> START <<<")
 	var (
@@ -27,14 +30,46 @@ func main() {
 		i              string
 		outputFileName string
 		o              string
+		traceFileName  string
+		inputFormat    string
+		channels       int
+		mappingFamily  int
+		inputChannels  int
+		inputRate      int
+		outputRate     int
+		pagePolicy     string
+		pageValue      int
+		server         string
+		sink           string
+		complexity     int
+		fec            int
+		cpuBudget      int
+		frameBudget    int
+		minComplexity  int
 	)
 
-	flag.StringVar(&mode, "mode", "", "encode or decode")
-	flag.StringVar(&m, "m", "default", "encode or decode")
+	flag.StringVar(&mode, "mode", "", "encode, decode, bench or stats")
+	flag.StringVar(&m, "m", "default", "encode, decode, bench or stats")
 	flag.StringVar(&inputFileName, "inputFileName", "", "输入文件")
 	flag.StringVar(&i, "i", "default", "输入文件")
 	flag.StringVar(&outputFileName, "outputFileName", "", "输出文件")
 	flag.StringVar(&o, "o", "default", "输出文件")
+	flag.StringVar(&traceFileName, "trace", "", "结束时导出 Chrome trace JSON，库需以 -DOPUS_OGG_TRACE 编译")
+	flag.StringVar(&inputFormat, "format", "s16", "编码输入的采样格式: s16, f32, s24 或 s32")
+	flag.IntVar(&channels, "channels", 1, "编码的声道数")
+	flag.IntVar(&mappingFamily, "mappingFamily", 0, "声道映射族: 0 为 1~2 声道，1 为 Vorbis 顺序的环绕声，255 为互不相关的声道")
+	flag.IntVar(&inputChannels, "inputChannels", 0, "编码输入的声道数，0 表示与 -channels 相同，单声道编码时 2 表示先下混")
+	flag.IntVar(&inputRate, "inputRate", 24000, "编码输入的采样率，不是 24000 时在编码器内重采样")
+	flag.IntVar(&outputRate, "outputRate", 0, "解码输出的采样率，0 表示使用编码时的原始采样率")
+	flag.StringVar(&pagePolicy, "pagePolicy", "default", "Ogg 页面切分策略: default, packet, duration(-pageValue 毫秒) 或 size(-pageValue 字节)")
+	flag.IntVar(&pageValue, "pageValue", 0, "duration 策略的页面最长毫秒数或 size 策略的页面目标字节数")
+	flag.StringVar(&sink, "sink", "buffer", "编码输出方式: buffer 写入内存再一次写文件，fd 由编码器直接 writev 到输出文件")
+	flag.IntVar(&complexity, "complexity", 8, "编码复杂度 0~10，开启调节器时为上限")
+	flag.IntVar(&fec, "fec", 0, "开启带内 FEC 的预期丢包率百分比，0 关闭")
+	flag.IntVar(&cpuBudget, "cpuBudget", 0, "开启复杂度调节器，进程 CPU 占可用核的百分比上限，0 关闭")
+	flag.IntVar(&frameBudget, "frameBudget", 20, "调节器的单帧编码耗时上限，占帧时长的百分比")
+	flag.IntVar(&minComplexity, "minComplexity", 2, "调节器最低降到的复杂度，降到此仍超预算时关闭 FEC/DRED")
+	flag.StringVar(&server, "server", "", "codec_server 的 socket 路径，设置时 encode/decode 交给服务端处理")
 	flag.Parse()
 
 	if m != "default" {
@@ -49,13 +84,64 @@ func main() {
 
 	fmt.Println("Params:", mode, inputFileName, outputFileName)
 
+	if inputChannels == 0 {
+		inputChannels = channels
+	}
+
+	if mode == "bench" {
+		runBenchmarks()
+		return
+	}
+	if mode == "stats" {
+		// 轮询其他进程通过 OpusOggCodecStatsShmOpen 发布的统计页，-i 为共享内存名
+		pollStats(inputFileName)
+		return
+	}
+	if server != "" {
+		runRemote(server, mode, inputFileName, outputFileName, channels, mappingFamily, pagePolicy, pageValue)
+		return
+	}
+
+	if cpuBudget > 0 {
+		if C.OpusOggCodecGovernorStart(C.int(cpuBudget), C.int(frameBudget), C.int(minComplexity), C.bool(true), 200) != C.OPUS_OGG_OK {
+			fmt.Println("Invalid governor budget", cpuBudget, frameBudget, minComplexity)
+			return
+		}
+		defer C.OpusOggCodecGovernorStop()
+	}
+
 	ooInst := &opusOggInst{}
 	cIntSampleRate := C.int(24000)
-	retC := C.OpusOggCodecStart(&(ooInst.inst), cIntSampleRate)
+	retC := C.OpusOggCodecStartMultichannel(&(ooInst.inst), cIntSampleRate, C.int(channels), C.int(mappingFamily))
 	if retC != 0 {
 		fmt.Println("Start error ", retC)
 		return
 	}
+	if mode == "encode" {
+		formats := map[string]C.int{"s16": C.OPUS_OGG_FORMAT_S16, "f32": C.OPUS_OGG_FORMAT_F32, "s24": C.OPUS_OGG_FORMAT_S24, "s32": C.OPUS_OGG_FORMAT_S32}
+		format, ok := formats[inputFormat]
+		if !ok || C.OpusOggCodecSetInputFormat(ooInst.inst, format, C.int(inputChannels)) != C.OPUS_OGG_OK {
+			fmt.Println("Invalid input format", inputFormat, inputChannels)
+			return
+		}
+		if C.OpusOggCodecSetInputRate(ooInst.inst, C.int(inputRate)) != C.OPUS_OGG_OK {
+			fmt.Println("Invalid input rate", inputRate)
+			return
+		}
+		policy, ok := pagePolicies[pagePolicy]
+		if !ok || C.OpusOggCodecSetPagePolicy(ooInst.inst, policy, C.int(pageValue)) != C.OPUS_OGG_OK {
+			fmt.Println("Invalid page policy", pagePolicy, pageValue)
+			return
+		}
+		if C.OpusOggCodecSetComplexity(ooInst.inst, C.int(complexity)) != C.OPUS_OGG_OK || C.OpusOggCodecSetFec(ooInst.inst, C.int(fec)) != C.OPUS_OGG_OK {
+			fmt.Println("Invalid complexity or fec", complexity, fec)
+			return
+		}
+	}
+	if mode == "decode" && C.OpusOggCodecSetOutputRate(ooInst.inst, C.int(outputRate)) != C.OPUS_OGG_OK {
+		fmt.Println("Invalid output rate", outputRate)
+		return
+	}
 
 	inputFile, err := os.Open(inputFileName)
 	if err != nil {
@@ -83,11 +169,9 @@ func main() {
 			return
 		}
 
-		cInput := C.CString(string(buffer[:bytesRead]))
-		defer C.free(unsafe.Pointer(cInput))
-
-		var cOutput *C.char
-		var cOutputLen C.int
+		// 直接把 Go 内存交给 C 读取，结果直接写入 outputBuffer 尾部，不再经过 C.CString/C.GoBytes
+		cInput := (*C.char)(unsafe.Pointer(&buffer[0]))
+		cInputLen := C.int(bytesRead)
 		last := C.bool(false)
 
 		if bytesRead < 4096 {
@@ -97,24 +181,46 @@ func main() {
 		fmt.Println(">>>", bytesRead)
 		switch mode {
 		case "encode":
-			result := C.OpusOggCodecEncode(ooInst.inst, cInput, C.int(bytesRead), &cOutput, &cOutputLen, last)
-			if result != 0 {
+			if sink == "fd" {
+				if C.OpusOggCodecEncodeToFd(ooInst.inst, cInput, cInputLen, C.int(outputFile.Fd()), last) != C.OPUS_OGG_OK {
+					fmt.Println("Encoding failed.")
+					return
+				}
+				break
+			}
+			bound := int(C.OpusOggCodecEncodeBound(ooInst.inst, cInputLen, last))
+			outputBuffer = reserve(outputBuffer, bound)
+			var cOutputLen C.int
+			result := C.OpusOggCodecEncodeInto(ooInst.inst, cInput, cInputLen, tail(outputBuffer), C.int(cap(outputBuffer)-len(outputBuffer)), &cOutputLen, last)
+			if result != C.OPUS_OGG_OK {
 				fmt.Println("Encoding failed.")
 				return
 			}
+			outputBuffer = outputBuffer[:len(outputBuffer)+int(cOutputLen)]
 		case "decode":
-			result := C.OpusOggCodecDecode(ooInst.inst, cInput, C.int(bytesRead), &cOutput, &cOutputLen, last)
-			if result != 0 {
-				fmt.Println("Decoding failed.")
-				return
+			bound := int(C.OpusOggCodecDecodeBound(ooInst.inst))
+			for {
+				outputBuffer = reserve(outputBuffer, bound)
+				var cOutputLen C.int
+				result := C.OpusOggCodecDecodeInto(ooInst.inst, cInput, cInputLen, tail(outputBuffer), C.int(cap(outputBuffer)-len(outputBuffer)), &cOutputLen, last)
+				if result == C.OPUS_OGG_ERR_BUFFER_TOO_SMALL {
+					bound = int(cOutputLen)
+				} else if result < 0 {
+					fmt.Println("Decoding failed.")
+					return
+				} else {
+					outputBuffer = outputBuffer[:len(outputBuffer)+int(cOutputLen)]
+				}
+				if result == C.OPUS_OGG_OK {
+					break
+				}
+				// 输入已全部交给解码器，继续取出剩余数据
+				cInput, cInputLen = nil, 0
 			}
 		default:
 			fmt.Println("Invalid mode.")
 			return
 		}
-		outputSlice := C.GoBytes(unsafe.Pointer(cOutput), cOutputLen)
-		outputBuffer = append(outputBuffer, outputSlice...)
-		C.free(unsafe.Pointer(cOutput))
 	}
 
 	// Write the processed output to the output file
@@ -124,11 +230,89 @@ func main() {
 		return
 	}
 
+	var layout C.OpusOggChannelLayout
+	if mode == "decode" && C.OpusOggCodecDecoderLayout(ooInst.inst, &layout) == C.OPUS_OGG_OK {
+		fmt.Println("Layout: channels", layout.channels, "mappingFamily", layout.mappingFamily, "streams", layout.streams,
+			"coupledStreams", layout.coupledStreams, "mapping", C.GoBytes(unsafe.Pointer(&layout.mapping[0]), layout.channels))
+	}
+
+	var stats C.OpusOggCodecStatsData
+	if C.OpusOggCodecStats(ooInst.inst, &stats) == C.OPUS_OGG_OK {
+		printStats(&stats)
+	}
+	var governor C.OpusOggGovernorStatsData
+	if cpuBudget > 0 && C.OpusOggCodecGovernorStats(&governor) == C.OPUS_OGG_OK {
+		fmt.Printf("governor: complexity %d, ceiling %d, cpu %d‰, downgrades %d, upgrades %d, ceiling -%d/+%d, features shed %d, restored %d, over budget frames %d\n",
+			int(C.OpusOggCodecComplexity(ooInst.inst)), governor.ceiling, governor.cpuPermille, governor.downgrades, governor.upgrades,
+			governor.ceilingDowngrades, governor.ceilingUpgrades, governor.featureSheds, governor.featureRestores, governor.overBudgetFrames)
+	}
+
 	retC = C.OpusOggCodecEnd(&(ooInst.inst))
 	if retC != 0 {
 		fmt.Println("End error ", retC)
 		return
 	}
 
+	if traceFileName != "" {
+		cTraceFileName := C.CString(traceFileName)
+		defer C.free(unsafe.Pointer(cTraceFileName))
+		if C.OpusOggCodecTraceDump(cTraceFileName) != C.OPUS_OGG_OK {
+			fmt.Println("Trace dump failed, is the library built with -DOPUS_OGG_TRACE?")
+		}
+	}
+
 	fmt.Println(">>> FINISH <<<")
 }
+
+// 保证 buf 尾部至少有 n 字节空闲空间
+func reserve(buf []byte, n int) []byte {
+	if cap(buf)-len(buf) >= n {
+		return buf
+	}
+	newBuf := make([]byte, len(buf), 2*cap(buf)+n)
+	copy(newBuf, buf)
+	return newBuf
+}
+
+// buf 尾部空闲空间的起始地址
+func tail(buf []byte) *C.char {
+	if cap(buf) == len(buf) {
+		return nil
+	}
+	return (*C.char)(unsafe.Pointer(&buf[:cap(buf)][len(buf)]))
+}
+
+// 每秒读取一次共享内存统计页，读取失败时退出
+func pollStats(name string) {
+	cName := C.CString(name)
+	defer C.free(unsafe.Pointer(cName))
+	for {
+		var stats C.OpusOggCodecStatsData
+		if C.OpusOggCodecStatsShmRead(cName, &stats) != C.OPUS_OGG_OK {
+			fmt.Println("Read stats failed:", name)
+			return
+		}
+		fmt.Println(time.Now().Format("15:04:05"))
+		printStats(&stats)
+		time.Sleep(time.Second)
+	}
+}
+
+func printStats(s *C.OpusOggCodecStatsData) {
+	fmt.Printf("sessions %d, frames encoded %d, decoded %d, pages %d, cached %d bytes, errors encode %d, decode %d\n",
+		s.sessions, s.framesEncoded, s.framesDecoded, s.pagesEmitted, s.cachedBytes, s.encodeErrors, s.decodeErrors)
+	fmt.Printf("encode %d -> %d bytes, decode %d -> %d bytes\n",
+		s.encodeInputBytes, s.encodeOutputBytes, s.decodeInputBytes, s.decodeOutputBytes)
+	printLatency("opus_encode", &s.opusEncode)
+	printLatency("opus_decode", &s.opusDecode)
+	printLatency("Encode", &s.encodeCall)
+	printLatency("Decode", &s.decodeCall)
+}
+
+func printLatency(name string, l *C.OpusOggLatencyStats) {
+	if l.count == 0 {
+		return
+	}
+	fmt.Printf("%-12s count %d, mean %d ns, p50 %d, p90 %d, p99 %d, p99.9 %d, max %d ns\n", name,
+		l.count, uint64(l.sumNs)/uint64(l.count), l.p50Ns, l.p90Ns, l.p99Ns, l.p999Ns, l.maxNs)
+}
@@ -1,5 +1,30 @@
 #include "opus_ogg.h"
 
+int OpusOggCodec::Encode(const char *input, size_t inputLength, PageSink &sink, bool last)
+{
+    return encoder->Encode(input, inputLength, sink, last);
+}
+
+int OpusOggCodec::Encode(const char *input, size_t inputLength, OutputSpan &output, bool last)
+{
+    return encoder->Encode(input, inputLength, output, last);
+}
+
+int OpusOggCodec::Decode(const char *input, size_t inputLength, OutputSpan &output, bool last, size_t *needed)
+{
+    return decoder->Decode(input, inputLength, output, last, needed);
+}
+
+int OpusOggCodec::Encode(const char *input, size_t inputLength, std::vector<char> &output, bool last)
+{
+    return encoder->Encode(input, inputLength, output, last);
+}
+
+int OpusOggCodec::Decode(const char *input, size_t inputLength, std::vector<char> &output, bool last)
+{
+    return decoder->Decode(input, inputLength, output, last);
+}
+
 int OpusOggCodec::Encode(const std::vector<char> &input, std::vector<char> &output, bool last)
 {
     return encoder->Encode(input, output, last);
@@ -8,4 +33,140 @@ int OpusOggCodec::Encode(const std::vector<char> &input, std::vector<char> &outp
 int OpusOggCodec::Decode(const std::vector<char> &input, std::vector<char> &output, bool last)
 {
     return decoder->Decode(input, output, last);
+}
+
+int OpusOggCodec::Flush(PageSink &sink)
+{
+    return encoder->Flush(sink);
+}
+
+int OpusOggCodec::Flush(OutputSpan &output)
+{
+    return encoder->Flush(output);
+}
+
+int OpusOggCodec::Flush(std::vector<char> &output)
+{
+    return encoder->Flush(output);
+}
+
+/**** OpusOggCodecPool ****/
+OpusOggCodecPool *OpusOggCodecPool::poolInst = new OpusOggCodecPool();
+
+OpusOggCodecPool *OpusOggCodecPool::GetInstance()
+{
+    return poolInst;
+}
+
+void OpusOggCodecPool::SetMaxIdle(size_t n)
+{
+    std::vector<OpusOggCodec *> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        maxIdle = n;
+        for (auto &entry : idle)
+        {
+            while (entry.second.size() > maxIdle)
+            {
+                dropped.push_back(entry.second.back());
+                entry.second.pop_back();
+            }
+        }
+    }
+    for (auto codec : dropped)
+    {
+        delete codec;
+    }
+}
+
+int OpusOggCodecPool::Prewarm(int sampleRate, int channels, int frameSize, int count, int mappingFamily)
+{
+    int added = 0;
+    for (int i = 0; i < count; i++)
+    {
+        OpusOggCodec *codec = new OpusOggCodec(sampleRate, channels, frameSize, mappingFamily);
+        if (!codec->Start())
+        {
+            delete codec;
+            break;
+        }
+        codec->EndSession(); // 预热的实例还没有会话
+
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<OpusOggCodec *> &list = idle[Key{sampleRate, channels, frameSize, mappingFamily}];
+        if (list.size() >= maxIdle)
+        {
+            delete codec;
+            break;
+        }
+        list.push_back(codec);
+        added++;
+    }
+    return added;
+}
+
+OpusOggCodec *OpusOggCodecPool::Acquire(int sampleRate, int channels, int frameSize, int mappingFamily)
+{
+    OpusOggCodec *codec = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = idle.find(Key{sampleRate, channels, frameSize, mappingFamily});
+        if (it != idle.end() && !it->second.empty())
+        {
+            codec = it->second.back();
+            it->second.pop_back();
+        }
+    }
+
+    if (codec)
+    {
+        if (codec->Reset())
+        {
+            return codec;
+        }
+        delete codec; // 重置失败的实例不再复用，重新创建
+    }
+
+    codec = new OpusOggCodec(sampleRate, channels, frameSize, mappingFamily);
+    if (!codec->Start())
+    {
+        delete codec;
+        return nullptr;
+    }
+    return codec;
+}
+
+void OpusOggCodecPool::Release(OpusOggCodec *codec)
+{
+    if (!codec)
+    {
+        return;
+    }
+    codec->EndSession();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<OpusOggCodec *> &list = idle[Key{codec->SampleRate(), codec->Channels(), codec->FrameSize(), codec->MappingFamily()}];
+        if (list.size() < maxIdle)
+        {
+            list.push_back(codec);
+            return;
+        }
+    }
+    delete codec;
+}
+
+void OpusOggCodecPool::Clear()
+{
+    std::map<Key, std::vector<OpusOggCodec *>> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        dropped.swap(idle);
+    }
+    for (auto &entry : dropped)
+    {
+        for (auto codec : entry.second)
+        {
+            delete codec;
+        }
+    }
 }
\ No newline at end of file
@@ -8,11 +8,34 @@
 #include <memory>
 #include <cstring>
 #include <ctime>
+#include <cstdint>
+#include <algorithm>
+#include <map>
+#include <mutex>
 #include <opus/opus.h>
+#include <opus/opus_multistream.h>
 #include <ogg/ogg.h>
+#include "codec_stats.h"
+#include "governor.h"
+#include "trace.h"
+#include "sample_format.h"
+#include "resampler.h"
+#include "page_sink.h"
 
 const int MAX_FRAME_SIZE = 5760;  // 120ms@48kHz
 const int MAX_PACKET_SIZE = 3828; // 3 * 1276
+const int MAX_OGG_HEADER_SIZE = 282; // 27字节页头 + 最多255个lacing值
+const int MAX_CHANNELS = 255;        // 映射族255最多255个声道
+const int DEFAULT_COMPLEXITY = 8;    // Start和Reset时的编码复杂度
+
+// Ogg页面的切分策略，决定编码出的包积累多少才输出成页面
+enum PagePolicy
+{
+    PAGE_POLICY_DEFAULT = 0,  // libogg默认，约4KB或255个lacing值一页，低码率时积累接近一秒
+    PAGE_POLICY_PACKET = 1,   // 每个包单独成页，首字节延迟最小，每包多至少28字节页头
+    PAGE_POLICY_DURATION = 2, // 页面时长达到value毫秒即输出
+    PAGE_POLICY_SIZE = 3,     // 页面达到value字节才输出，批量任务用大页减少页头和CRC开销
+};
 
 struct OpusHeader
 {
@@ -22,6 +45,10 @@ struct OpusHeader
     uint32_t sampleRate;
     int16_t outputGain;
     unsigned char channelMappingFamily;
+    // 映射族不为0时的声道映射表，映射族0时为1或2个声道的单流
+    unsigned char streamCount;
+    unsigned char coupledCount;
+    unsigned char mapping[MAX_CHANNELS]; // 第i个输出声道取自第mapping[i]个解码声道，255表示静音
 };
 
 struct OpusEncoderDeleter
@@ -33,38 +60,106 @@ struct OpusEncoderDeleter
     }
 };
 
+struct OpusMSEncoderDeleter
+{
+    void operator()(OpusMSEncoder *encoder)
+    {
+        if (encoder)
+            opus_multistream_encoder_destroy(encoder);
+    }
+};
+
 class OpusOggEncoder
 {
 private:
+    // 映射族0用单流编码器，其他映射族用多流编码器，一个Ogg流承载全部声道
     std::unique_ptr<OpusEncoder, OpusEncoderDeleter> encoder;
+    std::unique_ptr<OpusMSEncoder, OpusMSEncoderDeleter> msEncoder;
     ogg_stream_state oggStreamState;
     bool streamInitialized;
     int channels;
+    int mappingFamily;
+    int streamCount = 1;
+    int coupledCount = 0;
+    unsigned char mapping[MAX_CHANNELS] = {0, 1};
     int sampleRate;
     int frameSize;
-    std::vector<char> internalBuffer;
+    std::vector<unsigned char> frameBuffer; // 凑帧缓冲区，固定一帧大小，缓存不足一帧的输入
+    size_t cachedBytes = 0;                 // frameBuffer中已缓存的字节数
+    std::vector<unsigned char> opusData;    // opus 数据缓冲区
+    SampleFormat inputFormat = SAMPLE_FORMAT_S16;
+    int inputChannels;                      // 输入的声道数，与channels不同时下混
+    std::vector<opus_int16> pcmBuffer;      // S16下混后的一帧
+    std::vector<float> floatBuffer;         // 非S16输入转换后的一帧，送opus_encode_float
+    int inputRate;                          // 输入的采样率，与sampleRate不同时先重采样
+    std::unique_ptr<Resampler> resampler;
+    std::vector<float> resampled;           // 重采样后还不够一帧的样本，交错排列
+    size_t maxPacketBytes = MAX_PACKET_SIZE; // 按码率估算的单包大小上限
+    CodecStats *stats = nullptr;             // 统计，为空时不计
+    PagePolicy pagePolicy = PAGE_POLICY_DEFAULT;
+    int pageValue = 0;                       // DURATION为毫秒，SIZE为字节
+    std::vector<char> headerPages;           // Start时生成的OpusHead/OpusTags页面
+    int headerPageCount = 0;
+    bool headersPending = false;             // 头部页面还没有交给调用方
+    // 复杂度调节，见ComplexityGovernor
+    int baseComplexity = DEFAULT_COMPLEXITY; // 调用方设置的复杂度，调节器不会超过它
+    int complexity = DEFAULT_COMPLEXITY;     // 当前生效的复杂度
+    uint64_t avgEncodeNs = 0;                // opus_encode耗时的滑动平均
+    int framesSinceChange = 0;               // 上次调整后编码的帧数
+    bool featuresShed = false;               // 调节器关闭了FEC/DRED
+    opus_int32 savedFec = 0;                 // 关闭前的FEC和DRED设置，恢复时写回
+    opus_int32 savedDred = 0;
 
     // Ogg
     int packetno = 0;
     int64_t granulepos = 0;
+    int64_t pageStart = 0;        // 尚未输出的页面的起始granulepos
     opus_int32 granule_increment; // 每帧的实际granule增量
-    opus_int16 sampleSize;        // 每个采样点的大小
-    size_t bytesReadPerFrame;     // 每帧读取的字节数
+    size_t bytesReadPerFrame;     // 每帧读取的输入字节数，按输入格式和声道数计算
 
     bool initializeEncoder();   // 初始化编码器
+    // 单流和多流编码器的ctl
+    template <typename... Args>
+    int encoderCtl(int request, Args... args)
+    {
+        return msEncoder ? opus_multistream_encoder_ctl(msEncoder.get(), request, args...) : opus_encoder_ctl(encoder.get(), request, args...);
+    }
+    bool started() const
+    {
+        return encoder || msEncoder;
+    }
     bool initializeOggStream(); // 初始化Ogg流
-    bool writeOpusHeader(std::vector<char> &output);
-    bool writeOpusComments(std::vector<char> &output);
+    void updateMaxPacketBytes();
+    void updateFrameLayout();
+    bool directInput(const char *frame) const;
+    const void *convertFrame(const unsigned char *frame);
+    const float *convertBlock(const unsigned char *block, size_t frames);
+    bool writeHeaders();
+    bool writeOpusHeader();
+    bool writeOpusComments();
+    void appendHeaderPages();
+    bool emitHeaders(PageSink &sink);
+    bool emitPages(PageSink &sink);
+    bool writePage(const ogg_page &og, PageSink &sink);
+    int encodeFrames(const char *input, size_t inputLength, PageSink &sink, bool last);
+    int resampleFrames(const char *input, size_t inputLength, PageSink &sink, bool last);
+    bool encodePacket(const void *pcm, bool isFloat, bool eos, PageSink &sink);
+    bool flushPages(PageSink &sink);
+    void govern(uint64_t encodeNs);
+    bool applyComplexity(int level);
+    void setFeaturesShed(bool shed);
     void end();
 
 public:
-    OpusOggEncoder(int sampleRate = 24000, int channels = 1, int frameSize = 480)
-        : streamInitialized(false), channels(channels), sampleRate(sampleRate), frameSize(frameSize)
+    // mappingFamily: 0为单流(1~2声道)，1为Vorbis顺序的环绕声(1~8声道)，255为互不相关的声道(1~255声道)
+    OpusOggEncoder(int sampleRate = 24000, int channels = 1, int frameSize = 480, int mappingFamily = 0)
+        : streamInitialized(false), channels(channels), mappingFamily(mappingFamily), sampleRate(sampleRate), frameSize(frameSize), inputChannels(channels), inputRate(sampleRate)
     {
         granule_increment = frameSize * (48000.0 / sampleRate);
-        sampleSize = channels * sizeof(opus_int16);
-        bytesReadPerFrame = frameSize * sampleSize;
-        internalBuffer.reserve(bytesReadPerFrame * 2); // 适当大小空间
+        bytesReadPerFrame = frameSize * channels * sizeof(opus_int16);
+        // 编码用到的缓冲区在构造时一次分配好，编码过程中不再分配内存
+        frameBuffer.resize(bytesReadPerFrame);
+        opusData.resize(MAX_PACKET_SIZE * std::max(1, channels)); // 多流时每个流一个包
     }
 
     ~OpusOggEncoder()
@@ -73,7 +168,51 @@ public:
     }
 
     bool Start();
-    int Encode(const std::vector<char> &input, std::vector<char> &output, bool last);
+    // 复用已创建的编码器和Ogg流开始新的会话，编码参数保持不变
+    bool Reset();
+    // Start之后调整编码参数；Reset不恢复码率，复杂度和FEC恢复为默认值
+    bool SetBitrate(opus_int32 bitrate);
+    // 调节器运行时作为上限，实际生效的复杂度见Complexity
+    bool SetComplexity(int complexity);
+    int Complexity() const
+    {
+        return complexity;
+    }
+    // 开启带内FEC并按packetLossPercent的预期丢包率编码冗余，0关闭
+    bool SetFec(int packetLossPercent);
+    // Start之后、第一次Encode之前设置输入的采样格式，inputChannels只能等于channels或者为2(下混成单声道)
+    // Reset恢复为与channels相同的S16
+    bool SetInputFormat(SampleFormat format, int inputChannels);
+    // Start之后、第一次Encode之前设置输入的采样率，与编码采样率不同时在编码器内重采样，
+    // OpusHead记录原始采样率；Reset恢复为编码采样率
+    bool SetInputRate(int rate);
+    // 声道数和映射表，多流编码器在Start时按映射族生成
+    void GetLayout(OpusOggChannelLayout &layout) const;
+    // 随时可以调整，从下一个包开始生效；Reset恢复为PAGE_POLICY_DEFAULT
+    bool SetPagePolicy(PagePolicy policy, int value);
+    void SetStats(CodecStats *s)
+    {
+        stats = s;
+    }
+    // 本次输入最坏情况下产生的输出字节数，包括首次调用的头部页面和last时的冲刷
+    size_t EncodeBound(size_t inputLength, bool last) const;
+    // 把尚未输出的头部页面和已编码的包立即输出成页面，不足一帧的缓存保留，流不结束
+    // Start之后马上调用可以先取得头部页面
+    int Flush(PageSink &sink);
+    int Flush(OutputSpan &output);
+    int Flush(std::vector<char> &output);
+    size_t FlushBound() const
+    {
+        return EncodeBound(0, false);
+    }
+    // 页面按记录写入sink，返回前调用sink.Finish()；OutputSpan和vector版本都经由它实现
+    int Encode(const char *input, size_t inputLength, PageSink &sink, bool last);
+    int Encode(const char *input, size_t inputLength, OutputSpan &output, bool last);
+    int Encode(const char *input, size_t inputLength, std::vector<char> &output, bool last);
+    int Encode(const std::vector<char> &input, std::vector<char> &output, bool last)
+    {
+        return Encode(input.data(), input.size(), output, last);
+    }
 };
 
 struct OpusDecoderDeleter
@@ -85,25 +224,54 @@ struct OpusDecoderDeleter
     }
 };
 
+struct OpusMSDecoderDeleter
+{
+    void operator()(OpusMSDecoder *decoder)
+    {
+        if (decoder)
+            opus_multistream_decoder_destroy(decoder);
+    }
+};
+
 class OpusOggDecoder
 {
 private:
+    // 映射族0用单流解码器，其他映射族按OpusHead的映射表用多流解码器
     std::unique_ptr<OpusDecoder, OpusDecoderDeleter> decoder;
+    std::unique_ptr<OpusMSDecoder, OpusMSDecoderDeleter> msDecoder;
     ogg_sync_state oggSyncState;
     ogg_stream_state oggStreamState;
     bool streamInitialized;
     int channels;
     int sampleRate;
+    OpusHeader decoderHeader;  // 当前decoder创建时的声道布局
+    int decoderSampleRate = 0; // 当前decoder创建时的采样率
 
     // Ogg
-    int step = 0;
+    int step = 0;        // 0: 等待OpusHead, 1: 等待OpusTags, 2: 解码音频
     OpusHeader opusHeader;
+    int skipSamples = 0; // 还要丢弃的预跳过样本数，按解码采样率计
+    CodecStats *stats = nullptr; // 统计，为空时不计
 
-    int readPage(const std::vector<char> &input, int *index, ogg_page &page);
+    // 输出采样率与解码采样率不同时，解码成float后重采样
+    int outputRate = 0; // 调用方要求的输出采样率，0表示使用OpusHead记录的原始采样率
+    std::unique_ptr<Resampler> resampler;
+    std::vector<float> floatBuffer; // opus_decode_float的输出，一个包
+    std::vector<float> resampled;   // 重采样的输出，一个包
+
+    bool readPage(ogg_page &page);
+    bool readStreamPage(ogg_page &page);
+    int readHeader();
     bool initializeDecoder();
-    bool readOpusHeader(const std::vector<char> &input, int *index);
+    bool sameLayout(const OpusHeader &a, const OpusHeader &b) const;
+    int decodePacket(const ogg_packet &packet, opus_int16 *pcm, float *pcmFloat, int samples);
+    bool initializeResampler(int rate);
+    void resampleOutput(const float *pcm, size_t frames, bool flush, OutputSpan &output);
     bool parseOpusHeader(const unsigned char *data, size_t len, OpusHeader &header);
     bool skipOpusComments(ogg_packet &packet);
+    int decodeSpan(const char *input, size_t inputLength, OutputSpan &output, bool last, size_t *needed);
+    int decodeVector(const char *input, size_t inputLength, std::vector<char> &output, bool last);
+    void recordCall(uint64_t begin, size_t inputLength, size_t outputBytes, int ret);
     void end();
 
 public:
@@ -118,29 +286,199 @@ public:
     }
 
     bool Start();
-    int Decode(const std::vector<char> &input, std::vector<char> &output, bool last);
+    void SetStats(CodecStats *s)
+    {
+        stats = s;
+    }
+    // 第一次Decode之前设置输出采样率，可以是任意采样率，0表示使用OpusHead记录的原始采样率；Reset恢复为0
+    bool SetOutputRate(int rate);
+    // 解析OpusHead之后才有声道布局，之前返回false
+    bool GetLayout(OpusOggChannelLayout &layout) const;
+    // 清空解码状态准备解码新的流，已创建的decoder和Ogg流缓冲区会被复用
+    void Reset();
+    // 单个音频包解码后的最大字节数，输出缓冲区至少要这么大才能保证有进展
+    size_t DecodeBound() const;
+    // 输入可以按任意字节切分，不完整的页面保留在ogg_sync里，每个完整的包立即解码输出
+    // 返回0表示输入已全部解码；返回1表示输出缓冲区已满，剩余的包留在内部，需再次调用(inputLength可为0)
+    // 输出缓冲区连一个包都放不下时返回-2，needed为下一个包需要的字节数
+    int Decode(const char *input, size_t inputLength, OutputSpan &output, bool last, size_t *needed);
+    int Decode(const char *input, size_t inputLength, std::vector<char> &output, bool last);
+    int Decode(const std::vector<char> &input, std::vector<char> &output, bool last)
+    {
+        return Decode(input.data(), input.size(), output, last);
+    }
 };
 
 class OpusOggCodec
 {
 private:
+    CodecStats stats; // 当前会话的统计，Start/Reset时开始，EndSession时并入进程汇总
     std::unique_ptr<OpusOggEncoder> encoder;
     std::unique_ptr<OpusOggDecoder> decoder;
+    int sampleRate;
+    int channels;
+    int frameSize;
+    int mappingFamily;
+    std::vector<char> scratch;    // 旧接口复用的输出缓冲区
+    std::atomic<int> asyncWorker; // 异步引擎分配的工作线程，-1表示还没有提交过，归还到池后保留
 
 public:
-    OpusOggCodec(int sampleRate)
-        : encoder(std::unique_ptr<OpusOggEncoder>(new OpusOggEncoder(sampleRate, 1, 480))),
-          decoder(std::unique_ptr<OpusOggDecoder>(new OpusOggDecoder()))
+    OpusOggCodec(int sampleRate, int channels = 1, int frameSize = 480, int mappingFamily = 0)
+        : encoder(std::unique_ptr<OpusOggEncoder>(new OpusOggEncoder(sampleRate, channels, frameSize, mappingFamily))),
+          decoder(std::unique_ptr<OpusOggDecoder>(new OpusOggDecoder())),
+          sampleRate(sampleRate), channels(channels), frameSize(frameSize), mappingFamily(mappingFamily), asyncWorker(-1)
+    {
+        encoder->SetStats(&stats);
+        decoder->SetStats(&stats);
+    }
+    ~OpusOggCodec()
     {
+        EndSession();
     }
-    ~OpusOggCodec() = default;
+
+    int SampleRate() const { return sampleRate; }
+    int Channels() const { return channels; }
+    int FrameSize() const { return frameSize; }
+    int MappingFamily() const { return mappingFamily; }
+    int AsyncWorker() const { return asyncWorker.load(std::memory_order_relaxed); }
+    void SetAsyncWorker(int worker) { asyncWorker.store(worker, std::memory_order_relaxed); }
 
     bool Start()
     {
+        CodecStatsRegistry::GetInstance()->Begin(&stats);
         return encoder->Start();
     }
+    // 从池中取出后调用，复用编解码器状态开始新的会话
+    bool Reset()
+    {
+        CodecStatsRegistry::GetInstance()->Begin(&stats);
+        decoder->Reset();
+        return encoder->Reset();
+    }
+    // 会话结束，统计并入进程汇总
+    void EndSession()
+    {
+        CodecStatsRegistry::GetInstance()->End(&stats);
+    }
+    const CodecStats &Stats() const
+    {
+        return stats;
+    }
+    bool SetBitrate(opus_int32 bitrate)
+    {
+        return encoder->SetBitrate(bitrate);
+    }
+    bool SetComplexity(int complexity)
+    {
+        return encoder->SetComplexity(complexity);
+    }
+    int Complexity() const
+    {
+        return encoder->Complexity();
+    }
+    bool SetFec(int packetLossPercent)
+    {
+        return encoder->SetFec(packetLossPercent);
+    }
+    bool SetInputFormat(SampleFormat format, int inputChannels)
+    {
+        return encoder->SetInputFormat(format, inputChannels);
+    }
+    bool SetInputRate(int rate)
+    {
+        return encoder->SetInputRate(rate);
+    }
+    bool SetOutputRate(int rate)
+    {
+        return decoder->SetOutputRate(rate);
+    }
+    bool SetPagePolicy(PagePolicy policy, int value)
+    {
+        return encoder->SetPagePolicy(policy, value);
+    }
+    void EncoderLayout(OpusOggChannelLayout &layout) const
+    {
+        encoder->GetLayout(layout);
+    }
+    bool DecoderLayout(OpusOggChannelLayout &layout) const
+    {
+        return decoder->GetLayout(layout);
+    }
+    size_t EncodeBound(size_t inputLength, bool last) const
+    {
+        return encoder->EncodeBound(inputLength, last);
+    }
+    size_t DecodeBound() const
+    {
+        return decoder->DecodeBound();
+    }
+    size_t FlushBound() const
+    {
+        return encoder->FlushBound();
+    }
+    // 清空并返回实例自带的输出缓冲区，容量在多次调用间保留
+    std::vector<char> &Scratch()
+    {
+        scratch.clear();
+        return scratch;
+    }
+    int Encode(const char *input, size_t inputLength, PageSink &sink, bool last);
+    int Encode(const char *input, size_t inputLength, OutputSpan &output, bool last);
+    int Decode(const char *input, size_t inputLength, OutputSpan &output, bool last, size_t *needed);
+    int Encode(const char *input, size_t inputLength, std::vector<char> &output, bool last);
+    int Decode(const char *input, size_t inputLength, std::vector<char> &output, bool last);
     int Encode(const std::vector<char> &input, std::vector<char> &output, bool last);
     int Decode(const std::vector<char> &input, std::vector<char> &output, bool last);
+    int Flush(PageSink &sink);
+    int Flush(OutputSpan &output);
+    int Flush(std::vector<char> &output);
+};
+
+// 预先初始化好的编解码实例池，按 (sampleRate, channels, frameSize, mappingFamily) 分组
+// OpusOggCodecStart 从池中借出实例并用 OPUS_RESET_STATE 重置，OpusOggCodecEnd 归还，
+// 避免每个会话都重新创建编码器、设置参数、分配Ogg缓冲区
+class OpusOggCodecPool
+{
+private:
+    struct Key
+    {
+        int sampleRate;
+        int channels;
+        int frameSize;
+        int mappingFamily;
+
+        bool operator<(const Key &other) const
+        {
+            if (sampleRate != other.sampleRate)
+                return sampleRate < other.sampleRate;
+            if (channels != other.channels)
+                return channels < other.channels;
+            if (frameSize != other.frameSize)
+                return frameSize < other.frameSize;
+            return mappingFamily < other.mappingFamily;
+        }
+    };
+
+    static OpusOggCodecPool *poolInst;
+    std::mutex mutex;
+    std::map<Key, std::vector<OpusOggCodec *>> idle;
+    size_t maxIdle; // 每组最多保留的空闲实例数，0表示不使用池
+
+    OpusOggCodecPool() : maxIdle(32) {}
+    ~OpusOggCodecPool() = default;
+
+public:
+    static OpusOggCodecPool *GetInstance();
+
+    void SetMaxIdle(size_t n);
+    // 预先创建count个实例放入池中，返回实际放入的个数
+    int Prewarm(int sampleRate, int channels, int frameSize, int count, int mappingFamily = 0);
+    // 借出一个已重置的实例，池中没有时新建
+    OpusOggCodec *Acquire(int sampleRate, int channels, int frameSize, int mappingFamily = 0);
+    // 归还实例，池满时直接释放
+    void Release(OpusOggCodec *codec);
+    // 释放所有空闲实例
+    void Clear();
 };
 
 #endif // OPUS_OGG_H
\ No newline at end of file
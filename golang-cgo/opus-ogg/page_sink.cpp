@@ -0,0 +1,106 @@
+#include "page_sink.h"
+#include <algorithm>
+#include <cerrno>
+#include <iostream>
+#include <poll.h>
+#include <sys/uio.h>
+
+void FdPageSink::stage(const void *data, size_t len)
+{
+    pieces.push_back(Piece{nullptr, staging.size(), len});
+    staging.insert(staging.end(), static_cast<const char *>(data), static_cast<const char *>(data) + len);
+}
+
+bool FdPageSink::write(const void *head, size_t headLen, const void *body, size_t bodyLen)
+{
+    // 页头在 libogg 里每页复用同一块内存，必须拷贝；页体先只记下位置
+    if (pieces.size() + 2 > FD_SINK_MAX_IOV && !flush())
+    {
+        return false;
+    }
+    if (headLen > 0)
+    {
+        stage(head, headLen);
+    }
+    if (bodyLen > 0)
+    {
+        pieces.push_back(Piece{static_cast<const char *>(body), 0, bodyLen});
+    }
+    pending += headLen + bodyLen;
+    return true;
+}
+
+bool FdPageSink::Release()
+{
+    if (pending >= FD_SINK_BATCH_BYTES)
+    {
+        return flush();
+    }
+    // 小页面拷贝的开销远小于一次系统调用，拷进暂存区和后面的页面一起写出
+    for (Piece &piece : pieces)
+    {
+        if (piece.data)
+        {
+            size_t offset = staging.size();
+            staging.insert(staging.end(), piece.data, piece.data + piece.len);
+            piece = Piece{nullptr, offset, piece.len};
+        }
+    }
+    return true;
+}
+
+bool FdPageSink::flush()
+{
+    if (pieces.empty())
+    {
+        return true;
+    }
+    // staging 在追加时可能重新分配，iovec 到写出时才按 offset 生成
+    struct iovec iov[FD_SINK_MAX_IOV];
+    size_t count = pieces.size();
+    for (size_t i = 0; i < count; i++)
+    {
+        iov[i].iov_base = const_cast<char *>(pieces[i].data ? pieces[i].data : staging.data() + pieces[i].offset);
+        iov[i].iov_len = pieces[i].len;
+    }
+
+    bool ok = true;
+    size_t first = 0;
+    while (first < count)
+    {
+        ssize_t n = writev(fd, iov + first, count - first);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                // 非阻塞的 socket 或管道，等到可写再继续
+                struct pollfd pfd = {fd, POLLOUT, 0};
+                poll(&pfd, 1, -1);
+                continue;
+            }
+            std::cerr << "Failed to write pages: " << std::strerror(errno) << std::endl;
+            ok = false;
+            break;
+        }
+        // 跳过已写完的段，部分写入的段调整起点
+        size_t written = n;
+        while (first < count && written >= iov[first].iov_len)
+        {
+            written -= iov[first].iov_len;
+            first++;
+        }
+        if (first < count)
+        {
+            iov[first].iov_base = static_cast<char *>(iov[first].iov_base) + written;
+            iov[first].iov_len -= written;
+        }
+    }
+    pieces.clear();
+    staging.clear();
+    pending = 0;
+    return ok;
+}
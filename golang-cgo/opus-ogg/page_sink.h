@@ -0,0 +1,152 @@
+#ifndef PAGE_SINK_H
+#define PAGE_SINK_H
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+#include <ogg/ogg.h>
+
+#define FD_SINK_MAX_IOV 128             // 一次 writev 最多的段数，每页两段
+#define FD_SINK_BATCH_BYTES (16 * 1024) // 暂存超过这么多时不再拷贝，直接写出
+
+// 调用方持有的输出缓冲区，编解码结果直接写入，不经过中间vector
+struct OutputSpan
+{
+    char *data;
+    size_t capacity;
+    size_t size;
+
+    OutputSpan(char *data, size_t capacity) : data(data), capacity(capacity), size(0) {}
+
+    size_t remaining() const
+    {
+        return capacity - size;
+    }
+
+    bool append(const void *src, size_t len)
+    {
+        if (len > remaining())
+        {
+            return false;
+        }
+        std::memcpy(data + size, src, len);
+        size += len;
+        return true;
+    }
+};
+
+// 编码输出的去向。每条记录由两段组成：Ogg 页面是页头+页体，带长度前缀的包是前缀+包，
+// 编码器只管按记录写入，拷贝、合并和系统调用由具体实现决定
+// head 只在 Write 期间有效；body 在下一次 Release 之前有效(libogg 在 ogg_stream_packetin 时才改动页体所在的缓冲区)
+class PageSink
+{
+protected:
+    virtual bool write(const void *head, size_t headLen, const void *body, size_t bodyLen) = 0;
+
+public:
+    size_t bytes = 0; // 已写入的字节数
+
+    virtual ~PageSink() = default;
+
+    bool Write(const void *head, size_t headLen, const void *body, size_t bodyLen)
+    {
+        if (!write(head, headLen, body, bodyLen))
+        {
+            return false;
+        }
+        bytes += headLen + bodyLen;
+        return true;
+    }
+    bool WritePage(const ogg_page &og)
+    {
+        return Write(og.header, og.header_len, og.body, og.body_len);
+    }
+    // 之前的 body 即将失效，还引用着它们的实现在这里拷贝或写出
+    virtual bool Release()
+    {
+        return true;
+    }
+    // 一次编码调用结束，暂存的数据全部写出
+    virtual bool Finish()
+    {
+        return Release();
+    }
+};
+
+// 追加到调用方的缓冲区，容量不足时失败
+class SpanPageSink : public PageSink
+{
+private:
+    OutputSpan &span;
+
+protected:
+    bool write(const void *head, size_t headLen, const void *body, size_t bodyLen) override
+    {
+        if (headLen + bodyLen > span.remaining())
+        {
+            return false;
+        }
+        return span.append(head, headLen) && span.append(body, bodyLen);
+    }
+
+public:
+    explicit SpanPageSink(OutputSpan &span) : span(span) {}
+};
+
+// 每条记录调用一次回调，指针直接指向 libogg 的缓冲区，只在回调期间有效；回调返回非0时失败
+typedef int (*PageSinkCallback)(void *userData, const unsigned char *head, int headLen, const unsigned char *body, int bodyLen);
+
+class CallbackPageSink : public PageSink
+{
+private:
+    PageSinkCallback callback;
+    void *userData;
+
+protected:
+    bool write(const void *head, size_t headLen, const void *body, size_t bodyLen) override
+    {
+        return callback(userData, static_cast<const unsigned char *>(head), headLen, static_cast<const unsigned char *>(body), bodyLen) == 0;
+    }
+
+public:
+    CallbackPageSink(PageSinkCallback callback, void *userData) : callback(callback), userData(userData) {}
+};
+
+// 写入文件、管道或 socket：一次调用产生的页面合并成尽量少的 writev
+// 页体直接引用 libogg 的缓冲区，Release 时暂存还不多就拷进暂存区继续合并，否则先写出；Finish 时全部写出
+class FdPageSink : public PageSink
+{
+private:
+    struct Piece
+    {
+        const char *data; // 为空时在 staging 的 offset 处
+        size_t offset;
+        size_t len;
+    };
+
+    int fd;
+    std::vector<char> staging; // 页头，以及 Release 时拷贝的页体
+    std::vector<Piece> pieces;
+    size_t pending = 0;        // 还没写出的字节数
+
+    void stage(const void *data, size_t len);
+    bool flush();
+
+protected:
+    bool write(const void *head, size_t headLen, const void *body, size_t bodyLen) override;
+
+public:
+    explicit FdPageSink(int fd) : fd(fd) {}
+    ~FdPageSink()
+    {
+        flush();
+    }
+
+    bool Release() override;
+    bool Finish() override
+    {
+        return flush();
+    }
+};
+
+#endif // PAGE_SINK_H
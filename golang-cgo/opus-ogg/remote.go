@@ -0,0 +1,131 @@
+package main
+
+/*
+#include "interface.h"
+*/
+import "C"
+import (
+	"fmt"
+	"io"
+	"os"
+	"unsafe"
+)
+
+// -server: 编解码交给本机的 codec_server，数据经共享内存环传递
+// 输入按 4096 字节写入，写不进去(服务端输出环满)时先读出结果，形成背压而不是在本进程里堆积
+func runRemote(socketPath, mode, inputFileName, outputFileName string, channels, mappingFamily int, pagePolicy string, pageValue int) {
+	ops := map[string]C.int{"encode": C.OPUS_OGG_REMOTE_ENCODE, "decode": C.OPUS_OGG_REMOTE_DECODE}
+	op, ok := ops[mode]
+	if !ok {
+		fmt.Println("Invalid mode.")
+		return
+	}
+	policy, ok := pagePolicies[pagePolicy]
+	if !ok {
+		fmt.Println("Invalid page policy", pagePolicy, pageValue)
+		return
+	}
+
+	cSocketPath := C.CString(socketPath)
+	defer C.free(unsafe.Pointer(cSocketPath))
+	var conn unsafe.Pointer
+	if C.OpusOggRemoteConnect(cSocketPath, &conn) != C.OPUS_OGG_OK {
+		fmt.Println("Connect failed:", socketPath)
+		return
+	}
+	defer C.OpusOggRemoteDisconnect(&conn)
+
+	var session unsafe.Pointer
+	retC := C.OpusOggRemoteOpen(conn, op, 24000, C.int(channels), C.int(mappingFamily), policy, C.int(pageValue), 0, &session)
+	if retC != C.OPUS_OGG_OK {
+		fmt.Println("Open error ", retC)
+		return
+	}
+	var id, token C.ulonglong
+	C.OpusOggRemoteSessionInfo(session, &id, &token)
+	fmt.Printf("Session %d token %x\n", uint64(id), uint64(token))
+
+	inputFile, err := os.Open(inputFileName)
+	if err != nil {
+		fmt.Println("Error opening input file:", err)
+		return
+	}
+	defer inputFile.Close()
+
+	outputFile, err := os.Create(outputFileName)
+	if err != nil {
+		fmt.Println("Error creating output file:", err)
+		return
+	}
+	defer outputFile.Close()
+
+	readBuffer := C.malloc(65536)
+	defer C.free(readBuffer)
+	// 读出服务端已产生的结果，timeoutMs 为没有结果时的等待时间
+	drain := func(timeoutMs int) (bool, bool) {
+		var finished C.bool
+		n := C.OpusOggRemoteRead(session, (*C.char)(readBuffer), 65536, C.int(timeoutMs), &finished)
+		if n < 0 {
+			fmt.Println("Remote failed, result:", n)
+			return false, false
+		}
+		if _, err := outputFile.Write(C.GoBytes(readBuffer, n)); err != nil {
+			fmt.Println("Error writing to output file:", err)
+			return false, false
+		}
+		return true, bool(finished)
+	}
+
+	buffer := make([]byte, 4096)
+	eof := false
+	for !eof {
+		bytesRead, err := io.ReadFull(inputFile, buffer)
+		if err == io.EOF || err == io.ErrUnexpectedEOF {
+			eof = true
+		} else if err != nil {
+			fmt.Println("Error reading input file:", err)
+			return
+		}
+
+		data := buffer[:bytesRead]
+		for {
+			var cInput *C.char
+			if len(data) > 0 {
+				cInput = (*C.char)(unsafe.Pointer(&data[0]))
+			}
+			n := C.OpusOggRemoteWrite(session, cInput, C.int(len(data)), C.bool(eof))
+			if n < 0 {
+				fmt.Println("Remote write failed, result:", n)
+				return
+			}
+			data = data[int(n):]
+			if len(data) == 0 {
+				break
+			}
+			// 输入环满，等服务端处理后读出结果再写
+			if ok, _ := drain(100); !ok {
+				return
+			}
+		}
+		if ok, _ := drain(0); !ok {
+			return
+		}
+	}
+
+	for {
+		ok, finished := drain(-1)
+		if !ok {
+			return
+		}
+		if finished {
+			break
+		}
+	}
+
+	retC = C.OpusOggRemoteClose(&session)
+	if retC != C.OPUS_OGG_OK {
+		fmt.Println("Close error ", retC)
+		return
+	}
+	fmt.Println(">>> FINISH <<<")
+}
@@ -0,0 +1,278 @@
+#include "resampler.h"
+#include <cmath>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define RESAMPLER_X86
+#include <immintrin.h>
+#endif
+
+#define RESAMPLER_KAISER_BETA 8.0 // 阻带衰减约80dB
+#define RESAMPLER_CUTOFF 0.92     // 截止频率相对两者中较低的奈奎斯特频率
+
+/**** 点积，滤波的内层循环 ****/
+
+static float dotScalar(const float *a, const float *b, size_t n)
+{
+    float sum = 0.0f;
+    for (size_t i = 0; i < n; i++)
+    {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+#ifdef RESAMPLER_X86
+
+__attribute__((target("sse2"))) static float dotSse2(const float *a, const float *b, size_t n)
+{
+    __m128 sum0 = _mm_setzero_ps();
+    __m128 sum1 = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        sum0 = _mm_add_ps(sum0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        sum1 = _mm_add_ps(sum1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    float lanes[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(sum0, sum1));
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + dotScalar(a + i, b + i, n - i);
+}
+
+__attribute__((target("avx2,fma"))) static float dotAvx2(const float *a, const float *b, size_t n)
+{
+    __m256 sum0 = _mm256_setzero_ps();
+    __m256 sum1 = _mm256_setzero_ps();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        sum1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), sum1);
+    }
+    if (i + 8 <= n)
+    {
+        sum0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), sum0);
+        i += 8;
+    }
+    __m256 sum = _mm256_add_ps(sum0, sum1);
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    float lanes[4];
+    _mm_storeu_ps(lanes, half);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3] + dotScalar(a + i, b + i, n - i);
+}
+
+#endif // RESAMPLER_X86
+
+typedef float (*DotFunc)(const float *, const float *, size_t);
+
+static DotFunc selectDot()
+{
+#ifdef RESAMPLER_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+    {
+        return dotAvx2;
+    }
+    if (__builtin_cpu_supports("sse2"))
+    {
+        return dotSse2;
+    }
+#endif
+    return dotScalar;
+}
+
+static float dot(const float *a, const float *b, size_t n)
+{
+    static const DotFunc f = selectDot();
+    return f(a, b, n);
+}
+
+/**** 滤波器系数 ****/
+
+// 第一类零阶修正贝塞尔函数，Kaiser窗用
+static double besselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+    for (int k = 1; term > 1e-12 * sum; k++)
+    {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+    }
+    return sum;
+}
+
+static std::shared_ptr<const ResamplerFilter> buildFilter(int upFactor, int downFactor)
+{
+    std::shared_ptr<ResamplerFilter> filter(new ResamplerFilter());
+    filter->upFactor = upFactor;
+    filter->downFactor = downFactor;
+
+    // 降采样时截止频率按倍率降低，窗口按比例加长以保持过渡带陡峭
+    double ratio = std::min(1.0, static_cast<double>(upFactor) / downFactor);
+    int halfTaps = static_cast<int>(std::ceil(RESAMPLER_HALF_TAPS / ratio));
+    filter->taps = (2 * halfTaps + 7) / 8 * 8;
+    double cutoff = RESAMPLER_CUTOFF * ratio;
+    double halfWidth = filter->taps / 2.0;
+    double i0Beta = besselI0(RESAMPLER_KAISER_BETA);
+
+    filter->coeffs.resize(static_cast<size_t>(upFactor) * filter->taps);
+    for (int p = 0; p < upFactor; p++)
+    {
+        float *h = filter->coeffs.data() + static_cast<size_t>(p) * filter->taps;
+        double sum = 0.0;
+        std::vector<double> values(filter->taps);
+        for (int k = 0; k < filter->taps; k++)
+        {
+            // 第k个抽头的输入相对输出时刻的偏移，单位为输入采样
+            double d = k - (filter->taps / 2 - 1) - static_cast<double>(p) / upFactor;
+            double x = cutoff * d;
+            double sinc = x == 0.0 ? 1.0 : std::sin(M_PI * x) / (M_PI * x);
+            double r = d / halfWidth;
+            double window = std::fabs(r) < 1.0 ? besselI0(RESAMPLER_KAISER_BETA * std::sqrt(1.0 - r * r)) / i0Beta : 0.0;
+            values[k] = cutoff * sinc * window;
+            sum += values[k];
+        }
+        // 每相单独归一化，直流增益为1
+        for (int k = 0; k < filter->taps; k++)
+        {
+            h[k] = static_cast<float>(values[k] / sum);
+        }
+    }
+    return filter;
+}
+
+// 相同倍率的系数表只计算一次，进程内所有实例共享
+static std::mutex filtersMutex;
+static std::map<std::pair<int, int>, std::shared_ptr<const ResamplerFilter>> *filters = new std::map<std::pair<int, int>, std::shared_ptr<const ResamplerFilter>>();
+
+static std::shared_ptr<const ResamplerFilter> getFilter(int upFactor, int downFactor)
+{
+    std::lock_guard<std::mutex> lock(filtersMutex);
+    std::shared_ptr<const ResamplerFilter> &filter = (*filters)[std::make_pair(upFactor, downFactor)];
+    if (!filter)
+    {
+        filter = buildFilter(upFactor, downFactor);
+    }
+    return filter;
+}
+
+static int gcd(int a, int b)
+{
+    while (b != 0)
+    {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/**** Resampler ****/
+
+std::unique_ptr<Resampler> Resampler::Create(int inputRate, int outputRate, int channels)
+{
+    if (inputRate < RESAMPLER_MIN_RATE || inputRate > RESAMPLER_MAX_RATE ||
+        outputRate < RESAMPLER_MIN_RATE || outputRate > RESAMPLER_MAX_RATE || channels <= 0)
+    {
+        std::cerr << "Unsupported resampling " << inputRate << " -> " << outputRate << " with " << channels << " channels" << std::endl;
+        return nullptr;
+    }
+    int g = gcd(inputRate, outputRate);
+    if (outputRate / g > RESAMPLER_MAX_PHASES)
+    {
+        std::cerr << "Unsupported resampling ratio " << inputRate << " -> " << outputRate << std::endl;
+        return nullptr;
+    }
+    return std::unique_ptr<Resampler>(new Resampler(getFilter(outputRate / g, inputRate / g), inputRate, outputRate, channels));
+}
+
+Resampler::Resampler(std::shared_ptr<const ResamplerFilter> filter, int inputRate, int outputRate, int channels)
+    : filter(filter), inputRate(inputRate), outputRate(outputRate), channels(channels), history(channels)
+{
+    Reset();
+}
+
+void Resampler::Reset()
+{
+    // 延迟线开头补 taps/2-1 个0，第一个输出的窗口中心正好落在第一个输入上
+    for (auto &h : history)
+    {
+        h.assign(filter->taps / 2 - 1, 0.0f);
+    }
+    position = 0;
+    phase = 0;
+    inputFrames = 0;
+    outputFrames = 0;
+}
+
+size_t Resampler::OutputBound(size_t frames, bool flush) const
+{
+    uint64_t pending = history[0].size() - position + frames + (flush ? filter->taps : 0);
+    return pending * filter->upFactor / filter->downFactor + 1;
+}
+
+void Resampler::Process(const float *input, size_t frames, std::vector<float> &output, bool flush)
+{
+    for (int c = 0; c < channels; c++)
+    {
+        std::vector<float> &h = history[c];
+        size_t offset = h.size();
+        h.resize(offset + frames + (flush ? filter->taps : 0), 0.0f);
+        for (size_t i = 0; i < frames; i++)
+        {
+            h[offset + i] = input[i * channels + c];
+        }
+    }
+    inputFrames += frames;
+
+    if (flush)
+    {
+        // 补0之后输出到与输入等长为止
+        produce(output, (inputFrames * filter->upFactor + filter->downFactor - 1) / filter->downFactor);
+        Reset();
+        return;
+    }
+    produce(output, UINT64_MAX);
+
+    // 丢掉窗口已经滑过的输入，剩下的不超过一个窗口
+    for (auto &h : history)
+    {
+        h.erase(h.begin(), h.begin() + position);
+    }
+    position = 0;
+}
+
+void Resampler::produce(std::vector<float> &output, uint64_t limit)
+{
+    const int taps = filter->taps;
+    const int upFactor = filter->upFactor;
+    const int downFactor = filter->downFactor;
+    size_t size = history[0].size();
+    if (position + taps > size || outputFrames >= limit)
+    {
+        return;
+    }
+
+    // 第j个输出的窗口起点为 position + (phase + j*M) / L，先算出能输出的个数一次性扩容
+    uint64_t slack = size - taps - position;
+    uint64_t count = ((slack + 1) * upFactor - 1 - phase) / downFactor + 1;
+    count = std::min<uint64_t>(count, limit - outputFrames);
+
+    size_t offset = output.size();
+    output.resize(offset + count * channels);
+    float *out = output.data() + offset;
+    for (uint64_t j = 0; j < count; j++)
+    {
+        const float *coeffs = filter->coeffs.data() + static_cast<size_t>(phase) * taps;
+        for (int c = 0; c < channels; c++)
+        {
+            *out++ = dot(history[c].data() + position, coeffs, taps);
+        }
+        phase += downFactor;
+        position += phase / upFactor;
+        phase %= upFactor;
+    }
+    outputFrames += count;
+}
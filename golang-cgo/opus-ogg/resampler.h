@@ -0,0 +1,57 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#define RESAMPLER_MIN_RATE 1000
+#define RESAMPLER_MAX_RATE 384000
+#define RESAMPLER_MAX_PHASES 1024 // 约分后输出率超过这个值的倍率不支持，如 44056 -> 48000
+#define RESAMPLER_HALF_TAPS 32    // 全带宽时每侧的抽头数，降采样时按倍率加长
+
+// 一组输入输出采样率的多相滤波器系数，只读，相同倍率的实例共享
+struct ResamplerFilter
+{
+    int upFactor;   // L: 输出率/gcd
+    int downFactor; // M: 输入率/gcd
+    int taps;       // 每相的抽头数，8的倍数
+    std::vector<float> coeffs; // upFactor * taps，第p相从 p*taps 开始
+};
+
+// 有理数倍率的多相FIR重采样器(Kaiser窗sinc)，流式处理，延迟线在多次调用间保留
+// 输入输出都是交错排列的float，输出对齐到输入的时间轴，没有额外延迟
+class Resampler
+{
+private:
+    std::shared_ptr<const ResamplerFilter> filter;
+    int inputRate;
+    int outputRate;
+    int channels;
+    std::vector<std::vector<float>> history; // 每个声道一条延迟线，开头是窗口尚未滑过的输入
+    size_t position = 0;                     // 下一个输出的窗口在延迟线中的起点
+    int phase = 0;                           // 下一个输出所用的相位
+    uint64_t inputFrames = 0;                // 本次流累计的输入帧数
+    uint64_t outputFrames = 0;               // 本次流累计的输出帧数
+
+    Resampler(std::shared_ptr<const ResamplerFilter> filter, int inputRate, int outputRate, int channels);
+    void produce(std::vector<float> &output, uint64_t limit);
+
+public:
+    // 倍率不支持时返回空
+    static std::unique_ptr<Resampler> Create(int inputRate, int outputRate, int channels);
+
+    int InputRate() const { return inputRate; }
+    int OutputRate() const { return outputRate; }
+    int Channels() const { return channels; }
+
+    // 追加frames帧输入，产生的输出追加到output末尾
+    // flush时在末尾补0，把延迟线里的输入全部输出，之后自动Reset开始新的流
+    void Process(const float *input, size_t frames, std::vector<float> &output, bool flush);
+    // 再输入frames帧最多产生的输出帧数
+    size_t OutputBound(size_t frames, bool flush) const;
+    void Reset();
+};
+
+#endif // RESAMPLER_H
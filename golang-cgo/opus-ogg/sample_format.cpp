@@ -0,0 +1,368 @@
+#include "sample_format.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SAMPLE_FORMAT_X86
+#include <immintrin.h>
+#endif
+
+// 整数满幅对应的缩放系数，都是2的幂，乘法不引入舍入误差
+static const float S16_SCALE = 1.0f / 32768.0f;      // 2^-15
+static const float S24_SCALE = 1.0f / 8388608.0f;    // 2^-23
+static const float S32_SCALE = 1.0f / 2147483648.0f; // 2^-31
+
+bool sampleFormatValid(int format)
+{
+    return format >= SAMPLE_FORMAT_S16 && format <= SAMPLE_FORMAT_S32;
+}
+
+size_t sampleFormatBytes(SampleFormat format)
+{
+    switch (format)
+    {
+    case SAMPLE_FORMAT_F32:
+    case SAMPLE_FORMAT_S32:
+        return 4;
+    case SAMPLE_FORMAT_S24:
+        return 3;
+    default:
+        return 2;
+    }
+}
+
+/**** 标量实现，也用于处理向量实现剩下的尾部 ****/
+
+static void downmixS16Scalar(const unsigned char *src, int16_t *dst, size_t frames)
+{
+    for (size_t i = 0; i < frames; i++)
+    {
+        int16_t s[2];
+        std::memcpy(s, src + i * 4, sizeof(s));
+        dst[i] = static_cast<int16_t>((s[0] + s[1]) >> 1);
+    }
+}
+
+static void s16ToFloatScalar(const unsigned char *src, float *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        int16_t v;
+        std::memcpy(&v, src + i * 2, sizeof(v));
+        dst[i] = static_cast<float>(v) * S16_SCALE;
+    }
+}
+
+static void s24ToFloatScalar(const unsigned char *src, float *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        const unsigned char *p = src + i * 3;
+        // 放到高24位再算术右移，完成符号扩展
+        int32_t v = static_cast<int32_t>(static_cast<uint32_t>(p[0]) << 8 | static_cast<uint32_t>(p[1]) << 16 | static_cast<uint32_t>(p[2]) << 24) >> 8;
+        dst[i] = static_cast<float>(v) * S24_SCALE;
+    }
+}
+
+static void s32ToFloatScalar(const unsigned char *src, float *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        int32_t v;
+        std::memcpy(&v, src + i * 4, sizeof(v));
+        dst[i] = static_cast<float>(v) * S32_SCALE;
+    }
+}
+
+static void downmixFloatScalar(const float *src, float *dst, size_t frames)
+{
+    for (size_t i = 0; i < frames; i++)
+    {
+        dst[i] = (src[i * 2] + src[i * 2 + 1]) * 0.5f;
+    }
+}
+
+static void floatToS16Scalar(const float *src, int16_t *dst, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        // 先限幅再取整，与向量实现的 min/max + cvtps 结果一致
+        float v = std::min(std::max(src[i] * 32768.0f, -32768.0f), 32767.0f);
+        dst[i] = static_cast<int16_t>(std::lrintf(v));
+    }
+}
+
+#ifdef SAMPLE_FORMAT_X86
+
+/**** SSE2/SSSE3 ****/
+
+__attribute__((target("sse2"))) static void downmixS16Sse2(const unsigned char *src, int16_t *dst, size_t frames)
+{
+    const __m128i ones = _mm_set1_epi16(1);
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8)
+    {
+        // madd把相邻的左右声道相加成int32，不会溢出
+        __m128i a = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4)), ones);
+        __m128i b = _mm_madd_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4 + 16)), ones);
+        a = _mm_srai_epi32(a, 1);
+        b = _mm_srai_epi32(b, 1);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packs_epi32(a, b));
+    }
+    downmixS16Scalar(src + i * 4, dst + i, frames - i);
+}
+
+__attribute__((target("sse2"))) static void s16ToFloatSse2(const unsigned char *src, float *dst, size_t n)
+{
+    const __m128 scale = _mm_set1_ps(S16_SCALE);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        // 放到32位的高16位再算术右移，完成符号扩展
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+        _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+    }
+    s16ToFloatScalar(src + i * 2, dst + i, n - i);
+}
+
+__attribute__((target("ssse3"))) static void s24ToFloatSsse3(const unsigned char *src, float *dst, size_t n)
+{
+    // 每个采样的3个字节放到32位的高24位，低字节置0
+    const __m128i shuffle = _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    const __m128 scale = _mm_set1_ps(S32_SCALE);
+    size_t i = 0;
+    // 每次读16字节只用前12字节，保证不越过输入末尾
+    for (; i + 6 <= n; i += 4)
+    {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 3)), shuffle);
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    s24ToFloatScalar(src + i * 3, dst + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void s32ToFloatSse2(const unsigned char *src, float *dst, size_t n)
+{
+    const __m128 scale = _mm_set1_ps(S32_SCALE);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 4));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+    }
+    s32ToFloatScalar(src + i * 4, dst + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void downmixFloatSse2(const float *src, float *dst, size_t frames)
+{
+    const __m128 half = _mm_set1_ps(0.5f);
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4)
+    {
+        __m128 a = _mm_loadu_ps(src + i * 2);
+        __m128 b = _mm_loadu_ps(src + i * 2 + 4);
+        __m128 left = _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m128 right = _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_add_ps(left, right), half));
+    }
+    downmixFloatScalar(src + i * 2, dst + i, frames - i);
+}
+
+__attribute__((target("sse2"))) static void floatToS16Sse2(const float *src, int16_t *dst, size_t n)
+{
+    const __m128 scale = _mm_set1_ps(32768.0f);
+    const __m128 lower = _mm_set1_ps(-32768.0f);
+    const __m128 upper = _mm_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128 a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i), scale), lower), upper);
+        __m128 b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(src + i + 4), scale), lower), upper);
+        __m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), packed);
+    }
+    floatToS16Scalar(src + i, dst + i, n - i);
+}
+
+/**** AVX2 ****/
+
+__attribute__((target("avx2"))) static void downmixS16Avx2(const unsigned char *src, int16_t *dst, size_t frames)
+{
+    const __m256i ones = _mm256_set1_epi16(1);
+    size_t i = 0;
+    for (; i + 16 <= frames; i += 16)
+    {
+        __m256i a = _mm256_madd_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4)), ones);
+        __m256i b = _mm256_madd_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4 + 32)), ones);
+        a = _mm256_srai_epi32(a, 1);
+        b = _mm256_srai_epi32(b, 1);
+        // packs按128位通道交错，再把64位块换回顺序
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packs_epi32(a, b), _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+    }
+    downmixS16Sse2(src + i * 4, dst + i, frames - i);
+}
+
+__attribute__((target("avx2"))) static void s16ToFloatAvx2(const unsigned char *src, float *dst, size_t n)
+{
+    const __m256 scale = _mm256_set1_ps(S16_SCALE);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 2)));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    s16ToFloatScalar(src + i * 2, dst + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void s24ToFloatAvx2(const unsigned char *src, float *dst, size_t n)
+{
+    const __m256i shuffle = _mm256_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11,
+                                             -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+    const __m256 scale = _mm256_set1_ps(S32_SCALE);
+    size_t i = 0;
+    // 两个通道分别读src+0和src+12开始的16字节，最远读到第28字节
+    for (; i + 10 <= n; i += 8)
+    {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 3));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * 3 + 12));
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+        v = _mm256_shuffle_epi8(v, shuffle);
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    s24ToFloatScalar(src + i * 3, dst + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void s32ToFloatAvx2(const unsigned char *src, float *dst, size_t n)
+{
+    const __m256 scale = _mm256_set1_ps(S32_SCALE);
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i v = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(src + i * 4));
+        _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+    }
+    s32ToFloatScalar(src + i * 4, dst + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void downmixFloatAvx2(const float *src, float *dst, size_t frames)
+{
+    const __m256 half = _mm256_set1_ps(0.5f);
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8)
+    {
+        __m256 a = _mm256_loadu_ps(src + i * 2);
+        __m256 b = _mm256_loadu_ps(src + i * 2 + 8);
+        __m256 left = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+        __m256 right = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1));
+        __m256 mono = _mm256_mul_ps(_mm256_add_ps(left, right), half);
+        // 结果按64位块为 0,2,1,3 的顺序，换回来
+        mono = _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(mono), _MM_SHUFFLE(3, 1, 2, 0)));
+        _mm256_storeu_ps(dst + i, mono);
+    }
+    downmixFloatSse2(src + i * 2, dst + i, frames - i);
+}
+
+__attribute__((target("avx2"))) static void floatToS16Avx2(const float *src, int16_t *dst, size_t n)
+{
+    const __m256 scale = _mm256_set1_ps(32768.0f);
+    const __m256 lower = _mm256_set1_ps(-32768.0f);
+    const __m256 upper = _mm256_set1_ps(32767.0f);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256 a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i), scale), lower), upper);
+        __m256 b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(_mm256_loadu_ps(src + i + 8), scale), lower), upper);
+        __m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(a), _mm256_cvtps_epi32(b));
+        packed = _mm256_permute4x64_epi64(packed, _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(dst + i), packed);
+    }
+    floatToS16Sse2(src + i, dst + i, n - i);
+}
+
+#endif // SAMPLE_FORMAT_X86
+
+/**** 运行时分派 ****/
+
+struct SampleKernels
+{
+    void (*downmixS16)(const unsigned char *, int16_t *, size_t);
+    void (*s16ToFloat)(const unsigned char *, float *, size_t);
+    void (*s24ToFloat)(const unsigned char *, float *, size_t);
+    void (*s32ToFloat)(const unsigned char *, float *, size_t);
+    void (*downmixFloat)(const float *, float *, size_t);
+    void (*floatToS16)(const float *, int16_t *, size_t);
+};
+
+static SampleKernels selectKernels()
+{
+    SampleKernels k = {downmixS16Scalar, s16ToFloatScalar, s24ToFloatScalar, s32ToFloatScalar, downmixFloatScalar, floatToS16Scalar};
+#ifdef SAMPLE_FORMAT_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))
+    {
+        k.downmixS16 = downmixS16Sse2;
+        k.s16ToFloat = s16ToFloatSse2;
+        k.s32ToFloat = s32ToFloatSse2;
+        k.downmixFloat = downmixFloatSse2;
+        k.floatToS16 = floatToS16Sse2;
+    }
+    if (__builtin_cpu_supports("ssse3"))
+    {
+        k.s24ToFloat = s24ToFloatSsse3;
+    }
+    if (__builtin_cpu_supports("avx2"))
+    {
+        k.downmixS16 = downmixS16Avx2;
+        k.s16ToFloat = s16ToFloatAvx2;
+        k.s24ToFloat = s24ToFloatAvx2;
+        k.s32ToFloat = s32ToFloatAvx2;
+        k.downmixFloat = downmixFloatAvx2;
+        k.floatToS16 = floatToS16Avx2;
+    }
+#endif
+    return k;
+}
+
+static const SampleKernels &kernels()
+{
+    static const SampleKernels k = selectKernels();
+    return k;
+}
+
+void downmixS16(const unsigned char *src, int16_t *dst, size_t frames)
+{
+    kernels().downmixS16(src, dst, frames);
+}
+
+void convertToFloat(SampleFormat format, const unsigned char *src, float *dst, size_t n)
+{
+    switch (format)
+    {
+    case SAMPLE_FORMAT_S16:
+        kernels().s16ToFloat(src, dst, n);
+        break;
+    case SAMPLE_FORMAT_S24:
+        kernels().s24ToFloat(src, dst, n);
+        break;
+    case SAMPLE_FORMAT_S32:
+        kernels().s32ToFloat(src, dst, n);
+        break;
+    case SAMPLE_FORMAT_F32:
+        std::memcpy(dst, src, n * sizeof(float));
+        break;
+    }
+}
+
+void convertFromFloat(const float *src, int16_t *dst, size_t n)
+{
+    kernels().floatToS16(src, dst, n);
+}
+
+void downmixFloat(const float *src, float *dst, size_t frames)
+{
+    kernels().downmixFloat(src, dst, frames);
+}
@@ -0,0 +1,32 @@
+#ifndef SAMPLE_FORMAT_H
+#define SAMPLE_FORMAT_H
+
+#include <cstddef>
+#include <cstdint>
+
+// 编码输入PCM的采样格式，均为小端、多声道交错排列
+enum SampleFormat
+{
+    SAMPLE_FORMAT_S16 = 0, // 16位整数，原来唯一支持的格式
+    SAMPLE_FORMAT_F32 = 1, // 32位浮点，满幅为[-1, 1]
+    SAMPLE_FORMAT_S24 = 2, // 24位整数，每个采样3字节紧密排列
+    SAMPLE_FORMAT_S32 = 3, // 32位整数
+};
+
+bool sampleFormatValid(int format);
+// 每个采样的字节数
+size_t sampleFormatBytes(SampleFormat format);
+
+// 以下转换按CPU支持选用AVX2/SSSE3/SSE2实现，不支持时用标量实现，各实现结果逐位一致
+// 输入输出都不要求对齐
+
+// 立体声int16取平均下混成单声道，frames为帧数(每帧2个采样)
+void downmixS16(const unsigned char *src, int16_t *dst, size_t frames);
+// n个采样转成float，整数按满幅归一化到[-1, 1)
+void convertToFloat(SampleFormat format, const unsigned char *src, float *dst, size_t n);
+// n个float采样转成int16，四舍五入到最近的偶数，超出满幅的饱和
+void convertFromFloat(const float *src, int16_t *dst, size_t n);
+// 立体声float取平均下混成单声道，dst可以与src相同
+void downmixFloat(const float *src, float *dst, size_t frames);
+
+#endif // SAMPLE_FORMAT_H
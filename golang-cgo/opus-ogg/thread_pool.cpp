@@ -0,0 +1,103 @@
+#include "thread_pool.h"
+#include <algorithm>
+
+ThreadPool::ThreadPool(int threads)
+    : job(nullptr), jobCount(0), jobWorkers(0), next(0), running(0), generation(0), stopping(false)
+{
+    for (int i = 0; i < threads; i++)
+    {
+        workers.emplace_back(&ThreadPool::workerLoop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    workCond.notify_all();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+ThreadPool &ThreadPool::Shared()
+{
+    // 调用线程也会参与计算，所以工作线程比核数少一个
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+    return pool;
+}
+
+void ThreadPool::runJob()
+{
+    int i;
+    while ((i = next.fetch_add(1)) < jobCount)
+    {
+        (*job)(i);
+    }
+}
+
+void ThreadPool::workerLoop(int id)
+{
+    unsigned long seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            workCond.wait(lock, [&]
+                          { return stopping || generation != seen; });
+            if (stopping)
+            {
+                return;
+            }
+            seen = generation;
+            if (id >= jobWorkers)
+            {
+                continue; // 本批次不需要这个线程
+            }
+        }
+
+        runJob();
+
+        std::lock_guard<std::mutex> lock(mutex);
+        if (--running == 0)
+        {
+            doneCond.notify_one();
+        }
+    }
+}
+
+void ThreadPool::ParallelFor(int count, int maxThreads, const std::function<void(int)> &fn)
+{
+    int helpers = std::min(std::min(maxThreads - 1, count - 1), Size());
+    std::unique_lock<std::mutex> batchLock(batchMutex, std::try_to_lock);
+    if (helpers <= 0 || !batchLock.owns_lock())
+    {
+        // 单线程或者线程池正忙，直接在调用线程上顺序执行
+        for (int i = 0; i < count; i++)
+        {
+            fn(i);
+        }
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        jobCount = count;
+        jobWorkers = helpers;
+        next = 0;
+        running = helpers;
+        generation++;
+    }
+    workCond.notify_all();
+
+    runJob();
+
+    std::unique_lock<std::mutex> lock(mutex);
+    doneCond.wait(lock, [&]
+                  { return running == 0; });
+    job = nullptr;
+}
@@ -0,0 +1,49 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+
+// 固定大小的线程池，用于批量接口把多路会话分给多个核处理
+class ThreadPool
+{
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::mutex batchMutex; // 同一时刻只跑一个批次，并发的批次在调用线程上直接执行
+    std::condition_variable workCond;
+    std::condition_variable doneCond;
+
+    const std::function<void(int)> *job;
+    int jobCount;
+    int jobWorkers;            // 本批次允许参与的工作线程数
+    std::atomic<int> next;     // 下一个待处理的下标
+    int running;               // 还没结束本批次的工作线程数
+    unsigned long generation;  // 批次号，用于唤醒工作线程
+    bool stopping;
+
+    void workerLoop(int id);
+    void runJob();
+
+public:
+    explicit ThreadPool(int threads);
+    ~ThreadPool();
+
+    int Size() const
+    {
+        return workers.size();
+    }
+
+    // 对 [0, count) 的每个下标执行 fn，调用线程也参与，全部完成后返回
+    // maxThreads 限制本次参与的线程总数(含调用线程)
+    void ParallelFor(int count, int maxThreads, const std::function<void(int)> &fn);
+
+    // 进程内共享的线程池，按核数创建，首次使用时初始化
+    static ThreadPool &Shared();
+};
+
+#endif // THREAD_POOL_H
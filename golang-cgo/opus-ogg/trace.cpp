@@ -0,0 +1,66 @@
+#include "trace.h"
+
+#ifdef OPUS_OGG_TRACE
+
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// 所有线程的环形缓冲区，只在线程第一次记录和导出时加锁
+static std::mutex ringsMutex;
+static std::vector<TraceRing *> *rings = new std::vector<TraceRing *>();
+
+TraceRing *traceThreadRing()
+{
+    thread_local TraceRing *ring = nullptr;
+    if (!ring)
+    {
+        ring = new TraceRing(syscall(SYS_gettid));
+        std::lock_guard<std::mutex> lock(ringsMutex);
+        rings->push_back(ring);
+    }
+    return ring;
+}
+
+bool traceDump(const std::string &path)
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f)
+    {
+        return false;
+    }
+    int pid = getpid();
+    std::vector<TraceEvent> events(TRACE_RING_SIZE);
+    bool first = true;
+    fprintf(f, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+
+    std::lock_guard<std::mutex> lock(ringsMutex);
+    for (TraceRing *ring : *rings)
+    {
+        // 先拷出再检查，拷贝期间被写入线程覆盖的事件丢弃
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        uint64_t copied = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        for (uint64_t i = copied; i < head; i++)
+        {
+            events[i - copied] = ring->events[i & (TRACE_RING_SIZE - 1)];
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t newHead = ring->head.load(std::memory_order_relaxed);
+        uint64_t valid = newHead > TRACE_RING_SIZE ? std::max(copied, newHead - TRACE_RING_SIZE) : copied;
+
+        for (uint64_t i = valid; i < head; i++)
+        {
+            const TraceEvent &event = events[i - copied];
+            fprintf(f, "%s{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %ld, \"ts\": %.3f, \"dur\": %.3f}",
+                    first ? "" : ",\n", event.name, pid, ring->tid, event.beginNs / 1000.0, event.durationNs / 1000.0);
+            first = false;
+        }
+    }
+    fprintf(f, "\n]}\n");
+    return fclose(f) == 0;
+}
+
+#endif // OPUS_OGG_TRACE
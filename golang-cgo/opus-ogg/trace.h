@@ -0,0 +1,81 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// 编解码各阶段的耗时追踪，编译时加 -DOPUS_OGG_TRACE 开启，导出为Chrome trace JSON(chrome://tracing、Perfetto可直接打开)
+// 未开启时TRACE_SPAN展开为空语句，没有任何开销
+
+#ifdef OPUS_OGG_TRACE
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+#define TRACE_RING_SIZE 32768 // 每个线程保留的最近事件数，必须是2的幂
+
+struct TraceEvent
+{
+    const char *name; // 只接受字符串字面量，不拷贝
+    uint64_t beginNs;
+    uint64_t durationNs;
+};
+
+// 每个线程一个环形缓冲区，只有所属线程写入，写满后覆盖最旧的事件
+struct TraceRing
+{
+    TraceEvent events[TRACE_RING_SIZE];
+    std::atomic<uint64_t> head; // 已写入的事件总数
+    long tid;
+
+    TraceRing(long tid) : head(0), tid(tid) {}
+
+    void Push(const char *name, uint64_t beginNs, uint64_t durationNs)
+    {
+        uint64_t h = head.load(std::memory_order_relaxed);
+        TraceEvent &event = events[h & (TRACE_RING_SIZE - 1)];
+        event.name = name;
+        event.beginNs = beginNs;
+        event.durationNs = durationNs;
+        head.store(h + 1, std::memory_order_release);
+    }
+};
+
+inline uint64_t traceNowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 当前线程的环形缓冲区，第一次使用时创建并登记，线程退出后保留以便导出
+TraceRing *traceThreadRing();
+
+// 作用域内的耗时记为一个事件
+class TraceSpan
+{
+private:
+    const char *name;
+    uint64_t beginNs;
+
+public:
+    explicit TraceSpan(const char *name) : name(name), beginNs(traceNowNs()) {}
+    ~TraceSpan()
+    {
+        traceThreadRing()->Push(name, beginNs, traceNowNs() - beginNs);
+    }
+    TraceSpan(const TraceSpan &) = delete;
+    TraceSpan &operator=(const TraceSpan &) = delete;
+};
+
+// 把所有线程的事件写成Chrome trace JSON
+bool traceDump(const std::string &path);
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name) TraceSpan TRACE_CONCAT(traceSpan, __LINE__)(name)
+
+#else
+
+#define TRACE_SPAN(name) ((void)0)
+
+#endif // OPUS_OGG_TRACE
+
+#endif // TRACE_H
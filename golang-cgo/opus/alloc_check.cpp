@@ -0,0 +1,170 @@
+// 检查流式编解码的热路径不分配内存: 每种输入块大小先预热，之后统计 OpusCodecEncodeInto/DecodeInto
+// 调用期间的分配次数，不为0时返回1
+// 替换的是整个 malloc 系列，operator new 以及 libopus 内部的分配都计入
+//
+// 用法: ./alloc_check
+
+#include "interface.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+extern "C"
+{
+    void *__libc_malloc(size_t size);
+    void *__libc_calloc(size_t count, size_t size);
+    void *__libc_realloc(void *p, size_t size);
+    void __libc_free(void *p);
+
+    static std::atomic<bool> counting(false);
+    static std::atomic<size_t> allocCount(0);
+
+    void *malloc(size_t size)
+    {
+        if (counting.load(std::memory_order_relaxed))
+        {
+            allocCount++;
+        }
+        return __libc_malloc(size);
+    }
+
+    void *calloc(size_t count, size_t size)
+    {
+        if (counting.load(std::memory_order_relaxed))
+        {
+            allocCount++;
+        }
+        return __libc_calloc(count, size);
+    }
+
+    void *realloc(void *p, size_t size)
+    {
+        if (counting.load(std::memory_order_relaxed))
+        {
+            allocCount++;
+        }
+        return __libc_realloc(p, size);
+    }
+
+    void free(void *p)
+    {
+        __libc_free(p);
+    }
+}
+
+const int SAMPLE_RATE = 24000;
+const int SECONDS = 10;
+const size_t CHUNKS[] = {100, 960, 4096};
+
+// 前 1/4 的输入用来预热，第一次调用时 stdio 等会分配一次
+static size_t warmupBytes(size_t total, size_t chunk)
+{
+    return total / 4 / chunk * chunk;
+}
+
+static bool checkEncode(const std::vector<char> &pcm, size_t chunk, std::vector<char> &encoded)
+{
+    void *inst = nullptr;
+    if (OpusCodecStart(&inst, SAMPLE_RATE) != OPUS_CODEC_OK)
+    {
+        fprintf(stderr, "Failed to start codec\n");
+        return false;
+    }
+    encoded.assign(OpusCodecEncodeBound(inst, pcm.size(), true), 0);
+    size_t warmup = warmupBytes(pcm.size(), chunk);
+    size_t written = 0;
+    size_t allocs = 0;
+    size_t calls = 0;
+    bool ok = true;
+    for (size_t offset = 0; offset < pcm.size() && ok; offset += chunk)
+    {
+        size_t n = std::min(chunk, pcm.size() - offset);
+        bool last = offset + n == pcm.size();
+        bool measured = offset >= warmup && !last; // 结尾的 flush 不算热路径
+        int outputLen = 0;
+        size_t before = allocCount;
+        counting.store(measured);
+        int ret = OpusCodecEncodeInto(inst, pcm.data() + offset, n, encoded.data() + written, encoded.size() - written, &outputLen, last);
+        counting.store(false);
+        if (measured)
+        {
+            allocs += allocCount - before;
+            calls++;
+        }
+        ok = ret == OPUS_CODEC_OK;
+        written += outputLen;
+    }
+    encoded.resize(written);
+    OpusCodecEnd(&inst);
+    fprintf(stderr, "encode chunk=%zu calls=%zu allocs=%zu\n", chunk, calls, allocs);
+    return ok && allocs == 0;
+}
+
+static bool checkDecode(const std::vector<char> &encoded, size_t chunk, size_t pcmBytes)
+{
+    void *inst = nullptr;
+    if (OpusCodecStart(&inst, SAMPLE_RATE) != OPUS_CODEC_OK)
+    {
+        fprintf(stderr, "Failed to start codec\n");
+        return false;
+    }
+    std::vector<char> pcm(pcmBytes * 2);
+    size_t warmup = warmupBytes(encoded.size(), chunk);
+    size_t written = 0;
+    size_t allocs = 0;
+    size_t calls = 0;
+    bool ok = true;
+    for (size_t offset = 0; offset < encoded.size() && ok; offset += chunk)
+    {
+        size_t n = std::min(chunk, encoded.size() - offset);
+        bool last = offset + n == encoded.size();
+        bool measured = offset >= warmup && !last;
+        int outputLen = 0;
+        size_t before = allocCount;
+        counting.store(measured);
+        int ret = OpusCodecDecodeInto(inst, encoded.data() + offset, n, pcm.data() + written, pcm.size() - written, &outputLen, last);
+        counting.store(false);
+        if (measured)
+        {
+            allocs += allocCount - before;
+            calls++;
+        }
+        ok = ret == OPUS_CODEC_OK;
+        written += outputLen;
+    }
+    OpusCodecEnd(&inst);
+    fprintf(stderr, "decode chunk=%zu calls=%zu allocs=%zu\n", chunk, calls, allocs);
+    if (ok && written != pcmBytes)
+    {
+        fprintf(stderr, "Decoded %zu bytes, expected %zu\n", written, pcmBytes);
+        ok = false;
+    }
+    return ok && allocs == 0;
+}
+
+int main()
+{
+    // 440Hz正弦波，单声道S16
+    std::vector<char> pcm(SAMPLE_RATE * SECONDS * 2);
+    int16_t *samples = reinterpret_cast<int16_t *>(pcm.data());
+    for (size_t i = 0; i < pcm.size() / 2; i++)
+    {
+        samples[i] = static_cast<int16_t>(8000 * std::sin(2 * M_PI * 440 * i / SAMPLE_RATE));
+    }
+
+    bool ok = true;
+    std::vector<char> encoded;
+    for (size_t chunk : CHUNKS)
+    {
+        ok = checkEncode(pcm, chunk, encoded) && ok;
+    }
+    for (size_t chunk : CHUNKS)
+    {
+        ok = checkDecode(encoded, chunk, pcm.size()) && ok;
+    }
+    fprintf(stderr, ok ? "PASS\n" : "FAIL\n");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,393 @@
+// 2字节长度前缀封装的编解码性能基准: 各参数下 Pcm2OpusEncoder/Opus2PcmDecoder 的帧率和实时倍数、
+// 流式 OpusCodec::Encode 按输入块大小的单次调用延迟
+// 结果以JSON写出，可与保存的基线比较，超过阈值的退化会让进程返回1；格式与 opus-ogg 的 bench 相同，
+// 同名的项(如 latency/frame_960B/mean)可以直接对比两种封装
+//
+// 用法: ./bench [-o result.json] [-b baseline.json] [-t 阈值百分比] [-s 每项音频秒数] [-r 重复次数]
+
+#include "opus_codec.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <new>
+#include <atomic>
+#include <set>
+
+// 统计C++侧的内存分配次数(libopus内部的malloc不在内)
+static std::atomic<size_t> allocCount(0);
+
+void *operator new(size_t size)
+{
+    allocCount++;
+    void *p = std::malloc(size ? size : 1);
+    if (!p)
+    {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+// Pcm2OpusEncoder 的码率和复杂度固定为 48000/8，只改变采样率、声道数和帧长
+struct BenchConfig
+{
+    int sampleRate;
+    int channels;
+    int frameSize;
+
+    std::string Name() const
+    {
+        char buf[128];
+        snprintf(buf, sizeof(buf), "sr=%d,ch=%d,fs=%d", sampleRate, channels, frameSize);
+        return buf;
+    }
+};
+
+struct BenchResult
+{
+    std::string name;
+    double value;
+    std::string unit;
+    bool higherIsBetter;
+};
+
+static std::vector<BenchResult> results;
+
+static void report(const std::string &name, double value, const std::string &unit, bool higherIsBetter)
+{
+    results.push_back(BenchResult{name, value, unit, higherIsBetter});
+    fprintf(stderr, "%-72s %14.2f %s\n", name.c_str(), value, unit.c_str());
+}
+
+static double nowSeconds()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 确定性的测试信号，与 opus-ogg 的 bench 相同
+static std::vector<opus_int16> makePcm(int sampleRate, int channels, size_t samples)
+{
+    std::vector<opus_int16> pcm(samples * channels);
+    uint32_t seed = 12345;
+    for (size_t i = 0; i < samples; i++)
+    {
+        double t = static_cast<double>(i) / sampleRate;
+        for (int c = 0; c < channels; c++)
+        {
+            double v = 0.3 * std::sin(2 * M_PI * (220 + 40 * std::sin(t)) * t + c) +
+                       0.2 * std::sin(2 * M_PI * 1375 * t + 2 * c) +
+                       0.1 * std::sin(2 * M_PI * 3000 * t * (1 + 0.1 * std::sin(3 * t)));
+            seed = seed * 1664525 + 1013904223;
+            v += 0.02 * (static_cast<int>(seed >> 16) - 32768) / 32768.0;
+            pcm[i * channels + c] = static_cast<opus_int16>(v * 32767 * 0.8);
+        }
+    }
+    return pcm;
+}
+
+// 按chunkBytes分块流式编码整段PCM，返回长度前缀格式的数据
+static bool encodeStream(const BenchConfig &config, const std::vector<opus_int16> &pcm, size_t chunkBytes, std::vector<char> &encoded)
+{
+    Pcm2OpusEncoder encoder(config.sampleRate, config.channels, config.frameSize);
+    if (!encoder.Start())
+    {
+        return false;
+    }
+    const char *input = reinterpret_cast<const char *>(pcm.data());
+    size_t inputLength = pcm.size() * sizeof(opus_int16);
+    // 输出一次性按上界预留，计时范围内不扩容
+    encoded.resize(encoder.EncodeBound(inputLength, true));
+    OutputSpan output(encoded.data(), encoded.size());
+    for (size_t offset = 0; offset < inputLength; offset += chunkBytes)
+    {
+        size_t len = std::min(chunkBytes, inputLength - offset);
+        if (encoder.Encode(input + offset, len, output, false) != 0)
+        {
+            return false;
+        }
+    }
+    if (encoder.Encode(nullptr, 0, output, true) != 0)
+    {
+        return false;
+    }
+    encoded.resize(output.size);
+    return true;
+}
+
+static bool decodeStream(const BenchConfig &config, const std::vector<char> &encoded, size_t chunkBytes, std::vector<char> &pcm)
+{
+    Opus2PcmDecoder decoder(config.sampleRate, config.channels);
+    if (!decoder.Start())
+    {
+        return false;
+    }
+    OutputSpan output(pcm.data(), pcm.size());
+    for (size_t offset = 0; offset < encoded.size(); offset += chunkBytes)
+    {
+        size_t len = std::min(chunkBytes, encoded.size() - offset);
+        if (decoder.Decode(encoded.data() + offset, len, output, offset + len == encoded.size()) != 0)
+        {
+            return false;
+        }
+    }
+    pcm.resize(output.size);
+    return true;
+}
+
+// 各参数下编解码的帧率和实时倍数，重复多次取最快的一次
+static void benchThroughput(const BenchConfig &config, double seconds, int repeats)
+{
+    size_t frames = static_cast<size_t>(seconds * config.sampleRate / config.frameSize);
+    std::vector<opus_int16> pcm = makePcm(config.sampleRate, config.channels, frames * config.frameSize);
+    size_t frameBytes = config.frameSize * config.channels * sizeof(opus_int16);
+
+    double encodeTime = 1e30;
+    double decodeTime = 1e30;
+    std::vector<char> encoded;
+    std::vector<char> decoded;
+    for (int r = 0; r < repeats; r++)
+    {
+        double begin = nowSeconds();
+        if (!encodeStream(config, pcm, frameBytes, encoded))
+        {
+            fprintf(stderr, "encode failed: %s\n", config.Name().c_str());
+            return;
+        }
+        encodeTime = std::min(encodeTime, nowSeconds() - begin);
+
+        decoded.assign(Opus2PcmDecoder(config.sampleRate, config.channels).DecodeBound(encoded.data(), encoded.size()), 0);
+        begin = nowSeconds();
+        if (!decodeStream(config, encoded, 4096, decoded))
+        {
+            fprintf(stderr, "decode failed: %s\n", config.Name().c_str());
+            return;
+        }
+        decodeTime = std::min(decodeTime, nowSeconds() - begin);
+    }
+
+    double audioSeconds = static_cast<double>(frames) * config.frameSize / config.sampleRate;
+    std::string name = config.Name();
+    report("encode/" + name + "/frames_per_sec", frames / encodeTime, "frames/s", true);
+    report("encode/" + name + "/realtime", audioSeconds / encodeTime, "x", true);
+    report("decode/" + name + "/frames_per_sec", frames / decodeTime, "frames/s", true);
+    report("decode/" + name + "/realtime", audioSeconds / decodeTime, "x", true);
+}
+
+// 流式 OpusCodec::Encode 按输入块大小的单次调用延迟，块大小覆盖不足一帧、整帧和多帧
+static void benchLatency(int sampleRate, double seconds)
+{
+    size_t frameBytes = 480 * sizeof(opus_int16); // OpusCodec 固定单声道、每帧480个采样
+    std::vector<opus_int16> pcm = makePcm(sampleRate, 1, static_cast<size_t>(seconds * sampleRate));
+    const char *input = reinterpret_cast<const char *>(pcm.data());
+    size_t inputLength = pcm.size() * sizeof(opus_int16);
+
+    struct Chunk
+    {
+        const char *name;
+        size_t bytes;
+    };
+    const Chunk chunks[] = {
+        {"half_frame", frameBytes / 2},
+        {"frame_minus_2", frameBytes - 2},
+        {"frame", frameBytes},
+        {"frame_and_half", frameBytes * 3 / 2},
+        {"4_frames", frameBytes * 4},
+        {"10_frames", frameBytes * 10},
+    };
+    for (const auto &chunk : chunks)
+    {
+        std::vector<double> latencies;
+        std::vector<char> encoded;
+        latencies.reserve(inputLength / chunk.bytes + 1);
+        size_t allocs = 0;
+        bool ok = true;
+        // 先跑一遍预热，第二遍计时
+        for (int pass = 0; pass < 2 && ok; pass++)
+        {
+            OpusCodec codec(sampleRate);
+            ok = codec.Start();
+            encoded.resize(codec.EncodeBound(inputLength, true));
+            OutputSpan output(encoded.data(), encoded.size());
+            for (size_t offset = 0; offset < inputLength && ok; offset += chunk.bytes)
+            {
+                size_t len = std::min(chunk.bytes, inputLength - offset);
+                size_t allocsBefore = allocCount;
+                double begin = nowSeconds();
+                ok = codec.Encode(input + offset, len, output, false) == 0;
+                if (pass == 1)
+                {
+                    latencies.push_back((nowSeconds() - begin) * 1e9);
+                    allocs += allocCount - allocsBefore;
+                }
+            }
+        }
+        if (!ok || latencies.empty())
+        {
+            fprintf(stderr, "latency bench failed: %s\n", chunk.name);
+            continue;
+        }
+        double allocsPerCall = static_cast<double>(allocs) / latencies.size();
+
+        double sum = 0;
+        for (double ns : latencies)
+        {
+            sum += ns;
+        }
+        std::sort(latencies.begin(), latencies.end());
+        std::string name = "latency/" + std::string(chunk.name) + "_" + std::to_string(chunk.bytes) + "B";
+        report(name + "/mean", sum / latencies.size(), "ns", false);
+        report(name + "/p50", latencies[latencies.size() / 2], "ns", false);
+        report(name + "/p99", latencies[latencies.size() * 99 / 100], "ns", false);
+        report(name + "/max", latencies.back(), "ns", false);
+        report(name + "/allocs_per_call", allocsPerCall, "allocs", false);
+    }
+}
+
+static bool writeJson(const std::string &path, double seconds, int repeats)
+{
+    FILE *f = fopen(path.c_str(), "w");
+    if (!f)
+    {
+        fprintf(stderr, "Cannot open output file: %s\n", path.c_str());
+        return false;
+    }
+    fprintf(f, "{\n  \"seconds\": %g,\n  \"repeats\": %d,\n  \"results\": [\n", seconds, repeats);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const BenchResult &r = results[i];
+        fprintf(f, "    {\"name\": \"%s\", \"value\": %.4f, \"unit\": \"%s\", \"better\": \"%s\"}%s\n", r.name.c_str(), r.value,
+                r.unit.c_str(), r.higherIsBetter ? "higher" : "lower", i + 1 < results.size() ? "," : "");
+    }
+    fprintf(f, "  ]\n}\n");
+    fclose(f);
+    return true;
+}
+
+// 只解析writeJson写出的格式: 每行一个结果
+static bool readBaseline(const std::string &path, std::vector<BenchResult> &baseline)
+{
+    std::ifstream in(path);
+    if (!in.is_open())
+    {
+        fprintf(stderr, "Cannot open baseline: %s\n", path.c_str());
+        return false;
+    }
+    std::string line;
+    while (std::getline(in, line))
+    {
+        size_t name = line.find("\"name\": \"");
+        size_t value = line.find("\"value\": ");
+        if (name == std::string::npos || value == std::string::npos)
+        {
+            continue;
+        }
+        name += 9;
+        BenchResult r;
+        r.name = line.substr(name, line.find('"', name) - name);
+        r.value = std::atof(line.c_str() + value + 9);
+        r.higherIsBetter = line.find("\"better\": \"higher\"") != std::string::npos;
+        baseline.push_back(r);
+    }
+    return true;
+}
+
+// 与基线比较，返回退化超过阈值的项数
+static int compareBaseline(const std::vector<BenchResult> &baseline, double thresholdPct)
+{
+    int regressions = 0;
+    fprintf(stderr, "\n%-72s %12s %12s %9s\n", "compare with baseline", "baseline", "current", "change");
+    for (const auto &r : results)
+    {
+        for (const auto &b : baseline)
+        {
+            if (b.name != r.name)
+            {
+                continue;
+            }
+            double change = b.value != 0 ? (r.value - b.value) / std::fabs(b.value) * 100 : 0;
+            bool regressed = r.higherIsBetter ? change < -thresholdPct : change > thresholdPct;
+            regressions += regressed ? 1 : 0;
+            fprintf(stderr, "%-72s %12.2f %12.2f %+8.1f%%%s\n", r.name.c_str(), b.value, r.value, change, regressed ? "  REGRESSION" : "");
+            break;
+        }
+    }
+    fprintf(stderr, "%d regression(s) beyond %.1f%%\n", regressions, thresholdPct);
+    return regressions;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string outputPath = "bench_result.json";
+    std::string baselinePath;
+    double thresholdPct = 10;
+    double seconds = 5;
+    int repeats = 3;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        std::string opt(argv[i]);
+        if (opt == "-o")
+            outputPath = argv[i + 1];
+        else if (opt == "-b")
+            baselinePath = argv[i + 1];
+        else if (opt == "-t")
+            thresholdPct = std::atof(argv[i + 1]);
+        else if (opt == "-s")
+            seconds = std::atof(argv[i + 1]);
+        else if (opt == "-r")
+            repeats = std::max(1, std::atoi(argv[i + 1]));
+    }
+
+    // 以默认参数为中心，每次只改变一个维度
+    const BenchConfig base = {24000, 1, 480};
+    std::vector<BenchConfig> configs;
+    for (int frameMs10 : {25, 50, 100, 200, 400, 600})
+    {
+        BenchConfig c = base;
+        c.frameSize = c.sampleRate * frameMs10 / 10000;
+        configs.push_back(c);
+    }
+    for (int sampleRate : {8000, 16000, 24000, 48000})
+    {
+        BenchConfig c = base;
+        c.sampleRate = sampleRate;
+        c.frameSize = sampleRate / 50;
+        configs.push_back(c);
+    }
+    for (int channels : {1, 2})
+    {
+        BenchConfig c = base;
+        c.channels = channels;
+        configs.push_back(c);
+    }
+
+    std::set<std::string> done;
+    for (const auto &config : configs)
+    {
+        if (done.insert(config.Name()).second)
+        {
+            benchThroughput(config, seconds, repeats);
+        }
+    }
+    benchLatency(base.sampleRate, seconds);
+
+    if (!writeJson(outputPath, seconds, repeats))
+    {
+        return 1;
+    }
+    fprintf(stderr, "results written to %s\n", outputPath.c_str());
+
+    if (!baselinePath.empty())
+    {
+        std::vector<BenchResult> baseline;
+        if (!readBaseline(baselinePath, baseline))
+        {
+            return 1;
+        }
+        return compareBaseline(baseline, thresholdPct) > 0 ? 1 : 0;
+    }
+    return 0;
+}
@@ -0,0 +1,151 @@
+package main
+
+/*
+#include <stdlib.h>
+#include "interface.h"
+*/
+import "C"
+import (
+	"fmt"
+	"math"
+	"os"
+	"runtime"
+	"sync"
+	"sync/atomic"
+	"testing"
+	"unsafe"
+)
+
+// -mode bench: 测量 Go 经 cgo 调用编码接口的开销，与纯 C++ 的数字对比即为边界上的损耗
+// 每个并发度下各 goroutine 持有独立实例；ns/op 为单次接口调用的墙钟时间(多 goroutine 时为总时间除以总调用数)，
+// copiedB/op 为每次调用在 C 侧 malloc 拷贝和 C.GoBytes 上额外复制的字节数，零拷贝接口为 0
+// 编码器的调试输出被丢弃但 printf 本身的开销仍计入，结果写到标准错误
+
+const (
+	benchSampleRate = 24000
+	benchSeconds    = 30 // 测试音频时长，编码时循环读取
+)
+
+var benchEncodeChunks = []int{960, 4096, 9600, 38400} // PCM 字节数: 1 帧、main 的读块大小、10 帧、40 帧
+
+// 每个 goroutine 的被测函数，run 执行 ops 次调用并返回额外复制的字节数
+type benchWorker struct {
+	run   func(ops int) int64
+	close func()
+}
+
+func runBenchmarks() {
+	pcm := makeBenchPCM(benchSampleRate, benchSeconds)
+	fmt.Fprintf(os.Stderr, "GOMAXPROCS=%d, pcm %d bytes\n", runtime.GOMAXPROCS(0), len(pcm))
+
+	for _, chunk := range benchEncodeChunks {
+		for _, workers := range benchConcurrency() {
+			chunk, workers := chunk, workers
+			runBench(fmt.Sprintf("OpusCodecEncode/chunk=%d/goroutines=%d", chunk, workers), chunk, workers,
+				func() benchWorker { return newEncodeWorker(pcm, chunk, false) })
+			runBench(fmt.Sprintf("OpusCodecEncodeInto/chunk=%d/goroutines=%d", chunk, workers), chunk, workers,
+				func() benchWorker { return newEncodeWorker(pcm, chunk, true) })
+		}
+	}
+}
+
+// 1, 2, 4 ... 直到 GOMAXPROCS
+func benchConcurrency() []int {
+	maxProcs := runtime.GOMAXPROCS(0)
+	var levels []int
+	for n := 1; n < maxProcs; n *= 2 {
+		levels = append(levels, n)
+	}
+	return append(levels, maxProcs)
+}
+
+// 把 b.N 次调用分给 workers 个 goroutine，实例创建和销毁不计时
+func runBench(name string, chunk, workers int, newWorker func() benchWorker) {
+	result := testing.Benchmark(func(b *testing.B) {
+		b.ReportAllocs()
+		b.SetBytes(int64(chunk))
+		ws := make([]benchWorker, workers)
+		for w := range ws {
+			ws[w] = newWorker()
+		}
+		var copied int64
+		var wg sync.WaitGroup
+		b.ResetTimer()
+		for w := range ws {
+			ops := b.N / workers
+			if w < b.N%workers {
+				ops++
+			}
+			wg.Add(1)
+			go func(worker benchWorker, ops int) {
+				defer wg.Done()
+				atomic.AddInt64(&copied, worker.run(ops))
+			}(ws[w], ops)
+		}
+		wg.Wait()
+		b.StopTimer()
+		for _, worker := range ws {
+			worker.close()
+		}
+		b.ReportMetric(float64(copied)/float64(b.N), "copiedB/op")
+	})
+	fmt.Fprintf(os.Stderr, "%-60s %s %s\n", name, result.String(), result.MemString())
+}
+
+func newEncodeWorker(pcm []byte, chunk int, into bool) benchWorker {
+	var inst unsafe.Pointer
+	if C.OpusCodecStart(&inst, C.int(benchSampleRate)) != 0 {
+		panic("OpusCodecStart failed")
+	}
+	output := make([]byte, int(C.OpusCodecEncodeBound(inst, C.int(chunk), C.bool(false))))
+	pos := 0
+	// 传给 C 的输出参数会逃逸到堆上，放在循环外只分配一次
+	var cOutput *C.char
+	var cOutputLen C.int
+	run := func(ops int) int64 {
+		var copied int64
+		for i := 0; i < ops; i++ {
+			if pos+chunk > len(pcm) {
+				pos = 0
+			}
+			input := (*C.char)(unsafe.Pointer(&pcm[pos]))
+			pos += chunk
+			if into {
+				result := C.OpusCodecEncodeInto(inst, input, C.int(chunk), (*C.char)(unsafe.Pointer(&output[0])), C.int(len(output)), &cOutputLen, C.bool(false))
+				if result == C.OPUS_CODEC_ERR_BUFFER_TOO_SMALL {
+					// 不够时按返回的大小扩容后重试
+					output = make([]byte, int(cOutputLen))
+					result = C.OpusCodecEncodeInto(inst, input, C.int(chunk), (*C.char)(unsafe.Pointer(&output[0])), C.int(len(output)), &cOutputLen, C.bool(false))
+				}
+				if result != C.OPUS_CODEC_OK {
+					panic("OpusCodecEncodeInto failed")
+				}
+				continue
+			}
+			if C.OpusCodecEncode(inst, input, C.int(chunk), &cOutput, &cOutputLen, C.bool(false)) != 0 {
+				panic("OpusCodecEncode failed")
+			}
+			_ = C.GoBytes(unsafe.Pointer(cOutput), cOutputLen)
+			C.free(unsafe.Pointer(cOutput))
+			copied += 2 * int64(cOutputLen)
+		}
+		return copied
+	}
+	return benchWorker{run: run, close: func() { C.OpusCodecEnd(&inst) }}
+}
+
+// 确定性的测试信号，几个正弦叠加
+func makeBenchPCM(sampleRate, seconds int) []byte {
+	samples := sampleRate * seconds
+	pcm := make([]byte, samples*2)
+	for i := 0; i < samples; i++ {
+		t := float64(i) / float64(sampleRate)
+		v := 0.3*math.Sin(2*math.Pi*(220+40*math.Sin(t))*t) +
+			0.2*math.Sin(2*math.Pi*1375*t) +
+			0.1*math.Sin(2*math.Pi*3000*t*(1+0.1*math.Sin(3*t)))
+		s := int16(v * 32767 * 0.8)
+		pcm[2*i] = byte(s)
+		pcm[2*i+1] = byte(s >> 8)
+	}
+	return pcm
+}
@@ -0,0 +1,4 @@
+g++ -O2 -std=c++11 -o alloc_check alloc_check.cpp interface.cpp opus_codec.cpp thread_pool.cpp sample_format.cpp -pthread -I /usr/local/include/opus -L ./lib -lopus
+./alloc_check || exit 1
+g++ -O2 -std=c++11 -o bench bench.cpp opus_codec.cpp sample_format.cpp -pthread -I /usr/local/include/opus -L ./lib -lopus
+./bench -o bench_result.json -b bench_baseline.json "$@"
@@ -9,11 +9,53 @@ extern "C"
 #include <stdlib.h>
 #include <stdbool.h> 
 
+// 返回码
+#define OPUS_CODEC_OK 0
+#define OPUS_CODEC_ERR -1                  // 参数错误或编解码失败
+#define OPUS_CODEC_ERR_BUFFER_TOO_SMALL -2 // 输出缓冲区不足，*outputLen 为需要的字节数，本次输入未被消费
+
     int OpusCodecStart(void **inst, int sampleRate);
     int OpusCodecEnd(void **inst);
     int OpusCodecEncode(void *inst, const char *input, int inputLen, char **output, int *outputLen, bool last);
     int OpusCodecDecode(void *inst, const char *input, int inputLen, char **output, int *outputLen, bool last);
 
+    // 零拷贝接口：直接读取调用方的 input，结果直接写入调用方持有的 output(容量 outputCap)
+    // EncodeBound 返回本次编码最坏情况下的输出字节数，output 不小于该值时编码一定成功
+    int OpusCodecEncodeBound(void *inst, int inputLen, bool last);
+    int OpusCodecEncodeInto(void *inst, const char *input, int inputLen, char *output, int outputCap, int *outputLen, bool last);
+
+    // 解码 2 字节大端长度头 + opus 包 的流，input 可以在任意字节处切分，不完整的长度头和包缓存到下次调用
+    // DecodeBound 返回本次输入中完整的包解码后的总字节数，按每包的 TOC 计算，不解码
+    int OpusCodecDecodeBound(void *inst, const char *input, int inputLen);
+    int OpusCodecDecodeInto(void *inst, const char *input, int inputLen, char *output, int outputCap, int *outputLen, bool last);
+
+// 编码输入的采样格式，均为小端、多声道交错排列
+#define OPUS_CODEC_FORMAT_S16 0 // 16位整数，默认
+#define OPUS_CODEC_FORMAT_F32 1 // 32位浮点，满幅为[-1, 1]
+#define OPUS_CODEC_FORMAT_S24 2 // 24位整数，每个采样3字节紧密排列
+#define OPUS_CODEC_FORMAT_S32 3 // 32位整数
+    // Start 之后、第一次 Encode 之前调用，输入直接转换进编码帧，非 S16 格式以 float 编码
+    // inputChannels 为 2 而编码为单声道时先下混
+    int OpusCodecSetInputFormat(void *inst, int format, int inputChannels);
+
+    // 批量接口的单项描述，字段含义与 OpusCodecEncodeInto 的参数相同
+    typedef struct
+    {
+        void *inst;
+        const char *input;
+        int inputLen;
+        char *output;
+        int outputCap;
+        bool last;
+        int outputLen; // 输出: 写入的字节数，BUFFER_TOO_SMALL 时为需要的字节数
+        int status;    // 输出: 与单路接口的返回值相同
+    } OpusCodecBatchItem;
+
+    // 一次调用处理多路会话，摊薄每路每帧一次的 cgo 调用开销
+    // threads<=1 时在调用线程上顺序处理，否则最多用 threads 个线程(含调用线程)并行处理
+    // 同一个 inst 在一个批次里只能出现一次；返回失败的项数，每项结果见 status
+    int OpusCodecEncodeBatch(OpusCodecBatchItem *items, int count, int threads);
+
 #ifdef __cplusplus
 }
 #endif
@@ -2,15 +2,34 @@
 
 /**** OpusCodec ****/
 
+int OpusCodec::Encode(const char *input, size_t inputLength, OutputSpan &output, bool last)
+{
+    return encoder->Encode(input, inputLength, output, last);
+}
+
+int OpusCodec::Encode(const char *input, size_t inputLength, std::vector<char> &output, bool last)
+{
+    return encoder->Encode(input, inputLength, output, last);
+}
+
 int OpusCodec::Encode(const std::vector<char> &input, std::vector<char> &output, bool last)
 {
     return encoder->Encode(input, output, last);
 }
 
-// not implemented
+int OpusCodec::Decode(const char *input, size_t inputLength, OutputSpan &output, bool last)
+{
+    return decoder->Decode(input, inputLength, output, last);
+}
+
+int OpusCodec::Decode(const char *input, size_t inputLength, std::vector<char> &output, bool last)
+{
+    return decoder->Decode(input, inputLength, output, last);
+}
+
 int OpusCodec::Decode(const std::vector<char> &input, std::vector<char> &output, bool last)
 {
-    return -1;
+    return decoder->Decode(input.data(), input.size(), output, last);
 }
 
 /**** Pcm2OpusEncoder ****/
@@ -32,6 +51,12 @@ bool Pcm2OpusEncoder::initializeEncoder()
     opus_encoder_ctl(encoder.get(), OPUS_SET_COMPLEXITY(8));
     opus_encoder_ctl(encoder.get(), OPUS_SET_SIGNAL(OPUS_SIGNAL_MUSIC));
     opus_encoder_ctl(encoder.get(), OPUS_SET_LSB_DEPTH(16));
+
+    // 按码率估算单包大小上限，CBR下每包大小固定，留一倍余量给VBR，输出缓冲区据此预留
+    opus_int32 bitrate = 0;
+    opus_encoder_ctl(encoder.get(), OPUS_GET_BITRATE(&bitrate));
+    size_t nominalBytes = static_cast<int64_t>(bitrate) * frameSize / sampleRate / 8;
+    maxPacketBytes = std::min<size_t>(MAX_PACKET_SIZE, std::max<size_t>(nominalBytes * 2, 256));
     return true;
 }
 
@@ -40,76 +65,138 @@ bool Pcm2OpusEncoder::Start()
     return initializeEncoder();
 }
 
-int Pcm2OpusEncoder::Encode(const std::vector<char> &input, std::vector<char> &output, bool last)
+bool Pcm2OpusEncoder::SetInputFormat(SampleFormat format, int inputChannels)
 {
-    int inputLength = input.size();
-    std::vector<unsigned char> pcmBuffer(bytesReadPerFrame * 2); // pcm音频数据缓冲区，适当大小
-    std::vector<unsigned char> opusData(MAX_PACKET_SIZE);        // opus 数据缓冲区
+    if (!encoder || !sampleFormatValid(format) || !(inputChannels == channels || (inputChannels == 2 && channels == 1)))
+    {
+        std::cerr << "Invalid input format " << format << " with " << inputChannels << " channels" << std::endl;
+        return false;
+    }
+    if (cachedBytes != 0)
+    {
+        std::cerr << "Cannot change input format with cached input" << std::endl;
+        return false;
+    }
+    this->inputFormat = format;
+    this->inputChannels = inputChannels;
+    bytesReadPerFrame = frameSize * inputChannels * sampleFormatBytes(format);
+    // 格式确定后一次分配好，编码过程中不再分配内存
+    frameBuffer.resize(bytesReadPerFrame);
+    pcmBuffer.resize(format == SAMPLE_FORMAT_S16 && inputChannels != channels ? frameSize * channels : 0);
+    floatBuffer.resize(format != SAMPLE_FORMAT_S16 ? frameSize * inputChannels : 0);
+    // 高于16位的输入让编码器按24位精度分配比特
+    return opus_encoder_ctl(encoder.get(), OPUS_SET_LSB_DEPTH(format == SAMPLE_FORMAT_S16 ? 16 : 24)) == OPUS_OK;
+}
+
+bool Pcm2OpusEncoder::directInput(const char *frame) const
+{
+    // 与编码器格式相同且对齐时直接把调用方内存交给opus，否则转换时会读取输入，不要求对齐
+    if (inputChannels != channels)
+    {
+        return true;
+    }
+    if (inputFormat == SAMPLE_FORMAT_S16)
+    {
+        return reinterpret_cast<uintptr_t>(frame) % alignof(opus_int16) == 0;
+    }
+    if (inputFormat == SAMPLE_FORMAT_F32)
+    {
+        return reinterpret_cast<uintptr_t>(frame) % alignof(float) == 0;
+    }
+    return true;
+}
 
-    for (int index = 0; (inputLength == 0 && last) || index < inputLength;)
+const void *Pcm2OpusEncoder::convertFrame(const unsigned char *frame)
+{
+    if (inputFormat == SAMPLE_FORMAT_S16)
     {
-        size_t bytesRead;
-        if (index == 0)
+        if (inputChannels == channels)
         {
-            size_t cachedBytes = internalBuffer.size();
-            // 算上缓存，长度满足一帧
-            if (inputLength + cachedBytes >= bytesReadPerFrame)
-            {
-                std::memcpy(pcmBuffer.data(), internalBuffer.data(), cachedBytes);
-                internalBuffer.clear();
-                bytesRead = bytesReadPerFrame - cachedBytes;
-                std::memcpy(pcmBuffer.data() + cachedBytes, input.data(), bytesRead);
-                index += bytesRead;
-            }
-            else // 算上缓存，长度不满足一帧
-            {
-                if (last)
-                { // 最后一帧了，不缓存了，梭哈
-                    std::memcpy(pcmBuffer.data(), internalBuffer.data(), cachedBytes);
-                    internalBuffer.clear();
-                    bytesRead = inputLength;
-                    std::memcpy(pcmBuffer.data() + cachedBytes, input.data(), bytesRead);
-                    index += bytesRead;
-                    // 填充0
-                    std::fill(pcmBuffer.begin() + bytesRead + cachedBytes, pcmBuffer.end(), 0);
-                }
-                else
-                { // 还没结束，继续缓存，等待满足1帧
-                    printf("continue cached %d\n", inputLength);
-                    internalBuffer.insert(internalBuffer.end(), input.begin(), input.end());
-                    break;
-                }
-            }
+            return frame;
+        }
+        downmixS16(frame, pcmBuffer.data(), frameSize);
+        return pcmBuffer.data();
+    }
+    if (inputFormat == SAMPLE_FORMAT_F32 && inputChannels == channels)
+    {
+        return frame;
+    }
+    const float *pcm = reinterpret_cast<const float *>(frame);
+    if (inputFormat != SAMPLE_FORMAT_F32)
+    {
+        convertToFloat(inputFormat, frame, floatBuffer.data(), frameSize * inputChannels);
+        pcm = floatBuffer.data();
+    }
+    if (inputChannels != channels)
+    {
+        downmixFloat(pcm, floatBuffer.data(), frameSize);
+    }
+    return floatBuffer.data();
+}
+
+size_t Pcm2OpusEncoder::EncodeBound(size_t inputLength, bool last) const
+{
+    // 本次最多编码的帧数，last时末尾不足一帧也会补0编码一帧
+    size_t frames = (cachedBytes + inputLength) / bytesReadPerFrame + (last ? 1 : 0);
+    return frames * (FRAME_HEADER_SIZE + maxPacketBytes);
+}
+
+int Pcm2OpusEncoder::Encode(const char *input, size_t inputLength, std::vector<char> &output, bool last)
+{
+    // output的容量会被保留，调用方复用同一个vector时稳定后不再分配内存
+    size_t offset = output.size();
+    output.resize(offset + EncodeBound(inputLength, last));
+    OutputSpan span(output.data() + offset, output.size() - offset);
+    int ret = Encode(input, inputLength, span, last);
+    output.resize(offset + span.size);
+    return ret;
+}
+
+int Pcm2OpusEncoder::Encode(const char *input, size_t inputLength, OutputSpan &output, bool last)
+{
+    size_t index = 0;
+    bool flushCached = last && inputLength == 0; // 最后一次调用没有新数据时，把缓存(可能为空)补0编码成最后一帧
+    while (index < inputLength || flushCached)
+    {
+        flushCached = false;
+        const unsigned char *frame;
+        if (cachedBytes == 0 && inputLength - index >= bytesReadPerFrame && directInput(input + index))
+        {
+            // 没有缓存且剩余长度满足一帧，直接从调用方内存编码或转换
+            frame = reinterpret_cast<const unsigned char *>(input + index);
+            index += bytesReadPerFrame;
         }
         else
         {
-            // 剩余长度满足一帧
-            if (inputLength - index >= bytesReadPerFrame)
-            {
-                bytesRead = bytesReadPerFrame;
-                std::memcpy(pcmBuffer.data(), input.data() + index, bytesRead);
-                index += bytesRead;
-            }
-            else
+            // 先凑满frameBuffer
+            size_t bytesRead = std::min(bytesReadPerFrame - cachedBytes, inputLength - index);
+            std::memcpy(frameBuffer.data() + cachedBytes, input + index, bytesRead);
+            cachedBytes += bytesRead;
+            index += bytesRead;
+            if (cachedBytes < bytesReadPerFrame)
             {
-                if (last) // 最后一帧了，梭哈
-                {
-                    bytesRead = inputLength - index;
-                    std::memcpy(pcmBuffer.data(), input.data() + index, bytesRead);
-                    index += bytesRead;
-                    // 填充0
-                    std::fill(pcmBuffer.begin() + bytesRead, pcmBuffer.end(), 0);
-                }
-                else // 不够1帧，缓存起来
-                {
-                    printf("cached %d\n", inputLength - index);
-                    internalBuffer.insert(internalBuffer.end(), input.begin() + index, input.end());
+                if (!last)
+                { // 不够1帧，留在frameBuffer里等待下次输入
                     break;
                 }
+                // 最后一帧了，填充0
+                std::fill(frameBuffer.begin() + cachedBytes, frameBuffer.end(), 0);
             }
+            cachedBytes = 0;
+            frame = frameBuffer.data();
+        }
+
+        // 编码，S16以外的格式转换成float编码
+        const void *pcm = convertFrame(frame);
+        int encodedBytes;
+        if (inputFormat == SAMPLE_FORMAT_S16)
+        {
+            encodedBytes = opus_encode(encoder.get(), static_cast<const opus_int16 *>(pcm), frameSize, opusData.data(), maxPacketBytes);
+        }
+        else
+        {
+            encodedBytes = opus_encode_float(encoder.get(), static_cast<const float *>(pcm), frameSize, opusData.data(), maxPacketBytes);
         }
-        // 编码
-        int encodedBytes = opus_encode(encoder.get(), reinterpret_cast<const opus_int16 *>(pcmBuffer.data()), frameSize, opusData.data(), MAX_PACKET_SIZE);
         if (encodedBytes < 0)
         {
             std::cerr << "Encoding failed: " << opus_strerror(encodedBytes) << std::endl;
@@ -121,20 +208,161 @@ int Pcm2OpusEncoder::Encode(const std::vector<char> &input, std::vector<char> &o
         uint8_t bytesLen[2];
         bytesLen[0] = (truncatedNum >> 8) & 0xFF; // 高字节
         bytesLen[1] = truncatedNum & 0xFF;        // 低字节
-        char *srcBytsLen = reinterpret_cast<char *>(bytesLen);
-        output.insert(output.end(), srcBytsLen, srcBytsLen+2);
-        char *srcOpusData = reinterpret_cast<char *>(opusData.data());
-        output.insert(output.end(), srcOpusData, srcOpusData + encodedBytes);
-        
-        if (inputLength == 0 && last)
-        { // 防止无限循环
-            break;
+        if (!output.append(bytesLen, FRAME_HEADER_SIZE) || !output.append(opusData.data(), encodedBytes))
+        {
+            std::cerr << "Output buffer too small" << std::endl;
+            return -1;
         }
     }
     return 0;
 }
 
-void Pcm2OpusEncoder::end()
+/**** Opus2PcmDecoder ****/
+
+bool Opus2PcmDecoder::initializeDecoder()
+{
+    int err;
+    OpusDecoder *dec = opus_decoder_create(sampleRate, channels, &err);
+    if (!dec)
+    {
+        std::cerr << "Failed to create Opus decoder: " << opus_strerror(err) << std::endl;
+        return false;
+    }
+    decoder.reset(dec);
+    return true;
+}
+
+bool Opus2PcmDecoder::Start()
+{
+    return initializeDecoder();
+}
+
+int Opus2PcmDecoder::packetSamples(const char *input, size_t index, size_t cached, size_t length) const
+{
+    // 采样数只由TOC和code 3的帧数字节决定，前两个字节可能一部分在缓存里一部分在输入里
+    unsigned char toc[2] = {0, 0};
+    for (size_t i = 0; i < 2 && i < length; i++)
+    {
+        toc[i] = i < cached ? packetBuffer[i] : static_cast<unsigned char>(input[index + i - cached]);
+    }
+    return opus_packet_get_nb_samples(toc, length, sampleRate);
+}
+
+size_t Opus2PcmDecoder::DecodeBound(const char *input, size_t inputLength) const
+{
+    // 按长度头逐包扫描，不解码，与Decode按相同的规则拼包
+    size_t bound = 0;
+    size_t index = 0;
+    unsigned char header[FRAME_HEADER_SIZE] = {lengthHeader[0], lengthHeader[1]};
+    size_t have = headerBytes;
+    size_t cached = cachedBytes;
+    while (true)
+    {
+        while (have < FRAME_HEADER_SIZE && index < inputLength)
+        {
+            header[have++] = input[index++];
+        }
+        size_t length = packetLength(header);
+        if (have < FRAME_HEADER_SIZE || length == 0 || length > MAX_PACKET_SIZE || cached + (inputLength - index) < length)
+        {
+            break;
+        }
+        int samples = packetSamples(input, index, cached, length);
+        if (samples > 0)
+        {
+            bound += samples * channels * sizeof(opus_int16);
+        }
+        index += length - cached;
+        have = 0;
+        cached = 0;
+    }
+    return bound;
+}
+
+int Opus2PcmDecoder::Decode(const char *input, size_t inputLength, std::vector<char> &output, bool last)
+{
+    // output的容量会被保留，调用方复用同一个vector时稳定后不再分配内存
+    size_t offset = output.size();
+    output.resize(offset + DecodeBound(input, inputLength));
+    OutputSpan span(output.data() + offset, output.size() - offset);
+    int ret = Decode(input, inputLength, span, last);
+    output.resize(offset + span.size);
+    return ret;
+}
+
+int Opus2PcmDecoder::Decode(const char *input, size_t inputLength, OutputSpan &output, bool last)
 {
-    printf("Encoding completed! channels: %d, sampleRate:%d\n", channels, sampleRate);
+    size_t index = 0;
+    while (true)
+    {
+        // 先凑齐长度头
+        while (headerBytes < FRAME_HEADER_SIZE && index < inputLength)
+        {
+            lengthHeader[headerBytes++] = input[index++];
+        }
+        if (headerBytes < FRAME_HEADER_SIZE)
+        {
+            break;
+        }
+        size_t length = packetLength(lengthHeader);
+        if (length == 0 || length > MAX_PACKET_SIZE)
+        {
+            std::cerr << "Invalid packet length " << length << std::endl;
+            headerBytes = 0;
+            cachedBytes = 0;
+            return -1;
+        }
+
+        const unsigned char *packet;
+        if (cachedBytes == 0 && inputLength - index >= length)
+        {
+            // 包完整地在本次输入里，直接从调用方内存解码
+            packet = reinterpret_cast<const unsigned char *>(input + index);
+            index += length;
+        }
+        else
+        {
+            // 跨调用的包先凑满packetBuffer
+            size_t bytesRead = std::min(length - cachedBytes, inputLength - index);
+            std::memcpy(packetBuffer.data() + cachedBytes, input + index, bytesRead);
+            cachedBytes += bytesRead;
+            index += bytesRead;
+            if (cachedBytes < length)
+            {
+                break; // 不够1个包，留在packetBuffer里等待下次输入
+            }
+            packet = packetBuffer.data();
+        }
+        headerBytes = 0;
+        cachedBytes = 0;
+
+        int samples = opus_packet_get_nb_samples(packet, length, sampleRate);
+        if (samples < 0)
+        {
+            std::cerr << "Invalid packet: " << opus_strerror(samples) << std::endl;
+            continue;
+        }
+        if (samples * channels * sizeof(opus_int16) > output.remaining())
+        {
+            std::cerr << "Output buffer too small" << std::endl;
+            return -1;
+        }
+
+        // 解码，PCM直接写入输出缓冲区
+        int samplesDecoded = opus_decode(decoder.get(), packet, length, reinterpret_cast<opus_int16 *>(output.data + output.size), samples, 0);
+        if (samplesDecoded < 0)
+        {
+            std::cerr << "Decoding error: " << opus_strerror(samplesDecoded) << std::endl;
+            continue;
+        }
+        output.size += samplesDecoded * channels * sizeof(opus_int16);
+    }
+
+    if (last && (headerBytes > 0 || cachedBytes > 0))
+    {
+        std::cerr << "Truncated packet at end of stream, " << headerBytes + cachedBytes << " bytes dropped" << std::endl;
+        headerBytes = 0;
+        cachedBytes = 0;
+    }
+    return 0;
 }
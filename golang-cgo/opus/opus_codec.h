@@ -8,9 +8,39 @@
 #include <memory>
 #include <cstring>
 #include <ctime>
+#include <cstdint>
+#include <algorithm>
 #include <opus.h>
+#include "sample_format.h"
 
 const int MAX_PACKET_SIZE = 3828;  // opus 最大数据包 1276
+const int FRAME_HEADER_SIZE = 2;   // 每帧前2字节大端序长度
+
+// 调用方持有的输出缓冲区，编码结果直接写入，不经过中间vector
+struct OutputSpan
+{
+    char *data;
+    size_t capacity;
+    size_t size;
+
+    OutputSpan(char *data, size_t capacity) : data(data), capacity(capacity), size(0) {}
+
+    size_t remaining() const
+    {
+        return capacity - size;
+    }
+
+    bool append(const void *src, size_t len)
+    {
+        if (len > remaining())
+        {
+            return false;
+        }
+        std::memcpy(data + size, src, len);
+        size += len;
+        return true;
+    }
+};
 
 struct OpusEncoderDeleter
 {
@@ -28,33 +58,86 @@ private:
     int channels;
     int sampleRate;
     int frameSize;
-    opus_int16 sampleSize;        // 每个采样点的大小
-    size_t bytesReadPerFrame;     // 每帧读取的字节数
-    std::vector<char> internalBuffer;
+    size_t bytesReadPerFrame;     // 每帧读取的输入字节数，按输入格式和声道数计算
+    std::vector<unsigned char> frameBuffer;  // 凑帧缓冲区，固定一帧大小，缓存不足一帧的输入
+    size_t cachedBytes = 0;                  // frameBuffer中已缓存的字节数
+    std::vector<unsigned char> opusData;     // opus 数据缓冲区
+    size_t maxPacketBytes = MAX_PACKET_SIZE; // 按码率估算的单包大小上限
+    SampleFormat inputFormat = SAMPLE_FORMAT_S16;
+    int inputChannels;                       // 输入的声道数，与channels不同时下混
+    std::vector<opus_int16> pcmBuffer;       // S16下混后的一帧
+    std::vector<float> floatBuffer;          // 非S16输入转换后的一帧，送opus_encode_float
 
     bool initializeEncoder();   // 初始化编码器
-    void end();
+    bool directInput(const char *frame) const;
+    const void *convertFrame(const unsigned char *frame);
 
 public:
     Pcm2OpusEncoder(int sampleRate = 24000, int channels = 1, int frameSize = 480)
-        : channels(channels), sampleRate(sampleRate), frameSize(frameSize)
+        : channels(channels), sampleRate(sampleRate), frameSize(frameSize), inputChannels(channels)
     {
-        sampleSize = channels * sizeof(opus_int16);
-        bytesReadPerFrame = frameSize * sampleSize;
-        internalBuffer.reserve(bytesReadPerFrame * 2); // 适当大小空间
+        bytesReadPerFrame = frameSize * channels * sizeof(opus_int16);
+        // 编码用到的缓冲区在构造时一次分配好，编码过程中不再分配内存
+        frameBuffer.resize(bytesReadPerFrame);
+        opusData.resize(MAX_PACKET_SIZE);
     }
 
-    ~Pcm2OpusEncoder()
+    bool Start();
+    // Start之后、第一次Encode之前设置输入的采样格式，inputChannels只能等于channels或者为2(下混成单声道)
+    bool SetInputFormat(SampleFormat format, int inputChannels);
+    // 本次输入最坏情况下产生的输出字节数
+    size_t EncodeBound(size_t inputLength, bool last) const;
+    int Encode(const char *input, size_t inputLength, OutputSpan &output, bool last);
+    int Encode(const char *input, size_t inputLength, std::vector<char> &output, bool last);
+    int Encode(const std::vector<char> &input, std::vector<char> &output, bool last)
     {
-        end();
+        return Encode(input.data(), input.size(), output, last);
     }
+};
 
-    bool Start();
-    int Encode(const std::vector<char> &input, std::vector<char> &output, bool last);
+struct OpusDecoderDeleter
+{
+    void operator()(OpusDecoder *decoder)
+    {
+        if (decoder)
+            opus_decoder_destroy(decoder);
+    }
 };
 
+// 2字节长度头 + opus包 格式的流式解码器，输入可以在任意字节处切分
 class Opus2PcmDecoder
 {
+private:
+    std::unique_ptr<OpusDecoder, OpusDecoderDeleter> decoder;
+    int channels;
+    int sampleRate;
+    unsigned char lengthHeader[FRAME_HEADER_SIZE]; // 跨调用的不完整长度头
+    size_t headerBytes = 0;                        // lengthHeader中已收到的字节数
+    std::vector<unsigned char> packetBuffer;       // 跨调用的不完整包，固定MAX_PACKET_SIZE
+    size_t cachedBytes = 0;                        // packetBuffer中已缓存的字节数
+
+    bool initializeDecoder();
+    size_t packetLength(const unsigned char *header) const
+    {
+        return (header[0] << 8) | header[1];
+    }
+    int packetSamples(const char *input, size_t index, size_t cached, size_t length) const;
+
+public:
+    Opus2PcmDecoder(int sampleRate = 24000, int channels = 1)
+        : channels(channels), sampleRate(sampleRate)
+    {
+        // 解码用到的缓冲区在构造时一次分配好，解码过程中不再分配内存
+        packetBuffer.resize(MAX_PACKET_SIZE);
+    }
+
+    bool Start();
+    // 本次输入中完整的包解码后的总字节数，不完整的包留到下次
+    size_t DecodeBound(const char *input, size_t inputLength) const;
+    // 解码本次输入中所有完整的包，PCM直接写入output；不完整的长度头和包缓存在内部，
+    // last时丢弃末尾不完整的数据
+    int Decode(const char *input, size_t inputLength, OutputSpan &output, bool last);
+    int Decode(const char *input, size_t inputLength, std::vector<char> &output, bool last);
 };
 
 class OpusCodec
@@ -62,20 +145,43 @@ class OpusCodec
 private:
     std::unique_ptr<Pcm2OpusEncoder> encoder;
     std::unique_ptr<Opus2PcmDecoder> decoder;
+    std::vector<char> scratch; // 旧接口复用的输出缓冲区
 
 public:
     OpusCodec(int sampleRate)
         : encoder(std::unique_ptr<Pcm2OpusEncoder>(new Pcm2OpusEncoder(sampleRate, 1, 480))),
-          decoder(std::unique_ptr<Opus2PcmDecoder>(new Opus2PcmDecoder()))
+          decoder(std::unique_ptr<Opus2PcmDecoder>(new Opus2PcmDecoder(sampleRate, 1)))
     {
     }
     ~OpusCodec() = default;
 
     bool Start()
     {
-        return encoder->Start();
+        return encoder->Start() && decoder->Start();
+    }
+    bool SetInputFormat(SampleFormat format, int inputChannels)
+    {
+        return encoder->SetInputFormat(format, inputChannels);
+    }
+    size_t EncodeBound(size_t inputLength, bool last) const
+    {
+        return encoder->EncodeBound(inputLength, last);
+    }
+    size_t DecodeBound(const char *input, size_t inputLength) const
+    {
+        return decoder->DecodeBound(input, inputLength);
+    }
+    // 清空并返回实例自带的输出缓冲区，容量在多次调用间保留
+    std::vector<char> &Scratch()
+    {
+        scratch.clear();
+        return scratch;
     }
+    int Encode(const char *input, size_t inputLength, OutputSpan &output, bool last);
+    int Encode(const char *input, size_t inputLength, std::vector<char> &output, bool last);
     int Encode(const std::vector<char> &input, std::vector<char> &output, bool last);
+    int Decode(const char *input, size_t inputLength, OutputSpan &output, bool last);
+    int Decode(const char *input, size_t inputLength, std::vector<char> &output, bool last);
     int Decode(const std::vector<char> &input, std::vector<char> &output, bool last);
 };
 